@@ -0,0 +1,371 @@
+//
+//  RuntimeBench.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 16/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+// Microbenchmarks of every runtime entry point in runtime.h. Results are
+// printed to stderr, and with -json=PATH written to PATH for bench.py to
+// compare against a baseline. Program output goes to stdout, so run it
+// with stdout redirected:
+//
+//   RT=../../Vist/stdlib/runtime
+//   clang++ -std=c++14 -O3 -include $RT/runtime.h $RT/*.cpp RuntimeBench.cpp -o bench-runtime
+//   ./bench-runtime -json=runtime.json > /dev/null
+//
+// With gcc, which doesn't know clang's nullability qualifiers, also pass
+// -D_Nonnull= -D_Nullable= -lpthread. Build with -DRUNTIME_SINGLE_THREADED
+// to measure the non atomic ref counting.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static int scale = 1;
+
+struct Result {
+    const char *_Nonnull name;
+    int iterations;
+    double nsPerOp;
+};
+static std::vector<Result> results;
+
+/// Runs `fn` `iterations` times, three times over, and records the fastest
+template <typename Fn>
+static void measure(const char *_Nonnull name, int iterations, Fn fn) {
+    iterations *= scale;
+    double best = 0;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double nsPerOp = elapsed.count() * 1e9 / iterations;
+        best = run == 0 ? nsPerOp : std::min(best, nsPerOp);
+    }
+    fprintf(stderr, "  %-40s %8.2f ns/op\n", name, best);
+    results.push_back({name, iterations, best});
+}
+
+/// Stops the compiler removing a result it can see is unused
+template <typename T>
+static void sink(T value) {
+    asm volatile("" : : "r"(value) : "memory");
+}
+
+static void writeJSON(const char *_Nonnull path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "could not write %s\n", path);
+        return;
+    }
+    fprintf(file, "{\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i)
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %d, \"nsPerOp\": %.3f}",
+                i == 0 ? "" : ",", results[i].name, results[i].iterations, results[i].nsPerOp);
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+}
+
+struct Small { int64_t a; };
+struct Large { int64_t a, b, c, d, e, f, g, h; };
+
+static void nop(void *_Nullable) {}
+
+/// The ref counting before release became a decrement-and-test
+namespace legacy {
+    __attribute__((noinline))
+    static void retain(RefcountedObject *_Nonnull object) {
+        __atomic_fetch_add(&object->refCount, 1, __ATOMIC_RELAXED);
+    }
+    __attribute__((noinline))
+    static void release(RefcountedObject *_Nonnull object) {
+        if (object->refCount == 1)
+            vist_deallocObject(object);
+        else
+            __atomic_fetch_sub(&object->refCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/// The scan `vist_lookupConformance` replaced, a call like it is
+__attribute__((noinline))
+static int32_t linearLookup(TypeMetadata *_Nonnull type, TypeMetadata *_Nonnull concept) {
+    for (int32_t index = 0; index < type->numConformances; index += 1)
+        if (type->conformances[index]->concept == concept)
+            return index;
+    return -1;
+}
+
+/// Compares the conformance lookup to a linear scan, for a type conforming to
+/// `numConformances` concepts, and a cast to its last one
+static void measureConformanceLookup(int numConformances, const char *_Nonnull const names[4]) {
+    // a concept past the last, which the type doesn't conform to
+    std::vector<TypeMetadata> concepts(numConformances + 1);
+    std::vector<WitnessTable> tables(numConformances);
+    std::vector<WitnessTable *> conformances(numConformances);
+    for (int i = 0; i < numConformances; ++i) {
+        concepts[i].name = "Concept";
+        tables[i].concept = &concepts[i];
+        conformances[i] = &tables[i];
+    }
+    TypeMetadata type = {};
+    type.name = "Conforming";
+    type.size = sizeof(int64_t);
+    type.conformances = conformances.data();
+    type.numConformances = numConformances;
+    auto last = &concepts[numConformances - 1], missing = &concepts[numConformances];
+
+    measure(names[0], 20000000, [&] {
+        sink(linearLookup(&type, last));
+    });
+    measure(names[1], 20000000, [&] {
+        sink(vist_lookupConformance(&type, last));
+    });
+    measure(names[2], 20000000, [&] {
+        sink(vist_lookupConformance(&type, missing));
+    });
+
+    int64_t value = 1;
+    ExistentialObject existential(0, &type, 0, nullptr);
+    vist_constructExistential(conformances.data(), numConformances, &value, &type, true, &existential);
+    measure(names[3], 10000000, [&] {
+        ExistentialObject out(0, &type, 0, nullptr);
+        vist_castExistentialToConcept(&existential, last, &out);
+        vist_deallocExistentialBuffer(&out);
+    });
+    vist_deallocExistentialBuffer(&existential);
+}
+
+int main(int argc, const char *_Nonnull *_Nonnull argv) {
+    const char *jsonPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "-json=", 6) == 0)
+            jsonPath = argv[i] + 6;
+        else if (strncmp(argv[i], "-scale=", 7) == 0)
+            scale = std::max(1, atoi(argv[i] + 7));
+    }
+
+    // a concept with one method and one property, and a struct and class
+    // conforming to it
+    TypeMetadata concept = {};
+    concept.name = "Concept";
+    TypeMetadata otherConcept = {};
+    otherConcept.name = "Other";
+
+    void *witnesses[] = { (void *)nop };
+    int32_t offsets[] = { 0 };
+    WitnessTable table = {};
+    table.concept = &concept;
+    table.witnesses = witnesses;
+    table.numWitnesses = 1;
+    table.propWitnessOffsets = offsets;
+    table.numOffsets = 1;
+    WitnessTable *conformances[] = { &table };
+
+    TypeMetadata small = {};
+    small.name = "Small";
+    small.size = sizeof(Small);
+    small.conformances = conformances;
+    small.numConformances = 1;
+    TypeMetadata large = small;
+    large.name = "Large";
+    large.size = sizeof(Large);
+    TypeMetadata object = small;
+    object.name = "Object";
+    object.isRefCounted = true;
+
+    Small smallValue = {1};
+    Large largeValue = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    fprintf(stderr, "ref counting\n");
+    measure("alloc/release", 2000000, [&] {
+        vist_releaseObject(vist_allocObject(&object));
+    });
+    auto instance = vist_allocObject(&object);
+    measure("retain/release", 10000000, [&] {
+        vist_retainObject(instance);
+        vist_releaseObject(instance);
+    });
+    measure("retain/release, legacy", 10000000, [&] {
+        legacy::retain(instance);
+        legacy::release(instance);
+    });
+#ifndef RUNTIME_SINGLE_THREADED
+    {
+        // other threads retain and release the same object while this one is measured
+        std::atomic<bool> done(false);
+        std::vector<std::thread> workers;
+        auto threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([&] {
+                while (!done.load(std::memory_order_relaxed)) {
+                    vist_retainObject(instance);
+                    vist_releaseObject(instance);
+                }
+            });
+        measure("retain/release, contended", 10000000, [&] {
+            vist_retainObject(instance);
+            vist_releaseObject(instance);
+        });
+        done = true;
+        for (auto &worker : workers)
+            worker.join();
+    }
+#endif
+    measure("slab allocate/deallocate", 10000000, [&] {
+        auto mem = vist_slabAllocate(48);
+        sink(mem);
+        vist_slabDeallocate(mem, 48);
+    });
+
+    fprintf(stderr, "existentials\n");
+    measure("construct/dealloc, inline struct", 10000000, [&] {
+        ExistentialObject ex(0, &small, 0, nullptr);
+        vist_constructExistential(conformances, 1, &smallValue, &small, false, &ex);
+        vist_deallocExistentialBuffer(&ex);
+    });
+    measure("construct/dealloc, heap struct", 2000000, [&] {
+        ExistentialObject ex(0, &large, 0, nullptr);
+        vist_constructExistential(conformances, 1, &largeValue, &large, false, &ex);
+        vist_deallocExistentialBuffer(&ex);
+    });
+    measure("construct/dealloc, class", 10000000, [&] {
+        // the existential takes over a reference
+        vist_retainObject(instance);
+        ExistentialObject ex(0, &object, 0, nullptr);
+        vist_constructExistential(conformances, 1, instance, &object, false, &ex);
+        vist_deallocExistentialBuffer(&ex);
+    });
+
+    ExistentialObject smallEx(0, &small, 0, nullptr), largeEx(0, &large, 0, nullptr), objectEx(0, &object, 0, nullptr);
+    vist_constructExistential(conformances, 1, &smallValue, &small, false, &smallEx);
+    vist_constructExistential(conformances, 1, &largeValue, &large, false, &largeEx);
+    vist_retainObject(instance);
+    vist_constructExistential(conformances, 1, instance, &object, false, &objectEx);
+
+    measure("copy/dealloc, inline struct", 10000000, [&] {
+        ExistentialObject copy(0, &small, 0, nullptr);
+        vist_copyExistentialBuffer(&smallEx, &copy);
+        vist_deallocExistentialBuffer(&copy);
+    });
+    measure("copy/dealloc, heap struct", 2000000, [&] {
+        ExistentialObject copy(0, &large, 0, nullptr);
+        vist_copyExistentialBuffer(&largeEx, &copy);
+        vist_deallocExistentialBuffer(&copy);
+    });
+    measure("copy/dealloc, class", 10000000, [&] {
+        ExistentialObject copy(0, &object, 0, nullptr);
+        vist_copyExistentialBuffer(&objectEx, &copy);
+        vist_deallocExistentialBuffer(&copy);
+    });
+    measure("export, owned buffer", 50000000, [&] {
+        vist_exportExistentialBuffer(&largeEx);
+    });
+    measure("witness method", 50000000, [&] {
+        sink(vist_getWitnessMethod(&smallEx, 0, 0));
+    });
+    // the runtime dumps registered sites at exit, so this must outlive main
+    static WitnessCacheSite site = {"bench", 0, 0, nullptr, false};
+    measure("record witness cache lookup", 50000000, [&] {
+        vist_recordWitnessCacheLookup(&site, true);
+    });
+    measure("property projection, struct", 50000000, [&] {
+        sink(vist_getPropertyProjection(&smallEx, 0, 0));
+    });
+    measure("property projection, class", 50000000, [&] {
+        sink(vist_getPropertyProjection(&objectEx, 0, 0));
+    });
+    measure("buffer projection", 50000000, [&] {
+        sink(vist_getExistentialBufferProjection(&largeEx));
+    });
+
+    fprintf(stderr, "casting\n");
+    measure("cast to concrete, hit", 20000000, [&] {
+        Large out;
+        sink(vist_castExistentialToConcrete(&largeEx, &large, &out));
+    });
+    measure("cast to concrete, miss", 20000000, [&] {
+        Large out;
+        sink(vist_castExistentialToConcrete(&largeEx, &small, &out));
+    });
+    measure("cast to concept, hit", 10000000, [&] {
+        ExistentialObject out(0, &small, 0, nullptr);
+        vist_castExistentialToConcept(&smallEx, &concept, &out);
+        vist_deallocExistentialBuffer(&out);
+    });
+    measure("cast to concept, miss", 10000000, [&] {
+        ExistentialObject out(0, &small, 0, nullptr);
+        sink(vist_castExistentialToConcept(&smallEx, &otherConcept, &out));
+    });
+    static const char *const lookup1[] = {
+        "linear scan, 1 conformance", "conformance lookup, 1 conformance",
+        "conformance lookup miss, 1 conformance", "cast to concept, 1 conformance" };
+    static const char *const lookup8[] = {
+        "linear scan, 8 conformances", "conformance lookup, 8 conformances",
+        "conformance lookup miss, 8 conformances", "cast to concept, 8 conformances" };
+    static const char *const lookup64[] = {
+        "linear scan, 64 conformances", "conformance lookup, 64 conformances",
+        "conformance lookup miss, 64 conformances", "cast to concept, 64 conformances" };
+    measureConformanceLookup(1, lookup1);
+    measureConformanceLookup(8, lookup8);
+    measureConformanceLookup(64, lookup64);
+
+    fprintf(stderr, "introspection\n");
+    measure("get metadata", 50000000, [&] {
+        sink(vist_runtime_getMetadata(&smallEx));
+    });
+    measure("metadata size", 50000000, [&] {
+        sink(vist_runtime_metadataGetSize(&small));
+    });
+    measure("metadata name", 50000000, [&] {
+        sink(vist_runtime_metadataGetName(&small));
+    });
+
+    fprintf(stderr, "output\n");
+    measure("write int", 5000000, [&] {
+        vist_outputWriteInt64(1234567);
+        vist_outputWriteByte('\n');
+    });
+    measure("write double", 2000000, [&] {
+        vist_outputWriteDouble(3.25);
+        vist_outputWriteByte('\n');
+    });
+    measure("write string", 5000000, [&] {
+        vist_outputWrite("hello world\n", 12);
+    });
+    // larger than the buffer, so written straight to stdout
+    static char largeString[96 * 1024];
+    memset(largeString, 'a', sizeof(largeString));
+    measure("write large string", 1000, [&] {
+        vist_outputWrite(largeString, sizeof(largeString));
+    });
+    vist_outputFlush();
+    // the stdio calls the print shims made before the runtime buffered output
+    measure("printf int", 5000000, [&] {
+        printf("%lli\n", 1234567ll);
+    });
+    measure("printf double", 2000000, [&] {
+        printf("%lf\n", 3.25);
+    });
+    measure("fwrite string", 5000000, [&] {
+        fwrite("hello world\n", 12, 1, stdout);
+    });
+    fflush(stdout);
+
+    vist_deallocExistentialBuffer(&smallEx);
+    vist_deallocExistentialBuffer(&largeEx);
+    vist_deallocExistentialBuffer(&objectEx);
+    vist_releaseObject(instance);
+
+    if (jsonPath)
+        writeJSON(jsonPath);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+#  bench.py
+#  Vist
+#
+#  Created by Josef Willsher on 16/11/2016.
+#  Copyright © 2016 vistlang. All rights reserved.
+#
+
+"""Runs the compiler and runtime benchmarks without Xcode.
+
+  - builds and runs RuntimeBench.cpp, a microbenchmark of each runtime entry
+    point, with clang++ or g++
+  - compiles each file in the corpus with `vist -Ohigh`, timing the compile
+    and collecting its `-stats-json` report, then times the executable
+
+Results are written as JSON, and compared with a previous run's results:
+
+  ./bench.py -o results.json
+  ./bench.py --baseline results.json --threshold 5
+
+exits with status 1 if any benchmark is more than `threshold` percent slower
+than the baseline. Use --runtime-only on machines without a vist install.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+SOURCE_ROOT = os.path.dirname(os.path.dirname(BENCH_DIR))
+RUNTIME_DIR = os.path.join(SOURCE_ROOT, "Vist", "stdlib", "runtime")
+TEST_CASES = os.path.join(SOURCE_ROOT, "Tests", "TestCases")
+
+# test cases whose compile or run time we track, the runtime ones are also
+# used by the XCTest performance tests
+CORPUS = ["LoopPerf", "FunctionPerf", "Random", "Existential", "ARC",
+          "String", "Specialise", "InlineBlocks"]
+
+
+def find_vist(path):
+    for candidate in [path, shutil.which("vist"), "/usr/local/bin/vist"]:
+        if candidate and os.access(candidate, os.X_OK):
+            return candidate
+    return None
+
+
+def build_runtime_bench(out_dir):
+    sources = sorted(os.path.join(RUNTIME_DIR, name)
+                     for name in os.listdir(RUNTIME_DIR) if name.endswith(".cpp"))
+    sources.append(os.path.join(BENCH_DIR, "RuntimeBench.cpp"))
+    binary = os.path.join(out_dir, "bench-runtime")
+    flags = ["-std=c++14", "-O3", "-include", os.path.join(RUNTIME_DIR, "runtime.h")]
+
+    if shutil.which("clang++"):
+        command = ["clang++"] + flags + sources + ["-o", binary, "-lpthread"]
+    elif shutil.which("g++"):
+        # gcc doesn't know clang's nullability qualifiers
+        command = ["g++", "-D_Nonnull=", "-D_Nullable="] + flags + sources + ["-o", binary, "-lpthread"]
+    else:
+        sys.exit("bench.py: no C++ compiler found")
+    subprocess.run(command, check=True, stderr=subprocess.DEVNULL)
+    return binary
+
+
+def run_runtime_bench(out_dir, scale):
+    binary = build_runtime_bench(out_dir)
+    json_path = os.path.join(out_dir, "runtime.json")
+    subprocess.run([binary, "-json=" + json_path, "-scale=%d" % scale],
+                   check=True, stdout=subprocess.DEVNULL)
+    with open(json_path) as f:
+        return {b["name"]: b["nsPerOp"] for b in json.load(f)["benchmarks"]}
+
+
+def wall_time(command, cwd, runs):
+    """The median wall time of `runs` runs of `command`, in seconds"""
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(command, cwd=cwd, check=True,
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        times.append(time.perf_counter() - start)
+    return statistics.median(times)
+
+
+def run_corpus(vist, out_dir, runs):
+    results = {}
+    for name in CORPUS:
+        source = os.path.join(TEST_CASES, name + ".vist")
+        if not os.path.exists(source):
+            continue
+        work = os.path.join(out_dir, name)
+        os.makedirs(work, exist_ok=True)
+        shutil.copy(source, work)
+        compile_command = [vist, "-Ohigh", "-stats-json=stats.json", name + ".vist"]
+
+        try:
+            compile_time = wall_time(compile_command, work, runs)
+            run_time = wall_time([os.path.join(work, name)], work, runs)
+        except subprocess.CalledProcessError as error:
+            print("  %-40s failed: %s" % (name, error), file=sys.stderr)
+            continue
+
+        results["compile " + name] = compile_time * 1e9
+        results["run " + name] = run_time * 1e9
+        with open(os.path.join(work, "stats.json")) as f:
+            report = json.load(f)
+        for stat in report.get("statistics", []):
+            results["stat %s %s: %s" % (name, stat["pass"], stat["statistic"])] = stat["count"]
+        print("  %-40s compile %8.1f ms   run %8.1f ms"
+              % (name, compile_time * 1e3, run_time * 1e3), file=sys.stderr)
+    return results
+
+
+def compare(results, baseline, threshold):
+    """Prints the change from `baseline`, returns the names which regressed.
+    Timings are in ns, opt statistics are counts and only reported"""
+    regressions = []
+    print("\n%-56s %12s %12s %8s" % ("benchmark", "baseline", "now", "change"), file=sys.stderr)
+    for name in sorted(results):
+        if name not in baseline or baseline[name] == 0:
+            continue
+        old, new = baseline[name], results[name]
+        change = (new - old) / old * 100
+        is_stat = name.startswith("stat ")
+        regressed = not is_stat and change > threshold
+        if regressed:
+            regressions.append(name)
+        if regressed or abs(change) > threshold:
+            print("%-56s %12.2f %12.2f %+7.1f%%%s"
+                  % (name, old, new, change, "  REGRESSION" if regressed else ""), file=sys.stderr)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-o", "--output", help="write the results to this JSON file")
+    parser.add_argument("--baseline", help="compare against this results file")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slowdown counted as a regression (default 10)")
+    parser.add_argument("--vist", help="the vist compiler, defaults to the one on PATH")
+    parser.add_argument("--runs", type=int, default=5, help="runs of each end to end benchmark")
+    parser.add_argument("--scale", type=int, default=1, help="multiplies the microbenchmark iterations")
+    parser.add_argument("--runtime-only", action="store_true", help="skip the end to end benchmarks")
+    args = parser.parse_args()
+
+    out_dir = tempfile.mkdtemp(prefix="vist-bench-")
+    try:
+        print("runtime", file=sys.stderr)
+        results = {"runtime " + name: ns for name, ns in run_runtime_bench(out_dir, args.scale).items()}
+
+        if not args.runtime_only:
+            vist = find_vist(args.vist)
+            if vist is None:
+                sys.exit("bench.py: vist not found, pass --vist or --runtime-only")
+            print("corpus", file=sys.stderr)
+            results.update(run_corpus(vist, out_dir, args.runs))
+    finally:
+        shutil.rmtree(out_dir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"results": results}, f, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)["results"]
+        regressions = compare(results, baseline, args.threshold)
+        if regressions:
+            print("\n%d benchmarks regressed by more than %g%%" % (len(regressions), args.threshold), file=sys.stderr)
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -6,6 +6,8 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
+import class Foundation.NSString
+
 
 func testExampleCFGOpt() throws -> Bool {
     let module = Module()
@@ -148,3 +150,259 @@ func testExampleCFGOpt2() throws -> Bool {
     return expected == fn.vir
 }
 
+
+/// Builds a function of `segments` loops in sequence, each a diamond whose
+/// latch branches back to the loop header or on to the next loop
+///
+/// ```
+/// head0 -> left0, right0 -> latch0 -> head0, head1 ...
+/// ```
+func buildLoopChainCFG(segments: Int) throws -> Function {
+    let module = Module()
+    let fn = try module.builder.buildFunction(name: "loops", type: FunctionType(params: [BuiltinType.bool], returns: BuiltinType.void), paramNames: ["cond"])
+    let cond = try fn.param(named: "cond")
+    
+    var heads: [BasicBlock] = []
+    for i in 0...segments {
+        heads.append(try module.builder.appendBasicBlock(name: "head\(i)"))
+    }
+    try module.builder.buildBreak(to: heads[0])
+    
+    for i in 0..<segments {
+        let left = try module.builder.appendBasicBlock(name: "left\(i)")
+        let right = try module.builder.appendBasicBlock(name: "right\(i)")
+        let latch = try module.builder.appendBasicBlock(name: "latch\(i)")
+        
+        module.builder.insertPoint.block = heads[i]
+        try module.builder.buildCondBreak(if: Operand(cond), to: (left, nil), elseTo: (right, nil))
+        module.builder.insertPoint.block = left
+        try module.builder.buildBreak(to: latch)
+        module.builder.insertPoint.block = right
+        try module.builder.buildBreak(to: latch)
+        module.builder.insertPoint.block = latch
+        try module.builder.buildCondBreak(if: Operand(cond), to: (heads[i], nil), elseTo: (heads[i+1], nil))
+    }
+    
+    module.builder.insertPoint.block = heads[segments]
+    try module.builder.buildReturnVoid()
+    return fn
+}
+
+/// Checks the dominator tree and frontiers of a `buildLoopChainCFG` function
+func testLoopChainDominators(_ fn: Function, segments: Int) throws -> Bool {
+    let tree = fn.dominator.analysis
+    var blocks: [String: BasicBlock] = [:]
+    for block in fn.blocks! { blocks[block.name] = block }
+    
+    for i in 0..<segments {
+        let head = blocks["head\(i)"]!, next = blocks["head\(i+1)"]!
+        let left = blocks["left\(i)"]!, latch = blocks["latch\(i)"]!
+        
+        guard tree.getNode(for: latch).iDom?.block === head,
+            tree.getNode(for: next).iDom?.block === latch,
+            tree.block(head, dominates: next),
+            tree.block(head, dominates: head),
+            !tree.block(left, dominates: latch),
+            tree.dominanceFrontier(of: left).map({ $0 === latch }) == [true],
+            tree.dominanceFrontier(of: latch).map({ $0 === head }) == [true],
+            tree.dominanceFrontier(of: head).map({ $0 === head }) == [true] else {
+            return false
+        }
+    }
+    return true
+}
+
+/// Builds a function with one block of `count` adds, which all use the same
+/// literal, and returns the adds
+func buildLongBlock(count: Int) throws -> (block: BasicBlock, literal: Inst, adds: [Inst]) {
+    let module = Module()
+    let intType = BuiltinType.int(size: 64)
+    _ = try module.builder.buildFunction(name: "long", type: FunctionType(params: [], returns: intType), paramNames: [])
+    
+    let literal = try module.builder.build(IntLiteralInst(val: 1, size: 64))
+    var adds: [Inst] = []
+    adds.reserveCapacity(count)
+    for _ in 0..<count {
+        adds.append(try module.builder.build(BuiltinInstCall(inst: .iadd, args: [literal, literal])))
+    }
+    try module.builder.buildReturn(value: literal)
+    return (module.builder.insertPoint.block!, literal, adds)
+}
+
+/// Erases every other add in a `buildLongBlock` block of at least 4 adds, inserts
+/// thousands of insts after the first add so its neighbours' order numbers run
+/// out, and checks the block and the literal's use list are still consistent
+func testLongBlockEditing(block: BasicBlock, literal: Inst, adds: [Inst]) throws -> Bool {
+    for add in stride(from: 1, to: adds.count, by: 2).map({ adds[$0] }) {
+        try add.eraseFromParent()
+    }
+    let kept = stride(from: 0, to: adds.count, by: 2).map { adds[$0] }
+    
+    var inserted: [Inst] = []
+    for _ in 0..<10_000 {
+        let lit = IntLiteralInst(val: 0, size: 64)
+        try block.insert(inst: lit, after: kept[0])
+        inserted.append(lit)
+    }
+    
+    guard block.instructionCount == 1 + kept.count + inserted.count + 1,
+        literal.uses.count == kept.count * 2 + 1,
+        try block.inst(kept[0], precedes: inserted[0]),
+        try block.inst(inserted[0], precedes: inserted[1]) == false,
+        try block.inst(inserted[0], precedes: kept[1]),
+        try block.inst(literal, precedes: kept[kept.count-1]) else {
+        return false
+    }
+    
+    // the list is in order
+    var previous: Inst? = nil
+    for inst in block.instructions {
+        if let previous = previous, try !block.inst(previous, precedes: inst) { return false }
+        previous = inst
+    }
+    return true
+}
+
+/// Writes a module with block params and a call to `path` as binary VIR, reads
+/// it back, and checks the bodies are only read when materialised and print
+/// the same VIR
+func testBinaryVIRRoundTrip(path: String) throws -> Bool {
+    let module = Module()
+    let intType = BuiltinType.int(size: 64)
+    
+    let double = try module.builder.buildFunction(name: "double", type: FunctionType(params: [intType], returns: intType), paramNames: ["a"])
+    let a = try double.param(named: "a")
+    let sum = try module.builder.build(BuiltinInstCall(inst: .iadd, args: [a, a]))
+    try module.builder.buildReturn(value: sum)
+    
+    let fn = try module.builder.buildFunction(name: "select", type: FunctionType(params: [BuiltinType.bool], returns: intType), paramNames: ["cond"])
+    let cond = try fn.param(named: "cond")
+    let x = Param(paramName: "x", type: intType)
+    let then = try module.builder.appendBasicBlock(name: "then")
+    let els = try module.builder.appendBasicBlock(name: "else")
+    let join = try module.builder.appendBasicBlock(name: "join", parameters: [x])
+    try module.builder.buildCondBreak(if: Operand(cond), to: (then, nil), elseTo: (els, nil))
+    
+    for (block, value) in [(then, 1), (els, -2)] {
+        module.builder.insertPoint.block = block
+        let literal = try module.builder.build(IntLiteralInst(val: value, size: 64))
+        try module.builder.buildBreak(to: join, args: [BlockOperand(optionalValue: literal, param: x, block: block)])
+    }
+    module.builder.insertPoint.block = join
+    let call = try module.builder.build(FunctionCallInst(function: double, args: [Operand(x)]))
+    try module.builder.buildReturn(value: call)
+    
+    try module.writeBinaryVIR(toFile: path)
+    let read = Module()
+    let reader = try VIRReader(contentsOf: path, into: read)
+    
+    guard read.functions.count == 2,
+        !read.functions.contains(where: { function in !reader.isUnmaterialised(function) }) else {
+        return false
+    }
+    try reader.materialiseAll()
+    
+    /// The functions' VIR without the pred comments, whose order isn't fixed
+    func vir(of module: Module) -> [String] {
+        return module.functions
+            .sorted { $0.name < $1.name }
+            .map { function in
+                function.vir.components(separatedBy: "\n")
+                    .map { line in line.components(separatedBy: "\t\t\t//")[0] }
+                    .joined(separator: "\n")
+            }
+    }
+    return vir(of: read) == vir(of: module)
+}
+
+
+/// Both arms of a branch release the object passed in; the ARC pass
+/// releases it once before the `cond_break` instead
+func testARCHoistRelease() throws -> Bool {
+    let module = Module()
+    let objectType = StructType(members: [("x", BuiltinType.int(size: 64), false)], methods: [], name: "Obj", isHeapAllocated: true)
+    let type = FunctionType(params: [objectType.importedType(in: module).ptrType(), BuiltinType.bool], returns: BuiltinType.void)
+    let fn = try module.builder.buildFunction(name: "arc", type: type, paramNames: ["obj", "cond"])
+    let object = try fn.param(named: "obj") as! RefParam
+    
+    let left = try module.builder.appendBasicBlock(name: "left")
+    let right = try module.builder.appendBasicBlock(name: "right")
+    let exit = try module.builder.appendBasicBlock(name: "exit")
+    try module.builder.buildCondBreak(if: Operand(fn.param(named: "cond")),
+                                      to: (left, nil),
+                                      elseTo: (right, nil))
+    
+    for block in [left, right] {
+        module.builder.insertPoint.block = block
+        try module.builder.build(ReleaseInst(object: object))
+        try module.builder.buildBreak(to: exit)
+    }
+    module.builder.insertPoint.block = exit
+    try module.builder.buildReturnVoid()
+    
+    try ARCSimplifyPass.run(on: fn)
+    
+    let entry = fn.entryBlock!.instructions
+    return entry.count == 2 && entry[0] is ReleaseInst && entry[1] is CondBreakInst
+        && !left.instructions.contains { $0 is ReleaseInst }
+        && !right.instructions.contains { $0 is ReleaseInst }
+}
+
+
+/// An interface declares nothing when read. Its functions are declared as
+/// they are used, private functions are left out, and only the `@inline`
+/// bodies which use exported functions are written
+func testStdLibInterface(path: String) throws -> Bool {
+    let module = Module()
+    let intType = BuiltinType.int(size: 64)
+    let type = FunctionType(params: [intType], returns: intType)
+    
+    let helper = try module.builder.buildFunction(name: "helper", type: type, paramNames: ["a"])
+    helper.visibility = .private
+    try module.builder.buildReturn(value: helper.param(named: "a"))
+    
+    let double = try module.builder.buildFunction(name: "double", type: type, paramNames: ["a"])
+    double.inlineRequirement = .always
+    let a = try double.param(named: "a")
+    try module.builder.buildReturn(value: module.builder.build(BuiltinInstCall(inst: .iadd, args: [a, a])))
+    
+    let usesHelper = try module.builder.buildFunction(name: "usesHelper", type: type, paramNames: ["a"])
+    usesHelper.inlineRequirement = .always
+    let call = try module.builder.build(FunctionCallInst(function: helper, args: [Operand(usesHelper.param(named: "a"))]))
+    try module.builder.buildReturn(value: call)
+    
+    let pairType = StructType(members: [("x", intType, false)], methods: [], name: "Pair", isHeapAllocated: false)
+    let first = try module.builder.buildFunction(name: "first",
+                                                 type: FunctionType(params: [pairType.importedType(in: module)], returns: intType),
+                                                 paramNames: ["p"])
+    first.inlineRequirement = .always
+    try module.builder.buildReturn(value: module.builder.build(StructExtractInst(object: first.param(named: "p"), property: "x")))
+    
+    try module.writeStdLibInterface(toFile: path)
+    
+    // the program declares `double` without its attributes
+    let program = Module()
+    let declared = try program.builder.buildFunctionPrototype(name: "double", type: type)
+    try program.loadStdLibInterface(fromFile: path)
+    guard let interface = program.stdlibInterface, program.functions.count == 1,
+        try interface.function(named: "helper") == nil,
+        try interface.function(named: "double") === declared,
+        declared.inlineRequirement == .always, interface.isUnmaterialised(declared),
+        let declaredUsesHelper = try interface.function(named: "usesHelper"),
+        !interface.isUnmaterialised(declaredUsesHelper) else {
+        return false
+    }
+    
+    // the program doesn't have `Pair`
+    do {
+        _ = try interface.function(named: "first")
+        return false
+    }
+    catch VIRSerialisationError.notInModule {
+    }
+    
+    try interface.materialise(declared)
+    guard declared.hasBody else { return false }
+    try interface.dematerialiseAll()
+    return !declared.hasBody && interface.isUnmaterialised(declared)
+}
@@ -10,7 +10,11 @@ import XCTest
 //import class Foundation.Pipe
 import class Foundation.FileManager
 import struct Foundation.URL
+import struct Foundation.Data
+import struct Foundation.Date
+import struct Foundation.FileAttributeKey
 import class Foundation.Process
+import class Foundation.ProcessInfo
 
 // tests can define comments which define the expected output of the program
 // `// OUT: 1 2` will add "1\n2\n" to the expected result of the program
@@ -82,6 +86,29 @@ extension CheckingTest {
         return false
     }
     
+    /// Compiles `name`.vist with `flags` instead of its RUN line, for checking
+    /// output a file's own RUN line doesn't produce
+    /// - returns: what the compiler printed, such as the IR from `-emit-llvm`
+    func _compileOutput(name: String, flags: [String]) throws -> String {
+        let temp = URL(fileURLWithPath: "\(Self.testDir)/\(name).vist.out.tmp")
+        guard FileManager.default.createFile(atPath: temp.path, contents: nil, attributes: nil) else { fatalError() }
+        defer { try! FileManager.default.removeItem(at: temp) }
+        
+        try compile(withFlags: flags + ["\(name).vist"], inDirectory: Self.testDir, out: temp)
+        return try String(contentsOf: temp)
+    }
+    
+    /// The lines of a function in VIR or LLVM IR output, from the header
+    /// `isHeader` matches to the function's closing brace
+    func _functionBody(in output: String, where isHeader: (String) -> Bool) -> ArraySlice<String>? {
+        let lines = output.components(separatedBy: "\n")
+        guard let start = lines.index(where: isHeader),
+            let end = lines.suffix(from: start).index(of: "}") else {
+            return nil
+        }
+        return lines[start...end]
+    }
+    
 }
 
 final class RefCountingTests : XCTestCase, VistTest {
@@ -167,6 +194,89 @@ extension OutputTests {
         XCTAssertTrue(_testFile(name: "Existential"))
     }
     
+    /// WitnessInlineCache.vist
+    ///
+    /// Test calls through existentials with a speculated witness
+    func testWitnessInlineCache() {
+        XCTAssertTrue(_testFile(name: "WitnessInlineCache"))
+    }
+    
+    /// JIT.vist
+    ///
+    /// Test running a program in process with the JIT
+    func testJIT() {
+        XCTAssertTrue(_testFile(name: "JIT"))
+    }
+    
+    /// Builds a program of two files with `-incremental`. An unchanged rebuild
+    /// must only relink the cached objects, and editing a function's body must
+    /// only recompile its own file
+    func testIncrementalBuild() {
+        let dir = "\(OutputTests.testDir)/Incremental"
+        let cacheDir = "\(dir)/.vistcache"
+        let out = URL(fileURLWithPath: "\(dir)/out.tmp")
+        defer { try? FileManager.default.removeItem(atPath: dir) }
+        
+        let main = "let square = Square 3\nprint (area square)\nprint (double 4)\n"
+        let lib = "concept Shape {\n    func size :: -> Int\n}\n" +
+                  "type Square {\n    var side: Int\n    func size :: -> Int = do return side * side\n}\n" +
+                  "func area :: Shape -> Int = (shape) do return shape.size ()\n"
+        
+        /// The cached objects, and when each was written
+        func cachedObjects() throws -> [String: Date] {
+            var objects: [String: Date] = [:]
+            for name in try FileManager.default.contentsOfDirectory(atPath: cacheDir) {
+                let attributes = try FileManager.default.attributesOfItem(atPath: "\(cacheDir)/\(name)")
+                objects[name] = attributes[FileAttributeKey.modificationDate] as? Date
+            }
+            return objects
+        }
+        /// Builds and runs the program with `double` defined as `double`
+        func build(double: String) throws -> String {
+            try main.write(toFile: "\(dir)/Main.vist", atomically: true, encoding: .utf8)
+            try (lib + "func double :: Int -> Int = (a) do return \(double)\n")
+                .write(toFile: "\(dir)/Lib.vist", atomically: true, encoding: .utf8)
+            guard FileManager.default.createFile(atPath: out.path, contents: nil, attributes: nil) else { fatalError() }
+            try compile(withFlags: ["-Ohigh", "-r", "-cache-dir=\(cacheDir)", "Main.vist", "Lib.vist"], inDirectory: dir, out: out)
+            return try String(contentsOf: out)
+        }
+        
+        do {
+            try FileManager.default.createDirectory(atPath: dir, withIntermediateDirectories: true, attributes: nil)
+            
+            XCTAssertEqual(try build(double: "a + a"), "9\n8\n")
+            let first = try cachedObjects()
+            XCTAssertEqual(first.count, 2, "Expected an object for each file")
+            
+            // nothing changed, so both objects are relinked from the cache
+            XCTAssertEqual(try build(double: "a + a"), "9\n8\n")
+            XCTAssert(try cachedObjects() == first, "An unchanged build recompiled")
+            
+            // the body changed but not the interface, so only Lib.vist is recompiled
+            XCTAssertEqual(try build(double: "a * 2 + 1"), "9\n9\n")
+            let edited = try cachedObjects()
+            XCTAssertEqual(edited.count, 3, "The edited file wasn't recompiled")
+            XCTAssertEqual(edited.filter { first[$0.key] == $0.value }.count, 2, "An unchanged file was recompiled")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    
+    /// Interpret.vist
+    ///
+    /// Test running a program's VIR in the interpreter
+    func testInterpret() {
+        XCTAssertTrue(_testFile(name: "Interpret"))
+    }
+    
+    /// Generator.vist
+    ///
+    /// Test a generator lowered to a resumable frame
+    func testGenerator() {
+        XCTAssertTrue(_testFile(name: "Generator"))
+    }
+    
     /// Existential2.vist
     func testExistential2() {
 //        let file = "Existential2"
@@ -367,6 +477,65 @@ extension CoreTests {
         }
     }
     
+    /// Copies `shims.c` to a new directory, to build its bitcode there
+    private func shimsDirectory(named name: String) throws -> String {
+        let directory = FileManager.default.temporaryDirectory.appendingPathComponent(name).path
+        _ = try? FileManager.default.removeItem(atPath: directory)
+        try FileManager.default.createDirectory(atPath: directory, withIntermediateDirectories: true, attributes: nil)
+        try FileManager.default.copyItem(atPath: "\(CoreTests.stdlibDir)/shims.c", toPath: "\(directory)/shims.c")
+        return directory
+    }
+    
+    /// The shims' bitcode is rebuilt when `shims.c` is newer than it, and
+    /// only then
+    func testShimsRebuild() {
+        do {
+            let directory = try shimsDirectory(named: "ShimsRebuild")
+            defer { _ = try? FileManager.default.removeItem(atPath: directory) }
+            let bitcode = "\(directory)/shims.bc"
+            func modificationDate() throws -> Date {
+                return try FileManager.default.attributesOfItem(atPath: bitcode)[FileAttributeKey.modificationDate] as! Date
+            }
+            
+            try buildShims(directory: directory, bitcodePath: bitcode, force: false)
+            // as if shims.c was edited after the bitcode was built
+            let past = Date(timeIntervalSinceNow: -3600)
+            try FileManager.default.setAttributes([FileAttributeKey.modificationDate: past], ofItemAtPath: bitcode)
+            try buildShims(directory: directory, bitcodePath: bitcode, force: false)
+            let rebuilt = try modificationDate()
+            XCTAssert(rebuilt > past, "The bitcode was not rebuilt")
+            
+            try buildShims(directory: directory, bitcodePath: bitcode, force: false)
+            XCTAssertEqual(try modificationDate(), rebuilt, "Up to date bitcode was rebuilt")
+        }
+        catch {
+            XCTFail("Shims build failed with error:\n\(error)\n\n")
+        }
+    }
+    
+    /// The partly written bitcode of a compile which died is never loaded
+    func testShimsStaleTemporary() {
+        do {
+            let directory = try shimsDirectory(named: "ShimsStaleTemporary")
+            defer { _ = try? FileManager.default.removeItem(atPath: directory) }
+            let bitcode = "\(directory)/shims.bc"
+            let garbage = Data("not bitcode".utf8)
+            // left by another compile, and by an earlier one with this pid
+            let stale = ["\(bitcode).1.tmp", "\(bitcode).\(ProcessInfo.processInfo.processIdentifier).tmp"]
+            for path in stale {
+                try garbage.write(to: URL(fileURLWithPath: path))
+            }
+            
+            let shims = try LLVMModule.shims(directory: directory, bitcodePath: bitcode)
+            XCTAssertFalse(Array(shims.functions).isEmpty, "The shims were not loaded")
+            XCTAssertNotEqual(try Data(contentsOf: URL(fileURLWithPath: bitcode)), garbage)
+            XCTAssertFalse(FileManager.default.fileExists(atPath: stale[1]), "The temporary file was not renamed")
+        }
+        catch {
+            XCTFail("Shims build failed with error:\n\(error)\n\n")
+        }
+    }
+    
 }
 
 
@@ -451,6 +620,56 @@ extension OptimiserTests {
     func testInlinerSimple() {
         XCTAssert(_testFile(name: "InlineSimple"))
     }
+    func testInlinerBlocks() {
+        XCTAssert(_testFile(name: "InlineBlocks"))
+    }
+    
+    /// InlineBlocks.vist
+    ///
+    /// `clamp` and `sum` are inlined into main, `report` costs more than the
+    /// threshold so main still calls it
+    /// StdLibInterface.vist
+    func testStdLibInterface() {
+        XCTAssert(_testFile(name: "StdLibInterface"))
+    }
+    
+    /// `..<` is `@inline` in the stdlib, its body is read from the stdlib's
+    /// interface and inlined into main
+    func testStdLibInterfaceVIR() {
+        do {
+            let vir = try _compileOutput(name: "StdLibInterface", flags: ["-Ohigh", "-emit-vir"])
+            guard let main = _functionBody(in: vir, where: { $0.hasPrefix("func @main ") }) else {
+                return XCTFail("main was not emitted")
+            }
+            XCTAssertFalse(main.contains { $0.contains("call @_V-D-D-L_tII") },
+                           "..< was not inlined:\n\(main.joined(separator: "\n"))")
+            // libvist defines it, the body read is not emitted
+            XCTAssertFalse(vir.components(separatedBy: "\n").contains { $0.hasPrefix("func @_V-D-D-L_tII") && $0.hasSuffix("{") },
+                           "..< was defined in the program")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    
+    func testInlineBlocksVIR() {
+        do {
+            let vir = try _compileOutput(name: "InlineBlocks", flags: ["-Ohigh", "-emit-vir"])
+            guard let main = _functionBody(in: vir, where: { $0.hasPrefix("func @main ") }) else {
+                return XCTFail("main was not emitted")
+            }
+            let dump = main.joined(separator: "\n")
+            for callee in ["clamp", "sum"] {
+                XCTAssertFalse(main.contains { $0.contains("call @_V\(callee)_") },
+                               "\(callee) was not inlined:\n\(dump)")
+            }
+            XCTAssert(main.contains { $0.contains("call @_Vreport_") },
+                      "report was inlined:\n\(dump)")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
     func testStructFlattenVIR() {
         XCTAssert(_testFile(name: "StructFlatten"))
     }
@@ -463,6 +682,122 @@ extension OptimiserTests {
     func testConstantFolding() {
         XCTAssert(_testFile(name: "ConstantFolding"))
     }
+    func testARC() {
+        XCTAssert(_testFile(name: "ARC"))
+    }
+    
+    /// ARC.vist
+    ///
+    /// The retain copying `a` into `b` in `twice` is paired with `b`’s release,
+    /// leaving only the release of `a`. The inliner is disabled so `twice` is kept
+    func testARCVIR() {
+        do {
+            let vir = try _compileOutput(name: "ARC", flags: ["-Ohigh", "-disable-opt=inline", "-emit-vir"])
+            guard let body = _functionBody(in: vir, where: { $0.hasPrefix("func @twice") }) else {
+                return XCTFail("twice was not emitted")
+            }
+            XCTAssertFalse(body.contains { $0.contains("retain_object") },
+                           "twice still retains:\n\(body.joined(separator: "\n"))")
+            XCTAssertEqual(body.filter { $0.contains("release_object") }.count, 1,
+                           "twice should only release its param:\n\(body.joined(separator: "\n"))")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    func testARCHoist() {
+        do {
+            try XCTAssert(testARCHoistRelease())
+        }
+        catch {
+            XCTFail("\(error)")
+        }
+    }
+    func testExistentialUnbox() {
+        XCTAssert(_testFile(name: "ExistentialUnbox"))
+    }
+    
+    /// ExistentialUnbox.vist
+    ///
+    /// Once `describe` is inlined into `main` the shapes it is called with
+    /// are never boxed, and `area` is called on them directly
+    func testExistentialUnboxVIR() {
+        do {
+            let vir = try _compileOutput(name: "ExistentialUnbox", flags: ["-Ohigh", "-emit-vir"])
+            guard let main = _functionBody(in: vir, where: { $0.hasPrefix("func @main ") }) else {
+                return XCTFail("main was not emitted")
+            }
+            let dump = main.joined(separator: "\n")
+            XCTAssertFalse(main.contains { $0.contains("existential_construct") || $0.contains("existential_witness") },
+                           "main still boxes the shapes:\n\(dump)")
+            for type in ["Square", "Rect"] {
+                XCTAssert(main.contains { $0.contains("= call @_Varea_m") && $0.contains(type) },
+                          "\(type).area was not called directly:\n\(dump)")
+            }
+            
+            let ir = try _compileOutput(name: "ExistentialUnbox", flags: ["-Ohigh", "-emit-llvm"])
+            guard let mainIR = _functionBody(in: ir, where: { $0.hasPrefix("define ") && $0.contains("@main(") }) else {
+                return XCTFail("main was not emitted")
+            }
+            XCTAssertFalse(mainIR.contains { $0.contains("vist_deallocExistentialBuffer") },
+                           "main still frees an existential buffer:\n\(mainIR.joined(separator: "\n"))")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    func testSpecialise() {
+        XCTAssert(_testFile(name: "Specialise"))
+    }
+    
+    /// Specialise.vist
+    ///
+    /// `total r r` calls the clone taking both `Rect`s unboxed, the inliner
+    /// is disabled so the call is kept
+    func testSpecialiseVIR() {
+        do {
+            let vir = try _compileOutput(name: "Specialise", flags: ["-Ohigh", "-disable-opt=inline", "-emit-vir"])
+            let calls = vir.components(separatedBy: "\n").filter { $0.contains("= call @") && $0.contains("total") }
+            XCTAssert(calls.contains { $0.contains(".0Rect.1Rect (") && $0.contains(": #Rect, ") },
+                      "total was not called with the Rect clone:\n\(calls.joined(separator: "\n"))")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    
+    /// ProfileUse.vist
+    ///
+    /// Trains the program with -profile-generate, then builds it with the profile
+    func testProfileUse() {
+        let file = "ProfileUse"
+        let profraw = "\(OptimiserTests.testDir)/\(file).profraw"
+        defer {
+            for path in [profraw, "\(OptimiserTests.testDir)/\(file).profdata"] {
+                try? FileManager.default.removeItem(atPath: path)
+            }
+        }
+        do {
+            try compile(withFlags: ["-Ohigh", "-r", "-profile-generate=\(file).profraw", "\(file).vist"], inDirectory: OptimiserTests.testDir)
+            XCTAssert(FileManager.default.fileExists(atPath: profraw), "No profile was written")
+            XCTAssert(_testFile(name: file))
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
+    
+    /// Short training runs have small counts, which must not all be hot
+    func testProfileHotness() {
+        XCTAssertEqual(ProfileData.hotness(count: 0, maxCount: 50), .cold)
+        XCTAssertEqual(ProfileData.hotness(count: 1, maxCount: 50), .hot)
+        XCTAssertEqual(ProfileData.hotness(count: 0, maxCount: 0), .unknown)
+        XCTAssertEqual(ProfileData.hotness(count: 9, maxCount: 10_000), .cold)
+        XCTAssertEqual(ProfileData.hotness(count: 50, maxCount: 10_000), .unknown)
+        XCTAssertEqual(ProfileData.hotness(count: 100, maxCount: 10_000), .hot)
+        // scaling must not overflow
+        XCTAssertEqual(ProfileData.hotness(count: UInt64.max / 2, maxCount: UInt64.max), .hot)
+    }
     func testPhiPlacement() {
         do {
             try XCTAssert(testExampleCFGOpt())
@@ -486,6 +821,53 @@ extension OptimiserTests {
     func testPhiPlacementLoop() {
         XCTAssert(_testFile(name: "PhiPlacement3"))
     }
+    
+    /// Builds the dominator tree of a generated CFG of 10k blocks
+    func testDominatorTreeScaling10k() {
+        _testDominatorTreeScaling(segments: 2_500)
+    }
+    /// 40k blocks, the construction is near linear so this should take around
+    /// 4x as long as the 10k test
+    func testDominatorTreeScaling40k() {
+        _testDominatorTreeScaling(segments: 10_000)
+    }
+    
+    private func _testDominatorTreeScaling(segments: Int) {
+        do {
+            let fn = try buildLoopChainCFG(segments: segments)
+            try XCTAssert(testLoopChainDominators(fn, segments: segments))
+            
+            measure {
+                fn.invalidateCFGAnalyses()
+                _ = fn.dominator.analysis
+            }
+        }
+        catch {
+            XCTFail("\(error)")
+        }
+    }
+    
+    /// Erases and inserts instructions in a block of 100k, which with the
+    /// linked instruction and use lists are each constant time
+    func testLongBlockEditing() {
+        do {
+            var blocks: [(block: BasicBlock, literal: Inst, adds: [Inst])] = []
+            for _ in 0..<10 { blocks.append(try buildLongBlock(count: 100_000)) }
+            
+            measure {
+                guard let long = blocks.popLast() else { return }
+                do {
+                    try XCTAssert(testLongBlockEditing(block: long.block, literal: long.literal, adds: long.adds))
+                }
+                catch {
+                    XCTFail("\(error)")
+                }
+            }
+        }
+        catch {
+            XCTFail("\(error)")
+        }
+    }
 
 }
 
@@ -505,6 +887,30 @@ extension VIRGenTests {
     func testClosureParam() {
         XCTAssert(_testFile(name: "ClosureParam"))
     }
+    
+    /// Writes and memory maps binary VIR, reading the bodies lazily
+    func testBinaryVIRRoundTrip() {
+        let path = FileManager.default.temporaryDirectory.appendingPathComponent("RoundTrip.virb").path
+        defer { _ = try? FileManager.default.removeItem(atPath: path) }
+        do {
+            try XCTAssert(testBinaryVIRRoundTrip(path: path))
+        }
+        catch {
+            XCTFail("\(error)")
+        }
+    }
+    
+    /// Writes an interface and reads it into a module which uses it
+    func testStdLibInterfaceRead() {
+        let path = FileManager.default.temporaryDirectory.appendingPathComponent("Interface.virb").path
+        defer { _ = try? FileManager.default.removeItem(atPath: path) }
+        do {
+            try XCTAssert(testStdLibInterface(path: path))
+        }
+        catch {
+            XCTFail("\(error)")
+        }
+    }
 }
 
 extension ParseTests {
@@ -524,6 +930,24 @@ extension LLVMTests {
     func testStrings() {
         XCTAssert(_testFile(name: "String"))
     }
+    
+    /// Generator.vist
+    ///
+    /// The `@noinline` generator's body is moved to a resume function which
+    /// takes its frame
+    func testGeneratorFrame() {
+        do {
+            let ir = try _compileOutput(name: "Generator", flags: ["-Ohigh", "-emit-llvm"]).components(separatedBy: "\n")
+            let isGenerator = { (line: String) in line.contains("generate") && line.contains("Fibonacci") }
+            XCTAssert(ir.contains { isGenerator($0) && $0.hasPrefix("%") && $0.contains(".frame = type { i32, ") },
+                      "No frame type was emitted for the generator")
+            XCTAssert(ir.contains { isGenerator($0) && $0.hasPrefix("define ") && $0.contains(".resume(") && $0.contains(".frame* ") },
+                      "No resume function was emitted for the generator")
+        }
+        catch {
+            XCTFail("Compilation failed with error:\n\(error)\n\n")
+        }
+    }
 
 }
 
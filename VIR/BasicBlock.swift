@@ -17,7 +17,15 @@ final class BasicBlock : VIRElement {
     /// A name for the block
     var name: String
     /// The collection of instructions in this block
-    fileprivate(set) var instructions: [Inst] = []
+    var instructions: InstructionList { return InstructionList(block: self) }
+    
+    /// The ends of the instruction list, the rest are linked through the
+    /// insts' `listNode`s
+    fileprivate var firstInst: Inst? = nil, lastInst: Inst? = nil
+    fileprivate(set) var instructionCount = 0
+    /// Set when an inst was linked where there was no gap in the order
+    /// numbers, the block is renumbered on the next ordering query
+    fileprivate var orderIsStale = false
     
     weak var parentFunction: Function?
     var loweredBlock: LLVMBasicBlock? = nil
@@ -40,9 +48,20 @@ final class BasicBlock : VIRElement {
         self.applications = []
     }
     
+    deinit {
+        // unlink iteratively, releasing a long chain of `next` references
+        // recursively could overflow the stack
+        var inst = firstInst
+        firstInst = nil; lastInst = nil
+        while let current = inst {
+            inst = current.listNode.next
+            current.listNode.next = nil
+        }
+    }
+    
     /// The final break inst in this block
     var breakInst: BreakInstruction? {
-        return instructions.last as? BreakInstruction
+        return lastInst as? BreakInstruction
     }
     
     /// The application of a block, how you jump into the block. `nil` preds
@@ -63,17 +82,61 @@ final class BasicBlock : VIRElement {
 extension BasicBlock {
     
     func insert(inst: Inst, after: Inst) throws {
-        let i = try index(of: after)
-        instructions.insert(inst, at: instructions.index(after: i))
-        inst.parentBlock = self
+        guard contains(after) else { throw VIRError.instNotInBB }
+        link(inst, after: after)
     }
     func insert(inst: Inst, at: Inst) throws {
-        instructions.insert(inst, at: try index(of: at))
-        inst.parentBlock = self
+        guard contains(at) else { throw VIRError.instNotInBB }
+        link(inst, after: at.listNode.previous)
     }
     func append(_ inst: Inst) {
-        instructions.append(inst)
+        link(inst, after: lastInst)
+    }
+    
+    /// Links `inst` into the list after `previous`, or at the start if nil
+    private func link(_ inst: Inst, after previous: Inst?) {
+        let next = previous.map { previous in previous.listNode.next } ?? firstInst
+        inst.listNode.previous = previous
+        inst.listNode.next = next
+        if let previous = previous { previous.listNode.next = inst } else { firstInst = inst }
+        if let next = next { next.listNode.previous = inst } else { lastInst = inst }
         inst.parentBlock = self
+        instructionCount += 1
+        
+        // once stale the numbers are all reassigned, so there is no point
+        // placing this one
+        guard !orderIsStale else { return }
+        switch (previous?.listNode.order, next?.listNode.order) {
+        case let (p?, n?) where n - p > 1: inst.listNode.order = p + (n - p) / 2
+        case (_?, _?): orderIsStale = true
+        case let (p?, nil): inst.listNode.order = p + BasicBlock.orderSpacing
+        case let (nil, n?): inst.listNode.order = n - BasicBlock.orderSpacing
+        case (nil, nil): inst.listNode.order = 0
+        }
+    }
+    
+    private func unlink(_ inst: Inst) {
+        let previous = inst.listNode.previous, next = inst.listNode.next
+        if let previous = previous { previous.listNode.next = next } else { firstInst = next }
+        if let next = next { next.listNode.previous = previous } else { lastInst = previous }
+        inst.listNode = InstListNode()
+        inst.parentBlock = nil
+        instructionCount -= 1
+    }
+    
+    private static let orderSpacing = 1 << 16
+    
+    /// Spaces out the insts' order numbers, after an inst was inserted between
+    /// two with consecutive numbers. This is deferred until the order is next
+    /// queried, so a run of insertions at one point renumbers the block once
+    private func renumber() {
+        var order = 0, inst = firstInst
+        while let current = inst {
+            current.listNode.order = order
+            order += BasicBlock.orderSpacing
+            inst = current.listNode.next
+        }
+        orderIsStale = false
     }
     
     /// Get param named `name` or throw
@@ -122,6 +185,7 @@ extension BasicBlock {
         
         applications.append(.body(predecessor: block, params: args, breakInst: breakInst))
         block.successors.append(self)
+        parentFunction?.invalidateCFGAnalyses()
     }
     
     func addPhiArg(_ arg: BlockOperand, from block: BasicBlock) throws {
@@ -144,26 +208,29 @@ extension BasicBlock {
         
         let successorIndex = application.predecessor!.successors.index(of: self)!
         application.predecessor!.successors.remove(at: successorIndex)
+        parentFunction?.invalidateCFGAnalyses()
     }
     
-    /// Helper, the index of `inst` in self or throw
-    func index(of inst: Inst) throws -> Int {
-        guard let i = instructions.index(where: { $0 === inst }) else {
-            throw VIRError.instNotInBB
-        }
-        return i
+    /// - returns: whether `inst` comes before `other` in self, or throw if
+    ///            either isn't in self
+    func inst(_ inst: Inst, precedes other: Inst) throws -> Bool {
+        guard contains(inst), contains(other) else { throw VIRError.instNotInBB }
+        if orderIsStale { renumber() }
+        return inst.listNode.order < other.listNode.order
     }
     
     // instructions
     func set(inst: Inst, newValue: Inst) throws {
-        instructions[try index(of: inst)] = newValue
+        guard contains(inst) else { throw VIRError.instNotInBB }
+        link(newValue, after: inst)
+        unlink(inst)
     }
     
     /// Remove `inst` from self
     /// - precondition: `inst` is a member of `self`
     func remove(inst: Inst) throws {
-        try instructions.remove(at: index(of: inst))
-        inst.parentBlock = nil
+        guard contains(inst) else { throw VIRError.instNotInBB }
+        unlink(inst)
     }
     
     /// Adds a param to the block
@@ -180,9 +247,42 @@ extension BasicBlock {
         param.parentBlock = self
     }
     
+    /// Splits `self` after `inst`, moving the following instructions into a
+    /// new block which is placed after `self`. The new block takes over
+    /// `self`'s successors, `self` is left without a terminator
+    /// - returns: the new block
+    func split(after inst: Inst, named name: String) throws -> BasicBlock {
+        guard let function = parentFunction,
+            let blockIndex = function.blocks?.index(where: { block in block === self }) else {
+            throw VIRError.bbNotInFn
+        }
+        guard contains(inst) else { throw VIRError.instNotInBB }
+        
+        let continuation = BasicBlock(name: name, parameters: nil, parentFunction: function)
+        function.insert(block: continuation, atIndex: blockIndex + 1)
+        
+        while let moved = inst.listNode.next {
+            try remove(inst: moved)
+            continuation.append(moved)
+            
+            // the successors are now broken to from the continuation
+            if case let breakInst as BreakInstruction = moved {
+                for succ in breakInst.successors {
+                    for arg in succ.args ?? [] {
+                        arg.predBlock = continuation
+                    }
+                    try succ.block.removeApplication(break: breakInst)
+                    try succ.block.addApplication(from: continuation, args: succ.args, breakInst: breakInst)
+                }
+            }
+        }
+        return continuation
+    }
+    
     /// - returns: whether this block's instructions contains `inst`
     func contains(_ inst: Inst) -> Bool {
-        return instructions.contains { $0 === inst }
+        // an inst can name its block before being added, so check it is linked
+        return inst.parentBlock === self && (inst.listNode.previous != nil || firstInst === inst)
     }
     
     var module: Module { return parentFunction!.module }
@@ -228,27 +328,47 @@ extension Inst {
     
     /// The successor to `self`
     func successor() throws -> Inst? {
-        return try parentBlock.map { parent in
-            let x = try parent.index(of: self)
-            return parent.instructions[parent.instructions.index(after: x)]
-        }
+        guard let parent = parentBlock else { return nil }
+        guard parent.contains(self) else { throw VIRError.instNotInBB }
+        return listNode.next
     }
     /// The predecessor of `self`
     func predecessor() throws -> Inst? {
-        return try parentBlock.map { parent in
-            let x = try parent.index(of: self)
-            return parent.instructions[parent.instructions.index(before: x)]
-        }
+        guard let parent = parentBlock else { return nil }
+        guard parent.contains(self) else { throw VIRError.instNotInBB }
+        return listNode.previous
     }
     
     /// The predecessor of `self`
     func predecessorOrSelf() -> Inst {
-        let v: Inst? = parentBlock.map { parent in
-            guard let x = try? parent.index(of: self), x != parent.instructions.startIndex else { return self }
-            return parent.instructions[parent.instructions.index(before: x)]
-        }
-        return v ?? self
+        return listNode.previous ?? self
     }
 
     
 }
+
+
+/// The instructions of a block, in order. Iterating walks a copy of the list
+/// taken when iteration starts, so a pass can insert and erase instructions
+/// as it goes; an inst erased before it is reached is still visited, with no
+/// parent block
+struct InstructionList : Sequence {
+    fileprivate unowned let block: BasicBlock
+    
+    var first: Inst? { return block.firstInst }
+    var last: Inst? { return block.lastInst }
+    var isEmpty: Bool { return block.firstInst == nil }
+    var count: Int { return block.instructionCount }
+    var underestimatedCount: Int { return block.instructionCount }
+    
+    func makeIterator() -> IndexingIterator<[Inst]> {
+        var insts: [Inst] = []
+        insts.reserveCapacity(block.instructionCount)
+        var inst = block.firstInst
+        while let current = inst {
+            insts.append(current)
+            inst = current.listNode.next
+        }
+        return insts.makeIterator()
+    }
+}
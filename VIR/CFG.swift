@@ -54,8 +54,7 @@ enum CFGFoldPass : OptimisationPass {
                     
                     try inst.eraseFromParent(replacingAllUsesWith: br)
                     
-                    function.dominator.invalidate()
-                    OptStatistics.condBreakChecksRemoved += 1
+                    OptStatistics.condBreakChecksRemoved.increment()
                     
                 case let castBreakInst as CheckedCastBreakInst:
                     
@@ -120,8 +119,7 @@ enum CFGFoldPass : OptimisationPass {
                     
                     try inst.eraseFromParent(replacingAllUsesWith: br)
                     
-                    function.dominator.invalidate()
-                    OptStatistics.condBreakChecksRemoved += 1
+                    OptStatistics.condBreakChecksRemoved.increment()
                     
                 default:
                     continue instLoop
@@ -174,9 +172,8 @@ enum CFGFoldPass : OptimisationPass {
             }
             
             try block.eraseFromParent()
-            function.dominator.invalidate()
             
-            OptStatistics.blocksMerged += 1
+            OptStatistics.blocksMerged.increment()
         }
         
         
@@ -201,14 +198,14 @@ private extension Function {
         }
         // remove block
         try block.removeFromParent()
-        OptStatistics.deadBlocksRemoved += 1
+        OptStatistics.deadBlocksRemoved.increment()
     }
 }
 
 extension OptStatistics {
-    static var deadBlocksRemoved = 0
-    static var blocksMerged = 0
+    static let deadBlocksRemoved = Statistic(pass: CFGFoldPass.self, "dead blocks removed")
+    static let blocksMerged = Statistic(pass: CFGFoldPass.self, "blocks merged")
     /// How many `cond_break` insts are promoted to `break`
-    static var condBreakChecksRemoved = 0
+    static let condBreakChecksRemoved = Statistic(pass: CFGFoldPass.self, "cond_break checks removed")
 }
 
@@ -17,7 +17,9 @@ final class Function : VIRElement {
     fileprivate var body: FunctionBody?
     
     fileprivate unowned var parentModule: Module
-    var uses: [Operand] = []
+    /// The uses of refs to this function
+    let useList = UseList(shared: true)
+    var uses: [Operand] { return useList.operands }
     
     // Attrs
     var visibility: Visibility = .internal
@@ -96,7 +98,10 @@ extension Function {
     /// - precondition: self `hasBody`
     var blocks: [BasicBlock]? {
         get { return body?.blocks }
-        set { if let v = newValue { body?.blocks = v } }
+        set {
+            if let v = newValue { body?.blocks = v }
+            invalidateCFGAnalyses()
+        }
     }
     /// The list of params to this function
     /// - precondition: self `hasBody`
@@ -131,12 +136,30 @@ extension Function {
             }
         }
         
+        try defineBody(withParams: params)
+    }
+    
+    /// Creates the function body, with `params` as the entry block's args.
+    /// Unlike `defineBody(params:)`, the params are used as they are
+    /// - precondition: Body is undefined
+    func defineBody(withParams params: [Param]) throws {
+        guard !hasBody else { throw VIRError.hasBody }
+        
         body = FunctionBody(params: params, parentFunction: self, blocks: [])
         
         let entry = try module.builder.buildEntryBlock(function: self)
         for p in params { p.parentBlock = entry }
     }
     
+    /// Erases the function's blocks, leaving it a prototype
+    func eraseBody() throws {
+        // in reverse, so each instruction's users are erased before it
+        for block in (blocks ?? []).reversed() {
+            try block.eraseFromParent()
+        }
+        body = nil
+    }
+    
     /// The function's entry block
     /// - precondition: self `hasBody`
     var entryBlock: BasicBlock? { return body?.blocks.first }
@@ -154,10 +177,19 @@ extension Function {
     
     func insert(block: BasicBlock, atIndex index: Int) {
         body?.blocks.insert(block, at: index)
+        invalidateCFGAnalyses()
     }
     /// Add basic block to end of `self`
     func append(block: BasicBlock) {
         body?.blocks.append(block)
+        invalidateCFGAnalyses()
+    }
+    
+    /// Drops the analyses computed from the CFG. Called by every mutation
+    /// which adds or removes a block or an edge, so a pass never reads a
+    /// dominator tree of the old CFG
+    func invalidateCFGAnalyses() {
+        dominator.invalidate()
     }
     
     /// Apply AST attributes to set linkage, inline status, and attrs
@@ -241,10 +273,7 @@ final class FunctionRef : LValue {
     
     weak var parentBlock: BasicBlock?
     
-    var uses: [Operand] {
-        get { return function.uses }
-        set(uses) { function.uses = uses }
-    }
+    var useList: UseList { return function.useList }
     
     
 }
@@ -254,6 +283,7 @@ extension BasicBlock {
     func removeFromParent() throws {
         if let p = parentFunction {
             try p.body?.blocks.remove(at: p.index(of: self))
+            p.invalidateCFGAnalyses()
         }
     }
     /// Erases `self` from the parent function, cutting all references to
@@ -330,7 +360,7 @@ extension VIRBuilder {
     func buildEntryBlock(function: Function) throws -> BasicBlock {
         let bb = BasicBlock(name: "entry", parameters: function.params, parentFunction: function)
         try bb.addEntryApplication(args: function.params!)
-        function.body?.blocks.insert(bb, at: 0)
+        function.insert(block: bb, atIndex: 0)
         insertPoint.block = bb
         return bb
     }
@@ -345,6 +375,15 @@ extension VIRBuilder {
         return function
     }
     
+    /// Adds a prototype whose `type` is already canonical, such as one read
+    /// from serialised VIR
+    @discardableResult
+    func buildCanonicalFunctionPrototype(name: String, type: FunctionType) -> Function {
+        let function = Function(name: name, type: type, module: module)
+        module.insert(function: function)
+        return function
+    }
+    
 }
 
 extension Module {
@@ -22,6 +22,9 @@ protocol Inst : Value {
     /// The block owning this inst
     weak var parentBlock: BasicBlock? { get set }
     
+    /// The neighbouring insts in `parentBlock`, maintained by the block
+    var listNode: InstListNode { get set }
+    
     /// Does this inst have side effects? If false, it can
     /// be removed if there are no users
     var hasSideEffects: Bool { get }
@@ -29,6 +32,17 @@ protocol Inst : Value {
     var isTerminator: Bool { get }
 }
 
+/// An inst's links in its block's instruction list. The block owns the first
+/// inst, and each inst owns the next
+struct InstListNode {
+    weak var previous: Inst? = nil
+    var next: Inst? = nil
+    /// Increases along the list, so insts in the same block can be ordered
+    /// without walking it. Gaps are left so most insertions don't renumber,
+    /// and the block renumbers lazily when a gap runs out
+    var order = 0
+}
+
 extension Inst {
     
     /// Removes the function from its parent
@@ -13,7 +13,8 @@ final class ArrayInst : Inst {
     
     var type: Type? { return BuiltinType.array(el: arrayType.mem, size: arrayType.size) }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     fileprivate init(values: [Operand], memType: Type, irName: String?) {
@@ -29,6 +30,13 @@ final class ArrayInst : Inst {
         return "\(name) = array [\(v.joined(separator: ", "))]\(useComment)"
     }
     
+    func copy() -> ArrayInst {
+        return ArrayInst(values: values.map { $0.formCopy() }, memType: arrayType.mem, irName: irName)
+    }
+    func setArgs(_ args: [Operand]) {
+        values = args
+    }
+    
     weak var parentBlock: BasicBlock?
     var irName: String?
 }
@@ -19,7 +19,8 @@ protocol BreakInstruction : Inst {
 final class BreakInst : BreakInstruction, Inst {
     var call: BlockCall
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     var type: Type? { return nil }
@@ -61,7 +62,8 @@ final class CondBreakInst : Inst, BreakInstruction {
     var thenCall: BlockCall, elseCall: BlockCall
     var condition: Operand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     var type: Type? { return nil }
@@ -112,7 +114,8 @@ final class CheckedCastBreakInst : Inst, BreakInstruction {
     
     var successVariable: Param
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     var type: Type? { return nil }
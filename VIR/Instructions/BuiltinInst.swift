@@ -18,7 +18,8 @@ final class BuiltinInstCall : Inst {
     var instName: String { return inst.rawValue }
     var returnType: Type
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     weak var parentBlock: BasicBlock?
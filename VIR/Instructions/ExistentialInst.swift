@@ -17,7 +17,8 @@ final class ExistentialProjectPropertyInst : Inst, LValue {
     var memType: Type? { return propertyType.isClassType() ? propertyType.ptrType() : propertyType }
     var type: Type? { return propertyType.isClassType() ? propertyType.ptrType().ptrType() : propertyType.ptrType() }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(existential: LValue, propertyName: String, irName: String? = nil) throws {
@@ -65,7 +66,8 @@ final class ExistentialConstructInst : Inst, LValue {
     var memType: Type? { return existentialType.importedType(in: module) }
     var type: Type? { return memType?.ptrType() }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(value: Value, existentialType: ConceptType, module: Module, irName: String? = nil) throws {
@@ -114,7 +116,8 @@ final class ExistentialWitnessInst : Inst, LValue {
     var type: Type? { return memType.map { BuiltinType.pointer(to: $0) } }
     var memType: Type? { return methodType }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(existential: LValue,
@@ -168,7 +171,8 @@ final class ExistentialProjectInst : Inst, LValue {
     var type: Type? { return BuiltinType.opaquePointer }
     var memType: Type? { return BuiltinType.int(size: 8) }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand] = []
     
     convenience init(existential: LValue, irName: String? = nil) {
@@ -202,7 +206,8 @@ final class ExistentialExportBufferInst : Inst {
     
     var type: Type? { return nil }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(existential: LValue, irName: String? = nil) throws {
@@ -29,7 +29,8 @@ final class FunctionCallInst : Inst, VIRFunctionCall {
     
     var functionArgs: [Operand] { return args }
 
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     fileprivate init(function: Function, returnType: Type, args: [Operand], irName: String?) {
@@ -40,6 +41,11 @@ final class FunctionCallInst : Inst, VIRFunctionCall {
         self.irName = irName
     }
     
+    /// A call to `function` which is not yet in a block
+    convenience init(function: Function, args: [Operand], irName: String? = nil) {
+        self.init(function: function, returnType: function.type.returns, args: args, irName: irName)
+    }
+    
     var vir: String {
         return "\(name) = call @\(function.name) \(args.virValueTuple())\(useComment)"
     }
@@ -69,7 +75,8 @@ final class FunctionApplyInst : Inst, VIRFunctionCall {
     
     var type: Type? { return returnType }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     /// This VIR instruction's args -- includes the function reference
     var args: [Operand]
     
@@ -111,7 +118,8 @@ final class FunctionRefInst : Inst, LValue {
     var type: Type? { return function.type /*.map { BuiltinType.pointer(to: $0) }*/ }
     var memType: Type? { return function.type }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(function: Function, irName: String? = nil) {
@@ -19,7 +19,7 @@ final class GlobalValue : LValue {
     unowned var module: Module
     
     weak var parentBlock: BasicBlock? = nil
-    var uses: [Operand] = []
+    let useList = UseList(shared: true)
     
     var lifetime: Lifetime? {
         willSet {
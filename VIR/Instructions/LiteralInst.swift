@@ -19,7 +19,8 @@ final class IntLiteralInst : Inst {
     var type: Type? { return BuiltinType.int(size: size) }
     
     var args: [Operand] = []
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     
     init(val: Int, size: Int, irName: String? = nil) {
         self.value = val
@@ -49,7 +50,8 @@ final class BoolLiteralInst : Inst {
     var type: Type? { return BuiltinType.bool }
     
     var args: [Operand] = []
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
 
     init(val: Bool, irName: String? = nil) {
         self.value = val
@@ -80,7 +82,8 @@ final class StringLiteralInst : Inst {
     var type: Type? { return BuiltinType.opaquePointer }
     
     var args: [Operand] = []
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     
     init(val: String, irName: String? = nil) {
         self.value = val
@@ -14,7 +14,8 @@
 final class AllocInst : Inst, LValue {
     var storedType: Type
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand] = []
     
     /// - precondition: newType has types in this module
@@ -47,7 +48,8 @@ final class AllocInst : Inst, LValue {
 final class StoreInst : Inst {
     private(set) var address: PtrOperand, value: Operand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(address: LValue, value: Value) {
@@ -94,7 +96,8 @@ final class LoadInst : Inst {
     var type: Type? { return address.memType }
     private(set) var address: PtrOperand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(address: LValue, irName: String? = nil) {
@@ -137,7 +140,8 @@ final class BitcastInst : Inst, LValue {
     /// The new memory type of the cast
     private(set) var newType: ModuleType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     /// - note: the ptr will have type newType*
@@ -176,7 +180,8 @@ final class DestroyAddrInst : Inst {
     
     var type: Type? { return nil }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(addr: LValue, irName: String? = nil) throws {
@@ -213,7 +218,8 @@ final class DestroyValInst : Inst {
     
     var type: Type? { return nil }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(val: Value, irName: String? = nil) throws {
@@ -250,7 +256,8 @@ final class CopyAddrInst : Inst {
     
     var type: Type? { return nil }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(addr: LValue, out: LValue, irName: String? = nil) throws {
@@ -286,7 +293,8 @@ final class DeallocStackInst : Inst {
     
     var type: Type? { return nil }
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(address: LValue, irName: String? = nil) {
@@ -17,7 +17,8 @@
 final class AllocObjectInst : Inst, LValue {
     var storedType: StructType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand] = []
     
     init(memType: StructType, irName: String? = nil) {
@@ -50,7 +51,8 @@ final class AllocObjectInst : Inst, LValue {
 final class RetainInst : Inst {
     var object: PtrOperand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(object: LValue, irName: String? = nil) {
@@ -95,7 +97,8 @@ final class RetainInst : Inst {
 final class ReleaseInst : Inst {
     var object: PtrOperand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(object: LValue, irName: String? = nil) {
@@ -139,7 +142,8 @@ final class ReleaseInst : Inst {
 final class DeallocObjectInst : Inst {
     var object: PtrOperand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
 
     convenience init(object: LValue, irName: String? = nil) {
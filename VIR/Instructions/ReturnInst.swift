@@ -15,7 +15,8 @@
 final class ReturnInst : Inst {
     var returnValue: Operand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(value: Value, parentBlock: BasicBlock?) {
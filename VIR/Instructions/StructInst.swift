@@ -16,7 +16,8 @@ final class StructInitInst : Inst {
     var type: Type? { return module.getOrInsert(type: structType) }
     var structType: StructType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(type: StructType, values: Value..., irName: String? = nil) {
@@ -55,7 +56,8 @@ final class StructExtractInst : Inst {
     var object: Operand, propertyName: String
     var propertyType: Type, structType: StructType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     /// - Precondition: `structType` is a `StructType` or `ModuleType` storing a `StructType`
@@ -104,7 +106,8 @@ final class StructElementPtrInst : Inst, LValue {
     var object: PtrOperand, propertyName: String
     var propertyType: Type, structType: StructType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(object: LValue, property: String, irName: String? = nil) throws {
@@ -148,7 +151,8 @@ final class ClassProjectInstanceInst : Inst, LValue {
     var object: PtrOperand
     var classType: ClassType
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(object: LValue, irName: String? = nil) throws {
@@ -187,7 +191,8 @@ final class ClassProjectInstanceInst : Inst, LValue {
 final class ClassGetRefCountInst : Inst {
     var object: PtrOperand
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(object: LValue, irName: String? = nil) throws {
@@ -10,7 +10,8 @@
 final class TupleCreateInst : Inst {
     var tupleType: TupleType, elements: [Operand]
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
 
     /// - precondition: `type` has been included in the module using
@@ -49,7 +50,8 @@ final class TupleExtractInst : Inst {
     var tuple: Operand, elementIndex: Int
     var elementType: Type
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     /// - precondition: Tuple has an element at `index`
@@ -91,7 +93,8 @@ final class TupleElementPtrInst : Inst, LValue {
     var tuple: PtrOperand, elementIndex: Int
     var elementType: Type
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     convenience init(tuple: LValue, index: Int, irName: String? = nil) throws {
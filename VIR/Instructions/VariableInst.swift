@@ -9,7 +9,8 @@
 final class VariableInst : Inst {
     var value: Operand
 
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     var type: Type? { return value.type }
@@ -53,7 +54,8 @@ final class VariableAddrInst : Inst, LValue {
     var addr: PtrOperand
     let mutable: Bool
     
-    var uses: [Operand] = []
+    let useList = UseList()
+    var listNode = InstListNode()
     var args: [Operand]
     
     var type: Type? { return addr.type }
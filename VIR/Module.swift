@@ -6,6 +6,7 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
+import Dispatch
 
 /**
  The module -- the single container of state in a compilation.
@@ -25,6 +26,19 @@ final class Module : VIRElement {
     var builder: VIRBuilder!
     var loweredModule: LLVMModule! = nil
     var loweredBuilder: LLVMBuilder! = nil
+    var loweringOptions: VIRLowerOptions = []
+    /// Execution counts from a previous run, set with `-profile-use`
+    var profile: ProfileData? = nil
+    /// The number of functions `GenericSpecialisationPass` may clone, set
+    /// with `-specialise-budget`
+    var specialisationBudget = 32
+    /// The stdlib's binary VIR interface, the inliner reads the bodies of
+    /// its `@inline` functions from it
+    var stdlibInterface: VIRReader? = nil
+    
+    /// Serialises `typeList` lookups and insertions made while function
+    /// passes run concurrently
+    private let typeListQueue = DispatchQueue(label: "com.vist.type-list")
     
     init() { self.builder = VIRBuilder(module: self) }
     
@@ -36,31 +50,44 @@ final class Module : VIRElement {
         functions.insert(f)
     }
     
+    /// Remove a function from the module
+    /// - precondition: the function has no body or users
+    func remove(function f: Function) {
+        functions.remove(f)
+    }
+    
     /// Insert a type to the module
     func insert(targetType: NominalType, name: String) {
         typeList[name] = ModuleType(name: name, targetType: targetType)
     }
     
-    /// Insert a defined typealias to the module
-    private func insert(alias: ModuleType) {
-        typeList[alias.name] = alias
+    /// Insert a defined typealias to the module, unless another thread
+    /// already inserted one of the same name
+    /// - returns: the module's definition of the alias
+    private func insert(alias: ModuleType) -> ModuleType {
+        return typeListQueue.sync {
+            if let existing = typeList[alias.name] { return existing }
+            typeList[alias.name] = alias
+            return alias
+        }
     }
     
     /// Returns the module's definition of `type`
     @discardableResult
     func getOrInsert(type: Type) -> ModuleType {
         // if it exists, return it
-        if case let t as NominalType = type, let found = typeList[t.name] {
+        if case let t as NominalType = type, let found = self.type(named: t.name) {
             return found
         }
         
+        // importing the type can recursively import its members, so
+        // it is done outside of the queue
         let t = type.importedType(in: module) as! ModuleType
-        insert(alias: t)
-        return t
+        return insert(alias: t)
     }
     
     func type(named name: String) -> ModuleType? {
-        return typeList[name]
+        return typeListQueue.sync { typeList[name] }
     }
     
     func global(named name: String) -> GlobalValue? {
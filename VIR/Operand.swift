@@ -6,6 +6,8 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
+import Dispatch
+
 /**
  An argument type. `Inst`s take `Operand`.
  
@@ -28,6 +30,11 @@ class Operand : VIRTyped {
     /// The value using this operand
     final weak var user: Inst?
     
+    /// The neighbouring uses of `value`, and the list containing them
+    fileprivate final var nextUse: Operand? = nil
+    fileprivate final weak var previousUse: Operand? = nil
+    fileprivate final weak var list: UseList? = nil
+    
     convenience init(_ value: Value) {
         self.init(optionalValue: value)
     }
@@ -50,7 +57,7 @@ class Operand : VIRTyped {
     init(optionalValue value: Value?) {
         self.value = value
         self.user = nil
-        value?.uses.append(self)
+        value?.useList.append(self)
 //        value?.addUse(self) // FIXME(Swift bug): This crashes in -O
     }
     
@@ -199,3 +206,79 @@ final class PhiTrackingOperand : Operand, Hashable {
     }
 }
 
+
+
+/// The uses of a value: a doubly linked list threaded through the operands,
+/// so a use is added or removed in constant time however many the value has
+///
+/// The lists of module level values are `shared`: function passes run
+/// concurrently and may add and remove uses of functions and globals at the
+/// same time, so their updates are serialised
+final class UseList {
+    private var first: Operand? = nil, last: Operand? = nil
+    private(set) var count = 0
+    private let queue: DispatchQueue?
+    
+    init(shared: Bool = false) {
+        queue = shared ? DispatchQueue(label: "com.vist.use-list") : nil
+    }
+    
+    deinit {
+        // unlink iteratively, releasing a long chain of `nextUse`
+        // references recursively could overflow the stack
+        var use = first
+        first = nil; last = nil
+        while let current = use {
+            use = current.nextUse
+            current.nextUse = nil
+        }
+    }
+    
+    private func sync<T>(_ body: () -> T) -> T {
+        guard let queue = queue else { return body() }
+        return queue.sync(execute: body)
+    }
+    
+    /// The operands, in the order they were added
+    var operands: [Operand] {
+        return sync {
+            var operands: [Operand] = []
+            operands.reserveCapacity(count)
+            var use = first
+            while let current = use {
+                operands.append(current)
+                use = current.nextUse
+            }
+            return operands
+        }
+    }
+    
+    var isEmpty: Bool {
+        return sync { first == nil }
+    }
+    
+    func append(_ use: Operand) {
+        sync {
+            // an operand uses one value at a time
+            guard use.list == nil else { return }
+            use.list = self
+            use.previousUse = last
+            last?.nextUse = use
+            last = use
+            if first == nil { first = use }
+            count += 1
+        }
+    }
+    
+    func remove(_ use: Operand) {
+        sync {
+            guard use.list === self else { return }
+            if let previous = use.previousUse { previous.nextUse = use.nextUse } else { first = use.nextUse }
+            if let next = use.nextUse { next.previousUse = use.previousUse } else { last = use.previousUse }
+            use.nextUse = nil
+            use.previousUse = nil
+            use.list = nil
+            count -= 1
+        }
+    }
+}
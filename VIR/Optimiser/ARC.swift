@@ -7,16 +7,297 @@
 //
 
 
+/// Removes redundant reference counting operations.
+///
+/// A `retain_object` followed by a `release_object` of the same object,
+/// with nothing in between which could release the object or read its
+/// count, is a no-op and both are removed. The scan sinks the retain through
+/// unconditional breaks into blocks with a single predecessor.
+///
+/// Before pairing, releases which start both arms of a `cond_break` are
+/// hoisted into the branching block, so the retain above the branch can pair
+/// with them.
+///
+/// An object allocated in, or passed into, the function which never escapes
+/// it can only be released by the function itself, so for those objects
+/// calls and other opaque instructions are not barriers.
 enum ARCSimplifyPass : OptimisationPass {
-    
+
     typealias PassTarget = Function
     static let minOptLevel: OptLevel = .low
     static let name = "arc"
-    
-    static func run(on: Function) throws {
-        
-        // create graph of uses of the ref type, look for interferences and 
-        // annotate only the needed retain/releases, then try to pair up the rest
-        
+
+    static func run(on function: Function) throws {
+        guard function.hasBody else { return }
+
+        let dominator = function.dominator.analysis
+
+        // hoist from the leaves up so releases can move up several levels
+        for block in dominator.reversed() {
+            try hoistReleases(in: block, dominator: dominator)
+        }
+
+        for block in dominator {
+            for case let retain as RetainInst in block.instructions where retain.parentBlock != nil {
+                let root = try rcRoot(of: retain.object.value!, dominator: dominator)
+                guard let release = try pairedRelease(for: retain, root: root, dominator: dominator) else {
+                    continue
+                }
+                try retain.eraseFromParent()
+                try release.eraseFromParent()
+                OptStatistics.retainReleasePairsRemoved.increment()
+            }
+        }
+    }
+
+    /// Scans forward from `retain` for a release of the same object
+    /// - returns: the release, or nil if a barrier was found first
+    private static func pairedRelease(for retain: RetainInst,
+                                      root: Value,
+                                      dominator: DominatorTree) throws -> ReleaseInst? {
+        let locallyOwned = try isLocallyOwned(root, dominator: dominator)
+        var block = retain.parentBlock!
+        var inst = retain.listNode.next
+
+        while true {
+            while let current = inst {
+                inst = current.listNode.next
+                if case let release as ReleaseInst = current,
+                    try rcRoot(of: release.object.value!, dominator: dominator) === root {
+                    return release
+                }
+                if try current.decrementsOrReadsCount(of: root, dominator: dominator) {
+                    return nil
+                }
+                if !locallyOwned, !current.isRefCountNeutral {
+                    return nil
+                }
+            }
+            // sink into the successor if we are its only way in
+            guard block.breakInst is BreakInst,
+                let next = block.successors.first,
+                next !== block,
+                next.predecessors.count == 1 else {
+                return nil
+            }
+            block = next
+            inst = block.instructions.first
+        }
+    }
+
+    /// If both successors of a `cond_break` in `block` start with a
+    /// release of the same object, release it once before the branch instead
+    private static func hoistReleases(in block: BasicBlock, dominator: DominatorTree) throws {
+        guard block.breakInst is CondBreakInst else { return }
+        let successors = block.successors
+        guard successors.count == 2,
+            successors[0] !== successors[1],
+            !successors.contains(where: { succ in succ === block || succ.predecessors.count != 1 }) else {
+            return
+        }
+
+        for case let release as ReleaseInst in leadingReleases(of: successors[0]) {
+            guard let object = release.object.value, isAvailable(object, atEndOf: block, dominator: dominator) else {
+                continue
+            }
+            let root = try rcRoot(of: object, dominator: dominator)
+            guard let other = try leadingReleases(of: successors[1]).first(where: { other in
+                try rcRoot(of: other.object.value!, dominator: dominator) === root
+            }) else {
+                continue
+            }
+
+            let hoisted = ReleaseInst(object: release.object.lValue!)
+            try block.insert(inst: hoisted, at: block.breakInst!)
+            try release.eraseFromParent()
+            try other.eraseFromParent()
+            OptStatistics.releasesHoisted.increment()
+        }
+    }
+
+    /// The releases at the top of `block` which can be moved above it; only
+    /// instructions which do not touch memory may come before them
+    private static func leadingReleases(of block: BasicBlock) -> [ReleaseInst] {
+        var releases: [ReleaseInst] = []
+        for inst in block.instructions {
+            switch inst {
+            case let release as ReleaseInst:
+                releases.append(release)
+            case is IntLiteralInst, is BoolLiteralInst,
+                 is StructInitInst, is StructExtractInst,
+                 is TupleCreateInst, is TupleExtractInst:
+                continue
+            default:
+                return releases
+            }
+        }
+        return releases
+    }
+
+    private static func isAvailable(_ value: Value, atEndOf block: BasicBlock, dominator: DominatorTree) -> Bool {
+        let defBlock: BasicBlock?
+        switch value {
+        case let lValue as OpaqueLValue: return isAvailable(lValue.value, atEndOf: block, dominator: dominator)
+        case let inst as Inst: defBlock = inst.parentBlock
+        case let param as Param: defBlock = param.parentBlock
+        default: return false
+        }
+        guard let def = defBlock else { return false }
+        return def === block || dominator.block(def, dominates: block)
+    }
+}
+
+
+// MARK: RC identity
+
+/// The value whose object `value` refers to. Looks through opaque lvalues,
+/// block params whose every incoming argument refers to the same object,
+/// and loads from stack memory which is stored to exactly once
+private func rcRoot(of value: Value, dominator: DominatorTree) throws -> Value {
+    var visited: [Value] = []
+    return try rcRoot(of: value, dominator: dominator, visited: &visited)
+}
+
+private func rcRoot(of value: Value, dominator: DominatorTree, visited: inout [Value]) throws -> Value {
+    guard !visited.contains(where: { $0 === value }) else { return value }
+    visited.append(value)
+
+    switch value {
+    case let lValue as OpaqueLValue:
+        return try rcRoot(of: lValue.value, dominator: dominator, visited: &visited)
+
+    case let load as LoadInst:
+        guard case let alloc as AllocInst = load.address.value,
+            let store = singleStore(to: alloc),
+            try dominator.inst(store, dominates: load),
+            let stored = store.value.value else {
+            return load
+        }
+        return try rcRoot(of: stored, dominator: dominator, visited: &visited)
+
+    case let param as Param:
+        guard let block = param.parentBlock,
+            block !== block.parentFunction?.entryBlock,
+            let args = try? block.args(for: param),
+            let first = args.first?.value else {
+            return param
+        }
+        let root = try rcRoot(of: first, dominator: dominator, visited: &visited)
+        for arg in args.dropFirst() {
+            guard let argValue = arg.value,
+                try rcRoot(of: argValue, dominator: dominator, visited: &visited) === root else {
+                return param
+            }
+        }
+        return root
+
+    default:
+        return value
+    }
+}
+
+/// - returns: The only store to `alloc`, if every other use of it is a load,
+///            destroy or dealloc
+private func singleStore(to alloc: AllocInst) -> StoreInst? {
+    var store: StoreInst? = nil
+    for use in alloc.uses {
+        switch use.user {
+        case let s as StoreInst where s.address === use:
+            guard store == nil else { return nil }
+            store = s
+        case let load as LoadInst where load.address === use:
+            continue
+        case is DeallocStackInst, is DestroyAddrInst:
+            continue
+        default:
+            return nil
+        }
+    }
+    return store
+}
+
+/// Whether the only references to `root` are held by this function, so
+/// nothing it calls can release it. True for objects allocated here or
+/// passed in, whose references are never stored to memory other than
+/// single-store stack slots, passed on, or returned
+private func isLocallyOwned(_ root: Value, dominator: DominatorTree) throws -> Bool {
+    switch root {
+    case is AllocObjectInst:
+        break
+    case let param as Param where param.type?.getPointeeType()?.isClassType() ?? false:
+        break
+    default:
+        return false
+    }
+
+    var worklist = [root]
+    while let value = worklist.popLast() {
+        for use in value.uses {
+            switch use.user {
+            case is RetainInst, is ReleaseInst, is DeallocObjectInst,
+                 is ClassProjectInstanceInst, is ClassGetRefCountInst:
+                continue
+            case let store as StoreInst where store.value === use:
+                guard case let alloc as AllocInst = store.address.value, singleStore(to: alloc) === store else {
+                    return false
+                }
+                for case let load as LoadInst in alloc.uses.flatMap({ $0.user }) {
+                    worklist.append(load)
+                }
+            default:
+                return false
+            }
+        }
     }
+    return true
+}
+
+
+// MARK: Barriers
+
+private extension Inst {
+
+    /// Whether this can change or read the count of any object
+    var isRefCountNeutral: Bool {
+        switch self {
+        case is RetainInst, is AllocInst, is StoreInst, is LoadInst, is BitcastInst,
+             is StructInitInst, is StructExtractInst, is StructElementPtrInst,
+             is TupleCreateInst, is TupleExtractInst, is TupleElementPtrInst,
+             is ClassProjectInstanceInst, is AllocObjectInst,
+             is IntLiteralInst, is BoolLiteralInst, is StringLiteralInst,
+             is FunctionRefInst, is VariableInst, is VariableAddrInst,
+             is ExistentialProjectInst, is ExistentialProjectPropertyInst, is ExistentialWitnessInst,
+             is BuiltinInstCall, is DeallocStackInst, is BreakInst:
+            return true
+        default:
+            return false
+        }
+    }
+
+    /// Whether this releases `root` or observes its count
+    func decrementsOrReadsCount(of root: Value, dominator: DominatorTree) throws -> Bool {
+        switch self {
+        case let release as ReleaseInst:
+            return try rcRoot(of: release.object.value!, dominator: dominator) === root
+        case let dealloc as DeallocObjectInst:
+            return try rcRoot(of: dealloc.object.value!, dominator: dominator) === root
+        case let count as ClassGetRefCountInst:
+            return try rcRoot(of: count.object.value!, dominator: dominator) === root
+        case let destroy as DestroyAddrInst:
+            // destroying a slot holding the object releases it
+            guard case let alloc as AllocInst = destroy.addr.value,
+                let store = singleStore(to: alloc), let stored = store.value.value else {
+                return destroy.addr.memType?.isClassType() ?? true
+            }
+            return try rcRoot(of: stored, dominator: dominator) === root
+        default:
+            return false
+        }
+    }
+}
+
+
+extension OptStatistics {
+    static let retainReleasePairsRemoved = Statistic(pass: ARCSimplifyPass.self, "retain/release pairs removed")
+    static let releasesHoisted = Statistic(pass: ARCSimplifyPass.self, "releases hoisted")
 }
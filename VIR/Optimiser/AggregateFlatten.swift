@@ -124,7 +124,7 @@ enum AggrFlattenPass : OptimisationPass {
                 // If all struct users have been removed and it has not, remove the init
                 if initInst.uses.isEmpty {
                     try initInst.eraseFromParent()
-                    OptStatistics.structInitsFlattened += 1
+                    OptStatistics.structInitsFlattened.increment()
                 }
                 
             case let createInst as TupleCreateInst:
@@ -148,7 +148,7 @@ enum AggrFlattenPass : OptimisationPass {
                 // If all struct users have been removed and it has not, remove the init
                 if inst.uses.isEmpty {
                     try inst.eraseFromParent()
-                    OptStatistics.tupleInitsFlattened += 1
+                    OptStatistics.tupleInitsFlattened.increment()
                 }
                 
                 // If we hit a struct or tuple which takes an struct/tuple init
@@ -298,7 +298,7 @@ enum AggrFlattenPass : OptimisationPass {
                 }
                 
                 try allocInst.eraseFromParent()
-                OptStatistics.aggrMemoryFlattened += 1
+                OptStatistics.aggrMemoryFlattened.increment()
                 
                 
             default:
@@ -374,8 +374,8 @@ extension Inst {
 }
 
 extension OptStatistics {
-    static var structInitsFlattened = 0
-    static var tupleInitsFlattened = 0
-    static var aggrMemoryFlattened = 0
+    static let structInitsFlattened = Statistic(pass: AggrFlattenPass.self, "struct inits flattened")
+    static let tupleInitsFlattened = Statistic(pass: AggrFlattenPass.self, "tuple inits flattened")
+    static let aggrMemoryFlattened = Statistic(pass: AggrFlattenPass.self, "aggregate allocations flattened")
 }
 
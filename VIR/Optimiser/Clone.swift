@@ -0,0 +1,129 @@
+//
+//  Clone.swift
+//  Vist
+//
+//  Created by Josef Willsher on 13/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// Copies the body of a function into another block list, remapping the
+/// uses of its params, instructions, and blocks to the copies
+struct FunctionCloner {
+    
+    /// Maps source values to their clones
+    private var values: [ObjectIdentifier: Value] = [:]
+    /// Maps source blocks to their clones
+    private var blocks: [ObjectIdentifier: BasicBlock] = [:]
+    
+    /// Use `clone` in place of `value` in the cloned body. The params of the
+    /// source function must be mapped before cloning
+    mutating func map(_ value: Value, to clone: Value) {
+        values[ObjectIdentifier(value)] = clone
+    }
+    
+    /// The clone of `value`, or `value` if it is defined outside the
+    /// source function
+    func mapped(_ value: Value) -> Value {
+        return values[ObjectIdentifier(value)] ?? value
+    }
+    
+    /// The clone of `block`
+    func mapped(_ block: BasicBlock) -> BasicBlock {
+        return blocks[ObjectIdentifier(block)]!
+    }
+    
+    /// Whether `function`'s body can be cloned
+    /// - note: `cast_break` binds its success variable in the successor, this
+    ///         is not cloned
+    static func canClone(_ function: Function) -> Bool {
+        guard function.hasBody else { return false }
+        return !function.instructions.contains { inst in inst is CheckedCastBreakInst }
+    }
+    
+    /// Clones the blocks of `source`. The entry block's instructions are appended
+    /// to `entry`, the other blocks are copied and passed to `insert` in order
+    /// - precondition: `FunctionCloner.canClone(source)`
+    mutating func cloneBody(of source: Function,
+                            into entry: BasicBlock,
+                            insertingBlocks insert: (BasicBlock) throws -> Void) throws {
+        guard let sourceBlocks = source.blocks, let first = sourceBlocks.first else { return }
+        
+        // make the blocks first, breaks can be to blocks later in the list
+        blocks[ObjectIdentifier(first)] = entry
+        for block in sourceBlocks.dropFirst() {
+            let clone = block.copy()
+            clone.parentFunction = entry.parentFunction
+            for (param, clonedParam) in zip(block.parameters ?? [], clone.parameters ?? []) {
+                clonedParam.parentBlock = clone
+                map(param, to: clonedParam)
+            }
+            blocks[ObjectIdentifier(block)] = clone
+            try insert(clone)
+        }
+        
+        // copy the instructions; a copy's operands still use the source values
+        // until every value has a clone
+        var cloned: [Inst] = []
+        var breaks: [(BreakInstruction, BasicBlock)] = []
+        for block in sourceBlocks {
+            let target = mapped(block)
+            for inst in block.instructions {
+                if case let breakInst as BreakInstruction = inst {
+                    breaks.append((breakInst, target))
+                    continue
+                }
+                let clone = inst.copy()
+                target.append(clone)
+                map(inst, to: clone)
+                cloned.append(clone)
+            }
+        }
+        
+        for clone in cloned {
+            clone.setInstArgs(clone.args.map { arg in
+                let operand = arg.formCopy(nullValue: true)
+                let value = arg.value.map(mapped)
+                arg.value = nil; arg.user = nil
+                operand.value = value
+                operand.user = clone
+                return operand
+            })
+        }
+        
+        for (breakInst, block) in breaks {
+            try cloneBreak(breakInst, into: block)
+        }
+    }
+    
+    private func cloneBreak(_ breakInst: BreakInstruction, into block: BasicBlock) throws {
+        
+        /// The call to the cloned successor, with cloned args
+        func cloneCall(_ call: BlockCall) -> BlockCall {
+            let args = call.args?.map { arg in
+                BlockOperand(optionalValue: arg.value.map(mapped),
+                             param: mapped(arg.param) as! Param,
+                             block: block)
+            }
+            return (block: mapped(call.block), args: args)
+        }
+        
+        switch breakInst {
+        case let br as BreakInst:
+            let call = cloneCall(br.call)
+            let clone = BreakInst(call: call)
+            block.append(clone)
+            try call.block.addApplication(from: block, args: call.args, breakInst: clone)
+            
+        case let condBreak as CondBreakInst:
+            let then = cloneCall(condBreak.thenCall), elseCall = cloneCall(condBreak.elseCall)
+            let condition = Operand(mapped(condBreak.condition.value!))
+            let clone = CondBreakInst(then: then, else: elseCall, condition: condition)
+            block.append(clone)
+            try then.block.addApplication(from: block, args: then.args, breakInst: clone)
+            try elseCall.block.addApplication(from: block, args: elseCall.args, breakInst: clone)
+            
+        default:
+            fatalError("Cannot clone \(breakInst.vir)")
+        }
+    }
+}
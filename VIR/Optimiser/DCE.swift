@@ -21,7 +21,7 @@ enum DCEPass : OptimisationPass {
         for block in function.dominator.analysis.reversed() {
             for inst in block.instructions.reversed() where inst.canBeRemoved() {
                 try inst.eraseFromParent()
-                OptStatistics.deadInstructionsRemoved += 1
+                OptStatistics.deadInstructionsRemoved.increment()
                 for use in inst.uses {
                     try use.user?.eraseFromParent()
                 }
@@ -60,7 +60,7 @@ private enum UnreachableRemovePass : OptimisationPass {
             if case let trap as BuiltinInstCall = inst, trap.inst == .trap {
                 for i in after {
                     try i.eraseFromParent()
-                    OptStatistics.unreachableInstructionsRemoved += 1
+                    OptStatistics.unreachableInstructionsRemoved.increment()
                 }
             }
             after.append(inst)
@@ -98,7 +98,7 @@ enum CFGSimplificationPass : OptimisationPass {
 }
 
 extension OptStatistics {
-    static var deadInstructionsRemoved = 0
-    static var unreachableInstructionsRemoved = 0
+    static let deadInstructionsRemoved = Statistic(pass: DCEPass.self, "dead instructions removed")
+    static let unreachableInstructionsRemoved = Statistic(pass: UnreachableRemovePass.self, "unreachable instructions removed")
 }
 
@@ -8,20 +8,37 @@
 
 /// An block x [dominates](https://en.wikipedia.org/wiki/Dominator_(graph_theory)) an
 /// object y if every path in the CFG from the entry block to y must go through x.
+///
+/// The tree is computed from the CFG when first requested, and dropped by
+/// `Function.invalidateCFGAnalyses()` whenever a block or edge is added or
+/// removed. Blocks unreachable from the entry are not in the tree.
 final class DominatorTree : FunctionAnalysis {
     
     let function: Function
     private(set) var root: Node
     
+    /// The nodes of the reachable blocks, indexed by their reverse postorder number
+    fileprivate let nodes: [Node]
+    /// The reverse postorder number of each reachable block
+    fileprivate let indices: [ObjectIdentifier: Int]
+    
     /// A node in the dom tree graph
     final class Node {
         /// The block
         let block: BasicBlock
         /// The block's immediate dominator
         let iDom: Node?
-        /// The nodes dominated by `self`
-        var children: Set<Node> = []
+        /// The nodes dominated by `self`, in reverse postorder
+        fileprivate(set) var children: [Node] = []
         let level: Int
+        /// The nodes where `self`'s dominance ends: the successors of blocks
+        /// `self` dominates which `self` doesn't strictly dominate
+        fileprivate(set) var dominanceFrontier: [Node] = []
+        
+        /// The position of the node in a preorder walk of the tree, and the
+        /// last position in its subtree; `x dom y` iff y's preorder number is
+        /// within x's range
+        fileprivate var preorder = 0, lastDescendant = 0
         
         init(block: BasicBlock, iDom: Node?) {
             self.block = block
@@ -34,35 +51,139 @@ final class DominatorTree : FunctionAnalysis {
     
     /// Constructs a dominator tree from the CFG of `function`
     ///
-    /// Uses the [Lengauer-Tarjan algorithm](https://www.cs.princeton.edu/courses/archive/fall03/cs528/handouts/a%20fast%20algorithm%20for%20finding.pdf)
-    /// as implemented [here](http://staff.cs.upt.ro/~chirila/teaching/upt/c51-pt/aamcij/7113/Fly0143.html)
+    /// Uses the [Cooper, Harvey & Kennedy algorithm](https://www.cs.rice.edu/~keith/EMBED/dom.pdf)
+    /// over the blocks' reverse postorder numbers, which converges in a couple
+    /// of passes over the CFGs VIRGen creates. The dominance frontiers are
+    /// computed from the finished tree, as described in the same paper.
     static func get(_ function: Function) -> DominatorTree {
-        let tree = DominatorTree(function: function,
-                                 root: Node(block: function.entryBlock!, iDom: nil))
         
-        /// The depth first search of the tree
-        let dfs = DepthFirstSearchTree.get(function: function)
+        let order = reversePostorder(from: function.entryBlock!)
+        var indices: [ObjectIdentifier: Int] = [:]
+        for (index, block) in order.enumerated() {
+            indices[ObjectIdentifier(block)] = index
+        }
+        let predecessors = order.map { block in
+            block.predecessors.flatMap { pred in indices[ObjectIdentifier(pred)] }
+        }
+        
+        // iDoms[b] is b's immediate dominator, or -1 if not yet found;
+        // the entry is its own
+        var iDoms = [Int](repeating: -1, count: order.count)
+        iDoms[0] = 0
+        
+        /// The nearest common dominator of `a` and `b`, walking up the
+        /// deeper of the two, which has the larger reverse postorder number
+        func intersect(_ a: Int, _ b: Int) -> Int {
+            var a = a, b = b
+            while a != b {
+                while a > b { a = iDoms[a] }
+                while b > a { b = iDoms[b] }
+            }
+            return a
+        }
+        
+        var changed = true
+        while changed {
+            changed = false
+            for block in 1..<order.count {
+                var newIDom = -1
+                for pred in predecessors[block] where iDoms[pred] != -1 {
+                    newIDom = newIDom == -1 ? pred : intersect(pred, newIDom)
+                }
+                if iDoms[block] != newIDom {
+                    iDoms[block] = newIDom
+                    changed = true
+                }
+            }
+        }
         
-        // TODO: speed this up
-        let idoms = dfs.nodes.reversed().flatMap { node in
-            dfs.immediateDominator(of: node)
+        // a block's iDom precedes it in reverse postorder, so building
+        // the nodes in order always finds the parent already made
+        var nodes: [Node] = []
+        nodes.reserveCapacity(order.count)
+        for (index, block) in order.enumerated() {
+            let iDom = index == 0 ? nil : nodes[iDoms[index]]
+            let node = Node(block: block, iDom: iDom)
+            iDom?.children.append(node)
+            nodes.append(node)
         }
         
-        for (node, idom) in zip(dfs.nodes, idoms.reversed()) {
-            tree.add(block: node, dominatedBy: idom)
+        // the frontier of every node from each predecessor of a join
+        // block up to, and not including, the join's iDom
+        for (index, preds) in predecessors.enumerated() where preds.count > 1 {
+            let node = nodes[index]
+            for pred in preds {
+                var runner = pred
+                while runner != iDoms[index] {
+                    if nodes[runner].dominanceFrontier.last !== node {
+                        nodes[runner].dominanceFrontier.append(node)
+                    }
+                    runner = iDoms[runner]
+                }
+            }
         }
+        
+        let tree = DominatorTree(function: function, root: nodes[0], nodes: nodes, indices: indices)
+        tree.numberPreorder()
         return tree
     }
     
-    private init(function: Function, root: Node) {
+    private init(function: Function, root: Node, nodes: [Node], indices: [ObjectIdentifier: Int]) {
         self.function = function
         self.root = root
+        self.nodes = nodes
+        self.indices = indices
+    }
+    
+    /// The blocks reachable from `entry` in reverse postorder. The walk keeps
+    /// its own stack so very large functions can't overflow the thread's
+    static func reversePostorder(from entry: BasicBlock) -> [BasicBlock] {
+        var postorder: [BasicBlock] = []
+        var visited: Set<ObjectIdentifier> = [ObjectIdentifier(entry)]
+        // each block and the index of the next successor to visit
+        var stack: [(block: BasicBlock, successor: Int)] = [(entry, 0)]
+        
+        while let top = stack.last {
+            let block = top.block
+            if top.successor < block.successors.count {
+                stack[stack.count-1].successor += 1
+                let succ = block.successors[top.successor]
+                if visited.insert(ObjectIdentifier(succ)).inserted {
+                    stack.append((succ, 0))
+                }
+            }
+            else {
+                postorder.append(block)
+                stack.removeLast()
+            }
+        }
+        return postorder.reversed()
+    }
+    
+    /// Numbers the nodes in a preorder walk of the tree, recording the range
+    /// each subtree covers
+    private func numberPreorder() {
+        var counter = 0
+        var stack: [(node: Node, visitedChildren: Bool)] = [(root, false)]
+        while let top = stack.popLast() {
+            let node = top.node
+            if top.visitedChildren {
+                node.lastDescendant = counter - 1
+                continue
+            }
+            node.preorder = counter
+            counter += 1
+            stack.append((node, true))
+            for child in node.children.reversed() {
+                stack.append((child, false))
+            }
+        }
     }
     
     /// - returns: a subtree of `self` descending from `node`
     /// - note: the levels are the same as the original tree
     func subtree(from node: Node) -> DominatorTree {
-        return DominatorTree(function: function, root: node)
+        return DominatorTree(function: function, root: node, nodes: nodes, indices: indices)
     }
     
     /// The ancestors of `node`, ordered walking up the tree
@@ -86,272 +207,72 @@ extension DominatorTree {
         guard let b1 = inst.parentBlock, let b2 = other.parentBlock else { return false }
         
         if b1 === b2 {
-            return try b1.index(of: inst) < b1.index(of: other)
+            return try b1.inst(inst, precedes: other)
         }
         return block(b1, dominates: b2)
     }
     
     /// - returns: true if `block` dominates `other`, so all paths to `other` go
-    ///            through `block`
+    ///            through `block`. A block dominates itself
     func block(_ block: BasicBlock, dominates other: BasicBlock) -> Bool {
         return node(getNode(for: block), dominates: getNode(for: other))
     }
     
-    
+    /// `node dom other` if `node` is `other` or one of its ancestors
     func node(_ node: Node, dominates other: Node) -> Bool {
-        
-        var currentNode = other
-        
-        while let iDom = currentNode.iDom {
-            if iDom == node {
-                return true
-            }
-            currentNode = iDom
-        }
-        
-        return false
+        return node.preorder <= other.preorder && other.preorder <= node.lastDescendant
     }
     
     /// `node sdom other` if `node dom other` and `node != other`
     func node(_ node: Node, strictlyDominates other: Node) -> Bool {
-        return node.block !== other.block && self.node(node, dominates: other)
-    }
-
-}
-
-
-extension DominatorTree.Node {
-    
-    /// - returns: the node in this tree representing `block`
-    fileprivate func getNode(for block: BasicBlock) -> DominatorTree.Node? {
-        if self.block === block { return self }
-        
-        for child in children {
-            if let found = child.getNode(for: block) { return found }
-        }
-        return nil
-    }
-}
-
-extension DominatorTree.Node : Hashable {
-    var hashValue: Int { return block.hashValue }
-    static func == (l: DominatorTree.Node, r: DominatorTree.Node) -> Bool {
-        return l.block == r.block
-    }
-}
-
-extension DominatorTree {
-    
-    /// Adds `block` to `iDom`’s children
-    func add(block: BasicBlock, dominatedBy iDom: BasicBlock) {
-        
-        let iDomNode = getNode(for: iDom)
-        if block === iDom { return } // this is implied
-        let child = Node(block: block, iDom: iDomNode)
-        
-        iDomNode.children.insert(child)
-    }
-    
-    func getNode(for block: BasicBlock) -> Node {
-        return root.getNode(for: block)!
-    }
-}
-
-
-/// A [depth first spanning tree](http://pages.cs.wisc.edu/~fischer/cs701.f07/lectures/Lecture19.4up.pdf)
-/// constructed from the CFG of `function`. 
-///
-/// A DFST is formed by walking along each of the CFG’s edges until the end is reached, then backtracking
-/// until there is another branch, walking along it, and repeating.
-///
-/// ***
-/// Suppose there is a CFG path from a to b but a is not an ancestor of b. This means that some edge on 
-/// the path is not a spanning-tree edge, so b must have been reached in the depth-first search before a
-/// was (otherwise, after visiting a the search would continue along tree edges to b). Thus, dfnum(a) > dfnum(b).
-///
-/// Therefore, if we know that there is a path from a to b, we can test whether a is an ancestor of b just
-/// by comparing the dfnum's of a and b.
-/// 
-/// [Source](http://staff.cs.upt.ro/~chirila/teaching/upt/c51-pt/aamcij/7113/Fly0143.html)
-private struct DepthFirstSearchTree {
-    
-    /// The ordered list of basic block nodes
-    var nodes: [BasicBlock] = []
-    
-    static func get(function: Function) -> DepthFirstSearchTree {
-        var dfs = DepthFirstSearchTree()
-        function.entryBlock!.doDepthFirstSearch(search: &dfs)
-        return dfs
+        return node !== other && self.node(node, dominates: other)
     }
     
+    /// - returns: whether `block` is reachable from the entry, and so in the tree
     func contains(block: BasicBlock) -> Bool {
-        return nodes.contains { $0 === block }
+        return indices[ObjectIdentifier(block)] != nil
     }
     
-    /// The `dfnum` function
-    /// - returns: `block`'s index in the DFST
-    func index(of block: BasicBlock) -> Int? {
-        return nodes.index { $0 === block }
-    }
-    
-    func node(_ l: BasicBlock, predecesses r: BasicBlock) -> Bool {
-        return index(of: l)! < index(of: r)!
+    /// - returns: the node in this tree representing `block`
+    /// - precondition: `block` is reachable from the function's entry
+    func getNode(for block: BasicBlock) -> Node {
+        return nodes[indices[ObjectIdentifier(block)]!]
     }
-}
-
-// Ancestors & semidominators
-extension DepthFirstSearchTree {
     
-    /// - returns: whether `a` has ancestor `b` in the DFST
-    private func node(_ a: BasicBlock, hasAncestor b: BasicBlock) -> Bool {
-        return node(b, predecesses: a) && b.existsPath(to: a)
+    /// The blocks where the dominance of `block` ends
+    func dominanceFrontier(of block: BasicBlock) -> [BasicBlock] {
+        return getNode(for: block).dominanceFrontier.map { node in node.block }
     }
     
-    /// Nodes which are ancestors of `block` in the DFST: they occur above `block`
-    private func ancestors(of block: BasicBlock) -> [BasicBlock] {
-        
-        var ancestors: [BasicBlock] = []
-        
-        for cand in nodes[0..<index(of: block)!] where node(block, hasAncestor: cand) {
-            ancestors.append(cand)
-        }
-        
-        return ancestors
-    }
-    
-    /// `s` is the node of smallest dfnum having apathto `n` whose nodes (not counting `s` and `n`)
-    /// are not ancestors of `n`. This description of semidominators does not explicitly say that
-    /// `s` must be an ancestor of `n`, but of course any nonancestor with a path to `n` would have
-    /// a higher dfnum than `n`'s own parent in the spanning tree, which itself has a path to `n` with
-    /// no nonancestor internal nodes (actually, no internal nodes at all).
-    ///
-    /// - parameter block: `n`: the node who's semidominator we will find
-    /// - returns: `s`: the semidominator of `block`
-    func semidominator(of block: BasicBlock) -> BasicBlock {
-        var considered: Set<BasicBlock> = []
-        return _semidominator(of: block, considered: &considered)
-    }
-
-    private func _semidominator(of block: BasicBlock, considered: inout Set<BasicBlock>) -> BasicBlock {
-        var candidates: [BasicBlock] = []
-        
-        // To find the semidominator of a node n, consider all predecessors v of n in the CFG.
-        for pred in block.predecessors {
-            
-            // If pred is a proper ancestor of block in the spanning tree (so dfnum(pred) < dfnum(block)),
-            // then pred is a candidate for semi(block).
-            if node(pred, predecesses: block) {
-                candidates.append(pred)
-            }
-                // If pred is a nonancestor of block (so dfnum(pred) > dfnum(block)),
-                // then for each u that is an ancestor of pred (or u = pred), let semi(u) be a candidate for semi(block).
-            else {
-                for u in [pred] + pred.predecessors where !node(u, predecesses: block) {
-                    // if we have already considered u, dont try again
-                    guard considered.insert(u).inserted else { continue }
-                    candidates.append(_semidominator(of: u, considered: &considered))
-                }
+    /// The iterated dominance frontier of `nodes`: the closure of their
+    /// frontiers, where a value defined in each of `nodes` needs a φ
+    func iteratedDominanceFrontier(of nodes: Set<Node>) -> Set<Node> {
+        var frontier: Set<Node> = []
+        var worklist = Array(nodes)
+        while let node = worklist.popLast() {
+            for df in node.dominanceFrontier where frontier.insert(df).inserted {
+                worklist.append(df)
             }
         }
-        
-        return candidates
-            .min(by: node(_:predecesses:))
-            ?? block
-
-    }
-
-    
-    /// Return the path through the DFST from `block` to `other`
-    /// - returns: the path, excluding `other` and `block`
-    func path(from block: BasicBlock, to other: BasicBlock) -> [BasicBlock]? {
-        let behind = ancestors(of: other)
-        if behind.isEmpty { return [] }
-        guard let index = behind.index(where: {$0 === block}) else { return nil }
-        
-        return Array(behind[behind.index(after: index)..<behind.endIndex])
+        return frontier
     }
 }
 
-// immediate dominators
-extension DepthFirstSearchTree {
-    
-    /// On the spanning-tree path below semi(block) and above or including block,
-    /// let y be the node with the smallest-numbered semidominator (minimum 
-    /// dfnum(semi(y))). Then:
-    /// ```
-    /// idom(block) := semidom(y) === semidom(block) ?
-    ///                     semidom(block) :
-    ///                     idom(y)
-    /// ```
-    func immediateDominator(of block: BasicBlock) -> BasicBlock? {
-        
-        guard block.isReachableFromRoot(dfst: self) else { return nil }
-        
-        let semidom = semidominator(of: block)
-        // Search the DFST path from the semidom to the node
-        let searchPath = path(from: semidom, to: block)!
-        
-        // If the path is empty, the semidominator is the immediate dominator
-        if searchPath.isEmpty { return semidom }
-        
-        // get list of `y`s along with their computed semidominators
-        let subSemidominators = searchPath.map { y in
-            (node: y, semidominator: semidominator(of: y))
-        }
-        // this is the first semidominator of y, in the form (y, semidom(y))
-        let y = subSemidominators
-            .min { node($0.semidominator, predecesses: $1.semidominator) }!
-        
-        if y.semidominator === semidom {
-            return y.semidominator
-        }
-        
-        return immediateDominator(of: y.node)
+extension DominatorTree.Node : Hashable {
+    var hashValue: Int { return block.hashValue }
+    static func == (l: DominatorTree.Node, r: DominatorTree.Node) -> Bool {
+        return l.block == r.block
     }
-    
 }
 
 extension BasicBlock {
     
-    /// Searches `self`'s successors for `other`
-    fileprivate func existsPath(to other: BasicBlock) -> Bool {
-        var searched: [BasicBlock] = []
-        return _existsPath(to: other, searched: &searched)
-    }
-    // recursive searches through successors, checking not to get
-    // stuck in a loop
-    private func _existsPath(to other: BasicBlock, searched: inout [BasicBlock]) -> Bool {
-        for succ in successors where !searched.contains(where: {$0 === succ}) {
-            searched.append(succ)
-            if succ === other || succ._existsPath(to: other, searched: &searched) {
-                return true
-            }
-        }
-        
-        return false
-    }
-    
-    /// Constructs the DFST into `search`
-    fileprivate func doDepthFirstSearch(search: inout DepthFirstSearchTree) {
-        
-        // add self
-        search.nodes.append(self)
-        
-        for succ in successors where !search.contains(block: succ) {
-            succ.doDepthFirstSearch(search: &search)
-        }
-    }
-    
     var isJoinNode: Bool {
         // join(S) = the set of all nodes n, such that there are at least two non-null
         // paths in the flow graph that start at two distinct nodes in S and converge at n
         return predecessors.count > 1
         // because I only implement 1 break per block we can simply check pred count
     }
-    
-    fileprivate func isReachableFromRoot(dfst: DepthFirstSearchTree) -> Bool {
-        return dfst.nodes.contains(self)
-    }
 }
 
 extension DominatorTree : Sequence {
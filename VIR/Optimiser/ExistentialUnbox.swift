@@ -7,19 +7,141 @@
 //
 
 /// Unbox existentials and replace their existential container projections with
-/// the concrete object, witness method lookups with a function reference, and 
+/// the concrete object, witness method lookups with a function reference, and
 /// existential open for member access with a GEP
 enum ExistentialUnboxPass : OptimisationPass {
-    
+
     typealias PassTarget = Function
     static let minOptLevel: OptLevel = .high
     static let name = "existential-unbox"
-    
+
     static func run(on function: Function) throws {
-        
-        for _ in function.instructions {
-            
+
+        for case let construct as ExistentialConstructInst in function.instructions {
+            try unbox(construct, module: function.module)
         }
-        
+
     }
+
+    /// Replaces `construct` with a stack copy of the struct it boxes if every
+    /// use of the existential is local
+    private static func unbox(_ construct: ExistentialConstructInst, module: Module) throws {
+
+        // the value is a struct, a class instance is boxed by its shared
+        // heap ptr and would need its projections through the object header
+        guard let block = construct.parentBlock,
+            let value = construct.value.value,
+            let structType = value.type, structType.isStructType(), !structType.isClassType(),
+            isLocal(construct) else {
+            return
+        }
+
+        // %1 = existential_construct %0 in #Concept
+        //  - becomes
+        // %1 = alloc #Struct
+        // store %0 in %1
+        let memory = AllocInst(memType: structType, irName: construct.irName)
+        try block.insert(inst: memory, after: construct)
+        try block.insert(inst: StoreInst(address: memory, value: value), after: memory)
+
+        let users = construct.uses.flatMap { use in use.user }
+
+        // %2 = existential_witness %1, !method
+        // %3 = existential_project %1
+        // %4 = apply %2 (%3, ...)
+        //  - becomes
+        // %4 = call @Struct.method (%1, ...)
+        for case let witness as ExistentialWitnessInst in users {
+            let method = try construct.witnessTable.getWitnessFunction(name: witness.methodName, module: module)
+            for case let apply as FunctionApplyInst in witness.uses.flatMap({ use in use.user }) {
+                let args = [PtrOperand(memory)] + apply.functionArgs.dropFirst().map { arg in arg.formCopy() }
+                let call = FunctionCallInst(function: method, args: args, irName: apply.irName)
+                try apply.parentBlock!.insert(inst: call, after: apply)
+                try apply.eraseFromParent(replacingAllUsesWith: call)
+                OptStatistics.witnessCallsDevirtualised.increment()
+            }
+            try witness.eraseFromParent()
+        }
+
+        for user in users where user.parentBlock != nil {
+            switch user {
+            case let property as ExistentialProjectPropertyInst:
+                // existential_project_member %1, !prop -> struct_element %1, !prop
+                let gep = try StructElementPtrInst(object: memory, property: property.propertyName, irName: property.irName)
+                try property.parentBlock!.insert(inst: gep, after: property)
+                try property.eraseFromParent(replacingAllUsesWith: gep)
+
+            case let destroy as DestroyAddrInst:
+                // destroying the box destroys the struct
+                try destroy.parentBlock!.insert(inst: DestroyAddrInst(addr: memory), after: destroy)
+                try destroy.eraseFromParent()
+
+            case let dealloc as DeallocStackInst:
+                try dealloc.parentBlock!.insert(inst: DeallocStackInst(address: memory), after: dealloc)
+                try dealloc.eraseFromParent()
+
+            case is ExistentialProjectInst, is ExistentialExportBufferInst:
+                // the instance is only used by the devirtualised calls, and
+                // there is no buffer to export
+                try user.eraseFromParent()
+
+            default:
+                fatalError("Unexpected existential use")
+            }
+        }
+
+        try construct.eraseFromParent()
+        OptStatistics.existentialsUnboxed.increment()
+    }
+
+    /// Whether every use of `construct` is an instruction we can rewrite in
+    /// terms of the concrete value; the existential is never copied, stored
+    /// or passed on, and the instance is only used as `self` in witness calls
+    private static func isLocal(_ construct: ExistentialConstructInst) -> Bool {
+
+        /// - returns: whether `apply` calls a witness of `construct`
+        ///            with its instance as `self`
+        func isWitnessCall(_ apply: FunctionApplyInst) -> Bool {
+            guard case let witness as ExistentialWitnessInst = apply.function.value,
+                witness.existential.value === construct,
+                let project = apply.functionArgs.first?.value as? ExistentialProjectInst,
+                project.existential.value === construct else {
+                return false
+            }
+            // the instance must not be passed as any other argument
+            return !apply.functionArgs.dropFirst().contains { arg in
+                (arg.value as? ExistentialProjectInst)?.existential.value === construct
+            }
+        }
+
+        for use in construct.uses {
+            switch use.user {
+            case is ExistentialProjectPropertyInst, is ExistentialExportBufferInst,
+                 is DestroyAddrInst, is DeallocStackInst:
+                continue
+            case let witness as ExistentialWitnessInst:
+                for witnessUse in witness.uses {
+                    guard case let apply as FunctionApplyInst = witnessUse.user,
+                        witnessUse === apply.function, isWitnessCall(apply) else {
+                        return false
+                    }
+                }
+            case let project as ExistentialProjectInst:
+                for projectUse in project.uses {
+                    guard case let apply as FunctionApplyInst = projectUse.user,
+                        projectUse === apply.functionArgs.first, isWitnessCall(apply) else {
+                        return false
+                    }
+                }
+            default:
+                return false
+            }
+        }
+        return true
+    }
+}
+
+extension OptStatistics {
+    static let existentialsUnboxed = Statistic(pass: ExistentialUnboxPass.self, "existentials unboxed")
+    static let witnessCallsDevirtualised = Statistic(pass: ExistentialUnboxPass.self, "witness calls devirtualised")
 }
@@ -68,7 +68,7 @@ enum ConstantFoldingPass : OptimisationPass {
                 let literalOverflow = BoolLiteralInst(val: overflow)
                 try block.insert(inst: literalOverflow, after: inst)
                 
-                OptStatistics.overflowingArithmeticOpsFolded += 1
+                OptStatistics.overflowingArithmeticOpsFolded.increment()
                 
                 // All uses must be tuple extracts
                 guard let uses = inst.uses.optionalMap({ $0.user as? TupleExtractInst }) else {
@@ -93,7 +93,7 @@ enum ConstantFoldingPass : OptimisationPass {
                     try valueInst.eraseFromParent(replacingAllUsesWith: literalVal)
                 }
                 
-                OptStatistics.arithmeticOpsFolded += 1
+                OptStatistics.arithmeticOpsFolded.increment()
                 
             case .condfail:
                 guard case let cond as BoolLiteralInst = inst.args[0].value else { break }
@@ -108,7 +108,7 @@ enum ConstantFoldingPass : OptimisationPass {
                 else {
                     try inst.eraseFromParent()
                 }
-                OptStatistics.overflowChecksFolded += 1
+                OptStatistics.overflowChecksFolded.increment()
                 
             case .ilte, .ilt, .igte, .igt, .ieq, .ineq:
                 guard
@@ -131,7 +131,7 @@ enum ConstantFoldingPass : OptimisationPass {
                 try block.insert(inst: resultLiteral, after: inst)
                 try inst.eraseFromParent(replacingAllUsesWith: resultLiteral)
                 
-                OptStatistics.arithmeticOpsFolded += 1
+                OptStatistics.arithmeticOpsFolded.increment()
                 
             case .ishl, .ishr, .iand, .ixor, .ior, .idiv, .irem, .iaddunchecked, .ipow:
                 guard
@@ -157,7 +157,7 @@ enum ConstantFoldingPass : OptimisationPass {
                 try block.insert(inst: resultLiteral, after: inst)
                 try inst.eraseFromParent(replacingAllUsesWith: resultLiteral)
                 
-                OptStatistics.arithmeticOpsFolded += 1
+                OptStatistics.arithmeticOpsFolded.increment()
                 
             case .trunc8, .trunc16, .trunc32:
                 guard case let val as IntLiteralInst = inst.args[0].value else { break }
@@ -173,7 +173,7 @@ enum ConstantFoldingPass : OptimisationPass {
                 try block.insert(inst: literal, after: inst)
                 try inst.eraseFromParent(replacingAllUsesWith: literal)
                 
-                OptStatistics.arithmeticOpsFolded += 1
+                OptStatistics.arithmeticOpsFolded.increment()
                 
             default:
                 break // not implemented
@@ -183,8 +183,8 @@ enum ConstantFoldingPass : OptimisationPass {
 }
 
 extension OptStatistics {
-    static var overflowingArithmeticOpsFolded = 0
-    static var arithmeticOpsFolded = 0
-    static var overflowChecksFolded = 0
+    static let overflowingArithmeticOpsFolded = Statistic(pass: ConstantFoldingPass.self, "overflowing arithmetic ops folded")
+    static let arithmeticOpsFolded = Statistic(pass: ConstantFoldingPass.self, "arithmetic ops folded")
+    static let overflowChecksFolded = Statistic(pass: ConstantFoldingPass.self, "overflow checks folded")
 }
 
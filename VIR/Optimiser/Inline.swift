@@ -6,17 +6,38 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
-/// Inline pass inlines single block functions
+/// Inline pass, inlines calls where the callee's estimated size, less bonuses
+/// for args which let the inlined body be simplified, is under a threshold.
+///
+/// Callees are visited before their callers, so a function is simplified by
+/// its own inlining before its size is measured. Single block callees are
+/// inlined in place; for multi block callees the caller's block is split
+/// after the call, the callee's blocks are cloned between the halves, and
+/// its returns break to the continuation, passing the result as a param.
 enum InlinePass : OptimisationPass {
     
     typealias PassTarget = Module
     static let minOptLevel: OptLevel = .low
     static let name = "inline"
     
+    /// Calls which cost less than this are inlined
+    static let threshold = 40
+    /// Callees hot in the profile may cost this many times more
+    static let hotThresholdMultiplier = 3
+    /// The cost of each block after the entry
+    static let blockCost = 3
+    /// Bonus for each use of a param passed a literal, these may fold away
+    static let constantArgBonus = 4
+    /// Bonus for a param passed a function, its applies become direct calls
+    static let closureArgBonus = 15
+    
     /// Inline functions in `module`
     /// - note: entrypoint for the inline pass
     static func run(on module: Module) throws {
-        try module.functions.forEach(run(on:))
+        try callGraphPostOrder(of: module).forEach(run(on:))
+        // libvist defines the stdlib functions, the bodies read to be
+        // inlined are not emitted again
+        try module.stdlibInterface?.dematerialiseAll()
     }
     
     /// Run the inline opt on `function`
@@ -41,45 +62,89 @@ enum InlinePass : OptimisationPass {
     private static func runInline(on function: Function) throws {
         for inst in function.instructions {
             
-            let function: Function
+            let calledFunction: Function
             let call: VIRFunctionCall
             
             if case let callInst as FunctionCallInst = inst {
-                function = callInst.function
+                calledFunction = callInst.function
                 call = callInst
             }
             else if case let applyInst as FunctionApplyInst = inst, let fn = applyInst.getAppliedFunction() {
-                function = fn
+                calledFunction = fn
                 call = applyInst
             }
             else {
                 continue
             }
             
-            guard function.inlineRequirement != .never else { continue }
+            // never inline recursion
+            guard calledFunction.inlineRequirement != .never, calledFunction !== function else { continue }
+            
+            // a stdlib function's body is read from its interface
+            if !calledFunction.hasBody, let interface = function.module.stdlibInterface,
+                try interface.function(named: calledFunction.name) === calledFunction,
+                calledFunction.inlineRequirement == .always {
+                do {
+                    try interface.materialise(calledFunction)
+                    // it was visited as a declaration, the calls in the body
+                    // read are inlined into it first
+                    calledFunction.hasHadInline = !calledFunction.hasBody
+                }
+                catch VIRSerialisationError.notInModule {
+                    // the body uses a type the program doesn't, so it stays a call
+                }
+            }
             
             // ...inline the called function's body first...
-            try run(on: function)
+            try run(on: calledFunction)
             // ...then inline this call.
-            var explosion = Explosion(replacing: call)
-            if try inline(call, calledFunction: function, explosion: &explosion) {
-                // If it was inlined, replace the inst with the explosion
+            guard calledFunction.isInlineable, calledFunction.shouldInline(call, into: function) else {
+                continue
+            }
+            
+            if calledFunction.blocks!.count == 1 {
+                var explosion = Explosion(replacing: call)
+                try inline(call, calledFunction: calledFunction, explosion: &explosion)
+                // replace the inst with the explosion
                 try explosion.replaceInst()
-                
-                if call is FunctionCallInst { OptStatistics.functionCallsInlined += 1 }
-                else { OptStatistics.functionApplysInlined += 1 }
             }
+            else {
+                try inlineBlocks(call, calledFunction: calledFunction)
+                OptStatistics.multiBlockCallsInlined.increment()
+            }
+            
+            if call is FunctionCallInst { OptStatistics.functionCallsInlined.increment() }
+            else { OptStatistics.functionApplysInlined.increment() }
         }
     }
     
-    /// - returns: whether the call was inlined
-    static func inline(_ call: VIRFunctionCall, calledFunction: Function, explosion: inout Explosion) throws -> Bool {
+    /// The module's functions ordered so callees come before their callers
+    private static func callGraphPostOrder(of module: Module) -> [Function] {
+        var order: [Function] = [], visited: Set<Function> = []
         
-        // Can we inline this call?
-        // FIXME: Inlining multi block functions. (May need a dom tree analysis pass to do this)
-        guard calledFunction.isInlineable, calledFunction.shouldInline(at: .high) else {
-            return false
+        func visit(_ function: Function) {
+            guard !visited.contains(function) else { return }
+            visited.insert(function)
+            for inst in function.instructions {
+                switch inst {
+                case let call as FunctionCallInst: visit(call.function)
+                case let apply as FunctionApplyInst:
+                    if let applied = apply.getAppliedFunction() { visit(applied) }
+                default: break
+                }
+            }
+            order.append(function)
+        }
+        
+        // sort so the order is the same each compile
+        for function in module.functions.sorted(by: { $0.name < $1.name }) {
+            visit(function)
         }
+        return order
+    }
+    
+    /// Inlines a single block callee into `explosion`
+    static func inline(_ call: VIRFunctionCall, calledFunction: Function, explosion: inout Explosion) throws {
         
         let block = calledFunction.blocks![0]
         var alreadyInlined: [String: Value] = [:]
@@ -96,7 +161,6 @@ enum InlinePass : OptimisationPass {
         }
         
         // Forward pass through block insts
-        // FIXME: Should be through dominator tree in a multi block
         for sourceInst in block.instructions {
             
             // Create a copy of the instruction
@@ -142,22 +206,136 @@ enum InlinePass : OptimisationPass {
             }
             
         }
+    }
+    
+    /// Inlines a multi block callee. The caller's block is split after `call`,
+    /// and the callee's returns break to the continuation
+    static func inlineBlocks(_ call: VIRFunctionCall, calledFunction: Function) throws {
+        guard let block = call.parentBlock, let caller = block.parentFunction, let params = calledFunction.params else {
+            return
+        }
+        let calleeName = calledFunction.name.demangleName()
+        let continuation = try block.split(after: call, named: "\(block.name).\(calleeName).cont")
+        
+        // the returned value is passed into the continuation
+        var result: Param? = nil
+        if !call.uses.isEmpty, let type = call.type {
+            let param: Param
+            if case let bt as BuiltinType = type, case .pointer(let pointee) = bt {
+                param = RefParam(paramName: "\(calleeName).ret", type: pointee)
+            }
+            else {
+                param = Param(paramName: "\(calleeName).ret", type: type)
+            }
+            continuation.addParam(param)
+            result = param
+        }
+        
+        // clone the body between the split halves
+        var cloner = FunctionCloner()
+        for (arg, param) in zip(call.functionArgs, params) {
+            cloner.map(param, to: arg.value!)
+        }
+        let entry = BasicBlock(name: "\(calleeName).entry", parameters: nil, parentFunction: caller)
+        var inlinedBlocks = [entry]
+        func insertBeforeContinuation(_ inlined: BasicBlock) {
+            let index = caller.blocks!.index(where: { $0 === continuation })!
+            caller.insert(block: inlined, atIndex: index)
+        }
+        insertBeforeContinuation(entry)
+        try cloner.cloneBody(of: calledFunction, into: entry) { inlined in
+            inlined.name = "\(calleeName).\(inlined.name)"
+            insertBeforeContinuation(inlined)
+            inlinedBlocks.append(inlined)
+        }
+        
+        for inlined in inlinedBlocks {
+            // "%var" --> "%demangled.var"
+            for inst in inlined.instructions {
+                if let n = inst.irName { inst.irName = "\(calleeName).\(n)" }
+                // if we inlined an apply, we can try inlining again
+                if inst is FunctionApplyInst { caller.hasHadInline = false }
+            }
+            // returns become breaks to the continuation
+            guard case let returnInst as ReturnInst = inlined.instructions.last else { continue }
+            let returned = returnInst.returnValue.value
+            try returnInst.eraseFromParent()
+            let args = result.map { param in [BlockOperand(optionalValue: returned, param: param, block: inlined)] }
+            let breakInst = BreakInst(call: (block: continuation, args: args))
+            inlined.append(breakInst)
+            try continuation.addApplication(from: inlined, args: args, breakInst: breakInst)
+        }
         
-        return true
+        // replace the call with a break into the inlined body
+        try call.eraseFromParent(replacingAllUsesWith: result)
+        let breakInst = BreakInst(call: (block: entry, args: nil))
+        block.append(breakInst)
+        try entry.addApplication(from: block, args: nil, breakInst: breakInst)
     }
 }
 
 private extension Function {
     
-    /// Can we inline this function?
+    /// Can we inline this function? Generators are lowered with their
+    /// yield target and are not inlined
     var isInlineable: Bool {
-        return blocks.map { $0.count <= 1 } ?? false
+        return type.yieldType == nil && FunctionCloner.canClone(self)
     }
     
-    // TODO: Determine whether this function is favourable to inline
-    /// Do we want to inline this function at `optLevel`
-    func shouldInline(at optLevel: OptLevel) -> Bool {
-        return true
+    /// Do we want to inline `call` to this function into `caller`
+    /// - note: With a profile, calls which are cold in it are not inlined
+    ///         so the hot paths stay small, and hot callees may be larger
+    func shouldInline(_ call: VIRFunctionCall, into caller: Function) -> Bool {
+        guard inlineRequirement != .always else { return true }
+        
+        var threshold = InlinePass.threshold
+        if let profile = module.profile {
+            let calleeHotness = profile.hotness(of: self)
+            guard calleeHotness != .cold, profile.hotness(of: caller) != .cold else { return false }
+            if calleeHotness == .hot { threshold *= InlinePass.hotThresholdMultiplier }
+        }
+        return inlineCost(of: call) < threshold
+    }
+    
+    /// The estimated size of this function's body, less the bonuses for the
+    /// args `call` passes
+    func inlineCost(of call: VIRFunctionCall) -> Int {
+        var cost = instructions.reduce(0) { cost, inst in cost + inst.inlineCost }
+        cost += ((blocks?.count ?? 1) - 1) * InlinePass.blockCost
+        
+        for (arg, param) in zip(call.functionArgs, params ?? []) {
+            switch arg.value {
+            case is IntLiteralInst, is BoolLiteralInst:
+                cost -= InlinePass.constantArgBonus * param.uses.count
+            case is FunctionRefInst, is FunctionRef:
+                cost -= InlinePass.closureArgBonus
+            default:
+                break
+            }
+        }
+        return cost
+    }
+}
+
+private extension Inst {
+    /// An estimate of how many machine instructions this lowers to
+    var inlineCost: Int {
+        switch self {
+        case is IntLiteralInst, is BoolLiteralInst, is FunctionRefInst,
+             is StructInitInst, is StructExtractInst, is TupleCreateInst, is TupleExtractInst,
+             is BitcastInst, is VariableInst, is VariableAddrInst,
+             is DeallocStackInst, is BreakInst, is ReturnInst:
+            return 0
+        case is FunctionCallInst, is FunctionApplyInst:
+            return 5
+        case is ExistentialConstructInst, is ExistentialWitnessInst, is ExistentialProjectPropertyInst,
+             is AllocObjectInst:
+            return 4
+        case is RetainInst, is ReleaseInst, is DestroyAddrInst, is CopyAddrInst:
+            return 2
+        default:
+            return 1
+        }
     }
 }
 
@@ -175,7 +353,8 @@ private extension FunctionApplyInst {
 }
 
 extension OptStatistics {
-    static var functionCallsInlined = 0
-    static var functionApplysInlined = 0
+    static let functionCallsInlined = Statistic(pass: InlinePass.self, "calls inlined")
+    static let functionApplysInlined = Statistic(pass: InlinePass.self, "applies inlined")
+    static let multiBlockCallsInlined = Statistic(pass: InlinePass.self, "multi block calls inlined")
 }
 
@@ -6,15 +6,22 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
+import Dispatch
+
 enum OptLevel : Int {
     case off, low, high
 }
 
 struct PassManager {
     let module: Module, optLevel: OptLevel, opts: CompileOptions
+    /// If set, records the time and instruction delta of every pass run
+    let timer: CompileTimer?
     
     func runPasses() throws {
         
+        // clone functions for the concrete types they are called with
+        try create(pass: GenericSpecialisationPass.self, runOn: module)
+        
         // inline functions
         try create(pass: StdLibInlinePass.self, runOn: module)
         if !opts.contains(.disableInline) {
@@ -22,26 +29,55 @@ struct PassManager {
         }
         
         // run post inline opts
-        for function in module.functions where function.hasBody {
-            try create(pass: DCEPass.self, runOn: function)
-            try create(pass: CopyElisionPass.self, runOn: function)
-            try create(pass: RegisterPromotionPass.self, runOn: function)
-            try create(pass: ExistentialUnboxPass.self, runOn: function)
-            try create(pass: AggrFlattenPass.self, runOn: function)
-            try create(pass: ConstantFoldingPass.self, runOn: function)
-            try create(pass: StrengthReductionPass.self, runOn: function)
-            try create(pass: CFGFoldPass.self, runOn: function)
-            try create(pass: DCEPass.self, runOn: function)
-            try create(pass: ARCSimplifyPass.self, runOn: function)
-            try create(pass: RegisterPromotionPass.self, runOn: function)
+        try runFunctionPasses()
+    }
+    
+    /// Runs the function level pipeline on every function with a body.
+    ///
+    /// Function passes only modify the function they are run on, so the
+    /// functions are optimised concurrently. The functions are visited in name
+    /// order and the error thrown is that of the first failing function in
+    /// that order, so the result doesn't depend on scheduling
+    private func runFunctionPasses() throws {
+        let functions = module.functions
+            .filter { function in function.hasBody }
+            .sorted { $0.name < $1.name }
+        
+        var errors = [Error?](repeating: nil, count: functions.count)
+        let errorQueue = DispatchQueue(label: "com.vist.opt-errors")
+        
+        DispatchQueue.concurrentPerform(iterations: functions.count) { index in
+            do {
+                try runFunctionPasses(on: functions[index])
+            }
+            catch {
+                errorQueue.sync { errors[index] = error }
+            }
         }
         
+        if let error = errors.lazy.flatMap({ $0 }).first {
+            throw error
+        }
+    }
+    
+    private func runFunctionPasses(on function: Function) throws {
+        try create(pass: DCEPass.self, runOn: function)
+        try create(pass: CopyElisionPass.self, runOn: function)
+        try create(pass: RegisterPromotionPass.self, runOn: function)
+        try create(pass: ExistentialUnboxPass.self, runOn: function)
+        try create(pass: AggrFlattenPass.self, runOn: function)
+        try create(pass: ConstantFoldingPass.self, runOn: function)
+        try create(pass: StrengthReductionPass.self, runOn: function)
+        try create(pass: CFGFoldPass.self, runOn: function)
+        try create(pass: DCEPass.self, runOn: function)
+        try create(pass: ARCSimplifyPass.self, runOn: function)
+        try create(pass: RegisterPromotionPass.self, runOn: function)
     }
 }
 
 protocol OptimisationPass {
     /// What the pass is run on, normally function or module
-    associatedtype PassTarget
+    associatedtype PassTarget : OptimisationTarget
     /// The minimum opt level this pass will be run
     static var minOptLevel: OptLevel { get }
     /// Runs the pass
@@ -50,17 +86,76 @@ protocol OptimisationPass {
     static var name: String { get }
 }
 
+/// A unit of VIR a pass can be run on
+protocol OptimisationTarget {
+    /// The number of instructions in the target, used to report how
+    /// much each pass changed it
+    var instructionCount: Int { get }
+}
+
 extension PassManager {
     func create<PassType : OptimisationPass>(pass: PassType.Type, runOn target: PassType.PassTarget) throws {
         guard optLevel.rawValue >= pass.minOptLevel.rawValue else { return }
-        return try PassType.run(on: target)
+        guard let timer = timer else { return try PassType.run(on: target) }
+        
+        let instructionsBefore = target.instructionCount
+        let start = DispatchTime.now()
+        try PassType.run(on: target)
+        timer.record(pass: pass.name, since: start, instructionDelta: target.instructionCount - instructionsBefore)
     }
 }
 
-/// An opt pass statistic type
+/// An opt pass statistic type, passes add their counters in extensions
+/// of this namespace
 enum OptStatistics {
-    func description() -> String {
-        return ""
+    /// The statistics which have been incremented, ordered by pass
+    static var all: [Statistic] {
+        return Statistic.registered
+            .filter { stat in stat.count != 0 }
+            .sorted { ($0.pass, $0.description) < ($1.pass, $1.description) }
+    }
+    
+    /// Zeroes every statistic, so one compile's counts aren't
+    /// added to the last's
+    static func reset() {
+        for stat in Statistic.registered { stat.reset() }
+    }
+}
+
+/// A count of how many times an optimisation was applied. Function passes
+/// run concurrently, so the counters are only touched on `Statistic.queue`
+final class Statistic {
+    /// The name of the pass counting this
+    let pass: String
+    /// What is counted, shown by `-stats`
+    let description: String
+    
+    private var value = 0
+    private static let queue = DispatchQueue(label: "com.vist.opt-statistics")
+    /// Statistics are static members so are created when first incremented,
+    /// those never touched are not listed
+    private static var statistics: [Statistic] = []
+    
+    init<PassType : OptimisationPass>(pass: PassType.Type, _ description: String) {
+        self.pass = pass.name
+        self.description = description
+        Statistic.queue.sync { Statistic.statistics.append(self) }
+    }
+    
+    func increment() {
+        Statistic.queue.sync { value += 1 }
+    }
+    
+    var count: Int {
+        return Statistic.queue.sync { value }
+    }
+    
+    fileprivate func reset() {
+        Statistic.queue.sync { value = 0 }
+    }
+    
+    fileprivate static var registered: [Statistic] {
+        return queue.sync { statistics }
     }
 }
 
@@ -73,11 +168,26 @@ extension CompileOptions {
         else if contains(.O) { return .low }
         else { return .off }
     }
+    
+    func loweringOptions() -> VIRLowerOptions {
+        var options: VIRLowerOptions = []
+        if optLevel() != .off { options.insert(.inlineWitnessLookup) }
+        if contains(.debugRuntime) { options.insert(.witnessCacheStats) }
+        return options
+    }
 }
 extension Function {
     var instructions: LazyCollection<[Inst]> { return blocks.map { $0.flatMap { $0.instructions }.lazy } ?? [Inst]().lazy }
 }
 
+extension Function : OptimisationTarget {
+    var instructionCount: Int { return blocks?.reduce(0) { $0 + $1.instructionCount } ?? 0 }
+}
+extension BasicBlock : OptimisationTarget {}
+extension Module : OptimisationTarget {
+    var instructionCount: Int { return functions.reduce(0) { $0 + $1.instructionCount } }
+}
+
 
 enum OptError : VistError {
     case invalidValue(Value)
@@ -0,0 +1,68 @@
+//
+//  Profile.swift
+//  Vist
+//
+//  Created by Josef Willsher on 10/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// Execution counts from a merged `-profile-generate` run, read
+/// when compiling with `-profile-use`
+final class ProfileData {
+    private let profile: ProfileDataRef
+    /// The count of the hottest function in the profile
+    let maxCount: UInt64
+    
+    init(path: String) throws {
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let profile = loadProfileData(path, &errorMessage) else {
+            let message = errorMessage.map { String(cString: $0) } ?? ""
+            LLVMDisposeMessage(errorMessage)
+            throw error(ProfileError.couldNotRead(path: path, message: message))
+        }
+        self.profile = profile
+        self.maxCount = profileMaxFunctionCount(profile)
+    }
+    
+    deinit {
+        disposeProfileData(profile)
+    }
+    
+    enum Hotness {
+        /// Run a large fraction as often as the hottest function
+        case hot
+        /// Not run, or almost never run, in the profile
+        case cold
+        /// Warm, or not in the profile
+        case unknown
+    }
+    
+    /// How hot `function` was in the profiled run
+    func hotness(of function: Function) -> Hotness {
+        guard profileHasFunction(profile, function.name) else { return .unknown }
+        return ProfileData.hotness(count: profileFunctionCount(profile, function.name), maxCount: maxCount)
+    }
+    
+    /// How hot a function run `count` times is, if the hottest was run `maxCount`
+    /// times; cold under 0.1% of the hottest, hot within 1%
+    /// - note: The counts are scaled up rather than `maxCount` down, so short
+    ///         runs with small counts aren't all hot
+    static func hotness(count: UInt64, maxCount: UInt64) -> Hotness {
+        guard maxCount > 0 else { return .unknown }
+        let (coldScaled, coldOverflow) = UInt64.multiplyWithOverflow(count, 1000)
+        if !coldOverflow, coldScaled < maxCount { return .cold }
+        let (hotScaled, hotOverflow) = UInt64.multiplyWithOverflow(count, 100)
+        if hotOverflow || hotScaled >= maxCount { return .hot }
+        return .unknown
+    }
+}
+
+enum ProfileError : VistError {
+    case couldNotRead(path: String, message: String)
+    
+    var description: String {
+        switch self {
+        case .couldNotRead(let path, let message): return "Could not read profile '\(path)': \(message)"
+        }
+    }
+}
@@ -95,10 +95,13 @@ enum RegisterPromotionPass : OptimisationPass {
     fileprivate struct AllocStackPromoter {
         let function: Function
         let alloc: AllocInst
+        /// Suffix for the next φ param's name, unique in the function
+        var phiIndex: Int
         
-        init(function: Function, alloc: AllocInst) {
+        init(function: Function, alloc: AllocInst, phiIndex: Int) {
             self.function = function
             self.alloc = alloc
+            self.phiIndex = phiIndex
         }
         
         var lastStoredValueInBlock: [BasicBlock: Value] = [:]
@@ -114,10 +117,15 @@ enum RegisterPromotionPass : OptimisationPass {
         
         guard function.hasBody else { return }
         
+        // φ names are numbered per function, every φ adds a param so starting
+        // at the param count can't reuse a name from an earlier run
+        var phiIndex = function.blocks!.reduce(0) { count, block in count + (block.parameters?.count ?? 0) }
+        
         for block in function.blocks! {
             for case let allocInst as AllocInst in block.instructions {
-                var promoter = AllocStackPromoter(function: function, alloc: allocInst)
+                var promoter = AllocStackPromoter(function: function, alloc: allocInst, phiIndex: phiIndex)
                 try promoter.run()
+                phiIndex = promoter.phiIndex
             }
         }
     }
@@ -172,7 +180,7 @@ extension RegisterPromotionPass.AllocStackPromoter {
                 // remove the last store
                 if let last = lastStore {
                     try last.eraseFromParent()
-                    OptStatistics.storesPromotedToPhiUse += 1
+                    OptStatistics.storesPromotedToPhiUse.increment()
                 }
                 // and update it
                 lastStore = storeInst
@@ -186,7 +194,7 @@ extension RegisterPromotionPass.AllocStackPromoter {
                 // remove the last store
                 if let last = lastStore {
                     try last.eraseFromParent()
-                    OptStatistics.storesPromotedToPhiUse += 1
+                    OptStatistics.storesPromotedToPhiUse.increment()
                 }
                 // and update it
                 lastStore = copyInst
@@ -232,7 +240,7 @@ extension RegisterPromotionPass.AllocStackPromoter {
         
         // we can erase the alloc inst
         try alloc.eraseFromParent()
-        OptStatistics.allocationsPromotedToPhi += 1
+        OptStatistics.allocationsPromotedToPhi.increment()
     }
     
     
@@ -289,7 +297,7 @@ extension RegisterPromotionPass.AllocStackPromoter {
         }
         
         try load.eraseFromParent(replacingAllUsesWith: v)
-        OptStatistics.loadsPromotedToPhiUse += 1
+        OptStatistics.loadsPromotedToPhiUse.increment()
     }
     
     /// This removes any mutation of `alloc`, or a projection thereof
@@ -328,78 +336,31 @@ extension RegisterPromotionPass.AllocStackPromoter {
             if proj.uses.isEmpty { try proj.eraseFromParent() }
         }
         
-        OptStatistics.storesPromotedToPhiUse += 1
+        OptStatistics.storesPromotedToPhiUse.increment()
     }
     
     
     /// Replaces every use of the alloc memory in the iterated join set of the tree with
     /// a phi node variable passed as a block param
     ///
-    /// Phi placement algorithm detailed in [A Linear Tifme Algorgithm for Placing φ Nodes
-    /// — Sreedhar and Gao.](http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.8.1979&rep=rep1&type=pdf)
+    /// The join set is the iterated dominance frontier of the blocks storing to the
+    /// memory, [Cytron et al.](https://www.cs.utexas.edu/~pingali/CS380C/2010/papers/ssaCytron.pdf),
+    /// using the frontiers cached in the dominator tree
     private mutating func placeφ() throws {
         
-        // - Initial priority queue is the set of sparse nodes (N_α)
-        // - This collection must remain ordered increasing dom tree levels, and
-        //   uses should work backwards through the priority queue
-        let sparseSet = sparseNodes()
-        var priorityQueue = sparseSet
-            .sorted { $0.level <= $1.level }
-        
-        // all nodes visited, used to prevent re-walking subtrees
-        var visited: Set<DominatorTree.Node> = []
-        // list of blocks that require phi placement, these are
-        // members of IDF(N_α)
-        var phiBlocks: Set<DominatorTree.Node> = []
-        let allocNode = dominatorTree.getNode(for: alloc.parentBlock!)
+        let tree = dominatorTree
+        let allocNode = tree.getNode(for: alloc.parentBlock!)
         
-        // walk from the bottom of the dom tree up; in the order
-        // of decreasing node depth
-        while let rootNode = priorityQueue.popLast() {
-            // A node 'y ∈ DF(x)' iff
-            //  - there exists a 'z ∈ SubTree(x)'
-            //  - with a 'z -> y' J-edge
-            //  - where 'z.level ≤ y.level'
-            
-            // get nodes z in subtree of x
-            for subtreeBlock in dominatorTree.subtree(from: rootNode) {
-                let z = dominatorTree.getNode(for: subtreeBlock)
-                
-                // if we have already visited this subnode, because we are traversing
-                // the tree from the bottom up, we know its IDF has been added to the
-                // set of phi nodes
-                guard visited.insert(z).inserted else { continue }
-                
-                // get all edges 'z -> y'
-                for succBlock in subtreeBlock.successors {
-                    let succ = dominatorTree.getNode(for: succBlock)
-                    
-                    guard
-                        // 'z -> y' is a J-edge if 'z !sdom y'
-                        !dominatorTree.node(z, strictlyDominates: succ),
-                        // we only want J-edges where 'y.level <= root.level'
-                        succ.level <= rootNode.level,
-                        // the alloc must dominate this phi
-                        dominatorTree.node(allocNode, dominates: succ)
-                        else { continue }
-                    
-                    // if this is the first visit, and isnt in N_α, add it to the priority queue
-                    if phiBlocks.insert(succ).inserted, !sparseSet.contains(succ) {
-                        // insert this node in the priority queue at the index of
-                        // other element of the same level
-                        let index = priorityQueue.index { $0.level >= succ.level } ?? priorityQueue.endIndex
-                        priorityQueue.insert(succ, at: index)
-                    }
-                }
-            }
+        // the alloc must strictly dominate the phi, the memory isn't live
+        // into its own block
+        let phiBlocks = tree.iteratedDominanceFrontier(of: sparseNodes()).filter { node in
+            tree.node(allocNode, strictlyDominates: node)
         }
         
         // add BB args to all phi blocks
-        try addBlockArguments(phis: phiBlocks)
+        try addBlockArguments(phis: Set(phiBlocks))
     }
     
-    private static var count = 0
-    
     private mutating func addBlockArguments(phis: Set<DominatorTree.Node>) throws {
         
         // - Add phi nodes to the dominator frontier nodes
@@ -407,13 +368,13 @@ extension RegisterPromotionPass.AllocStackPromoter {
         //   are not dominated by node, so they require a parameterised entry
         for phiNode in phis {
             // rename
-            let name = alloc.unformattedName + ".reg.\(RegisterPromotionPass.AllocStackPromoter.count)"
-            RegisterPromotionPass.AllocStackPromoter.count += 1 // FIXME: Hack
+            let name = alloc.unformattedName + ".reg.\(phiIndex)"
+            phiIndex += 1
             // construct the φ param
             let phi = Param(paramName: name, type: alloc.memType!)
             phiNode.block.addParam(phi)
             placedPhiNodes[phiNode.block] = phi
-            OptStatistics.phiNodesPlaced += 1
+            OptStatistics.phiNodesPlaced.increment()
             
             // for each predecessor of the DF node, we add that block's live out
             // value as a phi param of the block's break inst
@@ -565,8 +526,8 @@ private extension AllocInst {
 }
 
 extension OptStatistics {
-    static var phiNodesPlaced = 0
-    static var allocationsPromotedToPhi = 0
-    static var storesPromotedToPhiUse = 0
-    static var loadsPromotedToPhiUse = 0
+    static let phiNodesPlaced = Statistic(pass: RegisterPromotionPass.self, "φ nodes placed")
+    static let allocationsPromotedToPhi = Statistic(pass: RegisterPromotionPass.self, "allocations promoted to registers")
+    static let storesPromotedToPhiUse = Statistic(pass: RegisterPromotionPass.self, "stores promoted")
+    static let loadsPromotedToPhiUse = Statistic(pass: RegisterPromotionPass.self, "loads promoted")
 }
@@ -0,0 +1,149 @@
+//
+//  Specialise.swift
+//  Vist
+//
+//  Created by Josef Willsher on 13/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// Clones functions taking concept typed params for the concrete types passed
+/// at call sites, and calls the clone instead.
+///
+/// ```
+/// %1 = existential_construct %0 in #Area
+/// %2 = load %1: #*Area
+/// %3 = call @total_tArea (%2: #Area)
+/// ```
+/// becomes `%3 = call @total_tArea.Rect (%0: #Rect)`. The clone reboxes its
+/// concrete param in an existential which `ExistentialUnboxPass` removes,
+/// turning the witness lookups into direct calls the inliner can see through.
+/// A clone where the existential escapes is discarded.
+///
+/// At most `module.specialisationBudget` clones are made for a module.
+enum GenericSpecialisationPass : OptimisationPass {
+    
+    typealias PassTarget = Module
+    static let minOptLevel: OptLevel = .high
+    static let name = "specialise"
+    
+    static func run(on module: Module) throws {
+        
+        var budget = module.specialisationBudget
+        /// The clones by name, nil if the clone was discarded
+        var specialisations: [String: Function?] = [:]
+        
+        for function in Array(module.functions) where function.hasBody {
+            for case let call as FunctionCallInst in function.instructions {
+                let boxes = concreteArguments(of: call)
+                guard !boxes.isEmpty else { continue }
+                
+                let name = specialisedName(of: call.function, boxes: boxes)
+                let specialised: Function?
+                if let cached = specialisations[name] {
+                    specialised = cached
+                }
+                else {
+                    guard budget > 0 else { continue }
+                    budget -= 1
+                    specialised = try specialise(call.function, boxes: boxes, name: name)
+                    specialisations[name] = specialised
+                }
+                guard let target = specialised else { continue }
+                
+                // pass the concrete values instead of the existentials; the caller
+                // still owns and destroys its boxes
+                let args = call.args.enumerated().map { index, arg -> Operand in
+                    boxes[index].map { box in Operand(box.value.value!) } ?? arg.formCopy()
+                }
+                let newCall = FunctionCallInst(function: target, args: args, irName: call.irName)
+                try call.parentBlock!.insert(inst: newCall, after: call)
+                try call.eraseFromParent(replacingAllUsesWith: newCall)
+                OptStatistics.callsSpecialised.increment()
+            }
+        }
+    }
+    
+    /// The existentials built from a struct of known type which are passed as
+    /// concept typed args of `call`, by arg index
+    private static func concreteArguments(of call: FunctionCallInst) -> [Int: ExistentialConstructInst] {
+        let callee = call.function
+        guard callee.hasBody, case .thin = callee.type.callingConvention else { return [:] }
+        
+        var boxes: [Int: ExistentialConstructInst] = [:]
+        for (index, (arg, paramType)) in zip(call.args, callee.type.params).enumerated() where paramType.isConceptType() {
+            guard case let load as LoadInst = arg.value,
+                case let box as ExistentialConstructInst = load.address.value,
+                let concreteType = box.value.value?.type,
+                concreteType.isStructType(), !concreteType.isClassType() else {
+                continue
+            }
+            boxes[index] = box
+        }
+        return boxes
+    }
+    
+    private static func specialisedName(of function: Function, boxes: [Int: ExistentialConstructInst]) -> String {
+        let types = boxes.keys.sorted().map { index in "\(index)\(boxes[index]!.witnessTable.type.name)" }
+        return "\(function.name).\(types.joined(separator: "."))"
+    }
+    
+    /// Clones `function` taking the concrete types of `boxes`
+    /// - returns: the clone, or nil if the boxes could not be removed from it
+    private static func specialise(_ function: Function,
+                                   boxes: [Int: ExistentialConstructInst],
+                                   name: String) throws -> Function? {
+        guard FunctionCloner.canClone(function), let sourceParams = function.params else { return nil }
+        let module = function.module
+        
+        var params = function.type.params
+        for (index, box) in boxes { params[index] = box.value.value!.type! }
+        let type = FunctionType(params: params,
+                                returns: function.type.returns,
+                                callingConvention: function.type.callingConvention,
+                                yieldType: function.type.yieldType)
+        
+        let specialised = try module.builder.buildFunction(name: name,
+                                                           type: type,
+                                                           params: sourceParams.map { param in (name: param.paramName, convention: param.convention) })
+        specialised.visibility = .private
+        specialised.inlineRequirement = function.inlineRequirement
+        specialised.attributes = function.attributes
+        
+        // rebox the concrete params so the cloned body type checks
+        var cloner = FunctionCloner()
+        var reboxed: [ExistentialConstructInst] = []
+        let entry = specialised.entryBlock!
+        for (index, (param, newParam)) in zip(sourceParams, specialised.params!).enumerated() {
+            guard let box = boxes[index] else {
+                cloner.map(param, to: newParam)
+                continue
+            }
+            let rebox = try ExistentialConstructInst(value: newParam, existentialType: box.existentialType, module: module)
+            let load = LoadInst(address: rebox)
+            entry.append(rebox)
+            entry.append(load)
+            cloner.map(param, to: load)
+            reboxed.append(rebox)
+        }
+        try cloner.cloneBody(of: function, into: entry) { block in
+            specialised.append(block: block)
+        }
+        
+        try CopyElisionPass.run(on: specialised)
+        try ExistentialUnboxPass.run(on: specialised)
+        
+        // if the concrete value still needs its box, the clone gains nothing
+        guard !reboxed.contains(where: { rebox in rebox.parentBlock != nil }) else {
+            for block in specialised.blocks!.reversed() {
+                try block.eraseFromParent()
+            }
+            module.remove(function: specialised)
+            return nil
+        }
+        return specialised
+    }
+}
+
+extension OptStatistics {
+    static let callsSpecialised = Statistic(pass: GenericSpecialisationPass.self, "calls specialised")
+}
@@ -55,7 +55,7 @@ enum StdLibInlinePass : OptimisationPass {
                         let structType = try call.function.type.returns.getAsStructType()
                         explosion.insertTail(StructInitInst(type: returnType ?? structType, values: virInst, irName: call.irName))
                     }
-                    OptStatistics.stdlibCallsInlined += 1
+                    OptStatistics.stdlibCallsInlined.increment()
                 }
                 
                 /// Explode the call to an overflow checking op
@@ -73,7 +73,7 @@ enum StdLibInlinePass : OptimisationPass {
                         let val = try explosion.insert(inst: TupleExtractInst(tuple: virInst, index: 0, irName: "value"))
                         explosion.insertTail(StructInitInst(type: structType, values: val, irName: call.irName))
                     }
-                    OptStatistics.overflowCheckedStdlibCallsInlined += 1
+                    OptStatistics.overflowCheckedStdlibCallsInlined.increment()
                 }
                 
                 // Now we switch over the mangled function name, if its a stdlib
@@ -140,8 +140,8 @@ enum StdLibInlinePass : OptimisationPass {
 }
 
 extension OptStatistics {
-    static var stdlibCallsInlined = 0
-    static var overflowCheckedStdlibCallsInlined = 0
+    static let stdlibCallsInlined = Statistic(pass: StdLibInlinePass.self, "stdlib calls inlined")
+    static let overflowCheckedStdlibCallsInlined = Statistic(pass: StdLibInlinePass.self, "overflow checked stdlib calls inlined")
 }
 
 
@@ -12,7 +12,7 @@ class Param : Value {
     var paramName: String
     var type: Type?
     weak var parentBlock: BasicBlock?
-    var uses: [Operand] = []
+    let useList = UseList()
     
     let convention: Convention?
     
@@ -0,0 +1,281 @@
+//
+//  VIRFormat.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// The binary VIR container. A file is laid out as
+///
+///     header      "VIRB", the format version, and the offset of each section
+///     strings     every name in the module, referenced by index
+///     types       the type table, records refer to other types by index
+///     module      the module's type aliases, globals, and witness tables
+///     functions   each function's name, type, attributes, and body offset
+///     bodies      the functions' blocks and instruction streams
+///
+/// Integers are unsigned LEB128 unless noted. Strings and types are reached
+/// through fixed width offset tables, so a reader can decode any one of them
+/// without reading the rest.
+///
+/// Within a body, values are numbered in block order, each block's params
+/// before its instructions. Operands refer to these numbers, or name the
+/// global or function they use.
+enum VIRFormat {
+    static let magic: [UInt8] = Array("VIRB".utf8)
+    static let version = 1
+    /// The magic, version, and 5 section offsets
+    static let headerSize = 8 + 5 * 8
+
+    enum Section : Int {
+        case strings, types, module, functions, bodies
+    }
+
+    /// The first byte of a type table record
+    enum TypeTag : UInt8 {
+        case null, void, int, float, bool, array, pointer, opaquePointer
+        case function, tuple
+        // nominal records follow the tag with the type's name
+        case `struct`, concept, `class`, generic, alias
+    }
+
+    /// A function type's calling convention
+    enum ConventionTag : UInt8 {
+        case thin, initialiser, deinitialiser, runtime, method
+    }
+
+    /// How an operand refers to its value
+    enum ValueTag : UInt8 {
+        case null, local, global, function, opaque
+    }
+
+    /// The kind of an operand in an argument list
+    enum OperandTag : UInt8 {
+        case value, pointer
+    }
+
+    enum ParamTag : UInt8 {
+        case value, reference
+    }
+
+    /// The first byte of an instruction record
+    enum Opcode : UInt8 {
+        case intLiteral, boolLiteral, stringLiteral, builtin
+        case `return`, array
+        case alloc, store, load, bitcast, destroyAddr, destroyVal, copyAddr, deallocStack
+        case call, apply, functionRef
+        case existentialProjectProperty, existentialConstruct, existentialWitness
+        case existentialProject, existentialExportBuffer
+        case `break`, condBreak, castBreak
+        case structInit, structExtract, structElementPtr, classProjectInstance, classGetRefCount
+        case tupleCreate, tupleExtract, tupleElementPtr
+        case allocObject, retain, release, deallocObject
+        case variable, variableAddr
+    }
+}
+
+extension Param.Convention {
+    /// The convention's tag in serialised VIR, 0 is no convention
+    var serialisedTag: UInt8 {
+        switch self {
+        case .in: return 1
+        case .out: return 2
+        case .inout: return 3
+        }
+    }
+    init?(serialisedTag tag: UInt8) {
+        switch tag {
+        case 1: self = .in
+        case 2: self = .out
+        case 3: self = .inout
+        default: return nil
+        }
+    }
+}
+
+extension Function.Visibility {
+    var serialisedTag: UInt8 {
+        switch self {
+        case .private: return 0
+        case .internal: return 1
+        case .public: return 2
+        }
+    }
+    init?(serialisedTag tag: UInt8) {
+        switch tag {
+        case 0: self = .private
+        case 1: self = .internal
+        case 2: self = .public
+        default: return nil
+        }
+    }
+}
+
+extension Function.InlineRequirement {
+    var serialisedTag: UInt8 {
+        switch self {
+        case .default: return 0
+        case .always: return 1
+        case .never: return 2
+        }
+    }
+    init?(serialisedTag tag: UInt8) {
+        switch tag {
+        case 0: self = .default
+        case 1: self = .always
+        case 2: self = .never
+        default: return nil
+        }
+    }
+}
+
+/// Appends the binary VIR encoding of values to a byte buffer
+struct VIRByteWriter {
+    private(set) var bytes: [UInt8] = []
+
+    var count: Int { return bytes.count }
+
+    mutating func write(byte: UInt8) {
+        bytes.append(byte)
+    }
+    mutating func write(_ bool: Bool) {
+        bytes.append(bool ? 1 : 0)
+    }
+    /// Writes `value` as unsigned LEB128
+    mutating func write(_ value: Int) {
+        precondition(value >= 0, "negative varint")
+        write(leb128: UInt64(value))
+    }
+    /// Writes a signed value as a zigzag encoded varint
+    mutating func write(signed value: Int) {
+        let value = Int64(value)
+        write(leb128: UInt64(bitPattern: value << 1) ^ UInt64(bitPattern: value >> 63))
+    }
+    private mutating func write(leb128 value: UInt64) {
+        var value = value
+        repeat {
+            var byte = UInt8(value & 0x7f)
+            value >>= 7
+            if value != 0 { byte |= 0x80 }
+            bytes.append(byte)
+        } while value != 0
+    }
+    /// Writes `value` as a little endian integer of `width` bytes
+    mutating func write(fixed value: Int, width: Int) {
+        var value = UInt64(value)
+        for _ in 0..<width {
+            bytes.append(UInt8(value & 0xff))
+            value >>= 8
+        }
+    }
+    /// Overwrites the `width` bytes at `offset` with `value`
+    mutating func patch(fixed value: Int, width: Int, at offset: Int) {
+        var value = UInt64(value)
+        for i in 0..<width {
+            bytes[offset + i] = UInt8(value & 0xff)
+            value >>= 8
+        }
+    }
+    mutating func write(bytes other: [UInt8]) {
+        bytes.append(contentsOf: other)
+    }
+}
+
+/// Reads values from a binary VIR buffer, checking each read is in bounds
+struct VIRByteReader {
+    private let bytes: UnsafePointer<UInt8>, count: Int
+    var offset: Int
+
+    init(bytes: UnsafePointer<UInt8>, count: Int, offset: Int) {
+        self.bytes = bytes
+        self.count = count
+        self.offset = offset
+    }
+
+    mutating func readByte() throws -> UInt8 {
+        guard offset < count else { throw VIRSerialisationError.truncated }
+        defer { offset += 1 }
+        return bytes[offset]
+    }
+    mutating func readBool() throws -> Bool {
+        return try readByte() != 0
+    }
+    mutating func readVarint() throws -> Int {
+        let value = try readLEB128()
+        guard value <= UInt64(Int.max) else { throw VIRSerialisationError.malformed("varint out of range") }
+        return Int(value)
+    }
+    mutating func readSigned() throws -> Int {
+        let value = try readLEB128()
+        return Int(Int64(bitPattern: (value >> 1) ^ (0 &- (value & 1))))
+    }
+    private mutating func readLEB128() throws -> UInt64 {
+        var value: UInt64 = 0, shift: UInt64 = 0
+        while true {
+            let byte = try readByte()
+            guard shift < 64 else { throw VIRSerialisationError.malformed("varint too long") }
+            value |= UInt64(byte & 0x7f) << shift
+            if byte & 0x80 == 0 { return value }
+            shift += 7
+        }
+    }
+    mutating func readFixed(width: Int) throws -> Int {
+        guard offset + width <= count else { throw VIRSerialisationError.truncated }
+        var value: UInt64 = 0
+        for i in (0..<width).reversed() {
+            value = value << 8 | UInt64(bytes[offset + i])
+        }
+        offset += width
+        guard value <= UInt64(Int.max) else { throw VIRSerialisationError.malformed("offset out of range") }
+        return Int(value)
+    }
+    mutating func readUTF8(length: Int) throws -> String {
+        guard length >= 0, offset + length <= count else { throw VIRSerialisationError.truncated }
+        let buffer = UnsafeBufferPointer(start: bytes + offset, count: length)
+        offset += length
+        return String(decoding: buffer)
+    }
+    /// Reads a tag byte as `Tag`
+    mutating func read<Tag : RawRepresentable>(_: Tag.Type) throws -> Tag where Tag.RawValue == UInt8 {
+        let byte = try readByte()
+        guard let tag = Tag(rawValue: byte) else {
+            throw VIRSerialisationError.malformed("unknown \(Tag.self) \(byte)")
+        }
+        return tag
+    }
+}
+
+private extension String {
+    init(decoding buffer: UnsafeBufferPointer<UInt8>) {
+        var string = ""
+        var iterator = buffer.makeIterator()
+        var decoder = UTF8()
+        decoding: while true {
+            switch decoder.decode(&iterator) {
+            case .scalarValue(let scalar): string.unicodeScalars.append(scalar)
+            case .emptyInput: break decoding
+            case .error: string.unicodeScalars.append("\u{FFFD}")
+            }
+        }
+        self = string
+    }
+}
+
+enum VIRSerialisationError : VistError {
+    case notVIR(String), unsupportedVersion(Int), truncated
+    case malformed(String), notInModule(String)
+    case unserialisableType(Type), unserialisableValue(String)
+
+    var description: String {
+        switch self {
+        case .notVIR(let path): return "'\(path)' is not a binary VIR file"
+        case .unsupportedVersion(let version): return "Binary VIR version \(version) is not supported, expected \(VIRFormat.version)"
+        case .truncated: return "Binary VIR file is truncated"
+        case .malformed(let reason): return "Malformed binary VIR: \(reason)"
+        case .notInModule(let name): return "Type '\(name)' from the interface is not in the module"
+        case .unserialisableType(let type): return "Type '\(type.prettyName)' cannot be serialised"
+        case .unserialisableValue(let name): return "Value '\(name)' is not defined in the function using it"
+        }
+    }
+}
@@ -0,0 +1,817 @@
+//
+//  VIRReader.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+import struct Foundation.Data
+import struct Foundation.URL
+
+/// Reads binary VIR, written by `VIRWriter`, into a module
+///
+/// The file is memory mapped. Opening it declares the functions and reads
+/// the module's types, globals, and witness tables; strings and types are
+/// decoded when first used, and function bodies only when `materialise(_:)`
+/// is called
+///
+/// An interface, read into a module which uses another, declares nothing
+/// when opened. Its functions are declared as `function(named:)` or the
+/// bodies read use them, and its types must already be in the module
+final class VIRReader {
+    /// A module holds the interfaces it reads
+    unowned let module: Module
+    let isInterface: Bool
+
+    private let data: Data, path: String
+    /// The offset of each `VIRFormat.Section` in the file
+    private var sections: [Int] = []
+
+    private var strings: [String?] = [], types: [Type?] = []
+    /// The types being decoded, a nominal type reached again while it is
+    /// being decoded refers to itself
+    private var typesInProgress: Set<Int> = []
+
+    private var functions: [String: Function] = [:]
+    /// The file offsets of the records of an interface's functions not yet
+    /// declared, after their names
+    private var functionRecords: [String: Int] = [:]
+    /// The file offsets of the bodies not yet materialised
+    private var bodyOffsets: [ObjectIdentifier: Int] = [:]
+    /// The functions whose bodies were read, and the offsets they were read from
+    private var materialised: [(function: Function, offset: Int)] = []
+
+    /// The values and blocks of the body being materialised, numbered
+    /// as described by `VIRFormat`
+    private var values: [Value?] = [], blocks: [BasicBlock] = []
+
+    /// Maps the binary VIR file at `path`
+    convenience init(contentsOf path: String, into module: Module, interface: Bool = false) throws {
+        let data = try Data(contentsOf: URL(fileURLWithPath: path), options: .alwaysMapped)
+        try self.init(data: data, path: path, into: module, interface: interface)
+    }
+
+    /// - parameter module: the module to read into; functions already in it
+    ///             are not redeclared, and keep any body they have
+    /// - parameter interface: whether the file is read as the interface of
+    ///             a module `module` uses
+    init(data: Data, path: String = "<memory>", into module: Module, interface: Bool = false) throws {
+        self.data = data
+        self.path = path
+        self.module = module
+        self.isInterface = interface
+
+        try readHeader()
+        strings = [String?](repeating: nil, count: try count(of: .strings))
+        types = [Type?](repeating: nil, count: try count(of: .types))
+        if interface {
+            try indexFunctions()
+        }
+        else {
+            try declareFunctions()
+            try readModule()
+        }
+    }
+
+    /// The function `name` from the file. An interface declares it if the
+    /// module hasn't; if the module has it without a body, it takes the
+    /// interface's body and inline requirement
+    func function(named name: String) throws -> Function? {
+        if let function = functions[name] { return function }
+        guard let offset = functionRecords[name] else { return nil }
+        let function = try withReader(at: offset) { reader in try self.declareFunction(named: name, from: &reader) }
+        functionRecords[name] = nil
+        return function
+    }
+
+    /// Whether `function`'s body is still to be read
+    func isUnmaterialised(_ function: Function) -> Bool {
+        return bodyOffsets[ObjectIdentifier(function)] != nil
+    }
+
+    /// Reads the body of `function`, if it has one which hasn't been read
+    /// - note: If the body can't be read, `function` is left without one
+    func materialise(_ function: Function) throws {
+        guard let offset = bodyOffsets.removeValue(forKey: ObjectIdentifier(function)) else { return }
+
+        let insertPoint = module.builder.insertPoint
+        defer {
+            module.builder.insertPoint = insertPoint
+            values.removeAll()
+            blocks.removeAll()
+        }
+        do {
+            try withReader(at: offset) { reader in try readBody(of: function, from: &reader) }
+            materialised.append((function, offset))
+        }
+        catch {
+            try function.eraseBody()
+            throw error
+        }
+    }
+
+    /// Erases the bodies `materialise(_:)` read, leaving their functions as
+    /// declarations which can be materialised again
+    func dematerialiseAll() throws {
+        for (function, offset) in materialised {
+            try function.eraseBody()
+            bodyOffsets[ObjectIdentifier(function)] = offset
+        }
+        materialised.removeAll()
+    }
+
+    /// Reads every function body in the file
+    func materialiseAll() throws {
+        for function in module.functions.sorted(by: { $0.name < $1.name }) {
+            try materialise(function)
+        }
+    }
+}
+
+// MARK: Sections
+
+private extension VIRReader {
+
+    /// Runs `body` with a reader at `offset` in the file
+    func withReader<Result>(at offset: Int, _ body: (inout VIRByteReader) throws -> Result) throws -> Result {
+        return try data.withUnsafeBytes { (bytes: UnsafePointer<UInt8>) -> Result in
+            var reader = VIRByteReader(bytes: bytes, count: data.count, offset: offset)
+            return try body(&reader)
+        }
+    }
+
+    func readHeader() throws {
+        guard data.count >= VIRFormat.headerSize else { throw VIRSerialisationError.notVIR(path) }
+        sections = try withReader(at: 0) { reader in
+            for byte in VIRFormat.magic where try reader.readByte() != byte {
+                throw VIRSerialisationError.notVIR(self.path)
+            }
+            let version = try reader.readFixed(width: 4)
+            guard version == VIRFormat.version else { throw VIRSerialisationError.unsupportedVersion(version) }
+
+            var sections: [Int] = []
+            for _ in 0..<5 {
+                let offset = try reader.readFixed(width: 8)
+                guard offset <= self.data.count else { throw VIRSerialisationError.truncated }
+                sections.append(offset)
+            }
+            return sections
+        }
+    }
+
+    /// The number of records in an offset table section
+    func count(of section: VIRFormat.Section) throws -> Int {
+        return try withReader(at: sections[section.rawValue]) { reader in try reader.readFixed(width: 4) }
+    }
+
+    /// The file offset of record `index` in an offset table section
+    func offset(ofRecord index: Int, in section: VIRFormat.Section, count: Int) throws -> Int {
+        guard index < count else {
+            throw VIRSerialisationError.malformed("no record \(index) in the \(section) table")
+        }
+        let start = sections[section.rawValue]
+        return try start + withReader(at: start + 4 + 4 * index) { reader in try reader.readFixed(width: 4) }
+    }
+
+    /// Declares each function in the function table, and records where
+    /// its body is
+    func declareFunctions() throws {
+        for function in module.functions {
+            functions[function.name] = function
+        }
+        try withReader(at: sections[VIRFormat.Section.functions.rawValue]) { reader in
+            for _ in 0..<(try reader.readVarint()) {
+                let name = try self.readString(from: &reader)
+                _ = try self.declareFunction(named: name, from: &reader)
+            }
+        }
+    }
+
+    /// Records where each of an interface's functions is in the function
+    /// table, so it can be declared when used
+    func indexFunctions() throws {
+        try withReader(at: sections[VIRFormat.Section.functions.rawValue]) { reader in
+            for _ in 0..<(try reader.readVarint()) {
+                let name = try self.readString(from: &reader)
+                self.functionRecords[name] = reader.offset
+                // skip the type, visibility, inline requirement, attributes, and body
+                _ = try reader.readVarint()
+                _ = try reader.readByte()
+                _ = try reader.readByte()
+                _ = try reader.readVarint()
+                if try reader.readBool() {
+                    _ = try reader.readVarint()
+                }
+            }
+        }
+    }
+
+    /// Reads the function table record of `name`, after its name, and
+    /// declares it unless the module already has it
+    func declareFunction(named name: String, from reader: inout VIRByteReader) throws -> Function {
+        let typeIndex = try reader.readVarint()
+        let visibility = try reader.readByte(), inline = try reader.readByte()
+        let attributes = try reader.readVarint()
+        guard let v = Function.Visibility(serialisedTag: visibility),
+            let i = Function.InlineRequirement(serialisedTag: inline) else {
+            throw VIRSerialisationError.malformed("attributes of @\(name)")
+        }
+
+        let function: Function
+        if let existing = functions[name] ?? (isInterface ? module.function(named: name) : nil) {
+            function = existing
+            // a module declares the functions it uses without their attributes
+            if isInterface, !function.hasBody {
+                function.inlineRequirement = i
+                function.attributes = Function.Attributes(rawValue: attributes)
+            }
+        }
+        else {
+            guard case let type as FunctionType = try self.type(at: typeIndex) else {
+                throw VIRSerialisationError.malformed("type of @\(name)")
+            }
+            function = module.builder.buildCanonicalFunctionPrototype(name: name, type: type)
+            function.visibility = v
+            function.inlineRequirement = i
+            function.attributes = Function.Attributes(rawValue: attributes)
+        }
+        functions[name] = function
+
+        if try reader.readBool() {
+            let offset = try sections[VIRFormat.Section.bodies.rawValue] + reader.readVarint()
+            if !function.hasBody {
+                bodyOffsets[ObjectIdentifier(function)] = offset
+            }
+        }
+        return function
+    }
+
+    /// A function a body uses, which the file must declare
+    func usedFunction(named name: String) throws -> Function {
+        guard let function = try function(named: name) else { throw VIRSerialisationError.malformed("no function @\(name)") }
+        return function
+    }
+
+    func readModule() throws {
+        try withReader(at: sections[VIRFormat.Section.module.rawValue]) { reader in
+            for _ in 0..<(try reader.readVarint()) {
+                let name = try self.readString(from: &reader)
+                let alias = try self.read(ModuleType.self, from: &reader)
+                alias.destructor = try self.readFunction(from: &reader)
+                alias.deinitialiser = try self.readFunction(from: &reader)
+                alias.copyConstructor = try self.readFunction(from: &reader)
+                self.module.typeList[name] = alias
+            }
+
+            for _ in 0..<(try reader.readVarint()) {
+                let name = try self.readString(from: &reader)
+                let type = try self.readType(from: &reader)
+                if self.module.global(named: name) == nil {
+                    self.module.globalValues.insert(GlobalValue(name: name, type: type, module: self.module))
+                }
+            }
+
+            for _ in 0..<(try reader.readVarint()) {
+                let type = try self.read(NominalType.self, from: &reader)
+                let concept = try self.read(ConceptType.self, from: &reader)
+                _ = VIRWitnessTable.create(module: self.module, type: type, conforms: concept)
+            }
+        }
+    }
+
+    /// Reads an optional function name
+    func readFunction(from reader: inout VIRByteReader) throws -> Function? {
+        guard let name = try readOptionalString(from: &reader) else { return nil }
+        guard let function = functions[name] else { throw VIRSerialisationError.malformed("no function @\(name)") }
+        return function
+    }
+}
+
+// MARK: Strings and types
+
+private extension VIRReader {
+
+    func string(at index: Int) throws -> String {
+        if index < strings.count, let string = strings[index] { return string }
+        let offset = try self.offset(ofRecord: index, in: .strings, count: strings.count)
+        let string = try withReader(at: offset) { reader in try reader.readUTF8(length: reader.readVarint()) }
+        strings[index] = string
+        return string
+    }
+
+    func readString(from reader: inout VIRByteReader) throws -> String {
+        return try string(at: reader.readVarint())
+    }
+    /// Reads 0 as nil, otherwise a string index + 1
+    func readOptionalString(from reader: inout VIRByteReader) throws -> String? {
+        let index = try reader.readVarint()
+        return index == 0 ? nil : try string(at: index - 1)
+    }
+
+    func type(at index: Int) throws -> Type {
+        if index < types.count, let type = types[index] { return type }
+        let offset = try self.offset(ofRecord: index, in: .types, count: types.count)
+
+        return try withReader(at: offset) { reader in
+            let tag = try reader.read(VIRFormat.TypeTag.self)
+
+            if self.typesInProgress.contains(index) {
+                return try self.placeholder(tag: tag, from: &reader)
+            }
+            self.typesInProgress.insert(index)
+            defer { self.typesInProgress.remove(index) }
+
+            let type = try self.decodeRecord(tag: tag, from: &reader)
+            self.types[index] = type
+            return type
+        }
+    }
+
+    func readType(from reader: inout VIRByteReader) throws -> Type {
+        return try type(at: reader.readVarint())
+    }
+    func readTypes(from reader: inout VIRByteReader) throws -> [Type] {
+        var types: [Type] = []
+        for _ in 0..<(try reader.readVarint()) { types.append(try readType(from: &reader)) }
+        return types
+    }
+    /// Reads a type which must be a `T`
+    func read<T>(_: T.Type, from reader: inout VIRByteReader) throws -> T {
+        let type = try readType(from: &reader)
+        guard case let t as T = type else {
+            throw VIRSerialisationError.malformed("'\(type.prettyName)' is not a \(T.self)")
+        }
+        return t
+    }
+    func readAll<T>(_: T.Type, from reader: inout VIRByteReader) throws -> [T] {
+        var types: [T] = []
+        for _ in 0..<(try reader.readVarint()) { types.append(try read(T.self, from: &reader)) }
+        return types
+    }
+
+    /// A nominal type referring to itself is given a type of the same name,
+    /// the module's if it has one
+    func placeholder(tag: VIRFormat.TypeTag, from reader: inout VIRByteReader) throws -> Type {
+        switch tag {
+        case .struct:
+            return StructType.named(try readString(from: &reader))
+        case .concept:
+            return ConceptType(name: try readString(from: &reader), requiredFunctions: [], requiredProperties: [])
+        case .class:
+            return ClassType(StructType.named(try readString(from: &reader)))
+        case .generic:
+            return GenericType(name: try readString(from: &reader), concepts: [], parentName: "")
+        case .alias:
+            let name = try readString(from: &reader)
+            return module.type(named: name) ?? ModuleType(name: name, targetType: StructType.named(name))
+        default:
+            throw VIRSerialisationError.malformed("type record refers to itself")
+        }
+    }
+
+    func decodeRecord(tag: VIRFormat.TypeTag, from reader: inout VIRByteReader) throws -> Type {
+        switch tag {
+        case .null: return BuiltinType.null
+        case .void: return BuiltinType.void
+        case .bool: return BuiltinType.bool
+        case .opaquePointer: return BuiltinType.opaquePointer
+        case .int: return BuiltinType.int(size: try reader.readVarint())
+        case .float: return BuiltinType.float(size: try reader.readVarint())
+        case .array:
+            let element = try readType(from: &reader)
+            let size = try reader.readVarint()
+            return BuiltinType.array(el: element, size: size == 0 ? nil : size - 1)
+        case .pointer:
+            return BuiltinType.pointer(to: try readType(from: &reader))
+
+        case .function:
+            let params = try readTypes(from: &reader)
+            let returns = try readType(from: &reader)
+            let convention: FunctionType.CallingConvention
+            switch try reader.read(VIRFormat.ConventionTag.self) {
+            case .thin: convention = .thin
+            case .initialiser: convention = .initialiser
+            case .deinitialiser: convention = .deinitialiser
+            case .runtime: convention = .runtime
+            case .method:
+                let selfType = try readType(from: &reader)
+                convention = .method(selfType: selfType, mutating: try reader.readBool())
+            }
+            let yieldIndex = try reader.readVarint()
+            let yieldType = yieldIndex == 0 ? nil : try type(at: yieldIndex - 1)
+            var function = FunctionType(params: params, returns: returns, callingConvention: convention, yieldType: yieldType)
+            function.isCanonicalType = try reader.readBool()
+            return function
+
+        case .tuple:
+            return TupleType(members: try readTypes(from: &reader))
+
+        case .struct:
+            let name = try readString(from: &reader)
+            let isHeapAllocated = try reader.readBool()
+            let members = try readMembers(from: &reader)
+            let methods = try readMethods(from: &reader)
+            let concepts = try readAll(ConceptType.self, from: &reader)
+            let hasGenericTypes = try reader.readBool()
+            let genericTypes = try readAll(GenericType.self, from: &reader)
+            let structType = StructType(members: members, methods: methods, name: name,
+                                        concepts: concepts, isHeapAllocated: isHeapAllocated)
+            structType.genericTypes = hasGenericTypes ? genericTypes : nil
+            return structType
+
+        case .concept:
+            let name = try readString(from: &reader)
+            let concept = ConceptType(name: name,
+                                      requiredFunctions: try readMethods(from: &reader),
+                                      requiredProperties: try readMembers(from: &reader))
+            concept.concepts = try readAll(ConceptType.self, from: &reader)
+            return concept
+
+        case .class:
+            _ = try readString(from: &reader)
+            return ClassType(try read(StructType.self, from: &reader))
+
+        case .generic:
+            let name = try readString(from: &reader)
+            let concepts = try readAll(ConceptType.self, from: &reader)
+            return GenericType(name: name, concepts: concepts, parentName: try readString(from: &reader))
+
+        case .alias:
+            let name = try readString(from: &reader)
+            let target = try read(NominalType.self, from: &reader)
+            if let alias = module.type(named: name) { return alias }
+            // a module only uses the types it has imported from an interface
+            guard !isInterface else { throw VIRSerialisationError.notInModule(name) }
+            return ModuleType(name: name, targetType: target)
+        }
+    }
+
+    func readMembers(from reader: inout VIRByteReader) throws -> [StructMember] {
+        var members: [StructMember] = []
+        for _ in 0..<(try reader.readVarint()) {
+            let name = try readString(from: &reader), type = try readType(from: &reader)
+            members.append((name: name, type: type, isMutable: try reader.readBool()))
+        }
+        return members
+    }
+    func readMethods(from reader: inout VIRByteReader) throws -> [StructMethod] {
+        var methods: [StructMethod] = []
+        for _ in 0..<(try reader.readVarint()) {
+            let name = try readString(from: &reader), type = try read(FunctionType.self, from: &reader)
+            methods.append((name: name, type: type, mutating: try reader.readBool()))
+        }
+        return methods
+    }
+}
+
+// MARK: Bodies
+
+private extension VIRReader {
+
+    func readBody(of function: Function, from reader: inout VIRByteReader) throws {
+        let functionParamCount = try reader.readVarint()
+        let blockCount = try reader.readVarint()
+
+        // the number of each block's first value, its param count, and its instructions
+        var firstIDs: [Int] = [], paramCounts: [Int] = []
+        var instCounts: [Int] = [], instOffsets: [Int] = []
+
+        for index in 0..<blockCount {
+            let name = try readString(from: &reader)
+            let paramListCount = try reader.readVarint()
+            var params: [Param] = []
+            for _ in 0..<max(paramListCount - 1, 0) {
+                params.append(try readParam(from: &reader))
+            }
+
+            let block: BasicBlock
+            if index == 0 {
+                guard functionParamCount <= params.count else {
+                    throw VIRSerialisationError.malformed("@\(function.name) has more params than its entry block")
+                }
+                try function.defineBody(withParams: Array(params.prefix(functionParamCount)))
+                block = function.entryBlock!
+                block.name = name
+                for param in params.dropFirst(functionParamCount) {
+                    try function.addParam(param)
+                    param.parentBlock = block
+                }
+            }
+            else {
+                block = BasicBlock(name: name, parameters: paramListCount == 0 ? nil : params, parentFunction: function)
+                function.append(block: block)
+                for param in params { param.parentBlock = block }
+            }
+            blocks.append(block)
+
+            let instCount = try reader.readVarint()
+            firstIDs.append(values.count)
+            paramCounts.append(params.count)
+            instCounts.append(instCount)
+            instOffsets.append(try reader.readVarint())
+            values.append(contentsOf: params.map { param in param as Value? })
+            values.append(contentsOf: [Value?](repeating: nil, count: instCount))
+        }
+
+        var order: [Int] = []
+        for _ in 0..<(try reader.readVarint()) {
+            let index = try reader.readVarint()
+            guard index < blockCount else { throw VIRSerialisationError.malformed("no block \(index)") }
+            order.append(index)
+        }
+
+        var lifetimes: [(globalName: String, start: Int, end: Int)] = []
+        for _ in 0..<(try reader.readVarint()) {
+            let name = try readString(from: &reader)
+            // lifetimes are written as value references to insts in the body
+            guard try reader.read(VIRFormat.ValueTag.self) == .local else { throw VIRSerialisationError.malformed("lifetime of \(name)") }
+            let start = try reader.readVarint()
+            guard try reader.read(VIRFormat.ValueTag.self) == .local else { throw VIRSerialisationError.malformed("lifetime of \(name)") }
+            lifetimes.append((name, start, try reader.readVarint()))
+        }
+
+        let instArea = reader.offset
+        // breaks are built last, in block order, once every block's
+        // instructions are in place
+        var breaks: [(block: Int, offset: Int)] = []
+
+        for index in order {
+            let block = blocks[index]
+            module.builder.insertPoint.block = block
+            reader.offset = instArea + instOffsets[index]
+
+            for position in 0..<instCounts[index] {
+                let recordOffset = reader.offset
+                let opcode = try reader.read(VIRFormat.Opcode.self)
+                let irName = try readOptionalString(from: &reader)
+
+                switch opcode {
+                case .break, .condBreak, .castBreak:
+                    guard position == instCounts[index] - 1 else {
+                        throw VIRSerialisationError.malformed("$\(block.name) breaks before its last instruction")
+                    }
+                    breaks.append((index, recordOffset))
+                default:
+                    let inst = try readInst(opcode, from: &reader)
+                    if let irName = irName { inst.irName = irName }
+                    values[firstIDs[index] + paramCounts[index] + position] = inst
+                }
+            }
+        }
+
+        for (index, recordOffset) in breaks.sorted(by: { $0.block < $1.block }) {
+            module.builder.insertPoint.block = blocks[index]
+            reader.offset = recordOffset
+            let opcode = try reader.read(VIRFormat.Opcode.self)
+            let irName = try readOptionalString(from: &reader)
+            let inst = try readBreak(opcode, from: &reader)
+            if let irName = irName { inst.irName = irName }
+            values[firstIDs[index] + paramCounts[index] + instCounts[index] - 1] = inst
+        }
+
+        for lifetime in lifetimes {
+            guard let global = module.global(named: lifetime.globalName),
+                case let start as Inst = try value(lifetime.start),
+                case let end as Inst = try value(lifetime.end) else {
+                throw VIRSerialisationError.malformed("lifetime of \(lifetime.globalName)")
+            }
+            global.lifetime = GlobalValue.Lifetime(start: start, end: end, globalName: lifetime.globalName, owningFunction: function)
+        }
+    }
+
+    func readParam(from reader: inout VIRByteReader) throws -> Param {
+        let tag = try reader.read(VIRFormat.ParamTag.self)
+        let name = try readString(from: &reader)
+        let type = try readType(from: &reader)
+        let conventionTag = try reader.readByte()
+        let convention = Param.Convention(serialisedTag: conventionTag)
+        guard conventionTag == 0 || convention != nil else {
+            throw VIRSerialisationError.malformed("convention of %\(name)")
+        }
+        switch tag {
+        case .value: return Param(paramName: name, type: type, convention: convention)
+        case .reference: return RefParam(paramName: name, type: type, convention: convention)
+        }
+    }
+
+    /// The value numbered `id`
+    func value(_ id: Int) throws -> Value {
+        guard id < values.count, let value = values[id] else {
+            throw VIRSerialisationError.malformed("value \(id) is used before it is defined")
+        }
+        return value
+    }
+
+    func readOptionalValue(from reader: inout VIRByteReader) throws -> Value? {
+        switch try reader.read(VIRFormat.ValueTag.self) {
+        case .null:
+            return nil
+        case .local:
+            return try value(reader.readVarint())
+        case .global:
+            let name = try readString(from: &reader)
+            guard let global = module.global(named: name) else { throw VIRSerialisationError.malformed("no global \(name)") }
+            return global
+        case .function:
+            return try usedFunction(named: readString(from: &reader)).buildFunctionPointer().value
+        case .opaque:
+            return try OpaqueLValue(rvalue: readValue(from: &reader))
+        }
+    }
+    func readValue(from reader: inout VIRByteReader) throws -> Value {
+        guard let value = try readOptionalValue(from: &reader) else {
+            throw VIRSerialisationError.malformed("expected a value")
+        }
+        return value
+    }
+    /// Reads a value used as an address
+    func readLValue(from reader: inout VIRByteReader) throws -> LValue {
+        let value = try readValue(from: &reader)
+        if case let lValue as LValue = value { return lValue }
+        return try OpaqueLValue(rvalue: value)
+    }
+
+    func readOperands(from reader: inout VIRByteReader) throws -> [Operand] {
+        var operands: [Operand] = []
+        for _ in 0..<(try reader.readVarint()) {
+            switch try reader.read(VIRFormat.OperandTag.self) {
+            case .value: operands.append(Operand(optionalValue: try readOptionalValue(from: &reader)))
+            case .pointer: operands.append(PtrOperand(try readLValue(from: &reader)))
+            }
+        }
+        return operands
+    }
+    func readValues(from reader: inout VIRByteReader) throws -> [Value] {
+        var values: [Value] = []
+        for _ in 0..<(try reader.readVarint()) { values.append(try readValue(from: &reader)) }
+        return values
+    }
+
+    func readInst(_ opcode: VIRFormat.Opcode, from r: inout VIRByteReader) throws -> Inst {
+        let builder = module.builder!
+        switch opcode {
+        case .intLiteral:
+            let value = try r.readSigned()
+            return try builder.build(IntLiteralInst(val: value, size: r.readVarint()))
+        case .boolLiteral:
+            return try builder.build(BoolLiteralInst(val: r.readBool()))
+        case .stringLiteral:
+            return try builder.build(StringLiteralInst(val: readString(from: &r)))
+        case .builtin:
+            let name = try readString(from: &r)
+            guard let builtin = BuiltinInst(rawValue: name) else { throw VIRSerialisationError.malformed("no builtin \(name)") }
+            return try builder.build(BuiltinInstCall(inst: builtin, operands: readOperands(from: &r)))
+        case .return:
+            return try builder.buildReturn(value: readValue(from: &r))
+        case .array:
+            let memType = try readType(from: &r)
+            return try builder.buildArray(values: readOperands(from: &r), memType: memType)
+
+        case .alloc:
+            return try builder.build(AllocInst(memType: readType(from: &r)))
+        case .store:
+            let address = try readLValue(from: &r)
+            return try builder.build(StoreInst(address: address, value: readValue(from: &r)))
+        case .load:
+            return try builder.build(LoadInst(address: readLValue(from: &r)))
+        case .bitcast:
+            let address = try readLValue(from: &r)
+            return try builder.build(BitcastInst(address: address, newType: read(ModuleType.self, from: &r)))
+        case .destroyAddr:
+            return try builder.build(DestroyAddrInst(addr: readLValue(from: &r)))
+        case .destroyVal:
+            return try builder.build(DestroyValInst(val: readValue(from: &r)))
+        case .copyAddr:
+            let addr = try readLValue(from: &r)
+            return try builder.build(CopyAddrInst(addr: addr, out: readLValue(from: &r)))
+        case .deallocStack:
+            return try builder.build(DeallocStackInst(address: readLValue(from: &r)))
+
+        case .call:
+            let function = try usedFunction(named: readString(from: &r))
+            let returnType = try readType(from: &r)
+            let call = try builder.build(FunctionCallInst(function: function, args: readOperands(from: &r)))
+            call.returnType = returnType
+            return call
+        case .apply:
+            let function = try readLValue(from: &r)
+            let returnType = try readType(from: &r)
+            return try builder.buildFunctionApply(function: PtrOperand(function), returnType: returnType, args: readOperands(from: &r))
+        case .functionRef:
+            return try builder.build(FunctionRefInst(function: usedFunction(named: readString(from: &r))))
+
+        case .existentialProjectProperty:
+            let existential = try readLValue(from: &r)
+            return try builder.build(ExistentialProjectPropertyInst(existential: existential, propertyName: readString(from: &r)))
+        case .existentialConstruct:
+            let value = try readValue(from: &r)
+            let concept = try read(ConceptType.self, from: &r)
+            let construct = try builder.build(ExistentialConstructInst(value: value, existentialType: concept, module: module))
+            construct.isLocal = try r.readBool()
+            return construct
+        case .existentialWitness:
+            let existential = try readLValue(from: &r)
+            let methodName = try readString(from: &r)
+            return try builder.build(ExistentialWitnessInst(existential: existential, methodName: methodName,
+                                                            existentialType: read(ConceptType.self, from: &r)))
+        case .existentialProject:
+            return try builder.build(ExistentialProjectInst(existential: readLValue(from: &r)))
+        case .existentialExportBuffer:
+            return try builder.build(ExistentialExportBufferInst(existential: readLValue(from: &r)))
+
+        case .structInit:
+            let type = try read(StructType.self, from: &r)
+            return try builder.build(StructInitInst(type: type, operands: readOperands(from: &r), irName: nil))
+        case .structExtract:
+            let object = try readValue(from: &r)
+            return try builder.build(StructExtractInst(object: object, property: readString(from: &r)))
+        case .structElementPtr:
+            let object = try readLValue(from: &r)
+            return try builder.build(StructElementPtrInst(object: object, property: readString(from: &r)))
+        case .classProjectInstance:
+            return try builder.build(ClassProjectInstanceInst(object: readLValue(from: &r)))
+        case .classGetRefCount:
+            return try builder.build(ClassGetRefCountInst(object: readLValue(from: &r)))
+
+        case .tupleCreate:
+            let type = try read(TupleType.self, from: &r)
+            return try builder.build(TupleCreateInst(type: type, elements: readValues(from: &r)))
+        case .tupleExtract:
+            let tuple = try readValue(from: &r)
+            return try builder.build(TupleExtractInst(tuple: tuple, index: r.readVarint()))
+        case .tupleElementPtr:
+            let tuple = try readLValue(from: &r)
+            return try builder.build(TupleElementPtrInst(tuple: tuple, index: r.readVarint()))
+
+        case .allocObject:
+            return try builder.build(AllocObjectInst(memType: read(StructType.self, from: &r)))
+        case .retain:
+            return try builder.build(RetainInst(object: readLValue(from: &r)))
+        case .release:
+            return try builder.build(ReleaseInst(object: readLValue(from: &r)))
+        case .deallocObject:
+            return try builder.build(DeallocObjectInst(object: readLValue(from: &r)))
+
+        case .variable:
+            return try builder.build(VariableInst(value: readValue(from: &r)))
+        case .variableAddr:
+            let addr = try readLValue(from: &r)
+            return try builder.build(VariableAddrInst(addr: addr, mutable: r.readBool()))
+
+        case .break, .condBreak, .castBreak:
+            return try readBreak(opcode, from: &r)
+        }
+    }
+
+    /// Reads a block call made from the builder's current block
+    func readCall(from reader: inout VIRByteReader) throws -> BlockCall {
+        let index = try reader.readVarint()
+        guard index < blocks.count else { throw VIRSerialisationError.malformed("no block \(index)") }
+        let block = blocks[index], source = module.builder.insertPoint.block!
+
+        let hasArgs = try reader.readBool()
+        var args: [BlockOperand] = []
+        for _ in 0..<(try reader.readVarint()) {
+            let paramIndex = try reader.readVarint()
+            guard let params = block.parameters, paramIndex < params.count else {
+                throw VIRSerialisationError.malformed("$\(block.name) has no param \(paramIndex)")
+            }
+            let value = try readOptionalValue(from: &reader)
+            args.append(BlockOperand(optionalValue: value, param: params[paramIndex], block: source))
+        }
+        return (block: block, args: hasArgs ? args : nil)
+    }
+
+    func readBreak(_ opcode: VIRFormat.Opcode, from r: inout VIRByteReader) throws -> Inst {
+        let builder = module.builder!
+        switch opcode {
+        case .break:
+            let call = try readCall(from: &r)
+            return try builder.buildBreak(to: call.block, args: call.args)
+        case .condBreak:
+            let condition = try readValue(from: &r)
+            let then = try readCall(from: &r)
+            return try builder.buildCondBreak(if: Operand(condition), to: then, elseTo: readCall(from: &r))
+        case .castBreak:
+            let val = try readLValue(from: &r)
+            let targetType = try readType(from: &r)
+            guard case let successVariable as RefParam = try readValue(from: &r) else {
+                throw VIRSerialisationError.malformed("cast break success variable")
+            }
+            let success = try readCall(from: &r), fail = try readCall(from: &r)
+            let source = builder.insertPoint.block!
+
+            // `buildCastBreak` would make witness tables for the target
+            // type, these were read with the module
+            let inst = try builder.build(CheckedCastBreakInst(successCall: success, successVariable: successVariable,
+                                                              failCall: fail, val: PtrOperand(val), targetType: targetType))
+            let result = CastResultBlockOperand(optionalValue: nil, param: successVariable, block: source)
+            try success.block.addApplication(from: source, args: [result] + (success.args ?? []), breakInst: inst)
+            try fail.block.addApplication(from: source, args: fail.args, breakInst: inst)
+            return inst
+        default:
+            throw VIRSerialisationError.malformed("\(opcode) is not a break")
+        }
+    }
+}
@@ -0,0 +1,634 @@
+//
+//  VIRWriter.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+import struct Foundation.Data
+import struct Foundation.URL
+
+/// Encodes a module as binary VIR, laid out as described by `VIRFormat`
+///
+/// The module and function sections are encoded first, interning every
+/// name and type they use; the string and type tables are written from
+/// what was interned
+final class VIRWriter {
+    let module: Module
+    /// Whether only the module's interface is written
+    let isInterface: Bool
+
+    private var strings: [String] = [], stringIndices: [String: Int] = [:]
+    /// The encoded type records, a nominal type's record is nil while it
+    /// is being encoded
+    private var types: [[UInt8]?] = []
+    /// Nominal types are numbered when first seen, so one can refer to itself
+    private var nominalIndices: [ObjectIdentifier: Int] = [:]
+    /// Structural types are numbered by their encoding
+    private var structuralIndices: [Data: Int] = [:]
+
+    /// The numbers of the params and instructions in the function being
+    /// encoded, and the indices of its blocks
+    private var valueIDs: [ObjectIdentifier: Int] = [:]
+    private var blockIndices: [ObjectIdentifier: Int] = [:]
+
+    /// - parameter interface: Write only what another module needs to call
+    ///             into this one: its types, witness tables, and non private
+    ///             functions, with the bodies of the `@inline` functions it
+    ///             can inline. Globals are not written
+    init(module: Module, interface: Bool = false) {
+        self.module = module
+        self.isInterface = interface
+    }
+
+    func write() throws -> Data {
+        var moduleSection = VIRByteWriter()
+        try encodeModule(into: &moduleSection)
+        var functionTable = VIRByteWriter(), bodies = VIRByteWriter()
+        try encodeFunctions(table: &functionTable, bodies: &bodies)
+
+        let stringSection = offsetTable(of: strings.map { string -> [UInt8] in
+            var record = VIRByteWriter()
+            let utf8 = Array(string.utf8)
+            record.write(utf8.count)
+            record.write(bytes: utf8)
+            return record.bytes
+        })
+        let typeSection = offsetTable(of: types.map { record in record! })
+
+        // in `VIRFormat.Section` order
+        let sections = [stringSection, typeSection, moduleSection, functionTable, bodies]
+        var file = VIRByteWriter()
+        file.write(bytes: VIRFormat.magic)
+        file.write(fixed: VIRFormat.version, width: 4)
+        var offset = VIRFormat.headerSize
+        for section in sections {
+            file.write(fixed: offset, width: 8)
+            offset += section.count
+        }
+        for section in sections {
+            file.write(bytes: section.bytes)
+        }
+        return Data(bytes: file.bytes)
+    }
+
+    /// A section of `records`, which starts with their count and
+    /// each one's offset from the start of the section
+    private func offsetTable(of records: [[UInt8]]) -> VIRByteWriter {
+        var section = VIRByteWriter()
+        section.write(fixed: records.count, width: 4)
+        var offset = 4 + 4 * records.count
+        for record in records {
+            section.write(fixed: offset, width: 4)
+            offset += record.count
+        }
+        for record in records {
+            section.write(bytes: record)
+        }
+        return section
+    }
+}
+
+// MARK: Strings and types
+
+private extension VIRWriter {
+
+    func index(of string: String) -> Int {
+        if let index = stringIndices[string] { return index }
+        strings.append(string)
+        stringIndices[string] = strings.count - 1
+        return strings.count - 1
+    }
+
+    func write(string: String, into record: inout VIRByteWriter) {
+        record.write(index(of: string))
+    }
+    /// Writes 0 for nil, otherwise the string's index + 1
+    func write(optionalString string: String?, into record: inout VIRByteWriter) {
+        record.write(string.map { string in self.index(of: string) + 1 } ?? 0)
+    }
+
+    func index(of type: Type) throws -> Int {
+        if case let nominal as NominalType = type {
+            let id = ObjectIdentifier(nominal)
+            if let index = nominalIndices[id] { return index }
+            // number it before encoding its members, which may refer back to it
+            let index = types.count
+            types.append(nil)
+            nominalIndices[id] = index
+            types[index] = try encodeRecord(of: type).bytes
+            return index
+        }
+
+        let record = try encodeRecord(of: type).bytes
+        let key = Data(bytes: record)
+        if let index = structuralIndices[key] { return index }
+        types.append(record)
+        structuralIndices[key] = types.count - 1
+        return types.count - 1
+    }
+
+    func write(type: Type, into record: inout VIRByteWriter) throws {
+        record.write(try index(of: type))
+    }
+    func write(types: [Type], into record: inout VIRByteWriter) throws {
+        record.write(types.count)
+        for type in types { try write(type: type, into: &record) }
+    }
+
+    func encodeRecord(of type: Type) throws -> VIRByteWriter {
+        var record = VIRByteWriter()
+        func tag(_ tag: VIRFormat.TypeTag) { record.write(byte: tag.rawValue) }
+
+        switch type {
+        case let builtin as BuiltinType:
+            switch builtin {
+            case .null: tag(.null)
+            case .void: tag(.void)
+            case .bool: tag(.bool)
+            case .opaquePointer: tag(.opaquePointer)
+            case .int(let size):
+                tag(.int)
+                record.write(size)
+            case .float(let size):
+                tag(.float)
+                record.write(size)
+            case .array(let element, let size):
+                tag(.array)
+                try write(type: element, into: &record)
+                record.write(size.map { size in size + 1 } ?? 0)
+            case .pointer(let pointee):
+                tag(.pointer)
+                try write(type: pointee, into: &record)
+            }
+
+        case let function as FunctionType:
+            tag(.function)
+            try write(types: function.params, into: &record)
+            try write(type: function.returns, into: &record)
+            switch function.callingConvention {
+            case .thin: record.write(byte: VIRFormat.ConventionTag.thin.rawValue)
+            case .initialiser: record.write(byte: VIRFormat.ConventionTag.initialiser.rawValue)
+            case .deinitialiser: record.write(byte: VIRFormat.ConventionTag.deinitialiser.rawValue)
+            case .runtime: record.write(byte: VIRFormat.ConventionTag.runtime.rawValue)
+            case .method(let selfType, let mutating):
+                record.write(byte: VIRFormat.ConventionTag.method.rawValue)
+                try write(type: selfType, into: &record)
+                record.write(mutating)
+            }
+            record.write(try function.yieldType.map { yieldType in try self.index(of: yieldType) + 1 } ?? 0)
+            record.write(function.isCanonicalType)
+
+        case let tuple as TupleType:
+            tag(.tuple)
+            try write(types: tuple.members, into: &record)
+
+        case let alias as ModuleType:
+            tag(.alias)
+            write(string: alias.name, into: &record)
+            try write(type: alias.targetType, into: &record)
+
+        case let structType as StructType:
+            tag(.struct)
+            write(string: structType.name, into: &record)
+            record.write(structType.isHeapAllocated)
+            try write(members: structType.members, into: &record)
+            try write(methods: structType.methods, into: &record)
+            try write(types: structType.concepts, into: &record)
+            record.write(structType.genericTypes != nil)
+            try write(types: structType.genericTypes ?? [], into: &record)
+
+        case let concept as ConceptType:
+            tag(.concept)
+            write(string: concept.name, into: &record)
+            try write(methods: concept.requiredFunctions, into: &record)
+            try write(members: concept.requiredProperties, into: &record)
+            try write(types: concept.concepts, into: &record)
+
+        case let classType as ClassType:
+            tag(.class)
+            write(string: classType.name, into: &record)
+            try write(type: classType.storedType, into: &record)
+
+        case let generic as GenericType:
+            tag(.generic)
+            write(string: generic.name, into: &record)
+            try write(types: generic.concepts, into: &record)
+            write(string: generic.parentName, into: &record)
+
+        default:
+            throw VIRSerialisationError.unserialisableType(type)
+        }
+        return record
+    }
+
+    func write(members: [StructMember], into record: inout VIRByteWriter) throws {
+        record.write(members.count)
+        for member in members {
+            write(string: member.name, into: &record)
+            try write(type: member.type, into: &record)
+            record.write(member.isMutable)
+        }
+    }
+    func write(methods: [StructMethod], into record: inout VIRByteWriter) throws {
+        record.write(methods.count)
+        for method in methods {
+            write(string: method.name, into: &record)
+            try write(type: method.type, into: &record)
+            record.write(method.mutating)
+        }
+    }
+}
+
+// MARK: Module and functions
+
+private extension VIRWriter {
+
+    func encodeModule(into section: inout VIRByteWriter) throws {
+        let aliases = module.typeList.sorted { $0.key < $1.key }
+        section.write(aliases.count)
+        for (name, alias) in aliases {
+            write(string: name, into: &section)
+            try write(type: alias, into: &section)
+            write(optionalString: exported(alias.destructor)?.name, into: &section)
+            write(optionalString: exported(alias.deinitialiser)?.name, into: &section)
+            write(optionalString: exported(alias.copyConstructor)?.name, into: &section)
+        }
+
+        let globals = isInterface ? [] : module.globalValues.sorted { $0.globalName < $1.globalName }
+        section.write(globals.count)
+        for global in globals {
+            write(string: global.globalName, into: &section)
+            try write(type: global.globalType, into: &section)
+        }
+
+        section.write(module.witnessTables.count)
+        for table in module.witnessTables {
+            try write(type: table.type, into: &section)
+            try write(type: table.concept, into: &section)
+        }
+    }
+
+    func encodeFunctions(table: inout VIRByteWriter, bodies: inout VIRByteWriter) throws {
+        let functions = module.functions
+            .filter { function in exported(function) != nil }
+            .sorted { $0.name < $1.name }
+        table.write(functions.count)
+        for function in functions {
+            write(string: function.name, into: &table)
+            try write(type: function.type, into: &table)
+            table.write(byte: function.visibility.serialisedTag)
+            table.write(byte: function.inlineRequirement.serialisedTag)
+            table.write(function.attributes.rawValue)
+            let writesBody = function.hasBody && (!isInterface || isInlineableFromInterface(function))
+            table.write(writesBody)
+            if writesBody {
+                table.write(bodies.count)
+                try encodeBody(of: function, into: &bodies)
+            }
+        }
+    }
+
+    /// `function`, unless it is private and only the interface is written
+    func exported(_ function: Function?) -> Function? {
+        guard isInterface else { return function }
+        return function.flatMap { function in function.visibility == .private ? nil : function }
+    }
+
+    /// Whether a module reading the interface can inline `function`. Its body
+    /// may only use the functions the interface declares, and not the
+    /// module's globals or witness tables
+    func isInlineableFromInterface(_ function: Function) -> Bool {
+        guard function.inlineRequirement == .always, function.globalLifetimes.isEmpty else { return false }
+
+        func isExported(_ value: Value?) -> Bool {
+            switch value {
+            case let opaque as OpaqueLValue: return isExported(opaque.value)
+            case is GlobalValue: return false
+            case let ref as FunctionRef: return exported(ref.function) != nil
+            default: return true
+            }
+        }
+        return !function.instructions.contains { inst in
+            if inst is ExistentialConstructInst { return true }
+            if case let call as FunctionCallInst = inst, exported(call.function) == nil { return true }
+            return inst.args.contains { arg in !isExported(arg.value) }
+        }
+    }
+
+    /// A body is the function's param count, its block table, the order to
+    /// build the blocks in, its global lifetimes, then the instructions
+    func encodeBody(of function: Function, into bodies: inout VIRByteWriter) throws {
+        let blocks = function.blocks!
+
+        valueIDs.removeAll(keepingCapacity: true)
+        blockIndices.removeAll(keepingCapacity: true)
+        var id = 0
+        for (index, block) in blocks.enumerated() {
+            blockIndices[ObjectIdentifier(block)] = index
+            for param in block.parameters ?? [] {
+                valueIDs[ObjectIdentifier(param)] = id
+                id += 1
+            }
+            for inst in block.instructions {
+                valueIDs[ObjectIdentifier(inst)] = id
+                id += 1
+            }
+        }
+
+        // the instructions of each block, and where they start
+        var insts = VIRByteWriter(), instOffsets: [Int] = []
+        for block in blocks {
+            instOffsets.append(insts.count)
+            for inst in block.instructions {
+                try encode(inst: inst, into: &insts)
+            }
+        }
+
+        bodies.write(function.params?.count ?? 0)
+        bodies.write(blocks.count)
+        for (block, instOffset) in zip(blocks, instOffsets) {
+            write(string: block.name, into: &bodies)
+            // 0 is a block without a param list
+            bodies.write(block.parameters.map { params in params.count + 1 } ?? 0)
+            for param in block.parameters ?? [] {
+                try encode(param: param, into: &bodies)
+            }
+            bodies.write(block.instructionCount)
+            bodies.write(instOffset)
+        }
+
+        // blocks are built in reverse postorder, so each instruction's
+        // operands are built before it
+        let reachable = DominatorTree.reversePostorder(from: function.entryBlock!)
+        let reachableSet = Set(reachable.map { block in ObjectIdentifier(block) })
+        let unreachable = blocks.filter { block in !reachableSet.contains(ObjectIdentifier(block)) }
+        bodies.write(blocks.count)
+        for block in reachable + unreachable {
+            bodies.write(blockIndices[ObjectIdentifier(block)]!)
+        }
+
+        bodies.write(function.globalLifetimes.count)
+        for lifetime in function.globalLifetimes {
+            write(string: lifetime.globalName, into: &bodies)
+            try write(value: lifetime.start.value, into: &bodies)
+            try write(value: lifetime.end.value, into: &bodies)
+        }
+
+        bodies.write(bytes: insts.bytes)
+    }
+
+    func encode(param: Param, into record: inout VIRByteWriter) throws {
+        if case let ref as RefParam = param {
+            record.write(byte: VIRFormat.ParamTag.reference.rawValue)
+            write(string: ref.paramName, into: &record)
+            try write(type: ref.memType!, into: &record)
+        }
+        else {
+            record.write(byte: VIRFormat.ParamTag.value.rawValue)
+            write(string: param.paramName, into: &record)
+            try write(type: param.type!, into: &record)
+        }
+        record.write(byte: param.convention?.serialisedTag ?? 0)
+    }
+}
+
+// MARK: Instructions
+
+private extension VIRWriter {
+
+    /// Writes a reference to `value`, values defined in the function are
+    /// referred to by number
+    func write(value: Value?, into record: inout VIRByteWriter) throws {
+        guard let value = value else {
+            record.write(byte: VIRFormat.ValueTag.null.rawValue)
+            return
+        }
+        switch value {
+        case let opaque as OpaqueLValue:
+            record.write(byte: VIRFormat.ValueTag.opaque.rawValue)
+            try write(value: opaque.value, into: &record)
+        case let global as GlobalValue:
+            record.write(byte: VIRFormat.ValueTag.global.rawValue)
+            write(string: global.globalName, into: &record)
+        case let ref as FunctionRef:
+            record.write(byte: VIRFormat.ValueTag.function.rawValue)
+            write(string: ref.function.name, into: &record)
+        default:
+            guard let id = valueIDs[ObjectIdentifier(value)] else {
+                throw VIRSerialisationError.unserialisableValue(value.name)
+            }
+            record.write(byte: VIRFormat.ValueTag.local.rawValue)
+            record.write(id)
+        }
+    }
+
+    func write(operands: [Operand], into record: inout VIRByteWriter) throws {
+        record.write(operands.count)
+        for operand in operands {
+            let tag: VIRFormat.OperandTag = operand is PtrOperand ? .pointer : .value
+            record.write(byte: tag.rawValue)
+            try write(value: operand.value, into: &record)
+        }
+    }
+
+    func write(values operands: [Operand], into record: inout VIRByteWriter) throws {
+        record.write(operands.count)
+        for operand in operands { try write(value: operand.value, into: &record) }
+    }
+
+    /// The target block, and each arg's param index and value
+    func write(call: BlockCall, into record: inout VIRByteWriter) throws {
+        record.write(blockIndices[ObjectIdentifier(call.block)]!)
+        record.write(call.args != nil)
+        record.write(call.args?.count ?? 0)
+        for arg in call.args ?? [] {
+            guard let index = call.block.parameters?.index(where: { param in param === arg.param }) else {
+                throw VIRSerialisationError.malformed("$\(call.block.name) has no param \(arg.param.name)")
+            }
+            record.write(index)
+            try write(value: arg.value, into: &record)
+        }
+    }
+
+    func begin(_ opcode: VIRFormat.Opcode, _ inst: Inst, into record: inout VIRByteWriter) {
+        record.write(byte: opcode.rawValue)
+        write(optionalString: inst.irName, into: &record)
+    }
+
+    func encode(inst: Inst, into r: inout VIRByteWriter) throws {
+        switch inst {
+        case let inst as IntLiteralInst:
+            begin(.intLiteral, inst, into: &r)
+            r.write(signed: inst.value)
+            r.write(inst.size)
+        case let inst as BoolLiteralInst:
+            begin(.boolLiteral, inst, into: &r)
+            r.write(inst.value)
+        case let inst as StringLiteralInst:
+            begin(.stringLiteral, inst, into: &r)
+            write(string: inst.value, into: &r)
+        case let inst as BuiltinInstCall:
+            begin(.builtin, inst, into: &r)
+            write(string: inst.instName, into: &r)
+            try write(operands: inst.args, into: &r)
+        case let inst as ReturnInst:
+            begin(.return, inst, into: &r)
+            try write(value: inst.returnValue.value, into: &r)
+        case let inst as ArrayInst:
+            begin(.array, inst, into: &r)
+            try write(type: inst.arrayType.mem, into: &r)
+            try write(operands: inst.values, into: &r)
+
+        case let inst as AllocInst:
+            begin(.alloc, inst, into: &r)
+            try write(type: inst.storedType, into: &r)
+        case let inst as StoreInst:
+            begin(.store, inst, into: &r)
+            try write(value: inst.address.value, into: &r)
+            try write(value: inst.value.value, into: &r)
+        case let inst as LoadInst:
+            begin(.load, inst, into: &r)
+            try write(value: inst.address.value, into: &r)
+        case let inst as BitcastInst:
+            begin(.bitcast, inst, into: &r)
+            try write(value: inst.address.value, into: &r)
+            try write(type: inst.newType, into: &r)
+        case let inst as DestroyAddrInst:
+            begin(.destroyAddr, inst, into: &r)
+            try write(value: inst.addr.value, into: &r)
+        case let inst as DestroyValInst:
+            begin(.destroyVal, inst, into: &r)
+            try write(value: inst.val.value, into: &r)
+        case let inst as CopyAddrInst:
+            begin(.copyAddr, inst, into: &r)
+            try write(value: inst.addr.value, into: &r)
+            try write(value: inst.outAddr.value, into: &r)
+        case let inst as DeallocStackInst:
+            begin(.deallocStack, inst, into: &r)
+            try write(value: inst.address.value, into: &r)
+
+        case let inst as FunctionCallInst:
+            begin(.call, inst, into: &r)
+            write(string: inst.function.name, into: &r)
+            try write(type: inst.returnType, into: &r)
+            try write(operands: inst.args, into: &r)
+        case let inst as FunctionApplyInst:
+            begin(.apply, inst, into: &r)
+            try write(value: inst.function.value, into: &r)
+            try write(type: inst.returnType, into: &r)
+            try write(operands: inst.functionArgs, into: &r)
+        case let inst as FunctionRefInst:
+            begin(.functionRef, inst, into: &r)
+            write(string: inst.functionName, into: &r)
+
+        case let inst as ExistentialProjectPropertyInst:
+            begin(.existentialProjectProperty, inst, into: &r)
+            try write(value: inst.existential.value, into: &r)
+            write(string: inst.propertyName, into: &r)
+        case let inst as ExistentialConstructInst:
+            begin(.existentialConstruct, inst, into: &r)
+            try write(value: inst.value.value, into: &r)
+            try write(type: inst.existentialType, into: &r)
+            r.write(inst.isLocal)
+        case let inst as ExistentialWitnessInst:
+            begin(.existentialWitness, inst, into: &r)
+            try write(value: inst.existential.value, into: &r)
+            write(string: inst.methodName, into: &r)
+            try write(type: inst.existentialType, into: &r)
+        case let inst as ExistentialProjectInst:
+            begin(.existentialProject, inst, into: &r)
+            try write(value: inst.existential.value, into: &r)
+        case let inst as ExistentialExportBufferInst:
+            begin(.existentialExportBuffer, inst, into: &r)
+            try write(value: inst.existential.value, into: &r)
+
+        case let inst as BreakInst:
+            begin(.break, inst, into: &r)
+            try write(call: inst.call, into: &r)
+        case let inst as CondBreakInst:
+            begin(.condBreak, inst, into: &r)
+            try write(value: inst.condition.value, into: &r)
+            try write(call: inst.thenCall, into: &r)
+            try write(call: inst.elseCall, into: &r)
+        case let inst as CheckedCastBreakInst:
+            begin(.castBreak, inst, into: &r)
+            try write(value: inst.val.value, into: &r)
+            try write(type: inst.targetType, into: &r)
+            try write(value: inst.successVariable, into: &r)
+            try write(call: inst.successCall, into: &r)
+            try write(call: inst.failCall, into: &r)
+
+        case let inst as StructInitInst:
+            begin(.structInit, inst, into: &r)
+            try write(type: inst.structType, into: &r)
+            try write(operands: inst.args, into: &r)
+        case let inst as StructExtractInst:
+            begin(.structExtract, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+            write(string: inst.propertyName, into: &r)
+        case let inst as StructElementPtrInst:
+            begin(.structElementPtr, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+            write(string: inst.propertyName, into: &r)
+        case let inst as ClassProjectInstanceInst:
+            begin(.classProjectInstance, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+        case let inst as ClassGetRefCountInst:
+            begin(.classGetRefCount, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+
+        case let inst as TupleCreateInst:
+            begin(.tupleCreate, inst, into: &r)
+            try write(type: inst.tupleType, into: &r)
+            try write(values: inst.elements, into: &r)
+        case let inst as TupleExtractInst:
+            begin(.tupleExtract, inst, into: &r)
+            try write(value: inst.tuple.value, into: &r)
+            r.write(inst.elementIndex)
+        case let inst as TupleElementPtrInst:
+            begin(.tupleElementPtr, inst, into: &r)
+            try write(value: inst.tuple.value, into: &r)
+            r.write(inst.elementIndex)
+
+        case let inst as AllocObjectInst:
+            begin(.allocObject, inst, into: &r)
+            try write(type: inst.storedType, into: &r)
+        case let inst as RetainInst:
+            begin(.retain, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+        case let inst as ReleaseInst:
+            begin(.release, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+        case let inst as DeallocObjectInst:
+            begin(.deallocObject, inst, into: &r)
+            try write(value: inst.object.value, into: &r)
+
+        case let inst as VariableInst:
+            begin(.variable, inst, into: &r)
+            try write(value: inst.value.value, into: &r)
+        case let inst as VariableAddrInst:
+            begin(.variableAddr, inst, into: &r)
+            try write(value: inst.addr.value, into: &r)
+            r.write(inst.mutable)
+
+        default:
+            throw VIRSerialisationError.unserialisableValue(inst.name)
+        }
+    }
+}
+
+extension Module {
+
+    /// The module encoded as binary VIR
+    /// - parameter interface: Encode only the module's interface, see `VIRWriter.init(module:interface:)`
+    func serialised(interface: Bool = false) throws -> Data {
+        return try VIRWriter(module: self, interface: interface).write()
+    }
+
+    /// Writes the module to `path` as binary VIR
+    func writeBinaryVIR(toFile path: String, interface: Bool = false) throws {
+        try serialised(interface: interface).write(to: URL(fileURLWithPath: path), options: .atomic)
+    }
+}
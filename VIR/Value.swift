@@ -15,10 +15,10 @@ protocol Value : class, VIRTyped, VIRElement {
     /// The block containing `self`
     weak var parentBlock: BasicBlock? { get set }
     
-    /// The list of uses of `self`. A collection of `Operand`
+    /// The list of uses of `self`. A list of `Operand`
     /// instances whose `value`s point to self, the operand's
     /// user is the inst which takes `self`
-    var uses: [Operand] { get set }
+    var useList: UseList { get }
     
     /// The formatted name as shown in IR
     var name: String { get set }
@@ -61,16 +61,18 @@ extension Value {
     
     func copy() -> Self { return self }
     
+    /// The uses of `self`, in the order they were added. This is a copy, so
+    /// the uses can be changed while iterating over it
+    var uses: [Operand] { return useList.operands }
+    
     /// Adds record of a user `use` to self’s users list
     func addUse(_ use: Operand) {
-        uses.append(use)
+        useList.append(use)
     }
     
     /// Removes `use` from self’s uses record
     func removeUse(_ use: Operand) {
-        //guard let i = uses.index(where: {$0.value === self}) else { return }
-        guard let i = uses.index(where: {$0 === use}) else { return }
-        uses.remove(at: i)
+        useList.remove(use)
     }
     
     /// Adds the lowered val to all users
@@ -148,13 +150,9 @@ final class OpaqueLValue : LValue {
         get { return value.name }
         set { value.name = newValue }
     }
-    var uses: [Operand] {
-        get { return value.uses }
-        set { value.uses = newValue }
-    }
+    var useList: UseList { return value.useList }
     var irName: String? {
         get { return value.irName }
         set { value.irName = newValue }
     }
 }
-
@@ -40,9 +40,13 @@ final class VIRWitnessTable : VIRElement {
     private var table: [String: String] = [:]
     
     func getWitness(name: String, module: Module) throws -> PtrOperand {
+        return try getWitnessFunction(name: name, module: module).buildFunctionPointer()
+    }
+    /// The function implementing the concept method `name`
+    func getWitnessFunction(name: String, module: Module) throws -> Function {
         guard let witness = table[name] else { fatalError("No witness recorded") }
         guard let function = module.function(named: witness) else { fatalError("Undefined witness") }
-        return function.buildFunctionPointer()
+        return function
     }
     func getOffset(name: String, module: Module) throws -> Int {
         let index = type.members.index(where: { $0.name == name })!
@@ -7,10 +7,16 @@
 #import "LLVM.h"
 
 #import "Intrinsic.hpp"
+#import "Coroutine.hpp"
 #import "Optimiser.hpp"
+#import "Profile.hpp"
 #import "Utils.h"
 #import "CreateType.hpp"
 #import "Backend.hpp"
+#import "JIT.hpp"
+#import "NativeCall.hpp"
+
+#import <CommonCrypto/CommonDigest.h>
 
 //#define SOURCE_ROOT #SRC_ROOT
 
@@ -0,0 +1,168 @@
+//
+//  Bytecode.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// Executes `inst` in `frame`
+/// - returns: the index of the next instruction to run, or -1 if
+///            the function returned
+typealias BytecodeHandler = (_ inst: BytecodeInst, _ pc: Int, _ frame: Frame) throws -> Int
+
+/// A register machine instruction. Its operands are byte offsets into the
+/// frame, branch targets, or immediates; which depends on the handler.
+///
+/// The handler is stored directly so dispatch is a single indirect call,
+/// with no decoding switch
+struct BytecodeInst {
+    let handler: BytecodeHandler
+    var a: Int32, b: Int32, c: Int32, d: Int32
+
+    init(_ handler: @escaping BytecodeHandler, _ a: Int32 = 0, _ b: Int32 = 0, _ c: Int32 = 0, _ d: Int32 = 0) {
+        self.handler = handler
+        self.a = a
+        self.b = b
+        self.c = c
+        self.d = d
+    }
+}
+
+/// The memory a function runs in. Every VIR value has a slot at a fixed
+/// offset from `base`, laid out as its lowered LLVM type; constants sit
+/// at negative offsets and are copied in when the frame is entered
+struct Frame {
+    let base: UnsafeMutableRawPointer
+    /// Where the return value is written
+    let result: UnsafeMutableRawPointer?
+    unowned(unsafe) let function: BytecodeFunction
+    unowned(unsafe) let interpreter: Interpreter
+
+    /// The slot at `offset`
+    func slot(_ offset: Int32) -> UnsafeMutableRawPointer {
+        return base + Int(offset)
+    }
+    /// The pointer stored in the slot at `offset`
+    func pointer(at offset: Int32) -> UnsafeMutableRawPointer? {
+        return base.load(fromByteOffset: Int(offset), as: UnsafeMutableRawPointer?.self)
+    }
+    /// The operand list at `index` of the function's operand pool
+    func operands(at index: Int32) -> UnsafeBufferPointer<Int32> {
+        return function.operands(at: index)
+    }
+}
+
+/// A VIR function translated to bytecode
+final class BytecodeFunction {
+    let function: Function
+    let code: ContiguousArray<BytecodeInst>
+
+    /// The bytes below the frame's base, holding the function's constants
+    let constants: [UInt8]
+    /// The bytes above the frame's base, holding the value slots and the
+    /// function's stack memory
+    let frameSize: Int
+    /// The slot and size of each param
+    let params: [(offset: Int, size: Int)]
+
+    /// Operand lists, each is its count followed by the slot offsets
+    private let operandPool: UnsafeMutablePointer<Int32>
+    private let operandPoolCount: Int
+
+    init(function: Function, code: [BytecodeInst], constants: [UInt8], frameSize: Int,
+         params: [(offset: Int, size: Int)], operandPool: [Int32]) {
+        self.function = function
+        self.code = ContiguousArray(code)
+        self.constants = constants
+        self.frameSize = frameSize
+        self.params = params
+        self.operandPoolCount = max(operandPool.count, 1)
+        self.operandPool = UnsafeMutablePointer<Int32>.allocate(capacity: operandPoolCount)
+        self.operandPool.initialize(from: operandPool)
+    }
+
+    deinit {
+        operandPool.deallocate(capacity: operandPoolCount)
+    }
+
+    /// The operand list starting at `index`
+    func operands(at index: Int32) -> UnsafeBufferPointer<Int32> {
+        let list = operandPool + Int(index)
+        return UnsafeBufferPointer(start: list + 1, count: Int(list.pointee))
+    }
+
+    /// The bytes of the frame, including the constants
+    var allocationSize: Int { return constants.count + frameSize }
+
+    /// Copies the constants into `memory`, a new allocation of `allocationSize`
+    /// - returns: the frame's base
+    func enter(memory: UnsafeMutableRawPointer) -> UnsafeMutableRawPointer {
+        if !constants.isEmpty {
+            constants.withUnsafeBytes { bytes in
+                memory.copyBytes(from: bytes.baseAddress!, count: bytes.count)
+            }
+        }
+        return memory + constants.count
+    }
+
+    /// Runs the function's code in `frame`
+    func execute(in frame: Frame) throws {
+        try code.withUnsafeBufferPointer { code in
+            var pc = 0
+            while pc >= 0 {
+                let inst = code[pc]
+                pc = try inst.handler(inst, pc, frame)
+            }
+        }
+    }
+}
+
+
+// MARK: Memory access
+
+extension UnsafeMutableRawPointer {
+
+    /// Loads the signed integer of `width` bytes here
+    func loadInt(width: Int32) -> Int64 {
+        switch width {
+        case 1: return Int64(load(as: Int8.self))
+        case 2: return Int64(load(as: Int16.self))
+        case 4: return Int64(load(as: Int32.self))
+        default: return load(as: Int64.self)
+        }
+    }
+    /// Loads the unsigned integer of `width` bytes here
+    func loadUInt(width: Int32) -> UInt64 {
+        switch width {
+        case 1: return UInt64(load(as: UInt8.self))
+        case 2: return UInt64(load(as: UInt16.self))
+        case 4: return UInt64(load(as: UInt32.self))
+        default: return load(as: UInt64.self)
+        }
+    }
+    /// Stores the low `width` bytes of `value` here
+    func storeInt(_ value: Int64, width: Int32) {
+        switch width {
+        case 1: storeBytes(of: Int8(truncatingBitPattern: value), as: Int8.self)
+        case 2: storeBytes(of: Int16(truncatingBitPattern: value), as: Int16.self)
+        case 4: storeBytes(of: Int32(truncatingBitPattern: value), as: Int32.self)
+        default: storeBytes(of: value, as: Int64.self)
+        }
+    }
+    func storeBool(_ value: Bool) {
+        storeBytes(of: value ? 1 : 0, as: UInt8.self)
+    }
+    func loadBool() -> Bool {
+        return load(as: UInt8.self) & 1 != 0
+    }
+
+    /// Loads the float of `width` bytes here, as a double
+    func loadFloat(width: Int32) -> Double {
+        return width == 4 ? Double(load(as: Float.self)) : load(as: Double.self)
+    }
+    func storeFloat(_ value: Double, width: Int32) {
+        if width == 4 { storeBytes(of: Float(value), as: Float.self) }
+        else { storeBytes(of: value, as: Double.self) }
+    }
+}
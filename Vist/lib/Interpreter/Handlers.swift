@@ -0,0 +1,362 @@
+//
+//  Handlers.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// The bytecode instruction handlers. Operands are written `a, b, c, d`
+/// in the order they are stored in the `BytecodeInst`; a `%` operand is
+/// the offset of a slot in the frame, and `*%` a slot holding a pointer
+enum Op {
+
+    // MARK: Moves
+
+    /// `copy %dst, %src, size`
+    static func copy(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).copyBytes(from: f.slot(i.b), count: Int(i.c))
+        return pc + 1
+    }
+    /// `copy8 %dst, %src`, copies an aligned word
+    static func copy8(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.base.storeBytes(of: f.base.load(fromByteOffset: Int(i.b), as: UInt64.self), toByteOffset: Int(i.a), as: UInt64.self)
+        return pc + 1
+    }
+    /// `load %dst, *%ptr, size`
+    static func load(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).copyBytes(from: f.pointer(at: i.b)!, count: Int(i.c))
+        return pc + 1
+    }
+    /// `load8 %dst, *%ptr`, loads an aligned word
+    static func load8(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.base.storeBytes(of: f.pointer(at: i.b)!.load(as: UInt64.self), toByteOffset: Int(i.a), as: UInt64.self)
+        return pc + 1
+    }
+    /// `store *%ptr, %src, size`
+    static func store(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.pointer(at: i.a)!.copyBytes(from: f.slot(i.b), count: Int(i.c))
+        return pc + 1
+    }
+    /// `store8 *%ptr, %src`, stores an aligned word
+    static func store8(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.pointer(at: i.a)!.storeBytes(of: f.base.load(fromByteOffset: Int(i.b), as: UInt64.self), as: UInt64.self)
+        return pc + 1
+    }
+    /// `loadField %dst, *%ptr, offset, size`
+    static func loadField(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).copyBytes(from: f.pointer(at: i.b)! + Int(i.c), count: Int(i.d))
+        return pc + 1
+    }
+
+    // MARK: Addresses
+
+    /// `slotAddress %dst, %slot`, takes the address of frame memory
+    static func slotAddress(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.base.storeBytes(of: f.slot(i.b), toByteOffset: Int(i.a), as: UnsafeMutableRawPointer.self)
+        return pc + 1
+    }
+    /// `elementAddress %dst, *%ptr, offset`
+    static func elementAddress(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.base.storeBytes(of: f.pointer(at: i.b).map { $0 + Int(i.c) }, toByteOffset: Int(i.a), as: UnsafeMutableRawPointer?.self)
+        return pc + 1
+    }
+    /// `advancePointer %dst, *%ptr, %index, scale << 4 | width`
+    static func advancePointer(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let index = f.slot(i.c).loadInt(width: i.d & 0xf), scale = Int64(i.d >> 4)
+        f.base.storeBytes(of: f.pointer(at: i.b).map { $0 + Int(index &* scale) },
+                          toByteOffset: Int(i.a), as: UnsafeMutableRawPointer?.self)
+        return pc + 1
+    }
+    /// `projectExistential %dst, *%ex, inlineBufferOffset`
+    static func projectExistential(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let ex = f.pointer(at: i.b)!
+        let taggedPointer = ex.load(as: Int.self)
+        let instance = taggedPointer & Runtime.existentialInlineTag != 0 ?
+            ex + Int(i.c) :
+            UnsafeMutableRawPointer(bitPattern: taggedPointer & ~Runtime.existentialTagMask)
+        f.base.storeBytes(of: instance, toByteOffset: Int(i.a), as: UnsafeMutableRawPointer?.self)
+        return pc + 1
+    }
+
+    // MARK: Memory
+
+    /// `stackAllocate %dst, %size, width`, the memory is freed when the
+    /// function returns
+    static func stackAllocate(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let memory = try f.interpreter.stack.allocate(bytes: Int(f.slot(i.b).loadInt(width: i.c)))
+        f.base.storeBytes(of: memory, toByteOffset: Int(i.a), as: UnsafeMutableRawPointer.self)
+        return pc + 1
+    }
+    /// `memcpy *%dst, *%src, %size, width`
+    static func memcpy(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let size = Int(f.slot(i.c).loadInt(width: i.d))
+        if size > 0 {
+            f.pointer(at: i.a)!.copyBytes(from: f.pointer(at: i.b)!, count: size)
+        }
+        return pc + 1
+    }
+
+    // MARK: Control flow
+
+    /// `jump target`
+    static func jump(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        return Int(i.a)
+    }
+    /// `branch %cond, then, else`
+    static func branch(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        return Int(f.slot(i.a).loadBool() ? i.b : i.c)
+    }
+    /// `ret %value, size`
+    static func ret(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.result?.copyBytes(from: f.slot(i.a), count: Int(i.b))
+        return -1
+    }
+    static func retVoid(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        return -1
+    }
+    /// `condFail %cond`
+    static func condFail(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        if f.slot(i.a).loadBool() {
+            throw error(InterpreterError.trap(function: f.function.function.name))
+        }
+        return pc + 1
+    }
+    static func trap(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        throw error(InterpreterError.trap(function: f.function.function.name))
+    }
+
+    // MARK: Calls
+
+    /// `call callee, args, %result`
+    static func call(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        try f.interpreter.call(calleeAt: Int(i.a), arguments: f.operands(at: i.b), base: f.base, result: f.slot(i.c))
+        return pc + 1
+    }
+    /// `apply *%function, args, %result, thunk`
+    static func apply(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        guard let function = f.pointer(at: i.a) else {
+            throw error(InterpreterError.nullFunctionPointer(function: f.function.function.name))
+        }
+        try f.interpreter.apply(function, thunkAt: Int(i.d), arguments: f.operands(at: i.b), base: f.base, result: f.slot(i.c))
+        return pc + 1
+    }
+    /// `nativeCall target, args, %result, thunk`
+    static func nativeCall(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        try f.interpreter.callNative(targetAt: Int(i.a), thunkAt: Int(i.d), arguments: f.operands(at: i.b), base: f.base, result: f.slot(i.c))
+        return pc + 1
+    }
+
+    // MARK: Integers
+    // `op %dst, %lhs, %rhs, width`
+
+    /// Stores the result of an overflowing op, and whether it overflowed
+    private static func storeChecked(_ value: Int64, overflow: Bool, _ i: BytecodeInst, _ f: Frame) {
+        let dst = f.slot(i.a)
+        // narrower ops overflow if the result doesn't survive truncation
+        let wrapped = i.d == 8 ? value : (value << Int64(64 - i.d * 8)) >> Int64(64 - i.d * 8)
+        dst.storeInt(wrapped, width: i.d)
+        (dst + Int(i.d)).storeBool(overflow || wrapped != value)
+    }
+    private static func operands(_ i: BytecodeInst, _ f: Frame) -> (Int64, Int64) {
+        return (f.slot(i.b).loadInt(width: i.d), f.slot(i.c).loadInt(width: i.d))
+    }
+
+    static func iaddOverflow(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f), (value, overflow) = Int64.addWithOverflow(l, r)
+        storeChecked(value, overflow: overflow, i, f)
+        return pc + 1
+    }
+    static func isubOverflow(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f), (value, overflow) = Int64.subtractWithOverflow(l, r)
+        storeChecked(value, overflow: overflow, i, f)
+        return pc + 1
+    }
+    static func imulOverflow(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f), (value, overflow) = Int64.multiplyWithOverflow(l, r)
+        storeChecked(value, overflow: overflow, i, f)
+        return pc + 1
+    }
+    static func iadd(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l &+ r, width: i.d)
+        return pc + 1
+    }
+    static func imul(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l &* r, width: i.d)
+        return pc + 1
+    }
+    static func idiv(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        guard r != 0 else { throw error(InterpreterError.divisionByZero(function: f.function.function.name)) }
+        f.slot(i.a).storeInt(Int64.divideWithOverflow(l, r).0, width: i.d)
+        return pc + 1
+    }
+    static func irem(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        guard r != 0 else { throw error(InterpreterError.divisionByZero(function: f.function.function.name)) }
+        f.slot(i.a).storeInt(Int64.remainderWithOverflow(l, r).0, width: i.d)
+        return pc + 1
+    }
+    static func ishl(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l << (r & Int64(i.d * 8 - 1)), width: i.d)
+        return pc + 1
+    }
+    static func ishr(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l >> (r & Int64(i.d * 8 - 1)), width: i.d)
+        return pc + 1
+    }
+    static func iand(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l & r, width: i.d)
+        return pc + 1
+    }
+    static func ior(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l | r, width: i.d)
+        return pc + 1
+    }
+    static func ixor(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeInt(l ^ r, width: i.d)
+        return pc + 1
+    }
+    /// `ipow %dst, %lhs, %rhs, rhsWidth << 8 | lhsWidth`, computed in double
+    /// precision and converted back, as the lowered `llvm.powi` is
+    static func ipow(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let width = i.d & 0xff
+        var base = Double(f.slot(i.b).loadInt(width: width))
+        let exponent = f.slot(i.c).loadInt(width: i.d >> 8)
+        let isReciprocal = exponent < 0
+        // negating the minimum exponent overflows, its magnitude only fits unsigned
+        var magnitude = UInt64(bitPattern: isReciprocal ? 0 &- exponent : exponent)
+        var value = 1.0
+        while magnitude != 0 {
+            if magnitude & 1 != 0 { value *= base }
+            base *= base
+            magnitude >>= 1
+        }
+        if isReciprocal { value = 1 / value }
+        f.slot(i.a).storeInt(value.isFinite && abs(value) < 0x1p63 ? Int64(value) : Int64.min, width: width)
+        return pc + 1
+    }
+
+    static func ieq(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l == r)
+        return pc + 1
+    }
+    static func ineq(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l != r)
+        return pc + 1
+    }
+    static func ilt(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l < r)
+        return pc + 1
+    }
+    static func igt(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l > r)
+        return pc + 1
+    }
+    static func ilte(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l <= r)
+        return pc + 1
+    }
+    static func igte(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = operands(i, f)
+        f.slot(i.a).storeBool(l >= r)
+        return pc + 1
+    }
+
+    /// `inot %dst, %src, width`
+    static func inot(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).storeInt(~f.slot(i.b).loadInt(width: i.d), width: i.d)
+        return pc + 1
+    }
+    /// `bnot %dst, %src`
+    static func bnot(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).storeBool(!f.slot(i.b).loadBool())
+        return pc + 1
+    }
+    /// `sext %dst, %src, srcWidth, dstWidth`, also truncates
+    static func sext(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).storeInt(f.slot(i.b).loadInt(width: i.c), width: i.d)
+        return pc + 1
+    }
+    /// `zext %dst, %src, srcWidth, dstWidth`
+    static func zext(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        f.slot(i.a).storeInt(Int64(bitPattern: f.slot(i.b).loadUInt(width: i.c)), width: i.d)
+        return pc + 1
+    }
+
+    // MARK: Floats
+    // `op %dst, %lhs, %rhs, width`
+
+    private static func floatOperands(_ i: BytecodeInst, _ f: Frame) -> (Double, Double) {
+        return (f.slot(i.b).loadFloat(width: i.d), f.slot(i.c).loadFloat(width: i.d))
+    }
+
+    static func fadd(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeFloat(l + r, width: i.d)
+        return pc + 1
+    }
+    static func fsub(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeFloat(l - r, width: i.d)
+        return pc + 1
+    }
+    static func fmul(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeFloat(l * r, width: i.d)
+        return pc + 1
+    }
+    static func fdiv(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeFloat(l / r, width: i.d)
+        return pc + 1
+    }
+    static func frem(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeFloat(l.truncatingRemainder(dividingBy: r), width: i.d)
+        return pc + 1
+    }
+    // comparisons are ordered, so false if either operand is NaN
+    static func feq(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l == r)
+        return pc + 1
+    }
+    static func fneq(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l < r || l > r)
+        return pc + 1
+    }
+    static func flt(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l < r)
+        return pc + 1
+    }
+    static func fgt(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l > r)
+        return pc + 1
+    }
+    static func flte(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l <= r)
+        return pc + 1
+    }
+    static func fgte(_ i: BytecodeInst, _ pc: Int, _ f: Frame) throws -> Int {
+        let (l, r) = floatOperands(i, f)
+        f.slot(i.a).storeBool(l >= r)
+        return pc + 1
+    }
+}
@@ -6,109 +6,475 @@
 //  Copyright © 2016 vistlang. All rights reserved.
 //
 
-// Test document -- implementation of a virtual machine
-// stack for use in a VIR interpreter
+enum InterpreterError : VistError {
+    case trap(function: String)
+    case divisionByZero(function: String)
+    case stackOverflow
+    case unresolvedFunction(String)
+    case nullFunctionPointer(function: String)
+    case unsupportedInst(String)
+    case bridgeFailed(message: String)
 
-//private extension UnsafeMutablePointer {
-//    mutating func advanceByAlignOf<T>(el: T.Type) { self = advancedBy(alignof(el)) }
-//    mutating func recedeByAlignOf<T>(el: T.Type) { self = advancedBy(-alignof(el)) }
-//}
-//
-//final class Stack {
-//    private var stack, stackPtr, basePtr: UnsafeMutablePointer<Int8>
-//    /// The maximum size of stack allocated
-//    private var capacity: Int
-//    private var bytesOccupied: Int { return offset }
-//    
-//    /// The offset of the stack pointer
-//    private var offset: Int { return stack.distanceTo(stackPtr) }
-//    /// The offset of the base pointer
-//    private var baseOffset: Int { return stack.distanceTo(basePtr) }
-//    
-//    init() {
-//        capacity = 100
-//        stack = UnsafeMutablePointer<Int8>.alloc(capacity)
-//        stackPtr = stack
-//        basePtr = stackPtr
-//    }
-//    
-//    deinit {
-//        stack.destroy(capacity)
-//    }
-//    
-//    /// Moves the stack into a new buffer twice the old size
-//    private func initialiseNewBuffer() {
-//        let oldCapacity = capacity
-//        capacity *= 2
-//        // create new buffer & copy into it
-//        let newStack = UnsafeMutablePointer<Int8>.alloc(capacity)
-//        newStack.moveInitializeFrom(stack, count: oldCapacity)
-//        // move sp & bp into this
-//        stackPtr = newStack.advancedBy(offset)
-//        basePtr = newStack.advancedBy(baseOffset)
-//        // remove refs to old stack buffer
-//        stack.destroy(oldCapacity)
-//        stack = newStack
-//    }
-//    
-//    /// Pushes an element onto the stack
-//    func push<T>(element: T) {
-//        if bytesOccupied + alignof(T) > capacity { initialiseNewBuffer() }
-//        unsafeBitCast(stackPtr, UnsafeMutablePointer<T>.self).initialize(element)
-//        stackPtr.advanceByAlignOf(T)
-//    }
-//    /// Pops an element of type `type` and moves the stack
-//    /// pointer backwards
-//    func pop<T>(type: T.Type) -> T {
-//        let val = read(T)
-//        unsafeBitCast(stackPtr, UnsafeMutablePointer<T>.self).destroy()
-//        stackPtr.recedeByAlignOf(T)
-//        return val
-//    }
-//    
-//    /// Reads the current stack pointer as `type`
-//    func read<T>(type: T.Type, advance: Int = 0) -> T {
-//        return unsafeBitCast(stackPtr, UnsafeMutablePointer<T>.self).predecessor().advancedBy(advance).memory
-//    }
-//    
-//    /// Adds a new stack frame and creates a function
-//    func call<Ret, Params>(returns ret: Ret, params: Params) {
-//        pushUninitialised(Ret) // allocate return mem
-//        push(baseOffset) // push old base ptr
-//        basePtr = stackPtr // this is the start of a new stack frame
-//        push(params) // push params
-//    }
-//    
-//    /// Returns from the current function
-//    func ret<Ret>(val: Ret) {
-//        destroyFrame() // destroy stack frame, moves to
-//        basePtr = stack.advancedBy(pop(Int)) // pop off the old base ptr
-//        initialise(val) // flls the mem for the return value
-//    }
-//    
-//    /// Pushes uninitialised memory of type `ty` onto the stack
-//    private func pushUninitialised<T>(type: T) {
-//        if bytesOccupied + alignof(T) > capacity { initialiseNewBuffer() }
-//        stackPtr.advanceByAlignOf(T)
-//    }
-//    /// Intiialises the current stack pointer with `val`
-//    private func initialise<T>(val: T) {
-//        unsafeBitCast(stackPtr, UnsafeMutablePointer<T>.self).predecessor().initialize(val)
-//    }
-//    /// Destroys the contents of the current frame and moves
-//    /// the stack pointer back to the base pointer
-//    private func destroyFrame() {
-//        let s = basePtr.successor()
-//        s.destroy(s.distanceTo(stackPtr)) // remove all of this stack frame
-//        stackPtr = basePtr // move to return mem
-//    }
-//    
-//    
-//    
-//    var description: String {
-//        return stack.stride(to: stackPtr, by: 1)
-//            .map { String($0.memory) }
-//            .joined(separator: "")
-//    }
-//}
-//
+    var description: String {
+        switch self {
+        case .trap(let function): return "Trapped in '\(function.demangleName())'"
+        case .divisionByZero(let function): return "Division by zero in '\(function.demangleName())'"
+        case .stackOverflow: return "Interpreter stack overflow"
+        case .unresolvedFunction(let name): return "Function '\(name)' has no body and is not in a loaded library"
+        case .nullFunctionPointer(let function): return "Called a null function pointer in '\(function.demangleName())'"
+        case .unsupportedInst(let vir): return "Cannot interpret '\(vir)'"
+        case .bridgeFailed(let message): return "Could not call native code: \(message)"
+        }
+    }
+}
+
+/// The interpreter's call stack. Frames are bump allocated and freed
+/// by resetting `top` when the function returns
+final class InterpreterStack {
+    private let memory: UnsafeMutableRawPointer
+    private let capacity: Int
+    /// The offset of the first free byte
+    var top = 0
+
+    init(capacity: Int) {
+        self.capacity = capacity
+        memory = UnsafeMutableRawPointer.allocate(bytes: capacity, alignedTo: 16)
+    }
+    deinit {
+        memory.deallocate(bytes: capacity, alignedTo: 16)
+    }
+
+    /// - returns: `bytes` of 16 byte aligned memory
+    func allocate(bytes: Int) throws -> UnsafeMutableRawPointer {
+        let start = (top + 15) & ~15
+        guard start + bytes <= capacity else { throw error(InterpreterError.stackOverflow) }
+        top = start + bytes
+        return memory + start
+    }
+}
+
+/// The function and interpreter a callback thunk calls back into
+private final class CallbackContext {
+    unowned let interpreter: Interpreter
+    let function: Function
+
+    init(interpreter: Interpreter, function: Function) {
+        self.interpreter = interpreter
+        self.function = function
+    }
+}
+
+/// Wraps, and frees, an error message from the bridge
+private func bridgeError(_ message: UnsafeMutablePointer<Int8>?) -> VistError {
+    let description = message.map { String(cString: $0) } ?? ""
+    LLVMDisposeMessage(message)
+    return error(InterpreterError.bridgeFailed(message: description))
+}
+
+/// Called by every callback thunk
+private let interpreterCallback: InterpreterCallback = { context, arguments, result in
+    let callback = Unmanaged<CallbackContext>.fromOpaque(context!).takeUnretainedValue()
+    callback.interpreter.callBack(callback.function, arguments: arguments, result: result)
+}
+
+
+/// Runs a VIR module without lowering it to LLVM IR.
+///
+/// Functions are translated to register bytecode the first time they are
+/// called. Values are kept in memory laid out as their lowered LLVM types,
+/// so functions without a body -- the stdlib's and the runtime's -- are
+/// called natively through thunks built for their lowered signature, and
+/// native code calls interpreted functions through callback thunks
+final class Interpreter {
+
+    let module: Module
+    let layout: HostLayout
+    let stack = InterpreterStack(capacity: 16 << 20)
+    private let bridge: InterpreterBridgeRef
+
+    /// What a `call` instruction calls
+    private enum Callee {
+        case unresolved(Function)
+        case interpreted(BytecodeFunction)
+        case native(address: UnsafeMutableRawPointer, thunk: NativeCallThunk)
+    }
+    private var callees: [Callee] = [], calleeIndices: [String: Int] = [:]
+    private var translated: [String: BytecodeFunction] = [:]
+
+    private var nativeTargets: [UnsafeMutableRawPointer] = [], nativeTargetIndices: [String: Int] = [:]
+    private var callThunks: [NativeCallThunk] = [], callThunkIndices: [LLVMTypeRef: Int] = [:]
+
+    private var callbacks: [String: UnsafeMutableRawPointer] = [:]
+    /// The interpreted function each callback thunk calls, so applying
+    /// one doesn't leave the interpreter
+    private var callbackFunctions: [UnsafeMutableRawPointer: Function] = [:]
+    private var callbackContexts: [CallbackContext] = []
+    /// An error thrown by an interpreted function native code called,
+    /// rethrown when the native call returns
+    private var pendingError: Error? = nil
+
+    private var metadataCache: [String: UnsafeMutableRawPointer] = [:], conformanceCache: [String: UnsafeMutableRawPointer] = [:]
+    private var globals: [String: UnsafeMutableRawPointer] = [:], strings: [String: UnsafeMutableRawPointer] = [:]
+    private var ownedMemory: [(memory: UnsafeMutableRawPointer, bytes: Int)] = []
+
+    /// The argument addresses passed to a call thunk
+    private var argumentBuffer: UnsafeMutablePointer<UnsafeMutableRawPointer?>
+    private var argumentCapacity = 16
+
+    /// - parameter libraries: dylibs native functions are found in
+    /// - parameter shims: bitcode whose functions are compiled and called natively
+    init(module: Module, libraries: [String], shims: LLVMModule? = nil) throws {
+        self.module = module
+        self.layout = try HostLayout(module: module)
+
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        for library in libraries {
+            guard loadJITLibrary(library, &errorMessage) else {
+                throw bridgeError(errorMessage)
+            }
+        }
+        guard let bridge = createInterpreterBridge(&errorMessage) else {
+            throw bridgeError(errorMessage)
+        }
+        self.bridge = bridge
+        self.argumentBuffer = UnsafeMutablePointer.allocate(capacity: 16)
+        
+        if let shims = try shims?.getModule() {
+            guard addNativeModule(bridge, shims, &errorMessage) else {
+                throw bridgeError(errorMessage)
+            }
+        }
+    }
+
+    deinit {
+        disposeInterpreterBridge(bridge)
+        argumentBuffer.deallocate(capacity: argumentCapacity)
+        for (memory, bytes) in ownedMemory {
+            memory.deallocate(bytes: bytes, alignedTo: 16)
+        }
+    }
+
+    /// Runs the module's `main`
+    /// - parameter outputFD: if not -1, stdout is written here while main runs
+    func run(outputFD: Int32 = -1) throws {
+        guard let main = module.function(named: "main"), main.hasBody else {
+            throw error(InterpreterError.unresolvedFunction("main"))
+        }
+        let function = try bytecode(for: main)
+
+        let savedFD = outputFD == -1 ? -1 : redirectStdout(outputFD)
+        defer {
+            // the runtime buffers output, compiled programs write it at exit
+            if let flush = try? nativeFunction(named: "vist_outputFlush", type: .functionType(params: [], returns: .void)) {
+                callThunks[flush.thunk](nativeTargets[flush.target], argumentBuffer, nil)
+            }
+            if savedFD != -1 { restoreStdout(savedFD) }
+        }
+        try enter(function, result: nil) { _ in }
+    }
+}
+
+
+// MARK: Calls
+
+extension Interpreter {
+
+    /// The bytecode of `function`, translated on first use
+    func bytecode(for function: Function) throws -> BytecodeFunction {
+        if let translated = translated[function.name] { return translated }
+        var translator = BytecodeTranslator(function: function, interpreter: self)
+        let bytecode = try translator.translate()
+        translated[function.name] = bytecode
+        return bytecode
+    }
+
+    /// Runs `function` in a new frame
+    /// - parameter copyArguments: initialises the params, given the frame's base
+    private func enter(_ function: BytecodeFunction, result: UnsafeMutableRawPointer?,
+                       arguments copyArguments: (UnsafeMutableRawPointer) -> ()) throws {
+        let top = stack.top
+        defer { stack.top = top }
+        let base = function.enter(memory: try stack.allocate(bytes: function.allocationSize))
+        copyArguments(base)
+        try function.execute(in: Frame(base: base, result: result, function: function, interpreter: self))
+    }
+
+    /// The index `call` instructions use to call `function`, it is resolved
+    /// when first called
+    func calleeIndex(of function: Function) -> Int32 {
+        if let index = calleeIndices[function.name] { return Int32(index) }
+        callees.append(.unresolved(function))
+        calleeIndices[function.name] = callees.count - 1
+        return Int32(callees.count - 1)
+    }
+
+    private func resolve(_ function: Function) throws -> Callee {
+        if function.hasBody {
+            return .interpreted(try bytecode(for: function))
+        }
+        let thunk = try callThunkIndex(for: function.type.lowered(module: module))
+        return .native(address: try nativeSymbol(named: function.name), thunk: callThunks[Int(thunk)])
+    }
+
+    /// Calls the callee at `index` with the arguments in the slots `arguments`
+    func call(calleeAt index: Int, arguments: UnsafeBufferPointer<Int32>,
+              base: UnsafeMutableRawPointer, result: UnsafeMutableRawPointer) throws {
+        switch callees[index] {
+        case .interpreted(let function):
+            try enter(function, result: result) { frame in
+                for (param, argument) in zip(function.params, arguments) {
+                    (frame + param.offset).copyBytes(from: base + Int(argument), count: param.size)
+                }
+            }
+        case .native(let address, let thunk):
+            try callNative(address, thunk: thunk, arguments: arguments, base: base, result: result)
+        case .unresolved(let function):
+            callees[index] = try resolve(function)
+            try call(calleeAt: index, arguments: arguments, base: base, result: result)
+        }
+    }
+
+    /// Calls a function pointer, interpreted functions' callback thunks are
+    /// run directly
+    func apply(_ pointer: UnsafeMutableRawPointer, thunkAt index: Int, arguments: UnsafeBufferPointer<Int32>,
+               base: UnsafeMutableRawPointer, result: UnsafeMutableRawPointer) throws {
+        guard let function = callbackFunctions[pointer] else {
+            return try callNative(pointer, thunk: callThunks[index], arguments: arguments, base: base, result: result)
+        }
+        let bytecode = try self.bytecode(for: function)
+        try enter(bytecode, result: result) { frame in
+            for (param, argument) in zip(bytecode.params, arguments) {
+                (frame + param.offset).copyBytes(from: base + Int(argument), count: param.size)
+            }
+        }
+    }
+
+    /// Calls the native function at `index`, as found by `nativeFunction(named:type:)`
+    func callNative(targetAt index: Int, thunkAt thunk: Int, arguments: UnsafeBufferPointer<Int32>,
+                    base: UnsafeMutableRawPointer, result: UnsafeMutableRawPointer) throws {
+        try callNative(nativeTargets[index], thunk: callThunks[thunk], arguments: arguments, base: base, result: result)
+    }
+
+    private func callNative(_ address: UnsafeMutableRawPointer, thunk: NativeCallThunk, arguments: UnsafeBufferPointer<Int32>,
+                            base: UnsafeMutableRawPointer, result: UnsafeMutableRawPointer?) throws {
+        if arguments.count > argumentCapacity {
+            argumentBuffer.deallocate(capacity: argumentCapacity)
+            argumentCapacity = arguments.count
+            argumentBuffer = UnsafeMutablePointer.allocate(capacity: argumentCapacity)
+        }
+        for (index, argument) in arguments.enumerated() {
+            argumentBuffer[index] = base + Int(argument)
+        }
+        thunk(address, argumentBuffer, result)
+
+        if let error = pendingError {
+            pendingError = nil
+            throw error
+        }
+    }
+
+    /// Native code calling into the interpreter through a callback thunk
+    fileprivate func callBack(_ function: Function, arguments: UnsafePointer<UnsafeMutableRawPointer?>,
+                              result: UnsafeMutableRawPointer?) {
+        // once something has thrown, unwind back to the interpreter
+        guard pendingError == nil else { return }
+        do {
+            let bytecode = try self.bytecode(for: function)
+            try enter(bytecode, result: result) { frame in
+                for (index, param) in bytecode.params.enumerated() {
+                    (frame + param.offset).copyBytes(from: arguments[index]!, count: param.size)
+                }
+            }
+        }
+        catch {
+            pendingError = error
+        }
+    }
+}
+
+
+// MARK: Native code
+
+extension Interpreter {
+
+    private func nativeSymbol(named name: String) throws -> UnsafeMutableRawPointer {
+        guard let address = findNativeSymbol(bridge, name) else {
+            throw error(InterpreterError.unresolvedFunction(name))
+        }
+        return address
+    }
+
+    /// The index of the thunk which calls native functions of the lowered `type`
+    func callThunkIndex(for type: LLVMType) throws -> Int32 {
+        if let index = callThunkIndices[type.type!] { return Int32(index) }
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let thunk = getNativeCallThunk(bridge, type.type!, &errorMessage) else {
+            throw bridgeError(errorMessage)
+        }
+        callThunks.append(thunk)
+        callThunkIndices[type.type!] = callThunks.count - 1
+        return Int32(callThunks.count - 1)
+    }
+
+    /// The indices `nativeCall` instructions use to call the C function `name`
+    func nativeFunction(named name: String, type: LLVMType) throws -> (target: Int, thunk: Int) {
+        let thunk = Int(try callThunkIndex(for: type))
+        if let index = nativeTargetIndices[name] { return (index, thunk) }
+        nativeTargets.append(try nativeSymbol(named: name))
+        nativeTargetIndices[name] = nativeTargets.count - 1
+        return (nativeTargets.count - 1, thunk)
+    }
+
+    /// The indices `nativeCall` instructions use to call a runtime function
+    func runtimeFunction(_ function: Runtime.Function) throws -> (target: Int, thunk: Int) {
+        let type = function.type.importedType(in: module) as! FunctionType
+        return try nativeFunction(named: function.name, type: type.lowered(module: module))
+    }
+
+    /// A pointer to `function` which native code can call. Functions with a
+    /// body are called through a callback thunk into the interpreter
+    func address(of function: Function) throws -> UnsafeMutableRawPointer {
+        if let thunk = callbacks[function.name] { return thunk }
+        guard function.hasBody else { return try nativeSymbol(named: function.name) }
+
+        let context = CallbackContext(interpreter: self, function: function)
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let thunk = createCallbackThunk(bridge, function.type.lowered(module: module).type!, interpreterCallback,
+                                              Unmanaged.passUnretained(context).toOpaque(), &errorMessage) else {
+            throw bridgeError(errorMessage)
+        }
+        callbackContexts.append(context)
+        callbacks[function.name] = thunk
+        callbackFunctions[thunk] = function
+        return thunk
+    }
+}
+
+
+// MARK: Memory
+
+extension Interpreter {
+
+    /// Zeroed memory, freed with the interpreter if `owned`
+    private func allocate(bytes: Int, owned: Bool = true) -> UnsafeMutableRawPointer {
+        let size = max(bytes, 1)
+        let memory = UnsafeMutableRawPointer.allocate(bytes: size, alignedTo: 16)
+        memory.initializeMemory(as: UInt8.self, at: 0, count: size, to: 0)
+        if owned { ownedMemory.append((memory, size)) }
+        return memory
+    }
+
+    /// The storage of the global `name`
+    func global(named name: String, type: Type) -> UnsafeMutableRawPointer {
+        if let global = globals[name] { return global }
+        let memory = allocate(bytes: layout.size(of: type))
+        globals[name] = memory
+        return memory
+    }
+
+    /// A NUL terminated copy of `string`
+    func string(_ string: String, owned: Bool = true) -> UnsafeMutableRawPointer {
+        if let cached = strings[string] { return cached }
+        let utf8 = string.utf8CString
+        let memory = allocate(bytes: utf8.count, owned: owned)
+        utf8.withUnsafeBufferPointer { buffer in
+            memory.copyBytes(from: buffer.baseAddress!, count: buffer.count)
+        }
+        strings[string] = memory
+        return memory
+    }
+
+    private func storePointers(_ pointers: [UnsafeMutableRawPointer]) -> UnsafeMutableRawPointer {
+        let memory = allocate(bytes: pointers.count * MemoryLayout<UnsafeMutableRawPointer>.stride, owned: false)
+        for (index, pointer) in pointers.enumerated() {
+            memory.storeBytes(of: pointer, toByteOffset: index * MemoryLayout<UnsafeMutableRawPointer>.stride, as: UnsafeMutableRawPointer.self)
+        }
+        return memory
+    }
+
+    /// The runtime metadata of `type`, laid out as `Runtime.typeMetadataType`.
+    ///
+    /// The runtime caches conformances by metadata address, and the runtime
+    /// outlives the interpreter, so metadata is never freed; otherwise a later
+    /// run could reuse an address the cache still holds
+    func metadata(for type: NominalType) throws -> UnsafeMutableRawPointer {
+        if let cached = metadataCache[type.name] { return cached }
+
+        let metadataType = Runtime.typeMetadataType.lowered(module: module).type!
+        let memory = allocate(bytes: layout.size(of: metadataType), owned: false)
+        // cached before building the conformances, which point back to it
+        metadataCache[type.name] = memory
+        let fields = layout.elements(of: metadataType)
+
+        let conformances: [UnsafeMutableRawPointer]
+        if let concrete = type.getConcreteNominalType(), !concrete.isConceptType(), !concrete.isRuntimeType() {
+            conformances = try type.concepts.map { try conformance(of: type, to: $0) }
+        }
+        else {
+            conformances = []
+        }
+        let moduleType = module.type(named: type.name)
+
+        memory.storeBytes(of: storePointers(conformances), toByteOffset: fields[0].offset, as: UnsafeMutableRawPointer.self)
+        memory.storeBytes(of: Int32(conformances.count), toByteOffset: fields[1].offset, as: Int32.self)
+        memory.storeBytes(of: Int32(layout.size(of: type.instanceRawType(module: module).type!)), toByteOffset: fields[3].offset, as: Int32.self)
+        memory.storeBytes(of: string(type.name, owned: false), toByteOffset: fields[4].offset, as: UnsafeMutableRawPointer.self)
+        memory.storeBytes(of: type.isHeapAllocated ? 1 : 0, toByteOffset: fields[5].offset, as: UInt8.self)
+        let destructor = try moduleType?.destructor.map { try address(of: $0) }
+        let deinitialiser = try moduleType?.deinitialiser.map { try address(of: $0) }
+        let copyConstructor = try moduleType?.copyConstructor.map { try address(of: $0) }
+        memory.storeBytes(of: destructor, toByteOffset: fields[6].offset, as: UnsafeMutableRawPointer?.self)
+        memory.storeBytes(of: deinitialiser, toByteOffset: fields[7].offset, as: UnsafeMutableRawPointer?.self)
+        memory.storeBytes(of: copyConstructor, toByteOffset: fields[8].offset, as: UnsafeMutableRawPointer?.self)
+        return memory
+    }
+
+    /// The witness table of `type`'s conformance to `concept`, laid out as
+    /// `Runtime.witnessTableType`
+    func conformance(of type: NominalType, to concept: ConceptType) throws -> UnsafeMutableRawPointer {
+        let key = "\(type.name).\(concept.name)"
+        if let cached = conformanceCache[key] { return cached }
+
+        let tableType = Runtime.witnessTableType.lowered(module: module).type!
+        let memory = allocate(bytes: layout.size(of: tableType), owned: false)
+        conformanceCache[key] = memory
+        let fields = layout.elements(of: tableType)
+
+        let conformingType = type.lowered(module: module).type!
+        let offsets = try concept.requiredProperties.map { property -> Int32 in
+            let index = try type.index(ofMemberNamed: property.name)
+            return Int32(layout.offset(ofElement: index, in: conformingType))
+        }
+        let offsetsMemory = allocate(bytes: offsets.count * MemoryLayout<Int32>.stride, owned: false)
+        for (index, offset) in offsets.enumerated() {
+            offsetsMemory.storeBytes(of: offset, toByteOffset: index * MemoryLayout<Int32>.stride, as: Int32.self)
+        }
+
+        let witnesses: [UnsafeMutableRawPointer]
+        if let table = module.witnessTables.first(where: { $0.concept.name == concept.name && $0.type.name == type.name }) {
+            witnesses = try concept.requiredFunctions.map { method in
+                try address(of: table.getWitnessFunction(name: method.name, module: module))
+            }
+        }
+        else {
+            witnesses = []
+        }
+
+        memory.storeBytes(of: try metadata(for: concept), toByteOffset: fields[0].offset, as: UnsafeMutableRawPointer.self)
+        memory.storeBytes(of: offsetsMemory, toByteOffset: fields[2].offset, as: UnsafeMutableRawPointer.self)
+        memory.storeBytes(of: Int32(offsets.count), toByteOffset: fields[3].offset, as: Int32.self)
+        memory.storeBytes(of: storePointers(witnesses), toByteOffset: fields[4].offset, as: UnsafeMutableRawPointer.self)
+        memory.storeBytes(of: Int32(witnesses.count), toByteOffset: fields[5].offset, as: Int32.self)
+        return memory
+    }
+
+    /// A one element array of `type`'s conformance to `concept`, as passed
+    /// to `vist_constructExistential`
+    func conformanceList(of type: NominalType, to concept: ConceptType) throws -> UnsafeMutableRawPointer {
+        let key = "\(type.name).\(concept.name).list"
+        if let cached = conformanceCache[key] { return cached }
+        let list = storePointers([try conformance(of: type, to: concept)])
+        conformanceCache[key] = list
+        return list
+    }
+}
@@ -0,0 +1,67 @@
+//
+//  Layout.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// The size and offsets of VIR types on the host. These are taken from the
+/// lowered LLVM types, so values in the interpreter are laid out exactly as
+/// they are in compiled code, and memory can be passed straight to the
+/// runtime and stdlib
+final class HostLayout {
+
+    private let targetData: LLVMTargetDataRef
+    unowned let module: Module
+
+    init(module: Module) throws {
+        self.module = module
+        let host = LLVMModule(name: "vist.interpreter.layout")
+        try host.setHostTarget(cpu: nil)
+        targetData = LLVMCreateTargetData(host.dataLayout)
+        LLVMDisposeModule(host.module)
+    }
+
+    deinit {
+        LLVMDisposeTargetData(targetData)
+    }
+
+    /// The lowered type values of `type` are stored as; functions are only
+    /// handled by pointer
+    func storageType(of type: Type) -> LLVMTypeRef {
+        if type.getCannonicalType() is FunctionType {
+            return LLVMType.opaquePointer.type!
+        }
+        return type.lowered(module: module).type!
+    }
+
+    func size(of type: Type) -> Int {
+        return size(of: storageType(of: type))
+    }
+    func alignment(of type: Type) -> Int {
+        return alignment(of: storageType(of: type))
+    }
+    /// - note: unsized types, such as void, take no space
+    func size(of type: LLVMTypeRef) -> Int {
+        guard LLVMTypeIsSized(type) != 0 else { return 0 }
+        return Int(LLVMABISizeOfType(targetData, type))
+    }
+    func alignment(of type: LLVMTypeRef) -> Int {
+        guard LLVMTypeIsSized(type) != 0 else { return 1 }
+        return Int(LLVMABIAlignmentOfType(targetData, type))
+    }
+
+    /// The offset of element `index` of the struct `type`
+    func offset(ofElement index: Int, in type: LLVMTypeRef) -> Int {
+        return Int(LLVMOffsetOfElement(targetData, type, UInt32(index)))
+    }
+
+    /// The offset and size of each element of the struct `type`
+    func elements(of type: LLVMTypeRef) -> [(offset: Int, size: Int)] {
+        let count = Int(LLVMCountStructElementTypes(type))
+        return (0..<count).map { index in
+            (offset(ofElement: index, in: type), size(of: LLVMStructGetTypeAtIndex(type, UInt32(index))))
+        }
+    }
+}
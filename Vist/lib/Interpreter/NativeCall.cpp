@@ -0,0 +1,286 @@
+//
+//  NativeCall.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include "NativeCall.hpp"
+#include "Backend.hpp"
+
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <map>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+/// Compiles the thunks the interpreter crosses into native code, and native
+/// code calls back into the interpreter, with. The thunks are built from the
+/// lowered function types so arguments are passed exactly as compiled Vist
+/// code passes them
+class InterpreterBridge {
+    std::unique_ptr<TargetMachine> targetMachine;
+    const DataLayout dataLayout;
+    orc::ObjectLinkingLayer<> objectLayer;
+    orc::IRCompileLayer<orc::ObjectLinkingLayer<>> compileLayer;
+
+    /// The compiled modules, the compile layer holds them unowned
+    std::vector<std::unique_ptr<Module>> modules;
+    /// Call thunks by the type of function they call, LLVM types are uniqued
+    std::map<FunctionType *, NativeCallThunk> callThunks;
+    unsigned thunkCount = 0;
+
+    std::string mangle(StringRef name) {
+        std::string mangled;
+        raw_string_ostream stream(mangled);
+        Mangler::getNameWithPrefix(stream, name, dataLayout);
+        return stream.str();
+    }
+
+    /// Binds the symbols compiled modules reference to the process, which
+    /// includes anything loaded by `loadJITLibrary`
+    std::unique_ptr<RuntimeDyld::SymbolResolver> processResolver() {
+        return orc::createLambdaResolver(
+            [](const std::string &name) {
+                return RuntimeDyld::SymbolInfo(nullptr);
+            },
+            [](const std::string &name) {
+                if (auto address = RTDyldMemoryManager::getSymbolAddressInProcess(name))
+                    return RuntimeDyld::SymbolInfo(address, JITSymbolFlags::Exported);
+                return RuntimeDyld::SymbolInfo(nullptr);
+            });
+    }
+
+    /// Creates an empty module for the host, in the context of `type`
+    Module *_Nonnull createModule(Type *_Nonnull type) {
+        auto name = "vist.interpreter.thunk." + std::to_string(thunkCount);
+        modules.push_back(make_unique<Module>(name, type->getContext()));
+        auto module = modules.back().get();
+        module->setTargetTriple(targetMachine->getTargetTriple().getTriple());
+        module->setDataLayout(dataLayout);
+        return module;
+    }
+
+    /// Compiles the module holding `function`, and returns its address
+    void *_Nullable compile(Module *_Nonnull module, Function *_Nonnull function, std::string &error) {
+        auto name = function->getName().str();
+        std::vector<Module *> moduleSet = { module };
+        compileLayer.addModuleSet(std::move(moduleSet),
+                                  make_unique<SectionMemoryManager>(),
+                                  processResolver());
+
+        auto symbol = compileLayer.findSymbol(mangle(name), true);
+        if (!symbol) {
+            error = "could not compile thunk '" + name + "'";
+            return nullptr;
+        }
+        return reinterpret_cast<void *>(static_cast<uintptr_t>(symbol.getAddress()));
+    }
+
+public:
+    InterpreterBridge(std::unique_ptr<TargetMachine> machine)
+        : targetMachine(std::move(machine)),
+          dataLayout(targetMachine->createDataLayout()),
+          compileLayer(objectLayer, orc::SimpleCompiler(*targetMachine)) {}
+
+    /// Compiles all of `module`, reading it in first if it was loaded lazily
+    bool addModule(std::unique_ptr<Module> module, std::string &error) {
+        if (auto readError = module->materializeAll()) {
+            error = "could not read module '" + module->getName().str() + "': " + readError.message();
+            return false;
+        }
+        module->setTargetTriple(targetMachine->getTargetTriple().getTriple());
+        module->setDataLayout(dataLayout);
+        
+        std::vector<Module *> moduleSet = { module.get() };
+        compileLayer.addModuleSet(std::move(moduleSet),
+                                  make_unique<SectionMemoryManager>(),
+                                  processResolver());
+        modules.push_back(std::move(module));
+        return true;
+    }
+    
+    /// The address of `name` if it is defined in an added module
+    void *_Nullable findSymbol(StringRef name) {
+        if (auto symbol = compileLayer.findSymbol(mangle(name), true))
+            return reinterpret_cast<void *>(static_cast<uintptr_t>(symbol.getAddress()));
+        return nullptr;
+    }
+
+    /// Builds `void (i8* function, i8** args, i8* result)`, which loads each
+    /// argument of `type` from `args`, and stores the call's result in `result`
+    NativeCallThunk _Nullable getCallThunk(FunctionType *_Nonnull type, std::string &error) {
+        auto cached = callThunks.find(type);
+        if (cached != callThunks.end())
+            return cached->second;
+
+        auto module = createModule(type);
+        auto &context = module->getContext();
+        auto bytePtr = Type::getInt8PtrTy(context);
+        auto thunkType = FunctionType::get(Type::getVoidTy(context),
+                                           { bytePtr, bytePtr->getPointerTo(), bytePtr }, false);
+        auto thunk = Function::Create(thunkType, GlobalValue::ExternalLinkage,
+                                      "vist.interpreter.call." + std::to_string(thunkCount++), module);
+
+        auto params = thunk->arg_begin();
+        Value *function = &*params++, *args = &*params++, *result = &*params;
+
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", thunk));
+        std::vector<Value *> values;
+        for (unsigned i = 0; i < type->getNumParams(); ++i) {
+            auto paramType = type->getParamType(i);
+            auto address = builder.CreateLoad(builder.CreateConstGEP1_32(args, i));
+            values.push_back(builder.CreateLoad(builder.CreateBitCast(address, paramType->getPointerTo())));
+        }
+        auto call = builder.CreateCall(builder.CreateBitCast(function, type->getPointerTo()), values);
+        if (!type->getReturnType()->isVoidTy())
+            builder.CreateStore(call, builder.CreateBitCast(result, type->getReturnType()->getPointerTo()));
+        builder.CreateRetVoid();
+
+        auto address = compile(module, thunk, error);
+        if (!address)
+            return nullptr;
+        auto callThunk = reinterpret_cast<NativeCallThunk>(address);
+        callThunks[type] = callThunk;
+        return callThunk;
+    }
+
+    /// Builds a function of `type` which stores its arguments to the stack, and
+    /// calls `callback` with `context`, their addresses, and the memory to
+    /// return the result from
+    void *_Nullable createCallbackThunk(FunctionType *_Nonnull type, InterpreterCallback _Nonnull callback,
+                                        void *_Nullable context, std::string &error) {
+        auto module = createModule(type);
+        auto &llvmContext = module->getContext();
+        auto bytePtr = Type::getInt8PtrTy(llvmContext);
+        auto intPtr = dataLayout.getIntPtrType(llvmContext);
+        auto callbackType = FunctionType::get(Type::getVoidTy(llvmContext),
+                                              { bytePtr, bytePtr->getPointerTo(), bytePtr }, false);
+        auto thunk = Function::Create(type, GlobalValue::ExternalLinkage,
+                                      "vist.interpreter.callback." + std::to_string(thunkCount++), module);
+
+        IRBuilder<> builder(BasicBlock::Create(llvmContext, "entry", thunk));
+        auto numParams = type->getNumParams();
+        auto args = builder.CreateAlloca(bytePtr, builder.getInt32(numParams == 0 ? 1 : numParams));
+        unsigned index = 0;
+        for (auto &param : thunk->args()) {
+            auto memory = builder.CreateAlloca(param.getType());
+            builder.CreateStore(&param, memory);
+            builder.CreateStore(builder.CreateBitCast(memory, bytePtr), builder.CreateConstGEP1_32(args, index++));
+        }
+
+        auto returnType = type->getReturnType();
+        Value *result = returnType->isVoidTy() ? nullptr : builder.CreateAlloca(returnType);
+
+        auto callbackAddress = ConstantInt::get(intPtr, reinterpret_cast<uintptr_t>(callback));
+        auto contextAddress = ConstantInt::get(intPtr, reinterpret_cast<uintptr_t>(context));
+        builder.CreateCall(ConstantExpr::getIntToPtr(callbackAddress, callbackType->getPointerTo()), {
+            ConstantExpr::getIntToPtr(contextAddress, bytePtr),
+            args,
+            result ? builder.CreateBitCast(result, bytePtr) : ConstantPointerNull::get(bytePtr),
+        });
+
+        if (result)
+            builder.CreateRet(builder.CreateLoad(result));
+        else
+            builder.CreateRetVoid();
+
+        return compile(module, thunk, error);
+    }
+};
+
+InterpreterBridgeRef _Nullable createInterpreterBridge(char *_Nullable *_Nonnull errorMessage) {
+    // the process and anything loaded by `loadJITLibrary` are searched
+    // for native functions
+    sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+    std::string error;
+    auto targetMachine = createTargetMachine("", sys::getHostCPUName(), error);
+    if (!targetMachine) {
+        *errorMessage = strdup(error.c_str());
+        return nullptr;
+    }
+    *errorMessage = nullptr;
+    return reinterpret_cast<InterpreterBridgeRef>(new InterpreterBridge(std::move(targetMachine)));
+}
+
+void disposeInterpreterBridge(InterpreterBridgeRef _Nonnull bridge) {
+    delete reinterpret_cast<InterpreterBridge *>(bridge);
+}
+
+NativeCallThunk _Nullable getNativeCallThunk(InterpreterBridgeRef _Nonnull bridge,
+                                             LLVMTypeRef _Nonnull functionType,
+                                             char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    auto type = cast<FunctionType>(unwrap(functionType));
+    if (auto thunk = reinterpret_cast<InterpreterBridge *>(bridge)->getCallThunk(type, error)) {
+        *errorMessage = nullptr;
+        return thunk;
+    }
+    *errorMessage = strdup(error.c_str());
+    return nullptr;
+}
+
+void *_Nullable createCallbackThunk(InterpreterBridgeRef _Nonnull bridge,
+                                    LLVMTypeRef _Nonnull functionType,
+                                    InterpreterCallback _Nonnull callback,
+                                    void *_Nullable context,
+                                    char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    auto type = cast<FunctionType>(unwrap(functionType));
+    if (auto thunk = reinterpret_cast<InterpreterBridge *>(bridge)->createCallbackThunk(type, callback, context, error)) {
+        *errorMessage = nullptr;
+        return thunk;
+    }
+    *errorMessage = strdup(error.c_str());
+    return nullptr;
+}
+
+bool addNativeModule(InterpreterBridgeRef _Nonnull bridge, LLVMModuleRef _Nonnull module,
+                     char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    if (reinterpret_cast<InterpreterBridge *>(bridge)->addModule(std::unique_ptr<Module>(unwrap(module)), error)) {
+        *errorMessage = nullptr;
+        return true;
+    }
+    *errorMessage = strdup(error.c_str());
+    return false;
+}
+
+void *_Nullable findNativeSymbol(InterpreterBridgeRef _Nonnull bridge, const char *_Nonnull name) {
+    if (auto address = reinterpret_cast<InterpreterBridge *>(bridge)->findSymbol(name))
+        return address;
+    return sys::DynamicLibrary::SearchForAddressOfSymbol(name);
+}
+
+int redirectStdout(int fd) {
+    fflush(stdout);
+    auto savedFD = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    return savedFD;
+}
+
+void restoreStdout(int savedFD) {
+    fflush(stdout);
+    dup2(savedFD, STDOUT_FILENO);
+    close(savedFD);
+}
@@ -0,0 +1,72 @@
+//
+//  NativeCall.hpp
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#ifndef NativeCall_hpp
+#define NativeCall_hpp
+
+#include "LLVM.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct OpaqueInterpreterBridge *InterpreterBridgeRef;
+
+    /// Calls `function`, loading each argument from the memory `args` points to and
+    /// storing any result into `result`. The values have the same layout as in
+    /// compiled code, so the call is made with the convention the stdlib uses
+    typedef void (*NativeCallThunk)(void *_Nonnull function, void *_Nullable const *_Nonnull args,
+                                    void *_Nullable result);
+    /// Called by a callback thunk with the context it was made with, the addresses
+    /// of the thunk's arguments, and the memory the thunk returns from
+    typedef void (*InterpreterCallback)(void *_Nullable context, void *_Nullable const *_Nonnull args,
+                                        void *_Nullable result);
+
+    /// Creates the host JIT which compiles the interpreter's thunks
+    /// \returns the bridge, or null and sets `errorMessage` to a message which
+    ///          must be freed with `LLVMDisposeMessage`
+    InterpreterBridgeRef _Nullable createInterpreterBridge(char *_Nullable *_Nonnull errorMessage);
+    /// Frees the bridge's thunks, none may be called after this
+    void disposeInterpreterBridge(InterpreterBridgeRef _Nonnull bridge);
+
+    /// Gets the thunk which calls native functions of `functionType`, thunks are
+    /// shared by every function of the same type
+    /// \returns the thunk, or null and sets `errorMessage`
+    NativeCallThunk _Nullable getNativeCallThunk(InterpreterBridgeRef _Nonnull bridge,
+                                                 LLVMTypeRef _Nonnull functionType,
+                                                 char *_Nullable *_Nonnull errorMessage);
+    /// Compiles a function of `functionType` which calls `callback` with `context`,
+    /// so native code can call into the interpreter through a function pointer
+    /// \returns the thunk's address, or null and sets `errorMessage`
+    void *_Nullable createCallbackThunk(InterpreterBridgeRef _Nonnull bridge,
+                                        LLVMTypeRef _Nonnull functionType,
+                                        InterpreterCallback _Nonnull callback,
+                                        void *_Nullable context,
+                                        char *_Nullable *_Nonnull errorMessage);
+
+    /// Compiles every function defined in `module`, so they can be found with
+    /// `findNativeSymbol`. The bridge takes ownership of the module
+    /// \returns whether it compiled, if not `errorMessage` is set
+    bool addNativeModule(InterpreterBridgeRef _Nonnull bridge, LLVMModuleRef _Nonnull module,
+                         char *_Nullable *_Nonnull errorMessage);
+
+    /// Looks up `name` in the modules added to `bridge`, then in the process
+    /// and any library loaded with `loadJITLibrary`
+    void *_Nullable findNativeSymbol(InterpreterBridgeRef _Nonnull bridge, const char *_Nonnull name);
+
+    /// Points stdout at `fd`, flushing anything buffered
+    /// \returns the descriptor to pass to `restoreStdout`
+    int redirectStdout(int fd);
+    /// Points stdout back at `savedFD`, as returned by `redirectStdout`
+    void restoreStdout(int savedFD);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NativeCall_hpp */
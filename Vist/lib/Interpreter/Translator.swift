@@ -0,0 +1,696 @@
+//
+//  Translator.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// A copy of `size` bytes between frame slots, moving a break's arg
+/// into its block's param
+private struct Move {
+    let dst: Int32, src: Int32, size: Int
+
+    /// Whether writing this move's destination clobbers `other`'s source
+    func clobbers(_ other: Move) -> Bool {
+        return dst < other.src + Int32(other.size) && other.src < dst + Int32(size)
+    }
+}
+
+private func align(_ value: Int, to alignment: Int) -> Int {
+    return (value + alignment - 1) / alignment * alignment
+}
+
+/// Translates a VIR function to bytecode.
+///
+/// Every value is given a slot in the frame. Values which are a view of
+/// another -- literals, extracts, bitcasts, variables -- share that value's
+/// slot rather than being copied into their own. Blocks are translated in
+/// reverse postorder, so values are defined before they are used, and block
+/// params are passed by moving the break's args into the params' slots
+struct BytecodeTranslator {
+
+    let function: Function
+    unowned let interpreter: Interpreter
+    private let layout: HostLayout
+    private var module: Module { return interpreter.module }
+
+    private var code: [BytecodeInst] = []
+    private var operandPool: [Int32] = []
+    private var slots: [ObjectIdentifier: Int32] = [:]
+    private var frameSize = 0
+
+    /// The constants below the frame's base, deduplicated by width and value
+    private var constants: [(offset: Int32, value: Int64, width: Int32)] = []
+    private var constantOffsets: [String: Int32] = [:]
+    private var constantSize = 0
+
+    /// The index of the first instruction of each block
+    private var blockStarts: [ObjectIdentifier: Int] = [:]
+    /// Branch operands to point at a block once every block is translated
+    private var fixups: [(pc: Int, operand: Int, block: BasicBlock)] = []
+    /// Conditional edges which pass args, these branch to a stub after the
+    /// block which moves the args before jumping to the block
+    private var edgeStubs: [(pc: Int, operand: Int, moves: [Move], block: BasicBlock)] = []
+    /// The block translated after the current one, which a break can fall through to
+    private var nextBlock: BasicBlock? = nil
+
+    init(function: Function, interpreter: Interpreter) {
+        self.function = function
+        self.interpreter = interpreter
+        self.layout = interpreter.layout
+    }
+
+    mutating func translate() throws -> BytecodeFunction {
+        guard let entry = function.entryBlock else {
+            throw error(InterpreterError.unresolvedFunction(function.name))
+        }
+
+        var params: [(offset: Int, size: Int)] = []
+        for param in function.params ?? [] {
+            let size = layout.size(of: param.type!)
+            // void params are not passed
+            guard size > 0 else { continue }
+            params.append((Int(try slot(for: param)), size))
+        }
+
+        let blocks = DominatorTree.reversePostorder(from: entry)
+        for (index, block) in blocks.enumerated() {
+            blockStarts[ObjectIdentifier(block)] = code.count
+            nextBlock = index + 1 < blocks.count ? blocks[index + 1] : nil
+            for inst in block.instructions {
+                try translate(inst)
+            }
+            emitEdgeStubs()
+        }
+        for fixup in fixups {
+            patch(fixup.pc, operand: fixup.operand, to: blockStarts[ObjectIdentifier(fixup.block)]!)
+        }
+
+        let constantsSize = align(constantSize, to: 16)
+        var image = [UInt8](repeating: 0, count: constantsSize)
+        image.withUnsafeMutableBytes { bytes in
+            for constant in constants {
+                (bytes.baseAddress! + constantsSize + Int(constant.offset)).storeInt(constant.value, width: constant.width)
+            }
+        }
+
+        return BytecodeFunction(function: function,
+                                code: code,
+                                constants: image,
+                                frameSize: align(frameSize, to: 16),
+                                params: params,
+                                operandPool: operandPool)
+    }
+}
+
+
+// MARK: Slots
+
+private extension BytecodeTranslator {
+
+    /// Reserves `size` bytes of the frame
+    mutating func allocate(size: Int, alignment: Int) -> Int32 {
+        frameSize = align(frameSize, to: max(alignment, 1))
+        defer { frameSize += size }
+        return Int32(frameSize)
+    }
+    mutating func allocate(_ type: Type) -> Int32 {
+        return allocate(size: layout.size(of: type), alignment: layout.alignment(of: type))
+    }
+    mutating func allocatePointer() -> Int32 {
+        let size = MemoryLayout<UnsafeMutableRawPointer>.size
+        return allocate(size: size, alignment: size)
+    }
+
+    /// The slot holding `value`; globals and functions are pointer constants
+    mutating func slot(for value: Value) throws -> Int32 {
+        if let slot = slots[ObjectIdentifier(value)] { return slot }
+
+        let slot: Int32
+        switch value {
+        case let global as GlobalValue:
+            slot = constant(pointer: interpreter.global(named: global.globalName, type: global.globalType))
+        case let ref as FunctionRef:
+            slot = constant(pointer: try interpreter.address(of: ref.function))
+        case let lValue as OpaqueLValue:
+            slot = try self.slot(for: lValue.value)
+        default:
+            slot = value.type.map { allocate($0) } ?? allocate(size: 0, alignment: 1)
+        }
+        slots[ObjectIdentifier(value)] = slot
+        return slot
+    }
+    mutating func slot(of operand: Operand) throws -> Int32 {
+        return try slot(for: operand.value!)
+    }
+
+    /// Gives `value` the slot `slot`. If a use was translated first and it
+    /// already has one, `slot` is copied into it
+    mutating func alias(_ value: Value, to slot: Int32) {
+        if let existing = slots[ObjectIdentifier(value)] {
+            emitCopy(dst: existing, src: slot, size: layout.size(of: value.type!))
+        }
+        else {
+            slots[ObjectIdentifier(value)] = slot
+        }
+    }
+
+    /// A slot below the frame's base holding `value`
+    mutating func constant(_ value: Int64, width: Int) -> Int32 {
+        let key = "\(width):\(value)"
+        if let offset = constantOffsets[key] { return offset }
+        let width = max(width, 1)
+        constantSize = align(constantSize + width, to: width)
+        let offset = Int32(-constantSize)
+        constants.append((offset, value, Int32(width)))
+        constantOffsets[key] = offset
+        return offset
+    }
+    mutating func constant(pointer: UnsafeMutableRawPointer) -> Int32 {
+        return constant(Int64(Int(bitPattern: pointer)), width: MemoryLayout<UnsafeMutableRawPointer>.size)
+    }
+
+    /// A slot holding the address of the frame memory at `slot`
+    mutating func address(of slot: Int32) -> Int32 {
+        let pointer = allocatePointer()
+        emit(Op.slotAddress, pointer, slot)
+        return pointer
+    }
+    /// Copies `operand` into new frame memory
+    /// - returns: a slot holding the memory's address
+    mutating func temporaryCopy(of operand: Operand) throws -> Int32 {
+        let type = operand.value!.type!
+        let memory = allocate(type)
+        emitCopy(dst: memory, src: try slot(of: operand), size: layout.size(of: type))
+        return address(of: memory)
+    }
+
+    /// The offset of element `index` of the struct or tuple `type`
+    func offset(ofElement index: Int, in type: Type) -> Int {
+        return layout.offset(ofElement: index, in: layout.storageType(of: type))
+    }
+    func size(of operand: Operand) -> Int {
+        return layout.size(of: operand.value!.type!)
+    }
+    /// Whether `type` is an aligned word, which can be moved with the `8` ops
+    func isWord(_ type: Type) -> Bool {
+        return layout.size(of: type) == 8 && layout.alignment(of: type) == 8
+    }
+}
+
+
+// MARK: Emission
+
+private extension BytecodeTranslator {
+
+    mutating func emit(_ handler: @escaping BytecodeHandler, _ a: Int32 = 0, _ b: Int32 = 0, _ c: Int32 = 0, _ d: Int32 = 0) {
+        code.append(BytecodeInst(handler, a, b, c, d))
+    }
+
+    mutating func emitCopy(dst: Int32, src: Int32, size: Int) {
+        guard dst != src, size > 0 else { return }
+        if size == 8, dst % 8 == 0, src % 8 == 0 {
+            emit(Op.copy8, dst, src)
+        }
+        else {
+            emit(Op.copy, dst, src, Int32(size))
+        }
+    }
+
+    /// Adds `slots` to the operand pool
+    /// - returns: the list's index
+    mutating func operandList(_ slots: [Int32]) -> Int32 {
+        let index = Int32(operandPool.count)
+        operandPool.append(Int32(slots.count))
+        operandPool.append(contentsOf: slots)
+        return index
+    }
+    /// The operand list of a call's args; void args are not passed
+    mutating func arguments(_ operands: [Operand]) throws -> Int32 {
+        var slots: [Int32] = []
+        for operand in operands where size(of: operand) > 0 {
+            slots.append(try slot(of: operand))
+        }
+        return operandList(slots)
+    }
+
+    mutating func emitCall(_ function: Function, _ args: [Operand], result: Int32) throws {
+        let list = try arguments(args)
+        emit(Op.call, interpreter.calleeIndex(of: function), list, result)
+    }
+    mutating func emitRuntimeCall(_ function: Runtime.Function, _ args: [Int32], result: Int32 = 0) throws {
+        let native = try interpreter.runtimeFunction(function)
+        let list = operandList(args)
+        emit(Op.nativeCall, Int32(native.target), list, result, Int32(native.thunk))
+    }
+    mutating func emitNativeCall(_ name: String, type: LLVMType, _ args: [Int32], result: Int32 = 0) throws {
+        let native = try interpreter.nativeFunction(named: name, type: type)
+        let list = operandList(args)
+        emit(Op.nativeCall, Int32(native.target), list, result, Int32(native.thunk))
+    }
+}
+
+
+// MARK: Control flow
+
+private extension BytecodeTranslator {
+
+    /// Points operand `operand` of the instruction at `pc` at `target`
+    mutating func patch(_ pc: Int, operand: Int, to target: Int) {
+        switch operand {
+        case 0: code[pc].a = Int32(target)
+        case 1: code[pc].b = Int32(target)
+        case 2: code[pc].c = Int32(target)
+        default: code[pc].d = Int32(target)
+        }
+    }
+
+    /// The moves which pass `call`'s args to its block's params
+    mutating func moves(for call: BlockCall) throws -> [Move] {
+        var moves: [Move] = []
+        for arg in call.args ?? [] {
+            guard let value = arg.value else { continue }
+            let move = Move(dst: try slot(for: arg.param), src: try slot(for: value), size: layout.size(of: arg.param.type!))
+            if move.dst != move.src, move.size > 0 {
+                moves.append(move)
+            }
+        }
+        return moves
+    }
+
+    /// Emits `moves` as if they happen at once; if one would clobber
+    /// another's source, all are moved through temporaries
+    mutating func emitMoves(_ moves: [Move]) {
+        let isClobbering = moves.indices.contains { i in
+            moves.indices.contains { j in i != j && moves[i].clobbers(moves[j]) }
+        }
+        guard isClobbering else {
+            for move in moves {
+                emitCopy(dst: move.dst, src: move.src, size: move.size)
+            }
+            return
+        }
+        let temporaries = moves.map { allocate(size: $0.size, alignment: 16) }
+        for (move, temporary) in zip(moves, temporaries) {
+            emitCopy(dst: temporary, src: move.src, size: move.size)
+        }
+        for (move, temporary) in zip(moves, temporaries) {
+            emitCopy(dst: move.dst, src: temporary, size: move.size)
+        }
+    }
+
+    /// Moves `call`'s args and jumps to its block, or falls through if it is next
+    mutating func emitJump(_ call: BlockCall) throws {
+        emitMoves(try moves(for: call))
+        guard call.block !== nextBlock else { return }
+        fixups.append((code.count, 0, call.block))
+        emit(Op.jump)
+    }
+
+    /// Branches on the bool in `condition`
+    mutating func emitBranch(_ condition: Int32, then thenCall: BlockCall, else elseCall: BlockCall) throws {
+        let pc = code.count
+        emit(Op.branch, condition)
+        try addTarget(thenCall, pc: pc, operand: 1)
+        try addTarget(elseCall, pc: pc, operand: 2)
+    }
+    mutating func addTarget(_ call: BlockCall, pc: Int, operand: Int) throws {
+        let moves = try self.moves(for: call)
+        if moves.isEmpty {
+            fixups.append((pc, operand, call.block))
+        }
+        else {
+            edgeStubs.append((pc, operand, moves, call.block))
+        }
+    }
+    mutating func emitEdgeStubs() {
+        for stub in edgeStubs {
+            patch(stub.pc, operand: stub.operand, to: code.count)
+            emitMoves(stub.moves)
+            fixups.append((code.count, 0, stub.block))
+            emit(Op.jump)
+        }
+        edgeStubs.removeAll()
+    }
+}
+
+
+// MARK: Instructions
+
+private extension BytecodeTranslator {
+
+    mutating func translate(_ inst: Inst) throws {
+        switch inst {
+        case let inst as IntLiteralInst:
+            alias(inst, to: constant(Int64(inst.value), width: layout.size(of: inst.type!)))
+        case let inst as BoolLiteralInst:
+            alias(inst, to: constant(inst.value ? 1 : 0, width: 1))
+        case let inst as StringLiteralInst:
+            alias(inst, to: constant(pointer: interpreter.string(inst.value)))
+
+        case let inst as StructInitInst:
+            try aggregate(inst, elements: inst.args, type: inst.structType)
+        case let inst as TupleCreateInst:
+            try aggregate(inst, elements: inst.elements, type: inst.tupleType)
+        case let inst as ArrayInst:
+            let stride = layout.size(of: inst.arrayType.mem)
+            if inst.values.count == 1 {
+                alias(inst, to: try slot(of: inst.values[0]))
+                break
+            }
+            let array = try slot(for: inst)
+            for (index, value) in inst.values.enumerated() {
+                emitCopy(dst: array + Int32(index * stride), src: try slot(of: value), size: stride)
+            }
+
+        case let inst as StructExtractInst:
+            let index = try inst.structType.index(ofMemberNamed: inst.propertyName)
+            alias(inst, to: try slot(of: inst.object) + Int32(offset(ofElement: index, in: inst.structType)))
+        case let inst as TupleExtractInst:
+            alias(inst, to: try slot(of: inst.tuple) + Int32(offset(ofElement: inst.elementIndex, in: inst.tuple.value!.type!)))
+        case let inst as StructElementPtrInst:
+            let index = try inst.structType.index(ofMemberNamed: inst.propertyName)
+            try elementPointer(inst, object: inst.object, offset: offset(ofElement: index, in: inst.structType))
+        case let inst as TupleElementPtrInst:
+            try elementPointer(inst, object: inst.tuple, offset: offset(ofElement: inst.elementIndex, in: inst.tuple.memType!))
+        case let inst as ClassProjectInstanceInst:
+            emit(Op.load8, try slot(for: inst), try slot(of: inst.object))
+        case let inst as ClassGetRefCountInst:
+            let field = offset(ofElement: 1, in: Runtime.refcountedObjectType)
+            emit(Op.loadField, try slot(for: inst), try slot(of: inst.object), Int32(field), 4)
+
+        case let inst as VariableInst:
+            alias(inst, to: try slot(of: inst.value))
+        case let inst as VariableAddrInst:
+            alias(inst, to: try slot(of: inst.addr))
+        case let inst as BitcastInst:
+            alias(inst, to: try slot(of: inst.address))
+        case let inst as FunctionRefInst:
+            alias(inst, to: try slot(of: inst.function))
+
+        case let inst as AllocInst:
+            emit(Op.slotAddress, try slot(for: inst), allocate(inst.storedType))
+        case let inst as StoreInst:
+            let type = inst.value.value!.type!, address = try slot(of: inst.address), value = try slot(of: inst.value)
+            if isWord(type), value % 8 == 0 { emit(Op.store8, address, value) }
+            else if layout.size(of: type) > 0 { emit(Op.store, address, value, Int32(layout.size(of: type))) }
+        case let inst as LoadInst:
+            let type = inst.type!, result = try slot(for: inst), address = try slot(of: inst.address)
+            if isWord(type), result % 8 == 0 { emit(Op.load8, result, address) }
+            else if layout.size(of: type) > 0 { emit(Op.load, result, address, Int32(layout.size(of: type))) }
+        case is DeallocStackInst:
+            break
+        case let inst as DestroyAddrInst:
+            try destroy(address: try slot(of: inst.addr), type: inst.addr.memType)
+        case let inst as DestroyValInst:
+            try destroy(address: try temporaryCopy(of: inst.val), type: inst.val.value!.type)
+        case let inst as CopyAddrInst:
+            try translate(inst)
+
+        case let inst as AllocObjectInst:
+            let metadata = constant(pointer: try interpreter.metadata(for: inst.refType))
+            try emitRuntimeCall(.allocObject, [metadata], result: try slot(for: inst))
+        case let inst as RetainInst:
+            let object = try slot(of: inst.object)
+            try emitRuntimeCall(.retainObject, [object])
+            alias(inst, to: object)
+        case let inst as ReleaseInst:
+            let object = try slot(of: inst.object)
+            try emitRuntimeCall(.releaseObject, [object])
+            alias(inst, to: object)
+        case let inst as DeallocObjectInst:
+            try emitRuntimeCall(.deallocObject, [try slot(of: inst.object)])
+
+        case let inst as ExistentialConstructInst:
+            try translate(inst)
+        case let inst as ExistentialWitnessInst:
+            guard let index = inst.existentialType.methods.index(where: { $0.name == inst.methodName }) else {
+                throw error(InterpreterError.unsupportedInst(inst.vir))
+            }
+            let existential = try slot(of: inst.existential)
+            try emitRuntimeCall(.getWitnessMethod, [existential, constant(0, width: 4), constant(Int64(index), width: 4)],
+                                result: try slot(for: inst))
+        case let inst as ExistentialProjectPropertyInst:
+            let index = try inst.existentialType.index(ofMemberNamed: inst.propertyName)
+            let existential = try slot(of: inst.existential)
+            try emitRuntimeCall(.getPropertyProjection, [existential, constant(0, width: 4), constant(Int64(index), width: 4)],
+                                result: try slot(for: inst))
+        case let inst as ExistentialProjectInst:
+            let inlineBuffer = offset(ofElement: 4, in: Runtime.existentialObjectType)
+            emit(Op.projectExistential, try slot(for: inst), try slot(of: inst.existential), Int32(inlineBuffer))
+        case let inst as ExistentialExportBufferInst:
+            try emitRuntimeCall(.exportExistentialBuffer, [try slot(of: inst.existential)])
+
+        case let inst as BuiltinInstCall:
+            try translate(inst)
+        case let inst as FunctionCallInst:
+            try emitCall(inst.function, inst.functionArgs, result: try slot(for: inst))
+        case let inst as FunctionApplyInst:
+            let pointer = try slot(of: inst.function), list = try arguments(inst.functionArgs)
+            let thunk = try interpreter.callThunkIndex(for: inst.functionType.lowered(module: module))
+            emit(Op.apply, pointer, list, try slot(for: inst), thunk)
+
+        case let inst as ReturnInst:
+            if (inst.returnValue.value as? TupleCreateInst)?.elements.isEmpty ?? false {
+                emit(Op.retVoid)
+            }
+            else {
+                emit(Op.ret, try slot(of: inst.returnValue), Int32(size(of: inst.returnValue)))
+            }
+        case let inst as BreakInst:
+            try emitJump(inst.call)
+        case let inst as CondBreakInst:
+            try emitBranch(try slot(of: inst.condition), then: inst.thenCall, else: inst.elseCall)
+        case let inst as CheckedCastBreakInst:
+            try translate(inst)
+
+        default:
+            throw error(InterpreterError.unsupportedInst(inst.vir))
+        }
+    }
+
+    /// A struct or tuple of `elements`; if it has one element filling it,
+    /// the struct shares its slot
+    mutating func aggregate(_ inst: Inst, elements: [Operand], type: Type) throws {
+        let size = layout.size(of: type)
+        if elements.count == 1, self.size(of: elements[0]) == size {
+            alias(inst, to: try slot(of: elements[0]))
+            return
+        }
+        let aggregate = try slot(for: inst)
+        for (index, element) in elements.enumerated() {
+            emitCopy(dst: aggregate + Int32(offset(ofElement: index, in: type)), src: try slot(of: element), size: self.size(of: element))
+        }
+    }
+
+    mutating func elementPointer(_ inst: Inst, object: PtrOperand, offset: Int) throws {
+        let pointer = try slot(of: object)
+        if offset == 0 {
+            alias(inst, to: pointer)
+        }
+        else {
+            emit(Op.elementAddress, try slot(for: inst), pointer, Int32(offset))
+        }
+    }
+
+    /// Destroys the value at `address`, as `DestroyAddrInst` is lowered
+    mutating func destroy(address: Int32, type: Type?) throws {
+        switch type {
+        case let type? where type.isConceptType():
+            try emitRuntimeCall(.destroyExistentialBuffer, [address])
+        case let type as NominalType where type.isClassType():
+            try emitRuntimeCall(.releaseObject, [address])
+        case let type as NominalType where type.isStructType():
+            guard case let moduleType as ModuleType = type, let destructor = moduleType.destructor else { return }
+            let list = operandList([address])
+            emit(Op.call, interpreter.calleeIndex(of: destructor), list, 0)
+        default:
+            break
+        }
+    }
+
+    mutating func translate(_ inst: CopyAddrInst) throws {
+        let address = try slot(of: inst.addr), out = try slot(of: inst.outAddr)
+        switch inst.addr.memType {
+        case let type? where type.isConceptType():
+            try emitRuntimeCall(.copyExistentialBuffer, [address, out])
+        case let moduleType as ModuleType where moduleType.isStructType() && moduleType.copyConstructor != nil:
+            let list = operandList([address, out])
+            emit(Op.call, interpreter.calleeIndex(of: moduleType.copyConstructor!), list, 0)
+        default:
+            // a shallow copy, through a temporary
+            guard let type = inst.addr.memType else { return }
+            let size = layout.size(of: type), temporary = allocate(type)
+            emit(Op.load, temporary, address, Int32(size))
+            emit(Op.store, out, temporary, Int32(size))
+        }
+    }
+
+    mutating func translate(_ inst: ExistentialConstructInst) throws {
+        guard let type = inst.value.value?.type?.getBasePointeeType() else {
+            throw error(InterpreterError.unsupportedInst(inst.vir))
+        }
+        let nominal: NominalType = try type.isStructType() ? type.getAsStructType() : type.getAsClassType()
+        // classes pass their shared instance, structs a copy
+        let instance = type.isClassType() ? try slot(of: inst.value) : try temporaryCopy(of: inst.value)
+
+        let result = try slot(for: inst)
+        emit(Op.slotAddress, result, allocate(Runtime.existentialObjectType))
+        try emitConstructExistential(instance: instance, type: nominal, concept: inst.existentialType,
+                                     isLocal: inst.isLocal, out: result)
+    }
+
+    /// Calls `vist_constructExistential` to store `instance` in the existential
+    /// pointed to by `out`
+    mutating func emitConstructExistential(instance: Int32, type: NominalType, concept: ConceptType,
+                                           isLocal: Bool, out: Int32) throws {
+        let conformances = constant(pointer: try interpreter.conformanceList(of: type, to: concept))
+        let metadata = constant(pointer: try interpreter.metadata(for: type))
+        try emitRuntimeCall(.constructExistential, [conformances, constant(1, width: 4), instance,
+                                                    metadata, constant(isLocal ? 0 : 1, width: 1), out])
+    }
+
+    mutating func translate(_ inst: CheckedCastBreakInst) throws {
+        let value = try slot(of: inst.val)
+
+        switch (inst.val.memType?.getConcreteNominalType(), inst.targetType.getConcreteNominalType()) {
+        case (is StructType, is StructType):
+            // the value is already of the target type
+            alias(inst.successVariable, to: value)
+            try emitJump(inst.successCall)
+
+        case (let structType as StructType, let concept as ConceptType):
+            guard structType.models(concept: concept) else {
+                return try emitJump(inst.failCall)
+            }
+            let existential = try slot(for: inst.successVariable)
+            emit(Op.slotAddress, existential, allocate(Runtime.existentialObjectType))
+            try emitConstructExistential(instance: value, type: structType, concept: concept, isLocal: true, out: existential)
+            try emitJump(inst.successCall)
+
+        case (is ConceptType, let structType as StructType):
+            let instance = try slot(for: inst.successVariable), succeeded = allocate(size: 1, alignment: 1)
+            emit(Op.slotAddress, instance, allocate(structType))
+            let metadata = constant(pointer: try interpreter.metadata(for: structType))
+            try emitRuntimeCall(.castExistentialToConcrete, [value, metadata, instance], result: succeeded)
+            try emitBranch(succeeded, then: inst.successCall, else: inst.failCall)
+
+        case (is ConceptType, let concept as ConceptType):
+            let existential = try slot(for: inst.successVariable), succeeded = allocate(size: 1, alignment: 1)
+            emit(Op.slotAddress, existential, allocate(Runtime.existentialObjectType))
+            let metadata = constant(pointer: try interpreter.metadata(for: concept))
+            try emitRuntimeCall(.castExistentialToConcept, [value, metadata, existential], result: succeeded)
+            try emitBranch(succeeded, then: inst.successCall, else: inst.failCall)
+
+        default:
+            throw error(InterpreterError.unsupportedInst(inst.vir))
+        }
+    }
+}
+
+
+// MARK: Builtins
+
+private extension BytecodeTranslator {
+
+    /// The handler of builtins which are a single `op %dst, %lhs, %rhs, width`
+    static func binaryHandler(for inst: BuiltinInst) -> BytecodeHandler? {
+        switch inst {
+        case .iadd: return Op.iaddOverflow
+        case .isub: return Op.isubOverflow
+        case .imul: return Op.imulOverflow
+        case .iaddunchecked: return Op.iadd
+        case .imulunchecked: return Op.imul
+        case .idiv: return Op.idiv
+        case .irem: return Op.irem
+        case .ieq, .beq: return Op.ieq
+        case .ineq, .bneq: return Op.ineq
+        case .ilt: return Op.ilt
+        case .igt: return Op.igt
+        case .ilte: return Op.ilte
+        case .igte: return Op.igte
+        case .ishl: return Op.ishl
+        case .ishr: return Op.ishr
+        case .iand, .and: return Op.iand
+        case .ior, .or: return Op.ior
+        case .ixor: return Op.ixor
+        case .fadd: return Op.fadd
+        case .fsub: return Op.fsub
+        case .fmul: return Op.fmul
+        case .fdiv: return Op.fdiv
+        case .frem: return Op.frem
+        case .feq: return Op.feq
+        case .fneq: return Op.fneq
+        case .flt: return Op.flt
+        case .fgt: return Op.fgt
+        case .flte: return Op.flte
+        case .fgte: return Op.fgte
+        default: return nil
+        }
+    }
+
+    mutating func translate(_ inst: BuiltinInstCall) throws {
+        let args = inst.args
+        func width(_ index: Int) -> Int32 { return Int32(size(of: args[index])) }
+
+        if let handler = BytecodeTranslator.binaryHandler(for: inst.inst) {
+            let lhs = try slot(of: args[0]), rhs = try slot(of: args[1])
+            emit(handler, try slot(for: inst), lhs, rhs, width(0))
+            return
+        }
+
+        switch inst.inst {
+        case .ipow:
+            let lhs = try slot(of: args[0]), rhs = try slot(of: args[1])
+            emit(Op.ipow, try slot(for: inst), lhs, rhs, width(1) << 8 | width(0))
+        case .not:
+            let isBool: Bool
+            if case .bool? = args[0].value!.type as? BuiltinType { isBool = true } else { isBool = false }
+            if isBool { emit(Op.bnot, try slot(for: inst), try slot(of: args[0])) }
+            else { emit(Op.inot, try slot(for: inst), try slot(of: args[0]), width(0)) }
+        case .trunc8, .trunc16, .trunc32, .sext64:
+            emit(Op.sext, try slot(for: inst), try slot(of: args[0]), width(0), Int32(layout.size(of: inst.returnType)))
+        case .zext64:
+            emit(Op.zext, try slot(for: inst), try slot(of: args[0]), width(0), Int32(layout.size(of: inst.returnType)))
+
+        case .expect:
+            alias(inst, to: try slot(of: args[0]))
+        case .trap:
+            emit(Op.trap)
+        case .condfail:
+            emit(Op.condFail, try slot(of: args[0]))
+
+        case .allocstack:
+            emit(Op.stackAllocate, try slot(for: inst), try slot(of: args[0]), width(0))
+        case .allocheap:
+            let type = LLVMType.functionType(params: [args[0].value!.type!.lowered(module: module)], returns: .opaquePointer)
+            try emitNativeCall("malloc", type: type, [try slot(of: args[0])], result: try slot(for: inst))
+        case .heapfree:
+            let type = LLVMType.functionType(params: [.opaquePointer], returns: .void)
+            try emitNativeCall("free", type: type, [try slot(of: args[0])])
+        case .memcpy:
+            let dst = try slot(of: args[0]), src = try slot(of: args[1])
+            emit(Op.memcpy, dst, src, try slot(of: args[2]), width(2))
+        case .advancepointer:
+            // a GEP, so the index is scaled by the pointee's size
+            let scale = args[0].value!.type?.getPointeeType().map { layout.size(of: $0) } ?? 1
+            let pointer = try slot(of: args[0]), index = try slot(of: args[1])
+            emit(Op.advancePointer, try slot(for: inst), pointer, index, Int32(scale) << 4 | width(1))
+        case .opaqueload:
+            emit(Op.load, try slot(for: inst), try slot(of: args[0]), 1)
+        case .opaquestore:
+            emit(Op.store, try slot(of: args[0]), try slot(of: args[1]), width(1))
+
+        case .withptr:
+            alias(inst, to: try temporaryCopy(of: args[0]))
+        case .isuniquelyreferenced:
+            let existential = try temporaryCopy(of: args[0]), projection = allocatePointer()
+            try emitRuntimeCall(.getBufferProjection, [existential], result: projection)
+            try emitRuntimeCall(.isUniquelyReferenced, [projection], result: try slot(for: inst))
+
+        default:
+            throw error(InterpreterError.unsupportedInst(inst.vir))
+        }
+    }
+}
@@ -1,4 +1,3 @@
-
 //
 //  Optimiser.cpp
 //  Vist
@@ -8,38 +7,152 @@
 //
 
 #include "Optimiser.hpp"
+#include "Backend.hpp"
 
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
 
 #include <iostream>
+#include <chrono>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace llvm;
 using namespace legacy;
 
-/// Runs the optimisations
-void performLLVMOptimisations(Module *module, int optLevel, bool isStdLib) {
+typedef std::chrono::steady_clock Clock;
+
+static long countInstructions(Module &module) {
+    long count = 0;
+    for (auto &function : module)
+        for (auto &block : function)
+            count += block.size();
+    return count;
+}
+
+/// The state of the module after a pass ran
+struct PassSample {
+    /// The pass which just ran, null for the sample taken before the pipeline
+    const char *name;
+    Clock::time_point time;
+    long instructions;
+};
+
+/// Samples the clock and the module's instruction count when it runs, one is
+/// placed after every pass so the difference between neighbouring samples
+/// is the cost of a single pass
+class PassSampler : public ModulePass {
+    std::vector<PassSample> &samples;
+    const char *passName;
+public:
+    static char ID;
+    PassSampler(std::vector<PassSample> &samples, const char *passName)
+        : ModulePass(ID), samples(samples), passName(passName) {}
+    
+    void getAnalysisUsage(AnalysisUsage &usage) const override {
+        usage.setPreservesAll();
+    }
+    bool runOnModule(Module &module) override {
+        samples.push_back({passName, Clock::now(), countInstructions(module)});
+        return false;
+    }
+    const char *getPassName() const override {
+        return "Vist pass sampler";
+    }
+};
+char PassSampler::ID = 0;
+
+/// A pass manager which follows every pass it's given with a `PassSampler`.
+/// Module level samplers split the function and loop pass managers, so
+/// each pass sees the whole module before the next one runs
+class SampledPassManager : public PassManager {
+    std::vector<PassSample> &samples;
+public:
+    SampledPassManager(std::vector<PassSample> &samples) : samples(samples) {
+        PassManager::add(new PassSampler(samples, nullptr));
+    }
+    
+    void add(Pass *pass) override {
+        // immutable passes are initialised before the pipeline, not run in it
+        bool isImmutable = pass->getAsImmutablePass() != nullptr;
+        const char *name = pass->getPassName();
+        PassManager::add(pass);
+        if (!isImmutable)
+            PassManager::add(new PassSampler(samples, name));
+    }
+};
+
+/// Adds the passes named in the comma separated `passes` to `passManager`
+/// \returns whether every pass was found, if not `error` names the missing one
+static bool addPassList(PassManagerBase &passManager, StringRef passes, std::string &error) {
+    
+    PassRegistry &registry = *PassRegistry::getPassRegistry();
+    initializeCore(registry);
+    initializeScalarOpts(registry);
+    initializeObjCARCOpts(registry);
+    initializeVectorization(registry);
+    initializeIPO(registry);
+    initializeAnalysis(registry);
+    initializeTransformUtils(registry);
+    initializeInstCombine(registry);
+    initializeInstrumentation(registry);
+    initializeTarget(registry);
+    
+    SmallVector<StringRef, 16> names;
+    passes.split(names, ',', -1, false);
+    
+    for (auto name : names) {
+        name = name.trim();
+        const PassInfo *info = registry.getPassInfo(name);
+        if (!info || !info->getNormalCtor()) {
+            error = "unknown pass '" + name.str() + "'";
+            return false;
+        }
+        passManager.add(info->createPass());
+    }
+    return true;
+}
+
+/// Adds the standard -O pipeline configured by `options` to `passManager`
+static void addStandardPipeline(PassManagerBase &passManager, const LLVMPipelineOptions &options) {
     
     PassManagerBuilder pmBuilder;
-    PassManager passManager;
-        
-    if (optLevel != 0) {
-        pmBuilder.OptLevel = optLevel;
-        pmBuilder.Inliner = createFunctionInliningPass();
+    
+    if (options.optLevel != 0) {
+        pmBuilder.OptLevel = options.optLevel;
+        pmBuilder.SizeLevel = options.sizeLevel;
+        pmBuilder.Inliner = options.inlineThreshold > 0 ?
+            createFunctionInliningPass(options.inlineThreshold) :
+            createFunctionInliningPass(options.optLevel, options.sizeLevel);
         pmBuilder.DisableTailCalls = false;
         pmBuilder.DisableUnitAtATime = false;
         pmBuilder.DisableUnrollLoops = false;
-        pmBuilder.BBVectorize = true;
-        pmBuilder.SLPVectorize = true;
-        pmBuilder.LoopVectorize = true;
+        pmBuilder.BBVectorize = options.slpVectorize;
+        pmBuilder.SLPVectorize = options.slpVectorize;
+        pmBuilder.LoopVectorize = options.loopVectorize;
         pmBuilder.RerollLoops = true;
         pmBuilder.LoadCombine = true;
         pmBuilder.DisableGVNLoadPRE = true;
         pmBuilder.VerifyInput = true;
         pmBuilder.VerifyOutput = true;
-        pmBuilder.MergeFunctions = true;
+        pmBuilder.MergeFunctions = options.mergeFunctions;
+        
+        if (options.profileGenerate) {
+            pmBuilder.EnablePGOInstrGen = true;
+            pmBuilder.PGOInstrGen = options.profileGenerate;
+        }
+        if (options.profileUse)
+            pmBuilder.PGOInstrUse = options.profileUse;
     }
     else { // we want some optimisations, even at -Onone
         pmBuilder.OptLevel = 0;
@@ -51,11 +164,106 @@ void performLLVMOptimisations(Module *module, int optLevel, bool isStdLib) {
     // add default opt passes
     initializeTargetPassConfigPass(*PassRegistry::getPassRegistry());
     pmBuilder.populateModulePassManager(passManager);
-    // and run them
+}
+
+/// Builds the pipeline described by `options` into `passManager` and runs it
+static bool runPipeline(Module *module, PassManager &passManager,
+                        const LLVMPipelineOptions &options, std::string &error) {
+    
+    // the vectorizers and unroller cost-model against the target, functions
+    // with target-cpu and target-features get their own subtarget's costs
+    auto targetMachine = createTargetMachine(module->getTargetTriple(),
+                                             options.targetCPU ? options.targetCPU : "", error);
+    if (!targetMachine)
+        return false;
+    passManager.add(new TargetLibraryInfoWrapperPass(targetMachine->getTargetTriple()));
+    passManager.add(createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+    
+    if (options.passes) {
+        if (!addPassList(passManager, options.passes, error))
+            return false;
+    }
+    else
+        addStandardPipeline(passManager, options);
+    
     passManager.run(*module);
+    return true;
+}
+
+LLVMPipelineOptions defaultLLVMPipeline(int optLevel, bool isStdLib, const char *__nullable targetCPU) {
+    LLVMPipelineOptions options = {};
+    options.optLevel = optLevel;
+    options.sizeLevel = 0;
+    options.loopVectorize = optLevel != 0;
+    options.slpVectorize = optLevel != 0;
+    // the stdlib's functions are exported from its dylib, so merging them
+    // leaves a thunk which adds a call to every use
+    options.mergeFunctions = optLevel != 0 && !isStdLib;
+    options.inlineThreshold = 0;
+    options.passes = nullptr;
+    options.targetCPU = targetCPU;
+    options.profileGenerate = nullptr;
+    options.profileUse = nullptr;
+    return options;
+}
+
+bool runLLVMPipeline(LLVMModuleRef __nonnull mod, const LLVMPipelineOptions *__nonnull options,
+                     LLVMPassTiming *__nullable *__nullable timings, int *__nullable numTimings,
+                     char *__nullable *__nonnull errorMessage) {
+    Module *module = unwrap(mod);
+    std::string error;
+    
+    if (!timings) {
+        PassManager passManager;
+        if (!runPipeline(module, passManager, *options, error)) {
+            *errorMessage = strdup(error.c_str());
+            return false;
+        }
+        *errorMessage = nullptr;
+        return true;
+    }
+    
+    std::vector<PassSample> samples;
+    samples.reserve(256);
+    SampledPassManager passManager(samples);
+    if (!runPipeline(module, passManager, *options, error)) {
+        *errorMessage = strdup(error.c_str());
+        return false;
+    }
+    
+    // each pass' cost is the difference from the sample before it
+    int count = samples.empty() ? 0 : int(samples.size()) - 1;
+    auto buffer = reinterpret_cast<LLVMPassTiming *>(malloc(sizeof(LLVMPassTiming) * (count ? count : 1)));
+    for (int i = 0; i < count; ++i) {
+        const PassSample &before = samples[i], &after = samples[i + 1];
+        std::chrono::duration<double> elapsed = after.time - before.time;
+        buffer[i].name = strdup(after.name ? after.name : "");
+        buffer[i].time = elapsed.count();
+        buffer[i].instructionDelta = after.instructions - before.instructions;
+    }
+    *timings = buffer;
+    if (numTimings)
+        *numTimings = count;
+    *errorMessage = nullptr;
+    return true;
+}
+
+void disposeLLVMPassTimings(LLVMPassTiming *__nullable timings, int numTimings) {
+    if (!timings)
+        return;
+    for (int i = 0; i < numTimings; ++i)
+        free(const_cast<char *>(timings[i].name));
+    free(timings);
 }
 
 /// Called from swift code
-void performLLVMOptimisations(LLVMModuleRef __nonnull mod, int optLevel, bool isStdLib) {
-    performLLVMOptimisations(unwrap(mod), optLevel, isStdLib);
+bool performLLVMOptimisations(LLVMModuleRef __nonnull mod, int optLevel, bool isStdLib,
+                              const char *__nullable targetCPU,
+                              const char *__nullable profileGenerate, const char *__nullable profileUse,
+                              LLVMPassTiming *__nullable *__nullable timings, int *__nullable numTimings,
+                              char *__nullable *__nonnull errorMessage) {
+    auto options = defaultLLVMPipeline(optLevel, isStdLib, targetCPU);
+    options.profileGenerate = profileGenerate;
+    options.profileUse = profileUse;
+    return runLLVMPipeline(mod, &options, timings, numTimings, errorMessage);
 }
@@ -14,8 +14,62 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-        
-    void performLLVMOptimisations(LLVMModuleRef __nonnull, int, bool);
+    
+    /// Describes the LLVM pass pipeline to run over a module
+    typedef struct {
+        /// 0-3, as -O0 to -O3
+        int optLevel;
+        /// 0-2, as none, -Os, -Oz
+        int sizeLevel;
+        bool loopVectorize;
+        bool slpVectorize;
+        bool mergeFunctions;
+        /// The inliner threshold, 0 uses the default for `optLevel` and `sizeLevel`
+        int inlineThreshold;
+        /// A comma separated list of registered pass names, such as "instcombine,gvn".
+        /// If set these are run instead of the standard pipeline
+        const char *__nullable passes;
+        /// The CPU the cost models target, which may be "native". Null is the
+        /// generic CPU for the module's triple
+        const char *__nullable targetCPU;
+        /// If set, the module is instrumented to write a raw profile to this path
+        /// when the program exits. Needs the profile runtime linked, and an opt
+        /// level above 0
+        const char *__nullable profileGenerate;
+        /// If set, the indexed profile at this path is attached to the module
+        /// so the inliner and block placement favour its hot paths
+        const char *__nullable profileUse;
+    } LLVMPipelineOptions;
+    
+    /// The cost of one pass in the pipeline
+    typedef struct {
+        const char *__nonnull name;
+        /// Wall time, in seconds
+        double time;
+        /// The change in the module's instruction count
+        long instructionDelta;
+    } LLVMPassTiming;
+    
+    /// The pipeline `performLLVMOptimisations` runs for `optLevel`
+    LLVMPipelineOptions defaultLLVMPipeline(int optLevel, bool isStdLib, const char *__nullable targetCPU);
+    
+    /// Runs the pipeline described by `options` over `module`
+    /// \param timings if not null, set to a buffer of per pass timings which must be
+    ///        freed with `disposeLLVMPassTimings`. Timing stops function passes being
+    ///        interleaved, so the pipeline runs slower than it otherwise would
+    /// \returns whether the pipeline was run, if not `errorMessage` is set to a message
+    ///          which must be freed with `LLVMDisposeMessage`
+    bool runLLVMPipeline(LLVMModuleRef __nonnull module, const LLVMPipelineOptions *__nonnull options,
+                         LLVMPassTiming *__nullable *__nullable timings, int *__nullable numTimings,
+                         char *__nullable *__nonnull errorMessage);
+    void disposeLLVMPassTimings(LLVMPassTiming *__nullable timings, int numTimings);
+    
+    /// Runs the default pipeline for `optLevel`, with the arguments and results
+    /// of `runLLVMPipeline`
+    bool performLLVMOptimisations(LLVMModuleRef __nonnull, int, bool, const char *__nullable targetCPU,
+                                  const char *__nullable profileGenerate, const char *__nullable profileUse,
+                                  LLVMPassTiming *__nullable *__nullable timings, int *__nullable numTimings,
+                                  char *__nullable *__nonnull errorMessage);
     int LLVMMetadataID(const char * __nonnull String);
     
 #ifdef __cplusplus
@@ -23,3 +77,4 @@ extern "C" {
 #endif
 
 #endif /* Optimiser_hpp */
+
@@ -0,0 +1,86 @@
+//
+//  Profile.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 10/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include "Profile.hpp"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Support/Error.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace llvm;
+
+/// The per function counts of a profile, read once up front so VIR passes
+/// can query functions by name without knowing their CFG hash
+struct ProfileData {
+    StringMap<uint64_t> functionCounts;
+    uint64_t maxFunctionCount = 0;
+};
+
+/// The profile name of a function, local functions are prefixed
+/// with their file name
+static StringRef functionName(StringRef profileName) {
+    auto separator = profileName.rfind(':');
+    return separator == StringRef::npos ? profileName : profileName.substr(separator + 1);
+}
+
+static char *copyMessage(Error error) {
+    std::string message;
+    handleAllErrors(std::move(error), [&](const ErrorInfoBase &info) {
+        message = info.message();
+    });
+    return strdup(message.c_str());
+}
+
+ProfileDataRef __nullable loadProfileData(const char *__nonnull path, char *__nullable *__nonnull errorMessage) {
+    
+    auto readerOrError = IndexedInstrProfReader::create(path);
+    if (auto error = readerOrError.takeError()) {
+        *errorMessage = copyMessage(std::move(error));
+        return nullptr;
+    }
+    auto reader = std::move(readerOrError.get());
+    
+    auto profile = new ProfileData();
+    for (const auto &record : *reader) {
+        uint64_t hottest = 0;
+        for (auto count : record.Counts)
+            hottest = std::max(hottest, count);
+        // a function can have a record per CFG hash, keep the hottest
+        auto &entry = profile->functionCounts[functionName(record.Name)];
+        entry = std::max(entry, hottest);
+        profile->maxFunctionCount = std::max(profile->maxFunctionCount, hottest);
+    }
+    if (reader->hasError()) {
+        *errorMessage = copyMessage(reader->getError());
+        delete profile;
+        return nullptr;
+    }
+    
+    *errorMessage = nullptr;
+    return profile;
+}
+
+void disposeProfileData(ProfileDataRef __nonnull profile) {
+    delete profile;
+}
+
+bool profileHasFunction(ProfileDataRef __nonnull profile, const char *__nonnull name) {
+    return profile->functionCounts.count(name) != 0;
+}
+
+uint64_t profileFunctionCount(ProfileDataRef __nonnull profile, const char *__nonnull name) {
+    auto found = profile->functionCounts.find(name);
+    return found == profile->functionCounts.end() ? 0 : found->second;
+}
+
+uint64_t profileMaxFunctionCount(ProfileDataRef __nonnull profile) {
+    return profile->maxFunctionCount;
+}
@@ -0,0 +1,37 @@
+//
+//  Profile.hpp
+//  Vist
+//
+//  Created by Josef Willsher on 10/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#ifndef Profile_hpp
+#define Profile_hpp
+
+#include "LLVM.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    
+    typedef struct ProfileData *ProfileDataRef;
+    
+    /// Reads the indexed profile, produced by `llvm-profdata merge`, at `path`
+    /// \returns the profile, or null and sets `errorMessage` to a message which
+    ///          must be freed with `LLVMDisposeMessage`
+    ProfileDataRef __nullable loadProfileData(const char *__nonnull path, char *__nullable *__nonnull errorMessage);
+    void disposeProfileData(ProfileDataRef __nonnull profile);
+    
+    /// Whether the profile has a record for the function named `name`
+    bool profileHasFunction(ProfileDataRef __nonnull profile, const char *__nonnull name);
+    /// The count of the hottest block in `name`, 0 if it is not in the profile
+    uint64_t profileFunctionCount(ProfileDataRef __nonnull profile, const char *__nonnull name);
+    /// The largest `profileFunctionCount` of any function in the profile
+    uint64_t profileMaxFunctionCount(ProfileDataRef __nonnull profile);
+    
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* Profile_hpp */
@@ -27,6 +27,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
@@ -47,51 +48,106 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include <memory>
+#include <string.h>
 
 
  
 using namespace llvm;
 
-/*
-static void compile(Module *_Nonnull module, TargetMachine::CodeGenFileType type) {
+/// Resolves `cpu` to a CPU name and feature string, "native" is the host CPU
+/// with the features the host reports, anything else uses the CPU's defaults
+static void resolveCPU(StringRef cpu, std::string &cpuName, std::string &features) {
+    if (cpu != "native") {
+        cpuName = cpu.str();
+        features = "";
+        return;
+    }
+    cpuName = sys::getHostCPUName();
     
-    PassRegistry *Registry = PassRegistry::getPassRegistry();
-    initializeCore(*Registry);
-    initializeCodeGen(*Registry);
-    
-    Triple TheTriple = Triple(module->getTargetTriple());
+    SubtargetFeatures subtargetFeatures;
+    StringMap<bool> hostFeatures;
+    if (sys::getHostCPUFeatures(hostFeatures))
+        for (auto &feature : hostFeatures)
+            subtargetFeatures.AddFeature(feature.first(), feature.second);
+    features = subtargetFeatures.getString();
+}
+
+std::unique_ptr<TargetMachine> createTargetMachine(StringRef tripleName, StringRef cpu, std::string &error) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
     
-    if (TheTriple.getTriple().empty())
-        TheTriple.setTriple(sys::getDefaultTargetTriple());
+    Triple triple = Triple(tripleName);
+    if (triple.getTriple().empty())
+        triple.setTriple(sys::getProcessTriple());
     
-    std::string Error;
-    const Target *TheTarget = TargetRegistry::lookupTarget(MArch, TheTriple, Error);
+    const Target *target = TargetRegistry::lookupTarget(triple.getTriple(), error);
+    if (!target)
+        return nullptr;
     
-    std::string CPUStr = getCPUStr(), FeaturesStr = getFeaturesStr();
-    TargetOptions Options = InitTargetOptionsFromCodeGenFlags();
+    std::string cpuName, features;
+    resolveCPU(cpu, cpuName, features);
     
-    CodeGenOpt::Level OLvl = CodeGenOpt::Default;
-    std::unique_ptr<TargetMachine> TargetMachine(TheTarget->createTargetMachine(TheTriple.getTriple(), CPUStr, FeaturesStr,
-                                                                                Options, RelocModel, CMModel, OLvl));
+    TargetOptions options;
+    auto targetMachine = std::unique_ptr<TargetMachine>(target->createTargetMachine(triple.getTriple(), cpuName, features,
+                                                                                    options, Reloc::PIC_, CodeModel::Default,
+                                                                                    CodeGenOpt::Default));
+    // LLVM only warns about an unknown CPU and falls back to the generic one,
+    // so a typo would silently lose the tuning asked for
+    if (!cpuName.empty() && !targetMachine->getMCSubtargetInfo()->isCPUStringValid(cpuName)) {
+        error = "'" + cpuName + "' is not a recognized processor for target " + triple.getTriple();
+        return nullptr;
+    }
+    return targetMachine;
+}
+
+/// Runs codegen for `module` on the host target tuned for `cpu`, writing an
+/// object or assembly file to `outputPath`
+/// \returns whether the file was emitted, if not `error` describes why
+static bool compile(Module *_Nonnull module, const char *_Nonnull outputPath, StringRef cpu,
+                    TargetMachine::CodeGenFileType type, std::string &error) {
     
-    module->setDataLayout(TargetMachine->createDataLayout());
-    setFunctionAttributes(CPUStr, FeaturesStr, *module);
+    // an empty `cpu` is the generic CPU, matching the optimiser's cost models,
+    // so the output runs on any machine with the host's triple
+    auto targetMachine = createTargetMachine(module->getTargetTriple(), cpu, error);
+    if (!targetMachine)
+        return false;
+    Triple triple = targetMachine->getTargetTriple();
+    module->setDataLayout(targetMachine->createDataLayout());
     
-    legacy::PassManager EmitPasses;
-    std::unique_ptr<raw_pwrite_stream> RawOS;
+    std::error_code errorCode;
+    raw_fd_ostream out(outputPath, errorCode, sys::fs::F_None);
+    if (errorCode) {
+        error = errorCode.message();
+        return false;
+    }
     
-    EmitPasses.add(createTargetTransformInfoWrapperPass(TargetMachine->getTargetIRAnalysis()));
+    legacy::PassManager emitPasses;
+    emitPasses.add(new TargetLibraryInfoWrapperPass(triple));
+    emitPasses.add(createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
     
-    bool fail = TargetMachine->addPassesToEmitFile(EmitPasses, *RawOS,
-                                                   type, true);
+    if (targetMachine->addPassesToEmitFile(emitPasses, out, type, /*DisableVerify=*/false)) {
+        error = "target cannot emit a file of this type";
+        return false;
+    }
     
+    emitPasses.run(*module);
+    out.flush();
+    return true;
 }
 
-void compileModule(LLVMModuleRef _Nonnull module) {
-    compile(unwrap(module),
-            TargetMachine::CodeGenFileType::CGFT_ObjectFile);
+bool compileModule(LLVMModuleRef _Nonnull module, const char *_Nonnull outputPath,
+                   bool emitAssembly, const char *_Nullable cpu,
+                   char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    auto type = emitAssembly ? TargetMachine::CGFT_AssemblyFile : TargetMachine::CGFT_ObjectFile;
+    if (compile(unwrap(module), outputPath, cpu ? cpu : "", type, error)) {
+        *errorMessage = nullptr;
+        return true;
+    }
+    *errorMessage = strdup(error.c_str());
+    return false;
 }
-*/
  
 const char * _Nonnull getHostTriple() {
     return sys::getProcessTriple().data();
@@ -99,8 +155,32 @@ const char * _Nonnull getHostTriple() {
 const char * _Nonnull getHostCPUName() {
     return sys::getHostCPUName().data();
 }
-//const char * _Nonnull getHostDataLayout() {
-//    return sys::
-//}
+
+bool setModuleTarget(LLVMModuleRef _Nonnull mod, const char *_Nullable cpu, char *_Nullable *_Nonnull errorMessage) {
+    Module *module = unwrap(mod);
+    std::string error;
+    auto targetMachine = createTargetMachine(sys::getProcessTriple(), cpu ? cpu : "", error);
+    if (!targetMachine) {
+        *errorMessage = strdup(error.c_str());
+        return false;
+    }
+    module->setTargetTriple(targetMachine->getTargetTriple().getTriple());
+    module->setDataLayout(targetMachine->createDataLayout());
+    *errorMessage = nullptr;
+    return true;
+}
+
+void addTargetAttributes(LLVMModuleRef _Nonnull mod, const char *_Nonnull cpu) {
+    std::string cpuName, features;
+    resolveCPU(cpu, cpuName, features);
+    
+    for (auto &function : *unwrap(mod)) {
+        if (function.isDeclaration())
+            continue;
+        function.addFnAttr("target-cpu", cpuName);
+        if (!features.empty())
+            function.addFnAttr("target-features", features);
+    }
+}
 
 
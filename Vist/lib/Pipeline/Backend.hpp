@@ -18,10 +18,39 @@ extern "C" {
     const char * _Nonnull getHostTriple();
     const char * _Nonnull getHostCPUName();
     
-    void compileModule(LLVMModuleRef _Nonnull module);
+    /// Sets the triple and data layout of `module` to the host's, with a target
+    /// machine for `cpu`, which may be "native". A null `cpu` is the generic CPU
+    /// \returns whether it succeeded, if not `errorMessage` is set to a message
+    ///          which must be freed with `LLVMDisposeMessage`
+    bool setModuleTarget(LLVMModuleRef _Nonnull module, const char *_Nullable cpu,
+                         char *_Nullable *_Nonnull errorMessage);
+    /// Adds `target-cpu` and `target-features` attributes for `cpu` to every
+    /// function defined in `module`, so optimisation and codegen use its features
+    void addTargetAttributes(LLVMModuleRef _Nonnull module, const char *_Nonnull cpu);
+    
+    /// Emits an object file, or assembly if `emitAssembly`, for `module` at `outputPath`
+    /// \param cpu the CPU to tune for, which may be "native". A null `cpu` is the
+    ///        generic CPU for the host triple
+    /// \returns whether it succeeded, if not `errorMessage` is set to a message
+    ///          which must be freed with `LLVMDisposeMessage`
+    bool compileModule(LLVMModuleRef _Nonnull module, const char *_Nonnull outputPath,
+                       bool emitAssembly, const char *_Nullable cpu,
+                       char *_Nullable *_Nonnull errorMessage);
     
 #ifdef __cplusplus
 }
+
+#include <memory>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Target/TargetMachine.h"
+
+/// Creates a target machine for `triple`, or the host if it is empty, tuned for
+/// `cpu`. "native" uses the host CPU and its features, and empty the generic CPU
+/// \returns the target machine, or null and sets `error` if the target or
+///          `cpu` is unknown
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(llvm::StringRef triple, llvm::StringRef cpu,
+                                                         std::string &error);
 #endif
 
 
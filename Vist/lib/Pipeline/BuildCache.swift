@@ -0,0 +1,181 @@
+//
+//  BuildCache.swift
+//  Vist
+//
+//  Created by Josef Willsher on 15/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+import class Foundation.FileManager
+import class Foundation.Bundle
+import class Foundation.ProcessInfo
+import struct Darwin.Dl_info
+import func Darwin.dladdr
+import struct Foundation.Data
+import struct Foundation.Date
+import struct Foundation.URL
+import struct Foundation.FileAttributeKey
+import class Foundation.NSNumber
+
+/// An on disk cache of the object files `compileDocuments` emits, one for each
+/// compilation unit.
+///
+/// Objects are keyed by a SHA-256 hash of the unit's source files, the interface
+/// of every unit, the flags which affect code generation, and the compiler and
+/// stdlib binaries. A unit whose key is cached skips VIRGen, the optimisers and
+/// codegen, and its object is relinked.
+struct BuildCache {
+    /// The directory the objects are stored in, created when first written to
+    let directory: String
+
+    /// The cached object for `key`, if there is one
+    func object(for key: String) -> String? {
+        let path = objectPath(for: key)
+        return FileManager.default.fileExists(atPath: path) ? path : nil
+    }
+
+    /// Copies the object at `path` into the cache. The copy is atomic, so a
+    /// concurrent build never links a partly written object
+    func store(object path: String, for key: String) throws {
+        guard let data = FileManager.default.contents(atPath: path) else { return }
+        try FileManager.default.createDirectory(atPath: directory, withIntermediateDirectories: true, attributes: nil)
+        try data.write(to: URL(fileURLWithPath: objectPath(for: key)), options: .atomic)
+    }
+
+    private func objectPath(for key: String) -> String {
+        return "\(directory)/\(key).o"
+    }
+}
+
+extension BuildCache {
+
+    /// The cache key of each of `units`, compiled in `directory`. A unit's object
+    /// depends on its own sources and on every unit's interface, which it calls
+    /// into or, if it is the primary unit, defines the metadata of
+    static func keys(units: [CompilationUnit],
+                     inDirectory directory: String,
+                     targetCPU: String?,
+                     profile: ProfileMode?,
+                     specialisationBudget: Int?,
+                     options: CompileOptions) throws -> [String] {
+        var hasher = ContentHasher()
+        hasher.combine("vist-build-cache-3")
+
+        // a rebuilt compiler or stdlib can emit different code, and the
+        // stdlib's interface gives the bodies inlined from it
+        for path in [compilerPath, "/usr/local/lib/libvist.dylib", libVistInterfacePath] {
+            hasher.combine(fileIdentity(path))
+        }
+
+        hasher.combine("\(options.subtracting(.doesNotAffectCodegen).rawValue)")
+        hasher.combine(targetCPU ?? "")
+        hasher.combine(specialisationBudget.map { "\($0)" } ?? "")
+        switch profile {
+        case .generate(let path)?:
+            hasher.combine("profile-generate=\(path)")
+        case .use(let path)?:
+            hasher.combine("profile-use")
+            try hasher.combine(contentsOf: path.hasPrefix("/") ? path : "\(directory)/\(path)")
+        case nil:
+            hasher.combine("")
+        }
+
+        for unit in units {
+            hasher.combine(unit.ast.interface)
+        }
+
+        return try units.map { unit in
+            var unitHasher = hasher
+            unitHasher.combine(unit.isPrimary ? "primary" : "declarations")
+            for name in unit.fileNames {
+                unitHasher.combine(name)
+                try unitHasher.combine(contentsOf: "\(directory)/\(name)")
+            }
+            return unitHasher.digest
+        }
+    }
+
+    /// The binary this code was loaded from, the compiler or the test bundle
+    /// it is built into. `arguments[0]` is only the name it was invoked by
+    private static var compilerPath: String {
+        var info = Dl_info()
+        if dladdr(#dsohandle, &info) != 0, let path = info.dli_fname {
+            return String(cString: path)
+        }
+        return Bundle.main.executablePath ?? ProcessInfo.processInfo.arguments[0]
+    }
+
+    /// Identifies the version of a binary by its size and modification date,
+    /// hashing it would cost more than many compiles save
+    private static func fileIdentity(_ path: String) -> String {
+        guard let attributes = try? FileManager.default.attributesOfItem(atPath: path) else { return "\(path):missing" }
+        let size = (attributes[FileAttributeKey.size] as? NSNumber)?.intValue ?? 0
+        let date = (attributes[FileAttributeKey.modificationDate] as? Date)?.timeIntervalSince1970 ?? 0
+        return "\(path):\(size):\(date)"
+    }
+}
+
+extension CompileOptions {
+    /// Options which only change what is printed or what happens after linking
+    fileprivate static let doesNotAffectCodegen: CompileOptions = [buildAndRun, preserveTempFiles, timePasses, printStatistics, incremental]
+
+    /// Whether a compile with these options can be served from the build cache.
+    /// Compiles which print intermediate stages, run in process, or depend on
+    /// files other than their inputs are not cached
+    var isCacheable: Bool {
+        return intersection([dumpAST, dumpVIR, dumpLLVMIR, dumpASM, verbose, jit, interpret,
+                             useAIRBackend, runPreprocessor, buildRuntime]).isEmpty
+    }
+}
+
+/// A SHA-256 hash of the key's fields, a collision would link the wrong
+/// object. Each field is length prefixed so adjacent fields can't run together
+private struct ContentHasher {
+    private var context = CC_SHA256_CTX()
+
+    init() {
+        CC_SHA256_Init(&context)
+    }
+
+    mutating func combine(_ string: String) {
+        combine(bytes: Array(string.utf8))
+    }
+
+    mutating func combine(contentsOf path: String) throws {
+        guard let data = FileManager.default.contents(atPath: path) else {
+            throw BuildCacheError.unreadable(path)
+        }
+        combine(bytes: [UInt8](data))
+    }
+
+    private mutating func combine(bytes: [UInt8]) {
+        var count = UInt64(bytes.count), prefix: [UInt8] = []
+        for _ in 0..<8 {
+            prefix.append(UInt8(truncatingBitPattern: count))
+            count >>= 8
+        }
+        CC_SHA256_Update(&context, prefix, CC_LONG(prefix.count))
+        CC_SHA256_Update(&context, bytes, CC_LONG(bytes.count))
+    }
+
+    var digest: String {
+        // finalising consumes the context, so hash a copy
+        var context = self.context
+        var hash = [UInt8](repeating: 0, count: Int(CC_SHA256_DIGEST_LENGTH))
+        CC_SHA256_Final(&hash, &context)
+        return hash.map { byte in
+            let hex = String(byte, radix: 16)
+            return byte < 0x10 ? "0" + hex : hex
+        }.joined()
+    }
+}
+
+enum BuildCacheError : VistError {
+    case unreadable(String)
+
+    var description: String {
+        switch self {
+        case .unreadable(let path): return "Could not read '\(path)'"
+        }
+    }
+}
@@ -29,6 +29,8 @@ public func compile(withFlags flags: [String], inDirectory dir: String, out: URL
         "-emit-asm": .dumpASM,
         "-run": .buildAndRun,
         "-r": .buildAndRun,
+        "-jit": [.buildAndRun, .jit],
+        "-interpret": [.buildAndRun, .interpret],
         "-O0": .O0,
         "-O": .O,
         "-Ohigh": .Ohigh,
@@ -36,8 +38,12 @@ public func compile(withFlags flags: [String], inDirectory dir: String, out: URL
         "-parse-stdlib": .doNotLinkStdLib,
         "-build-runtime": .buildRuntime,
         "-debug-runtime": .debugRuntime,
+        "-single-threaded-runtime": .singleThreadedRuntime,
         "-run-preprocessor": .runPreprocessor,
         "-use-air": .useAIRBackend,
+        "-time-passes": .timePasses,
+        "-stats": .printStatistics,
+        "-incremental": .incremental,
     ]
     
     for flag in flags.flatMap({map[$0]}) {
@@ -53,6 +59,48 @@ public func compile(withFlags flags: [String], inDirectory dir: String, out: URL
         compileOptions.insert(.disableInline)
     }
     
+    // -march=native and -mcpu=NAME pick the CPU to tune for
+    let targetCPU = flags.flatMap { flag -> String? in
+        if flag == "-march=native" { return "native" }
+        if let range = flag.range(of: "-mcpu=") { return flag.replacingCharacters(in: range, with: "") }
+        return nil
+    }.last
+    
+    // -profile-generate[=PATH] instruments, -profile-use=PATH optimises with the profile
+    let profile = flags.flatMap { flag -> ProfileMode? in
+        if flag == "-profile-generate" { return .generate(path: "default.profraw") }
+        if let range = flag.range(of: "-profile-generate=") { return .generate(path: flag.replacingCharacters(in: range, with: "")) }
+        if let range = flag.range(of: "-profile-use=") { return .use(path: flag.replacingCharacters(in: range, with: "")) }
+        return nil
+    }.last
+    
+    // -specialise-budget=N limits the clones made for concrete types
+    let specialisationBudget = flags.flatMap { flag -> Int? in
+        guard let range = flag.range(of: "-specialise-budget=") else { return nil }
+        return Int(flag.replacingCharacters(in: range, with: ""))
+    }.last
+    
+    // -stats-json=PATH writes the timings and statistics for tooling
+    let statisticsPath = flags.flatMap { flag -> String? in
+        guard let range = flag.range(of: "-stats-json=") else { return nil }
+        return flag.replacingCharacters(in: range, with: "")
+    }.last
+    
+    // -cache-dir=PATH stores incremental build objects in PATH
+    let cacheDirectory = flags.flatMap { flag -> String? in
+        guard let range = flag.range(of: "-cache-dir=") else { return nil }
+        return flag.replacingCharacters(in: range, with: "")
+    }.last
+    if cacheDirectory != nil {
+        compileOptions.insert(.incremental)
+    }
+    
+    // -dump-vir-binary=PATH prints the binary VIR file at PATH as text
+    let binaryVIRPath = flags.flatMap { flag -> String? in
+        guard let range = flag.range(of: "-dump-vir-binary=") else { return nil }
+        return flag.replacingCharacters(in: range, with: "")
+    }.last
+    
     let explicitName = flags
         .first { flag in flag.hasPrefix("-o") }
         .map { name in name.replacingOccurrences(of: "-o", with: "") }
@@ -67,13 +115,38 @@ public func compile(withFlags flags: [String], inDirectory dir: String, out: URL
                 "  -emit-vir\t\t- Print the VIR file\n" +
                 "  -emit-asm\t\t- print the assembly code\n" +
                 "  -run -r\t\t- Run the program after compilation\n" +
+                "  -jit\t\t\t- Run the program in process with the JIT, without linking an executable\n" +
+                "  -interpret\t\t- Run the program's VIR in the interpreter, without lowering it\n" +
                 "  -run-preprocessor\t- Run the C preprocessor on the source\n" +
                 "  -oNAME -r\t\t- Define the output name to be NAME\n" +
+                "  -march=native\t\t- Tune for and use all features of the host CPU\n" +
+                "  -mcpu=NAME\t\t- Tune for and use the features of the CPU NAME\n" +
+                "  -profile-generate[=PATH] - Instrument the program to write a profile to PATH, default.profraw by default\n" +
+                "  -profile-use=PATH\t- Optimise hot paths using the profile at PATH, raw profiles are merged first\n" +
+                "  -specialise-budget=N\t- Clone at most N functions for the concrete types they are called with, at -Ohigh\n" +
+                "  -time-passes\t\t- Print the time taken by each compile phase, VIR optimiser pass, and LLVM pass\n" +
+                "  -stats\t\t- Print the VIR optimiser's statistics and the instructions each pass removed\n" +
+                "  -stats-json=PATH\t- Write the phase timings and optimiser statistics to PATH as JSON\n" +
+                "  -incremental\t\t- Compile each file to a cached object, and only recompile the files which changed\n" +
+                "  -cache-dir=PATH\t- Store incremental build objects in PATH, .vistcache by default\n" +
                 "  -build-stdlib\t\t- Build the standard library too\n" +
                 "  -parse-stdlib\t\t- Compile the module as if it were the stdlib. This exposes Builtin functions and links the runtime directly\n" +
                 "  -build-runtime\t- Build the runtime\n" +
-                "  -debug-runtime\t- The runtime logs reference counting operations\n" +
-                "  -preserve\t\t- Keep intermediate IR and ASM files")
+                "  -debug-runtime\t- The runtime logs reference counting operations and witness cache hits\n" +
+                "  -single-threaded-runtime - Build and link a separate runtime with non atomic reference counting\n" +
+                "  -dump-vir-binary=PATH\t- Print the binary VIR file at PATH as text\n" +
+                "  -preserve\t\t- Keep intermediate IR and ASM files, VIR is kept as binary .virb files")
+    }
+    else if let path = binaryVIRPath {
+        let module = Module()
+        let reader = try VIRReader(contentsOf: path.hasPrefix("/") ? path : "\(dir)/\(path)", into: module)
+        try reader.materialiseAll()
+        if let out = out {
+            try module.vir.write(to: out, atomically: true, encoding: .utf8)
+        }
+        else {
+            print(module.vir)
+        }
     }
     else {
         #if DEBUG
@@ -94,10 +167,16 @@ public func compile(withFlags flags: [String], inDirectory dir: String, out: URL
                                  inDirectory: dir,
                                  explicitName: explicitName,
                                  output: out,
+                                 targetCPU: targetCPU,
+                                 profile: profile,
+                                 specialisationBudget: specialisationBudget,
+                                 statisticsPath: statisticsPath,
+                                 cacheDirectory: cacheDirectory,
                                  options: compileOptions)
         }
         else if compileOptions.contains(.buildRuntime) {
-            try buildRuntime(debugRuntime: compileOptions.contains(.debugRuntime))
+            try buildRuntime(debugRuntime: compileOptions.contains(.debugRuntime),
+                             singleThreaded: compileOptions.contains(.singleThreadedRuntime))
         }
         
         #if DEBUG
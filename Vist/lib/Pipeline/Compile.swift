@@ -58,14 +58,43 @@ struct CompileOptions : OptionSet {
     static let runPreprocessor = CompileOptions(rawValue: 1 << 18)
     
     static let useAIRBackend = CompileOptions(rawValue: 1 << 19)
+    
+    /// Builds the runtime with non atomic ref counting, only safe for programs
+    /// which do not share objects between threads
+    static let singleThreadedRuntime = CompileOptions(rawValue: 1 << 20)
+    
+    /// Runs the program in process with the ORC JIT instead of writing
+    /// and linking an executable
+    static let jit = CompileOptions(rawValue: 1 << 21)
+    
+    /// Prints the time taken by each compile phase and VIR pass
+    static let timePasses = CompileOptions(rawValue: 1 << 22)
+    /// Prints the VIR optimiser's statistics and each pass' instruction delta
+    static let printStatistics = CompileOptions(rawValue: 1 << 23)
+    
+    /// Compiles each file to its own cached object, so files which are unchanged
+    /// since an earlier compile are only relinked
+    static let incremental = CompileOptions(rawValue: 1 << 24)
+    
+    /// Runs the optimised VIR in the bytecode interpreter, skipping LLVM
+    static let interpret = CompileOptions(rawValue: 1 << 25)
 }
 
 
+/// Profile guided optimisation mode
+enum ProfileMode {
+    /// Instrument the program so it writes a raw profile to `path` on exit
+    case generate(path: String)
+    /// Optimise with the profile at `path`, a raw profile is merged first
+    case use(path: String)
+}
+
 
+/// - returns: the files' ASTs, in the order of `names`
 private func parseFiles(_ names: [String],
                         inDirectory dir: String,
                         options: CompileOptions
-    ) throws -> [AST] {
+    ) throws -> [(fileName: String, ast: AST)] {
     
     var asts: [String: AST] = [:]
     /// The queue used to access asts
@@ -111,7 +140,7 @@ private func parseFiles(_ names: [String],
                 
                 // on ast queue, synchronously write this AST
                 astQueue.sync {
-                    asts[fileName] = ast
+                    asts[name] = ast
                 }
             }
             catch let e as VistError {
@@ -134,7 +163,7 @@ private func parseFiles(_ names: [String],
     if let e = astQueue.sync(execute: {unhandledError}) { throw e }
     
     // synchrnonoslt
-    return astQueue.sync { Array(asts.values) }
+    return astQueue.sync { names.map { name in (name, asts[name]!) } }
 }
 
 
@@ -142,12 +171,26 @@ private func parseFiles(_ names: [String],
 /// - parameter fileNames: The file paths to compile
 /// - parameter inDirectory: The current working directory
 /// - parameter out: Override stdout
+/// - parameter targetCPU: The CPU to tune for, "native" is the host's. If nil
+///             the generic CPU for the host triple is used
+/// - parameter profile: Whether to instrument for, or optimise with, a profile
+/// - parameter specialisationBudget: The number of functions which may be cloned
+///             for concrete types, the module's default if nil
+/// - parameter statisticsPath: If set, the phase timings and opt statistics are
+///             written to this path as JSON
+/// - parameter cacheDirectory: Where `.incremental` compiles store each unit's object,
+///             `.vistcache` in the working directory if nil
 /// - parameter options: An option set of compilation flags
 func compileDocuments(
     fileNames: [String],
     inDirectory currentDirectory: String,
     explicitName: String? = nil,
     output: URL? = nil,
+    targetCPU: String? = nil,
+    profile: ProfileMode? = nil,
+    specialisationBudget: Int? = nil,
+    statisticsPath: String? = nil,
+    cacheDirectory: String? = nil,
     options: CompileOptions
     ) throws {
     
@@ -160,12 +203,99 @@ func compileDocuments(
         else { Swift.print(s) }
     }
     
+    // time the phases and passes if we report them
+    let reportsStatistics = options.contains(.printStatistics) || statisticsPath != nil
+    let timer = options.contains(.timePasses) || reportsStatistics ? CompileTimer() : nil
+    if reportsStatistics {
+        OptStatistics.reset()
+    }
+    
+    /// Runs `body`, timing it as the phase `name` if we are timing
+    @discardableResult
+    func phase<T>(_ name: String, _ body: () throws -> T) rethrows -> T {
+        guard let timer = timer else { return try body() }
+        return try timer.time(phase: name, body)
+    }
+    
+    // report on every exit, compiles can return early after dumping
+    defer {
+        if let timer = timer, options.contains(.timePasses) || options.contains(.printStatistics) {
+            print("")
+            print(timer.timingTable())
+        }
+        if options.contains(.printStatistics) {
+            print("")
+            print(statisticsTable(OptStatistics.all))
+        }
+        if let path = statisticsPath {
+            let json = compileReportJSON(timer: timer, statistics: reportsStatistics ? OptStatistics.all : nil)
+            try! json.write(toFile: path, atomically: true, encoding: .utf8)
+        }
+    }
+    
+    // get file title
+    let file = explicitName ?? fileNames.first!
+        .replacingOccurrences(of: ".vist", with: "")
+        .replacingOccurrences(of: ".previst", with: "")
+    
+    let libVistPath = "/usr/local/lib/libvist.dylib"
+    let libVistRuntimePath = runtimeLibraryPath(singleThreaded: false)
+    // executables built with -single-threaded-runtime link its variant, programs
+    // run in the compiler's process use the default runtime
+    let linkedRuntimePath = runtimeLibraryPath(singleThreaded: options.contains(.singleThreadedRuntime))
+    let objectPath = "\(currentDirectory)/\(file).o"
+    
+    let profileGeneratePath: String?
+    if case .generate(let path)? = profile { profileGeneratePath = path }
+    else { profileGeneratePath = nil }
+    
+    /// Links the objects into the stdlib dylib or an executable
+    func link(objects: [String] = [objectPath]) {
+        phase("link") {
+            // if its the stdlib, produce a dylib
+            if options.contains(.compileStdLib) {
+                // .o -> .dylib
+                // to link against program
+                Process.execute(exec: .clang,
+                                files: [libVistRuntimePath] + objects,
+                                outputName: libVistPath,
+                                cwd: currentDirectory,
+                                args: "-dynamiclib")
+            }
+            else {
+                // get the input for the clang binary
+                let inputFiles = options.contains(.doNotLinkStdLib) ?
+                    [linkedRuntimePath] + objects :
+                    [linkedRuntimePath, libVistPath] + objects
+                // .o -> exec, instrumented programs link the profile runtime
+                var args = profileGeneratePath == nil ? [] : ["-fprofile-instr-generate"]
+                // libvist is linked against the default runtime, binding flat makes
+                // its runtime calls resolve to the variant, which is loaded first
+                if linkedRuntimePath != libVistRuntimePath, !options.contains(.doNotLinkStdLib) {
+                    args.append("-Wl,-force_flat_namespace")
+                }
+                Process.execute(execName: Exec.clang.rawValue,
+                                files: inputFiles,
+                                outputName: file,
+                                cwd: currentDirectory,
+                                args: args)
+            }
+        }
+        
+        if options.contains(.buildAndRun), !options.contains(.compileStdLib) {
+            if options.contains(.verbose) { print("\n\n-----------------------------RUN-----------------------------\n") }
+            runExecutable(file: file, inDirectory: currentDirectory, output: output)
+        }
+    }
+    
     // MARK: Parse
-    let astList = try parseFiles(fileNames, inDirectory: currentDirectory, options: options)
+    let astList = try phase("parse") {
+        try parseFiles(fileNames, inDirectory: currentDirectory, options: options)
+    }
     
     // collect all ast nodes into a single ast object
     let ast = astList.reduce(AST(exprs: [])) { i, x in
-        AST(exprs: i.exprs + x.exprs)
+        AST(exprs: i.exprs + x.ast.exprs)
     }
     
     // MARK: Sema
@@ -175,29 +305,124 @@ func compileDocuments(
     
     let globalScope = SemaScope.globalScope(isStdLib: options.contains(.parseStdLib))
     
-    try ast.sema(globalScope: globalScope)
+    try phase("sema") {
+        try ast.sema(globalScope: globalScope)
+    }
     
     if options.contains(.dumpAST) { ast.dump(); return }
     
+    // read the profile, so the VIR inliner can use it too
+    var profileUsePath: String? = nil, profileData: ProfileData? = nil
+    if case .use(let path)? = profile {
+        let profdataPath = try mergeProfile(path: path, cwd: currentDirectory)
+        profileData = try ProfileData(path: profdataPath)
+        profileUsePath = profdataPath
+    }
+    
+    // MARK: Build cache
+    // each unit is compiled to its own object, keyed on its sources and every
+    // unit's interface; the objects of unchanged units are only relinked
+    if options.contains(.incremental) && options.isCacheable {
+        let cache = BuildCache(directory: cacheDirectory ?? "\(currentDirectory)/.vistcache")
+        let units = CompilationUnit.units(of: astList, isLibrary: options.contains(.produceLib))
+        let keys = try BuildCache.keys(units: units,
+                                       inDirectory: currentDirectory,
+                                       targetCPU: targetCPU,
+                                       profile: profile,
+                                       specialisationBudget: specialisationBudget,
+                                       options: options)
+        
+        var objects: [String] = []
+        for (index, (unit, key)) in zip(units, keys).enumerated() {
+            if let cached = cache.object(for: key) {
+                objects.append(cached)
+                continue
+            }
+            
+            let virModule = Module()
+            if !options.contains(.parseStdLib) {
+                try virModule.loadStdLibInterface()
+            }
+            // the primary unit defines the metadata of every type any unit uses
+            if unit.isPrimary {
+                virModule.importStdLibTypes()
+            }
+            try phase("virgen") {
+                try unit.ast.emitVIR(module: virModule,
+                                     isLibrary: !unit.isPrimary || options.contains(.produceLib),
+                                     externalDecls: unit.externalDecls(in: units))
+                if unit.isPrimary {
+                    try virModule.createConformances()
+                }
+            }
+            #if DEBUG
+                try virModule.verify()
+            #endif
+            
+            virModule.profile = profileData
+            if let budget = specialisationBudget {
+                virModule.specialisationBudget = budget
+            }
+            try phase("vir-opt") {
+                try PassManager(module: virModule, optLevel: options.optLevel(), opts: options, timer: timer)
+                    .runPasses()
+            }
+            
+            // other units only declare the metadata
+            var loweringOptions = options.loweringOptions()
+            if !unit.isPrimary {
+                loweringOptions.insert(.externalMetadata)
+            }
+            let llvmModule = LLVMModule(name: file)
+            try llvmModule.setHostTarget(cpu: targetCPU)
+            try phase("vir-lower") {
+                try virModule.virLower(module: llvmModule, isStdLib: false, options: loweringOptions)
+            }
+            if let cpu = targetCPU {
+                llvmModule.setFunctionTarget(cpu: cpu)
+            }
+            try phase("llvm-opt") {
+                try llvmModule.optimise(optLevel: options.optLevel().rawValue,
+                                        isStdLib: false,
+                                        cpu: targetCPU,
+                                        profileGenerate: profileGeneratePath,
+                                        profileUse: profileUsePath,
+                                        timer: options.contains(.timePasses) ? timer : nil)
+            }
+            
+            let unitObjectPath = "\(currentDirectory)/\(file).\(index).o"
+            try phase("codegen") {
+                try llvmModule.emit(to: unitObjectPath, assembly: false, cpu: targetCPU)
+            }
+            try cache.store(object: unitObjectPath, for: key)
+            if !options.contains(.preserveTempFiles) {
+                try FileManager.default.removeItem(atPath: unitObjectPath)
+            }
+            objects.append(cache.object(for: key)!)
+        }
+        
+        link(objects: objects)
+        return
+    }
+    
     // MARK: VIR Gen
     if options.contains(.verbose) {
         ast.dump()
         print("\n----------------------------VIR GEN-------------------------------\n")
     }
     
-    // get file title
-    let file = explicitName ?? fileNames.first!
-        .replacingOccurrences(of: ".vist", with: "")
-        .replacingOccurrences(of: ".previst", with: "")
-    
     // create module and gen vir
     let virModule = Module()
-    try ast.emitVIR(module: virModule, isLibrary: options.contains(.produceLib))
+    if !options.contains(.parseStdLib) {
+        try virModule.loadStdLibInterface()
+    }
+    try phase("virgen") {
+        try ast.emitVIR(module: virModule, isLibrary: options.contains(.produceLib))
+    }
     
-    // write out
-    let unoptVIRPath = "\(currentDirectory)/\(file)_.vir"
+    // write out, as binary VIR; the text form is only built when dumped
     if options.contains(.preserveTempFiles) {
-        try virModule.vir.write(toFile: unoptVIRPath, atomically: true, encoding: .utf8)
+        try virModule.writeBinaryVIR(toFile: "\(currentDirectory)/\(file)_.virb")
     }
     if options.contains(.verbose) {
         print(virModule.vir)
@@ -212,15 +437,23 @@ func compileDocuments(
         print("\n----------------------------VIR OPT-------------------------------\n")
     }
     
+    virModule.profile = profileData
+    if let budget = specialisationBudget {
+        virModule.specialisationBudget = budget
+    }
+    
     // run optimiser
-    try PassManager(module: virModule, optLevel: options.optLevel(), opts: options)
-        .runPasses()
+    try phase("vir-opt") {
+        try PassManager(module: virModule, optLevel: options.optLevel(), opts: options, timer: timer)
+            .runPasses()
+    }
     
     // write out
-    let optVIRPath = "\(currentDirectory)/\(file).vir"
-    try virModule.vir.write(toFile: optVIRPath, atomically: true, encoding: .utf8)
     if options.contains(.preserveTempFiles) {
-        try virModule.vir.write(toFile: optVIRPath, atomically: true, encoding: .utf8)
+        try virModule.writeBinaryVIR(toFile: "\(currentDirectory)/\(file).virb")
+    }
+    if options.contains(.compileStdLib) {
+        try virModule.writeStdLibInterface()
     }
     if options.contains(.verbose) {
         print(virModule.vir)
@@ -244,7 +477,6 @@ func compileDocuments(
         let mc = try air.emitMachine(at: asm, target: X8664Machine.self)
         if options.contains(.verbose) { print(mc.asm) }
         
-        let libVistPath = "/usr/local/lib/libvist.dylib"
         Process.execute(exec: .clang,
                         files: [asm, libVistPath],
                         outputName: file,
@@ -260,31 +492,57 @@ func compileDocuments(
     
     // MARK: Build runtime
     if options.contains(.buildRuntime) {
-        try buildRuntime(debugRuntime: options.contains(.debugRuntime))
+        try buildRuntime(debugRuntime: options.contains(.debugRuntime),
+                         singleThreaded: options.contains(.singleThreadedRuntime))
+    }
+    
+    // MARK: Interpret
+    // run the VIR directly, calling into the runtime and stdlib dylibs
+    if options.contains(.interpret), !options.contains(.compileStdLib) {
+        if options.contains(.verbose) { print("\n\n-----------------------------RUN-----------------------------\n") }
+        let libraries = options.contains(.doNotLinkStdLib) ?
+            [libVistRuntimePath] :
+            [libVistRuntimePath, libVistPath]
+        let outputHandle = try output.map { url -> FileHandle in
+            let handle = try FileHandle(forWritingTo: url)
+            handle.seekToEndOfFile()
+            return handle
+        }
+        // the stdlib's C shims are compiled rather than interpreted
+        let shims = options.contains(.linkWithRuntime) ?
+            try LLVMModule.shims(directory: "\(SOURCE_ROOT)/Vist/stdlib") : nil
+        try phase("interpret") {
+            try Interpreter(module: virModule, libraries: libraries, shims: shims)
+                .run(outputFD: outputHandle?.fileDescriptor ?? -1)
+        }
+        return
     }
     
     
     // MARK: LLVM Generation
     var llvmModule = LLVMModule(name: file)
     
-    // import runtime module if needed
-    let stdlibDirectory = "\(SOURCE_ROOT)/Vist/stdlib"
-    if options.contains(.linkWithRuntime) {
-        llvmModule.import(fromFile: "shims.c", directory: stdlibDirectory)
-    }
-    
-    // set triple
-    llvmModule.dataLayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
-    llvmModule.target = String(cString: getHostTriple())
+    // set triple and the target's data layout
+    try llvmModule.setHostTarget(cpu: targetCPU)
     
     // Generate LLVM IR code for program
     if options.contains(.verbose) {
         print("\n-----------------------------IR LOWER------------------------------\n")
     }
-    try virModule.virLower(module: llvmModule, isStdLib: options.contains(.parseStdLib))
+    try phase("vir-lower") {
+        try virModule.virLower(module: llvmModule,
+                               isStdLib: options.contains(.parseStdLib),
+                               options: options.loweringOptions())
+    }
+    // link the shims the lowered module calls
+    if options.contains(.linkWithRuntime) {
+        try llvmModule.importShims(directory: "\(SOURCE_ROOT)/Vist/stdlib")
+    }
+    if let cpu = targetCPU {
+        llvmModule.setFunctionTarget(cpu: cpu)
+    }
     
     // print and write to file
-    let unoptimisedIR = llvmModule.description()
     let unoptIRPath = "\(currentDirectory)/\(file)_.ll"
     if options.contains(.preserveTempFiles) {
         try llvmModule.description().write(toFile: unoptIRPath, atomically: true, encoding: String.Encoding.utf8)
@@ -295,17 +553,19 @@ func compileDocuments(
     }
     
     // run LLVM opt passes
-    try performLLVMOptimisations(llvmModule.getModule(),
-                                 Int32(options.optLevel().rawValue),
-                                 options.contains(.compileStdLib))
+    try phase("llvm-opt") {
+        try llvmModule.optimise(optLevel: options.optLevel().rawValue,
+                                isStdLib: options.contains(.compileStdLib),
+                                cpu: targetCPU,
+                                profileGenerate: profileGeneratePath,
+                                profileUse: profileUsePath,
+                                timer: options.contains(.timePasses) ? timer : nil)
+    }
     
     // write out
-    let optIRPath = "\(currentDirectory)/\(file).ll"
-    try llvmModule.description().write(toFile: optIRPath, atomically: true, encoding: .utf8)
-    defer {
-        if !options.contains(.preserveTempFiles) {
-            try! FileManager.default.removeItem(atPath: optIRPath)
-        }
+    if options.contains(.preserveTempFiles) {
+        let optIRPath = "\(currentDirectory)/\(file).ll"
+        try llvmModule.description().write(toFile: optIRPath, atomically: true, encoding: .utf8)
     }
     
     if options.contains(.dumpLLVMIR) {
@@ -317,60 +577,52 @@ func compileDocuments(
     }
     
     
-    // MARK: Link and assemble
-    let libVistPath = "/usr/local/lib/libvist.dylib"
-    let libVistRuntimePath = "/usr/local/lib/libvistruntime.dylib"
+    // MARK: JIT
+    // run the module in process, nothing is written to disk or linked
+    // instrumented programs need the profile runtime, so are always linked
+    if options.contains(.jit), !options.contains(.compileStdLib), !options.contains(.dumpASM), profileGeneratePath == nil {
+        if options.contains(.verbose) { print("\n\n-----------------------------RUN-----------------------------\n") }
+        let libraries = options.contains(.doNotLinkStdLib) ?
+            [libVistRuntimePath] :
+            [libVistRuntimePath, libVistPath]
+        let outputHandle = try output.map { url -> FileHandle in
+            let handle = try FileHandle(forWritingTo: url)
+            handle.seekToEndOfFile()
+            return handle
+        }
+        try phase("jit") {
+            try llvmModule.run(libraries: libraries, outputFD: outputHandle?.fileDescriptor ?? -1)
+        }
+        return
+    }
     
-    // if its the stdlin, produce a dylib
-    if options.contains(.compileStdLib) {
-        
-        // .ll -> .dylib
-        // to link against program
-        Process.execute(exec: .clang,
-                        files: [libVistRuntimePath, "\(file).ll"],
-                        outputName: libVistPath,
-                        cwd: currentDirectory,
-                        args: "-dynamiclib")
+    // MARK: Codegen and link
+    // codegen the module in process, clang is only used to link
+    try phase("codegen") {
+        try llvmModule.emit(to: objectPath, assembly: false, cpu: targetCPU)
     }
-    else {
-        
-        let wantsDumpASM = options.contains(.dumpASM), verboseOutput = options.contains(.verbose)
-        
-        // if the output requires asm, we compile to it first
-        if wantsDumpASM || verboseOutput {
-            // .ll -> .s
-            // for printing/saving
-            Process.execute(exec: .clang,
-                            files: ["\(file).ll"],
-                            cwd: currentDirectory,
-                            args: "-S")
-            let asmPath = "\(currentDirectory)/\(file).s"
-            let asm = try String(contentsOfFile: asmPath, encoding: .utf8)
-            defer {
-                if !options.contains(.preserveTempFiles) { try! FileManager.default.removeItem(atPath: asmPath) }
-            }
-            
-            print(asm)
-            if wantsDumpASM { return }
+    defer {
+        if !options.contains(.preserveTempFiles) {
+            try! FileManager.default.removeItem(atPath: objectPath)
         }
-        
-        // get the input for the clang binary
-        let inputFiles = options.contains(.doNotLinkStdLib) ?
-            [libVistRuntimePath, "\(file).ll"] :
-            [libVistRuntimePath, libVistPath, "\(file).ll"]
-        // .ll -> exec
-        Process.execute(exec: .clang,
-                        files: inputFiles,
-                        outputName: file,
-                        cwd: currentDirectory)
-        
-        if options.contains(.buildAndRun) {
-            if options.contains(.verbose) { print("\n\n-----------------------------RUN-----------------------------\n") }
-            runExecutable(file: file, inDirectory: currentDirectory, output: output)
+    }
+    // if the output requires asm, we compile to it first
+    let wantsDumpASM = options.contains(.dumpASM), verboseOutput = options.contains(.verbose)
+    if !options.contains(.compileStdLib), wantsDumpASM || verboseOutput {
+        // module -> .s
+        // for printing/saving
+        let asmPath = "\(currentDirectory)/\(file).s"
+        try llvmModule.emit(to: asmPath, assembly: true, cpu: targetCPU)
+        let asm = try String(contentsOfFile: asmPath, encoding: .utf8)
+        defer {
+            if !options.contains(.preserveTempFiles) { try! FileManager.default.removeItem(atPath: asmPath) }
         }
         
+        print(asm)
+        if wantsDumpASM { return }
     }
     
+    link()
 }
 
 
@@ -405,21 +657,52 @@ func runExecutable(
 
 private struct RuntimeCompilationError : Error {}
 
-func buildRuntime(debugRuntime debug: Bool) throws {
+/// The path of the runtime dylib. The single threaded variant has its own, so
+/// building it doesn't change the runtime every other program links
+func runtimeLibraryPath(singleThreaded: Bool) -> String {
+    return singleThreaded ? "/usr/local/lib/libvistruntime_st.dylib" : "/usr/local/lib/libvistruntime.dylib"
+}
+
+func buildRuntime(debugRuntime debug: Bool, singleThreaded: Bool = false) throws {
     
     let runtimeDirectory = "\(SOURCE_ROOT)/Vist/stdlib/runtime"
-    let libVistRuntimePath = "/usr/local/lib/libvistruntime.dylib"
+    let libVistRuntimePath = runtimeLibraryPath(singleThreaded: singleThreaded)
+    
+    var args = ["-dynamiclib", "-std=c++14", "-O3", "-lstdc++", "-includeruntime.h"]
+    if debug { args.append("-DRUNTIME_DEBUG") }
+    if singleThreaded { args.append("-DRUNTIME_SINGLE_THREADED") }
     
     // .cpp -> .dylib
     // to link against program
-    let process = Process.execute(exec: .clang,
-                                  files: ["Existential.cpp", "RefcountedObject.cpp", "Casting.cpp", "Demangle.cpp", "Introspection.cpp"],
+    let process = Process.execute(execName: Exec.clang.rawValue,
+                                  files: ["Allocator.cpp", "Output.cpp", "Existential.cpp", "RefcountedObject.cpp", "Casting.cpp", "Demangle.cpp", "Introspection.cpp"],
                                   outputName: libVistRuntimePath,
                                   cwd: runtimeDirectory,
-                                  args: "-dynamiclib", "-std=c++14", "-O3", "-lstdc++", "-includeruntime.h", debug ? "-DRUNTIME_DEBUG" : "")
+                                  args: args)
     if case let fh as FileHandle = process.standardError, fh.seekToEndOfFile() != 0 {
         throw RuntimeCompilationError()
     }
+    
+    // the shims are built with the runtime so compiles only have to load them
+    try buildShims(directory: "\(SOURCE_ROOT)/Vist/stdlib", force: true)
+}
+
+/// Merges the raw profile at `path` into an indexed profile next to it
+/// - returns: the path of the indexed profile, `path` if it already is one
+private func mergeProfile(path: String, cwd: String) throws -> String {
+    let rawPath = path.hasPrefix("/") ? path : "\(cwd)/\(path)"
+    guard rawPath.hasSuffix(".profraw") else { return rawPath }
+    
+    let profdataPath = rawPath.replacingOccurrences(of: ".profraw", with: ".profdata")
+    let process = Process.execute(exec: .profdata,
+                                  files: [rawPath],
+                                  outputName: profdataPath,
+                                  cwd: cwd,
+                                  args: "merge")
+    guard process.terminationStatus == 0 else {
+        throw error(ProfileError.couldNotRead(path: rawPath, message: "llvm-profdata merge failed"))
+    }
+    return profdataPath
 }
 
 func runPreprocessor(file: inout String, cwd: String) {
@@ -0,0 +1,186 @@
+//
+//  CompileTimer.swift
+//  Vist
+//
+//  Created by Josef Willsher on 14/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+import Dispatch
+
+/// Collects the wall time of the compiler's phases and of every optimisation
+/// pass run, reported by `-time-passes` and `-stats`
+final class CompileTimer {
+
+    /// The time spent in one phase or pass
+    struct Record {
+        let name: String
+        /// Wall time in seconds, summed over every run
+        var time: Double
+        var runs: Int
+        /// The change in instruction count, summed over every run
+        var instructionDelta: Int
+    }
+
+    private var phaseRecords: [Record] = [], passRecords: [Record] = [], llvmPassRecords: [Record] = []
+    /// Function passes are recorded from the optimiser's workers
+    private let queue = DispatchQueue(label: "com.vist.compile-timer")
+
+    /// The phases, in the order they were first run
+    var phases: [Record] { return queue.sync { phaseRecords } }
+    /// The passes, in the order they were first run
+    var passes: [Record] { return queue.sync { passRecords } }
+    /// The LLVM passes, in the order they were first run
+    var llvmPasses: [Record] { return queue.sync { llvmPassRecords } }
+
+    /// Runs `body`, adding the time it took to the phase `name`
+    func time<T>(phase name: String, _ body: () throws -> T) rethrows -> T {
+        let start = DispatchTime.now()
+        defer {
+            let time = CompileTimer.seconds(since: start)
+            queue.sync { CompileTimer.add(name: name, time: time, instructionDelta: 0, to: &phaseRecords) }
+        }
+        return try body()
+    }
+
+    /// Adds a run of the pass `name` which started at `start`
+    func record(pass name: String, since start: DispatchTime, instructionDelta: Int) {
+        let time = CompileTimer.seconds(since: start)
+        queue.sync { CompileTimer.add(name: name, time: time, instructionDelta: instructionDelta, to: &passRecords) }
+    }
+    
+    /// Adds a run of the LLVM pass `name`, which LLVM timed itself
+    func record(llvmPass name: String, time: Double, instructionDelta: Int) {
+        queue.sync { CompileTimer.add(name: name, time: time, instructionDelta: instructionDelta, to: &llvmPassRecords) }
+    }
+
+    private static func add(name: String, time: Double, instructionDelta: Int, to records: inout [Record]) {
+        if let index = records.index(where: { $0.name == name }) {
+            records[index].time += time
+            records[index].runs += 1
+            records[index].instructionDelta += instructionDelta
+        }
+        else {
+            records.append(Record(name: name, time: time, runs: 1, instructionDelta: instructionDelta))
+        }
+    }
+
+    private static func seconds(since start: DispatchTime) -> Double {
+        return Double(DispatchTime.now().uptimeNanoseconds - start.uptimeNanoseconds) / 1_000_000_000
+    }
+}
+
+
+// MARK: Reports
+
+extension CompileTimer {
+
+    /// A table of phase and pass timings. Function passes run concurrently
+    /// so their total can exceed the wall time of the optimiser phase
+    func timingTable() -> String {
+        var lines: [String] = []
+        let phases = self.phases
+        let total = phases.reduce(0) { $0 + $1.time }
+
+        lines.append("===-------------------- Compile phases ---------------------===")
+        lines.append(row("phase", "time (ms)", "%", ""))
+        for phase in phases {
+            lines.append(row(phase.name, milliseconds(phase.time), percent(phase.time, of: total), ""))
+        }
+        lines.append(row("total", milliseconds(total), "100.0", ""))
+
+        appendPasses(passes, title: "===----------------- VIR optimiser passes ------------------===", to: &lines)
+        appendPasses(llvmPasses, title: "===--------------------- LLVM passes -----------------------===", to: &lines)
+        return lines.joined(separator: "\n")
+    }
+
+    private func appendPasses(_ passes: [Record], title: String, to lines: inout [String]) {
+        guard !passes.isEmpty else { return }
+        let passTotal = passes.reduce(0) { $0 + $1.time }
+        lines.append("")
+        lines.append(title)
+        lines.append(row("pass", "time (ms)", "runs", "inst delta"))
+        for pass in passes.sorted(by: { $0.time > $1.time }) {
+            lines.append(row(pass.name, milliseconds(pass.time), "\(pass.runs)", "\(pass.instructionDelta)"))
+        }
+        lines.append(row("total", milliseconds(passTotal), "", ""))
+    }
+
+    private func row(_ name: String, _ columns: String...) -> String {
+        return columns.reduce(name.padding(to: 24)) { line, column in line + column.leftPadding(to: 12) }
+    }
+    private func milliseconds(_ time: Double) -> String {
+        return format(time * 1000, places: 3)
+    }
+    private func percent(_ time: Double, of total: Double) -> String {
+        return format(total == 0 ? 0 : time / total * 100, places: 1)
+    }
+}
+
+/// A table of the opt statistics which are non zero
+func statisticsTable(_ statistics: [Statistic]) -> String {
+    var lines = ["===------------------- VIR opt statistics ------------------==="]
+    for stat in statistics {
+        lines.append("\(stat.count)".leftPadding(to: 8) + "  " + stat.pass.padding(to: 20) + stat.description)
+    }
+    return lines.joined(separator: "\n")
+}
+
+/// The timings and statistics as a JSON object, for tooling to compare builds
+func compileReportJSON(timer: CompileTimer?, statistics: [Statistic]?) -> String {
+    var fields: [String] = []
+
+    func records(_ records: [CompileTimer.Record], withDelta: Bool) -> String {
+        let objects = records.map { record -> String in
+            var object = "{\"name\": \(jsonString(record.name)), \"time\": \(record.time), \"runs\": \(record.runs)"
+            if withDelta { object += ", \"instructionDelta\": \(record.instructionDelta)" }
+            return object + "}"
+        }
+        return "[" + objects.map { "\n    " + $0 }.joined(separator: ",") + (objects.isEmpty ? "]" : "\n  ]")
+    }
+
+    if let timer = timer {
+        fields.append("\"phases\": " + records(timer.phases, withDelta: false))
+        fields.append("\"passes\": " + records(timer.passes, withDelta: true))
+        fields.append("\"llvmPasses\": " + records(timer.llvmPasses, withDelta: true))
+    }
+    if let statistics = statistics {
+        let objects = statistics.map { stat in
+            "{\"pass\": \(jsonString(stat.pass)), \"statistic\": \(jsonString(stat.description)), \"count\": \(stat.count)}"
+        }
+        fields.append("\"statistics\": [" + objects.map { "\n    " + $0 }.joined(separator: ",") + (objects.isEmpty ? "]" : "\n  ]"))
+    }
+    return "{\n  " + fields.joined(separator: ",\n  ") + "\n}\n"
+}
+
+private func jsonString(_ string: String) -> String {
+    var escaped = ""
+    for scalar in string.unicodeScalars {
+        switch scalar {
+        case "\"": escaped += "\\\""
+        case "\\": escaped += "\\\\"
+        case "\n": escaped += "\\n"
+        default: escaped.unicodeScalars.append(scalar)
+        }
+    }
+    return "\"" + escaped + "\""
+}
+
+private func format(_ value: Double, places: Int) -> String {
+    var scale = 1.0
+    for _ in 0..<places { scale *= 10 }
+    let rounded = Int((value * scale).rounded())
+    let whole = "\(rounded / Int(scale))", fraction = "\(abs(rounded % Int(scale)))"
+    return whole + "." + String(repeating: "0", count: places - fraction.characters.count) + fraction
+}
+
+private extension String {
+    func padding(to width: Int) -> String {
+        let count = characters.count
+        return count >= width ? self + " " : self + String(repeating: " ", count: width - count)
+    }
+    func leftPadding(to width: Int) -> String {
+        let count = characters.count
+        return count >= width ? " " + self : String(repeating: " ", count: width - count) + self
+    }
+}
@@ -0,0 +1,139 @@
+//
+//  IncrementalBuild.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+/// A part of the program compiled to its own object by `-incremental` builds:
+/// a file of declarations, or the files with top level code, which form `main`.
+///
+/// A unit declares the other units' functions and types and defines only its
+/// own, so an unchanged unit's object can be relinked. Metadata is compared by
+/// address at runtime, so only the primary unit defines it
+struct CompilationUnit {
+    let fileNames: [String]
+    let ast: AST
+    /// Whether this unit defines `main` and the program's type metadata
+    let isPrimary: Bool
+
+    /// Splits the program into units. A library's first file is its primary unit
+    /// - parameter files: The sema checked ASTs of the files, in the order given
+    static func units(of files: [(fileName: String, ast: AST)], isLibrary: Bool) -> [CompilationUnit] {
+        if isLibrary {
+            return files.enumerated().map { index, file in
+                CompilationUnit(fileNames: [file.fileName], ast: file.ast, isPrimary: index == 0)
+            }
+        }
+
+        let isDeclarations = { (file: (fileName: String, ast: AST)) in
+            !file.ast.exprs.contains { !($0 is LibraryTopLevel) }
+        }
+        // the top level code is run in order, in one `main`
+        let code = files.filter { !isDeclarations($0) }
+        let main = CompilationUnit(fileNames: code.map { $0.fileName },
+                                   ast: AST(exprs: code.flatMap { $0.ast.exprs }),
+                                   isPrimary: true)
+        return [main] + files.filter(isDeclarations).map { file in
+            CompilationUnit(fileNames: [file.fileName], ast: file.ast, isPrimary: false)
+        }
+    }
+
+    /// The declarations of the other units, which this unit may use
+    func externalDecls(in units: [CompilationUnit]) -> [LibraryTopLevel] {
+        return units
+            .filter { $0.fileNames != fileNames }
+            .flatMap { unit in unit.ast.exprs.flatMap { $0 as? LibraryTopLevel } }
+    }
+}
+
+
+// MARK: Interfaces
+
+extension AST {
+
+    /// A description of the declarations other units can see. Every unit is
+    /// keyed on every interface, as a change could alter how it calls into,
+    /// lays out, or defines the metadata of another unit's declarations
+    var interface: String {
+        return exprs.flatMap { expr -> String? in
+            switch expr {
+            case let decl as FuncDecl: return decl.interface
+            case let decl as TypeDecl: return decl.interface
+            case let decl as ConceptDecl: return decl.interface
+            default: return nil
+            }
+        }.joined(separator: "\n")
+    }
+}
+
+private extension FuncDecl {
+    var interface: String {
+        let type = typeRepr.type.map { "\($0.mangledName) \($0.prettyName)" } ?? ""
+        return "func \(mangledName ?? name) \(type) \(attrs.map { $0.rawValue })"
+    }
+}
+
+private extension TypeDecl {
+    var interface: String {
+        guard let type = type else { return "type \(name)" }
+        let header = "type \(name)\(type.isHeapAllocated ? " ref" : "") \(type.concepts.map { $0.name })"
+        let members = type.members.map { "\($0.name) \($0.type.prettyName) \($0.isMutable)" }
+        let initialisers = self.initialisers.map { "init \($0.mangledName ?? "") \($0.typeRepr.type?.prettyName ?? "")" }
+        let deinitialisers = self.deinitialisers.map { "deinit \($0.mangledName ?? "")" }
+        return ([header] + members + methods.map { $0.interface } + initialisers + deinitialisers)
+            .joined(separator: "\n  ")
+    }
+}
+
+private extension ConceptDecl {
+    var interface: String {
+        guard let type = type else { return "concept \(name)" }
+        let properties = type.requiredProperties.map { "\($0.name) \($0.type.prettyName) \($0.isMutable)" }
+        return (["concept \(name)"] + properties + requiredMethods.map { $0.interface })
+            .joined(separator: "\n  ")
+    }
+}
+
+
+// MARK: Metadata
+
+extension Module {
+
+    /// Imports every stdlib type and concept, so the primary unit can define
+    /// the metadata of those any unit uses
+    func importStdLibTypes() {
+        let types: [NominalType] = StdLib.types, concepts: [NominalType] = StdLib.concepts
+        for type in types + concepts {
+            _ = type.importedType(in: self)
+        }
+    }
+
+    /// Records a conformance for every type which models a concept. Other units
+    /// construct existentials and cast with metadata this module defines, so
+    /// it can't only record the conformances its own code uses
+    func createConformances() throws {
+        let types = typeList.values.sorted { $0.name < $1.name }
+        let concepts = try types.filter { $0.isConceptType() }.map { try $0.getAsConceptType() }
+
+        for type in types {
+            guard let structType = type.getConcreteNominalType(), !structType.isConceptType() else { continue }
+
+            for concept in concepts where structType.models(concept: concept) {
+                // the witnesses must be functions this module can reference
+                let witnesses = concept.requiredFunctions.flatMap { required in
+                    structType.methods.first { $0.name.demangleName() == required.name.demangleName() && $0.type == required.type }
+                }
+                guard try !witnesses.contains(where: { witness in
+                    try function(named: witness.name) ?? getOrInsertStdLibFunction(mangledName: witness.name) == nil
+                }) else { continue }
+
+                _ = VIRWitnessTable.create(module: self, type: structType, conforms: concept)
+                if !type.concepts.contains(concept) {
+                    type.concepts.append(concept)
+                }
+            }
+        }
+    }
+}
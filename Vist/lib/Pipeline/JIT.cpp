@@ -0,0 +1,151 @@
+//
+//  JIT.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 08/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include "JIT.hpp"
+#include "Backend.hpp"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+/// Points stdout at `fd` for the lifetime of the object, flushing
+/// anything buffered on either side of the swap
+class StdoutRedirect {
+    int savedFD = -1;
+public:
+    StdoutRedirect(int fd) {
+        if (fd == -1)
+            return;
+        fflush(stdout);
+        savedFD = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+    }
+    ~StdoutRedirect() {
+        if (savedFD == -1)
+            return;
+        fflush(stdout);
+        dup2(savedFD, STDOUT_FILENO);
+        close(savedFD);
+    }
+};
+
+/// JIT compiles `module` for the host and runs its `main` function
+/// \returns whether main was run, if not `error` describes why
+static bool runJIT(Module *_Nonnull module, int outputFD, std::string &error) {
+    
+    // libc and anything loaded by `loadJITLibrary` is searched
+    // by `getSymbolAddressInProcess`
+    sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    
+    auto targetMachine = createTargetMachine(module->getTargetTriple(), sys::getHostCPUName(), error);
+    if (!targetMachine)
+        return false;
+    module->setDataLayout(targetMachine->createDataLayout());
+    
+    orc::ObjectLinkingLayer<> objectLayer;
+    orc::IRCompileLayer<decltype(objectLayer)> compileLayer(objectLayer, orc::SimpleCompiler(*targetMachine));
+    
+    // symbols defined in the module bind to the JIT'd code, everything
+    // else comes from the process
+    auto resolver = orc::createLambdaResolver(
+        [&](const std::string &name) {
+            if (auto symbol = compileLayer.findSymbol(name, false))
+                return symbol.toRuntimeDyldSymbol();
+            return RuntimeDyld::SymbolInfo(nullptr);
+        },
+        [](const std::string &name) {
+            if (auto address = RTDyldMemoryManager::getSymbolAddressInProcess(name))
+                return RuntimeDyld::SymbolInfo(address, JITSymbolFlags::Exported);
+            return RuntimeDyld::SymbolInfo(nullptr);
+        });
+    
+    // the module is owned by the caller, so the set holds it unowned
+    std::vector<Module *> moduleSet = { module };
+    auto handle = compileLayer.addModuleSet(std::move(moduleSet),
+                                            make_unique<SectionMemoryManager>(),
+                                            std::move(resolver));
+    
+    auto mangle = [&](StringRef name) {
+        std::string mangled;
+        raw_string_ostream stream(mangled);
+        Mangler::getNameWithPrefix(stream, name, module->getDataLayout());
+        return stream.str();
+    };
+    
+    auto mainSymbol = compileLayer.findSymbol(mangle("main"), true);
+    if (!mainSymbol) {
+        compileLayer.removeModuleSet(handle);
+        error = "module has no main function";
+        return false;
+    }
+    
+    // the runtime buffers output, it must be written before stdout is restored
+    // rather than when the compiler exits
+    auto flushAddress = RTDyldMemoryManager::getSymbolAddressInProcess(mangle("vist_outputFlush"));
+    // the runtime caches conformances by metadata address, the module's metadata
+    // is freed when it is removed and a later module may be given the same memory
+    auto flushConformancesAddress = RTDyldMemoryManager::getSymbolAddressInProcess(mangle("vist_flushConformanceCache"));
+    // witness cache sites are the module's globals, their counts are printed
+    // and they are unregistered before it is freed, rather than at exit
+    auto flushWitnessSitesAddress = RTDyldMemoryManager::getSymbolAddressInProcess(mangle("vist_flushWitnessCacheSites"));
+    
+    auto main = reinterpret_cast<void (*)()>(static_cast<uintptr_t>(mainSymbol.getAddress()));
+    {
+        StdoutRedirect redirect(outputFD);
+        main();
+        if (flushAddress)
+            reinterpret_cast<void (*)()>(static_cast<uintptr_t>(flushAddress))();
+        if (flushWitnessSitesAddress)
+            reinterpret_cast<void (*)()>(static_cast<uintptr_t>(flushWitnessSitesAddress))();
+    }
+    
+    if (flushConformancesAddress)
+        reinterpret_cast<void (*)()>(static_cast<uintptr_t>(flushConformancesAddress))();
+    compileLayer.removeModuleSet(handle);
+    return true;
+}
+
+bool loadJITLibrary(const char *_Nonnull path, char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    if (!sys::DynamicLibrary::LoadLibraryPermanently(path, &error)) {
+        *errorMessage = nullptr;
+        return true;
+    }
+    *errorMessage = strdup(error.c_str());
+    return false;
+}
+
+bool runModuleJIT(LLVMModuleRef _Nonnull module, int outputFD,
+                  char *_Nullable *_Nonnull errorMessage) {
+    std::string error;
+    if (runJIT(unwrap(module), outputFD, error)) {
+        *errorMessage = nullptr;
+        return true;
+    }
+    *errorMessage = strdup(error.c_str());
+    return false;
+}
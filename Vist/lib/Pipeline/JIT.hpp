@@ -0,0 +1,36 @@
+//
+//  JIT.hpp
+//  Vist
+//
+//  Created by Josef Willsher on 08/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#ifndef JIT_hpp
+#define JIT_hpp
+
+#include "LLVM.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    
+    /// Loads the dylib at `path` into the process so JIT'd code can call into it,
+    /// used for the runtime and stdlib
+    /// \returns whether it was loaded, if not `errorMessage` is set to a message
+    ///          which must be freed with `LLVMDisposeMessage`
+    bool loadJITLibrary(const char *_Nonnull path, char *_Nullable *_Nonnull errorMessage);
+    
+    /// Compiles `module` in memory with ORC and calls its `main` function
+    /// \param outputFD if not -1, stdout is redirected to this file descriptor
+    ///        while `main` runs
+    /// \returns whether `main` was run, if not `errorMessage` is set to a message
+    ///          which must be freed with `LLVMDisposeMessage`
+    bool runModuleJIT(LLVMModuleRef _Nonnull module, int outputFD,
+                      char *_Nullable *_Nonnull errorMessage);
+    
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JIT_hpp */
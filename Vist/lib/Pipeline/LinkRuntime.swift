@@ -8,6 +8,13 @@
 
 import class Foundation.Process
 import class Foundation.FileManager
+import class Foundation.ProcessInfo
+import struct Foundation.Date
+import struct Foundation.FileAttributeKey
+import func Darwin.rename
+
+/// The stdlib's C shims compiled to bitcode
+let libVistShimsPath = "/usr/local/lib/libvistshims.bc"
 
 extension LLVMModule {
     
@@ -62,3 +69,64 @@ extension LLVMModule {
         
     }
 }
+
+extension LLVMModule {
+    
+    /// Links in the shims this module calls from their precompiled bitcode,
+    /// building it first if `shims.c` has changed. The bitcode is memory
+    /// mapped and read lazily; the shims the module doesn't declare are
+    /// deleted before linking, so their bodies are never read
+    /// - precondition: The module has been lowered, so it declares the shims it calls
+    func importShims(directory: String, bitcodePath: String = libVistShimsPath) throws {
+        let shimsModule = try LLVMModule.shims(directory: directory, bitcodePath: bitcodePath)
+        // shims don't call each other, so an unused shim has no users; the
+        // internal functions they use are only linked if a linked shim does
+        for shim in Array(shimsModule.functions)
+            where !shim.isDeclaration && shim.linkage == LLVMExternalLinkage && function(named: shim.name!) == nil {
+            try shim.eraseFromParent()
+        }
+        self.import(from: shimsModule)
+    }
+    
+    /// The shims' bitcode, with their functions given their runtime names
+    static func shims(directory: String, bitcodePath: String = libVistShimsPath) throws -> LLVMModule {
+        try buildShims(directory: directory, bitcodePath: bitcodePath, force: false)
+        
+        let shimsModule = LLVMModule(path: bitcodePath, name: "shims")
+        for function in shimsModule.functions {
+            let name = function.name!
+            guard name.hasPrefix("_Vvist$U") else { continue }
+            function.name = name.demangleRuntimeName()
+        }
+        return shimsModule
+    }
+}
+
+/// Compiles `shims.c` in `directory` to bitcode at `bitcodePath`
+/// - parameter force: Rebuild even if the bitcode is newer than the source
+func buildShims(directory: String, bitcodePath: String = libVistShimsPath, force: Bool) throws {
+    let sourcePath = "\(directory)/shims.c"
+    
+    func modificationDate(_ path: String) -> Date? {
+        let attributes = try? FileManager.default.attributesOfItem(atPath: path)
+        return attributes?[FileAttributeKey.modificationDate] as? Date
+    }
+    if !force, let built = modificationDate(bitcodePath), let source = modificationDate(sourcePath), built >= source {
+        return
+    }
+    
+    // .c -> .bc, written beside the bitcode and renamed over it so concurrent
+    // compiles never load a partly written file
+    let temporaryPath = "\(bitcodePath).\(ProcessInfo.processInfo.processIdentifier).tmp"
+    let process = Process.execute(exec: .clang,
+                                  files: ["shims.c"],
+                                  outputName: temporaryPath,
+                                  cwd: directory,
+                                  args: "-O3", "-c", "-emit-llvm")
+    guard process.terminationStatus == 0, rename(temporaryPath, bitcodePath) == 0 else {
+        _ = try? FileManager.default.removeItem(atPath: temporaryPath)
+        throw ShimsCompilationError()
+    }
+}
+
+private struct ShimsCompilationError : Error {}
@@ -0,0 +1,30 @@
+//
+//  StdLibInterface.swift
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+import class Foundation.FileManager
+
+/// The stdlib's interface in binary VIR, written beside libvist when the
+/// stdlib is built
+let libVistInterfacePath = "/usr/local/lib/libvist.virb"
+
+extension Module {
+
+    /// Writes the interface of the stdlib: its types, witness tables, and
+    /// function signatures, and the bodies of its `@inline` functions. The
+    /// file is replaced atomically, as other compiles may be mapping it
+    func writeStdLibInterface(toFile path: String = libVistInterfacePath) throws {
+        try writeBinaryVIR(toFile: path, interface: true)
+    }
+
+    /// Memory maps the stdlib's interface, if it has been built, so the
+    /// inliner can read the `@inline` bodies the program calls
+    func loadStdLibInterface(fromFile path: String = libVistInterfacePath) throws {
+        guard FileManager.default.fileExists(atPath: path) else { return }
+        stdlibInterface = try VIRReader(contentsOf: path, into: self, interface: true)
+    }
+}
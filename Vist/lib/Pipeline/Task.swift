@@ -20,6 +20,8 @@ enum Exec: String {
     case assemble = "/usr/local/Cellar/llvm/3.9.0/bin/llvm-as"
     /// LLVM backend
     case llc = "/usr/local/Cellar/llvm/3.9.0/bin/llc"
+    /// LLVM profile merger
+    case profdata = "/usr/local/Cellar/llvm/3.9.0/bin/llvm-profdata"
 }
 
 extension Process {
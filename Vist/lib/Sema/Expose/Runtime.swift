@@ -29,9 +29,22 @@ enum Runtime {
                          /*name=*/BuiltinType.opaquePointer, /*isreftype=*/boolType,
                                   /*destructor=*/BuiltinType.opaquePointer, /*deinit=*/BuiltinType.opaquePointer, /*copyconstructor=*/BuiltinType.opaquePointer],
                                                        name: "vist.metadata")
-    static let existentialObjectType = StructType.withTypes([BuiltinType.wordType, int32Type, witnessTableType.ptrType().ptrType(), typeMetadataType], name: "vist.existential")
+    /// Matches `ExistentialObject` in runtime.h
+    static let existentialObjectType = StructType.withTypes([
+        /*instanceTaggedPtr=*/BuiltinType.wordType, /*conformances=*/witnessTableType.ptrType().ptrType(), /*numConformances=*/int32Type,
+                              /*metadata=*/typeMetadataType.ptrType(), /*inlineBuffer=*/BuiltinType.array(el: BuiltinType.wordType, size: existentialInlineBufferWords)],
+                                                            name: "vist.existential")
+    /// The number of words in an existential's inline buffer
+    static let existentialInlineBufferWords = 3
+    /// Set in an existential's `instanceTaggedPtr` if the instance is stored inline
+    static let existentialInlineTag = 0x2
+    static let existentialTagMask = 0x3
     
-    static let allRuntimeTypes = [refcountedObjectType, witnessTableType, typeMetadataType, existentialObjectType]
+    /// Matches `WitnessCacheSite` in runtime.h
+    static let witnessCacheSiteType = StructType.withTypes([/*name=*/BuiltinType.opaquePointer, /*hits=*/intType, /*misses=*/intType,
+                                                            /*next=*/BuiltinType.opaquePointer, /*registered=*/boolType], name: "vist.witness_cache_site")
+    
+    static let allRuntimeTypes = [refcountedObjectType, witnessTableType, typeMetadataType, existentialObjectType, witnessCacheSiteType]
     
     struct Function {
         let name: String, type: FunctionType
@@ -48,11 +61,10 @@ enum Runtime {
         static let releaseObject  = Function(name: "vist_releaseObject", type: FunctionType(params: [refcountedObjectPointerType], returns: voidType))
         static let isUniquelyReferenced  = Function(name: "vist_objectHasUniqueReference", type: FunctionType(params: [refcountedObjectPointerType], returns: boolType))
         
-        static let setYieldTarget = Function(name: "vist_setYieldTarget", type: FunctionType(params: [], returns: boolType))
-        static let yieldUnwind = Function(name: "vist_yieldUnwind", type: FunctionType(params: [], returns: voidType))
-        
         static let getWitnessMethod = Function(name: "vist_getWitnessMethod",
                                                type: FunctionType(params: [existentialObjectType.ptrType(), int32Type, int32Type], returns: Builtin.opaquePointerType))
+        static let recordWitnessCacheLookup = Function(name: "vist_recordWitnessCacheLookup",
+                                                       type: FunctionType(params: [witnessCacheSiteType.ptrType(), boolType], returns: voidType))
         static let getPropertyProjection = Function(name: "vist_getPropertyProjection",
                                                     type: FunctionType(params: [existentialObjectType.ptrType(), int32Type, int32Type], returns: Builtin.opaquePointerType))
         static let getBufferProjection = Function(name: "vist_getExistentialBufferProjection",
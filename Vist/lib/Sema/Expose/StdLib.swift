@@ -39,8 +39,8 @@ enum StdLib {
     
     static let metatypeType = StructType(members: [("_metadata", BuiltinType.opaquePointer, true)], methods: [(name: "size", type: FunctionType(params: [], returns: intType), mutating: false), (name: "name", type: FunctionType(params: [], returns: stringType), mutating: false)], name: "Metatype")
     
-    private static let types = [intType, int32Type, boolType, doubleType, rangeType, utf8CodeUnitType, utf16CodeUnitType, stringType, metatypeType]
-    private static let concepts = [printableConcept, anyConcept]
+    static let types = [intType, int32Type, boolType, doubleType, rangeType, utf8CodeUnitType, utf16CodeUnitType, stringType, metatypeType]
+    static let concepts = [printableConcept, anyConcept]
     
     static let printableConcept = ConceptType(name: "Printable", requiredFunctions: [(name: "description", type: FunctionType(params: [], returns: stringType), mutating: false)], requiredProperties: [])
     static let anyConcept = ConceptType(name: "Any", requiredFunctions: [], requiredProperties: [])
@@ -139,6 +139,7 @@ enum StdLib {
         ("vist_cshim_print", FunctionType(params: [BuiltinType.int(size: 32)], returns: voidType)),
         ("vist_cshim_putchar", FunctionType(params: [BuiltinType.int(size: 8)], returns: voidType)),
         ("vist_cshim_write", FunctionType(params: [BuiltinType.opaquePointer, BuiltinType.int(size: 64)], returns: voidType)),
+        ("vist_cshim_flush", FunctionType(params: [], returns: voidType)),
         ("vist_cshim_strlen", FunctionType(params: [BuiltinType.opaquePointer], returns: BuiltinType.int(size: 64))),
         ("vist_cshim_log", FunctionType(params: [], returns: voidType)),
         ("vist_cshim_time", FunctionType(params: [], returns: BuiltinType.float(size: 64))),
@@ -47,7 +47,11 @@ extension _LValueEmitter where Self : LValueEmitter {
 }
 
 /// A libaray without a main function can emit vir for this
-protocol LibraryTopLevel: ASTNode {}
+protocol LibraryTopLevel: ASTNode {
+    /// Declares this in a module which uses but doesn't define it, such as
+    /// the compilation unit of another file
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws
+}
 
 extension ASTNode {
     func emit(module: Module, gen: VIRGenFunction) throws {
@@ -106,10 +110,17 @@ func .+ (lhs: String?, rhs: String) -> String? {
 
 extension AST {
     
-    func emitVIR(module: Module, isLibrary: Bool) throws {
+    /// - parameter externalDecls: Declarations from other compilation units, which
+    ///             this module can use but doesn't define
+    func emitVIR(module: Module, isLibrary: Bool, externalDecls: [LibraryTopLevel] = []) throws {
         
         let builder = module.builder!
         let gen = VIRGenFunction(scope: VIRGenScope(module: module), builder: builder, parent: nil)
+        
+        for decl in externalDecls {
+            try decl.emitDeclaration(module: module, gen: gen)
+        }
+        
         if isLibrary {
             // if its a library we dont emit a main, and just virgen on any decls/statements
             for case let g as LibraryTopLevel in exprs {
@@ -394,6 +405,15 @@ extension FuncDecl : StmtEmitter {
         
         gen.builder.insertPoint = originalInsertPoint
     }
+    
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws {
+        guard let type = typeRepr.type else { throw VIRError.noType(#function) }
+        guard let mangledName = self.mangledName else { throw VIRError.noMangledName }
+        // private functions can only be called from their own file
+        guard !attrs.contains(.private) else { return }
+        
+        try module.getOrInsertFunction(named: mangledName, type: type, attrs: attrs)
+    }
 }
 
 
@@ -711,6 +731,9 @@ extension ForInLoopStmt : StmtEmitter {
      
      The `yield` applies this closure. The closure can also be thick, this allows
      it to capture state from the loop's scope.
+     
+     Small generators are inlined into the loop, large ones are lowered to a
+     resumable frame which the loop calls into, see `lowerGeneratorToCoroutine`.
      */
     func emitStmt(module: Module, gen: VIRGenFunction) throws {
         
@@ -755,9 +778,9 @@ extension ForInLoopStmt : StmtEmitter {
         // move back out
         gen.builder.insertPoint = entryInsertPoint
         
-        // require that we inline the loop thunks early
+        // require that we inline the loop thunks early, whether the generator
+        // is inlined is decided when it is lowered
         loopClosure.thunk.inlineRequirement = .always
-        generatorClosure.thunk.inlineRequirement = .always
         
         // get the instance of the generator
         var generator = try self.generator.emitRValue(module: module, gen: gen)
@@ -859,6 +882,32 @@ extension TypeDecl : StmtEmitter {
         alias.destructor = try emitImplicitDestructorDecl(module: module, gen: gen)
         alias.copyConstructor = try emitImplicitCopyConstructorDecl(module: module, gen: gen)
     }
+    
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws {
+        
+        guard let type = type else { throw irGenError(.notTyped) }
+        
+        let alias = module.getOrInsert(type: type)
+        
+        for i in initialisers {
+            try i.emitDeclaration(module: module, gen: gen)
+        }
+        for d in deinitialisers {
+            alias.deinitialiser = try d.emitDeclaration(module: module, gen: gen)
+        }
+        for method in methods {
+            try method.emitDeclaration(module: module, gen: gen)
+        }
+        
+        // the implicit functions are defined with the type
+        guard case let nominal as NominalType = type.importedType(in: module) else { return }
+        if !nominal.isTrivial() {
+            alias.destructor = try nominal.emitImplicitDestructorDef(module: module, gen: gen)
+        }
+        if nominal.requiresCopyConstruction() {
+            alias.copyConstructor = try nominal.emitImplicitCopyConstructorDef(module: module, gen: gen)
+        }
+    }
 }
 
 
@@ -875,6 +924,17 @@ extension ConceptDecl : StmtEmitter {
         }
     }
     
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws {
+        
+        guard let type = type else { throw irGenError(.notTyped) }
+        
+        module.getOrInsert(type: type)
+        
+        for m in requiredMethods {
+            try m.emitDeclaration(module: module, gen: gen)
+        }
+    }
+    
 }
 
 extension InitDecl : StmtEmitter {
@@ -950,6 +1010,16 @@ extension InitDecl : StmtEmitter {
         // move out of function
         gen.builder.insertPoint = originalInsertPoint
     }
+    
+    /// Declares the initialiser of a type defined in another compilation unit
+    @discardableResult
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws -> Function {
+        guard let initialiserType = typeRepr.type?.cannonicalType(module: module),
+            let mangledName = self.mangledName else {
+                throw VIRError.noType(#file)
+        }
+        return try module.getOrInsertFunction(named: mangledName, type: initialiserType)
+    }
 }
 
 extension DeinitDecl : StmtEmitter {
@@ -1008,6 +1078,15 @@ extension DeinitDecl : StmtEmitter {
         // move out of function
         gen.builder.insertPoint = originalInsertPoint
     }
+    
+    /// Declares the deinitialiser of a type defined in another compilation unit
+    func emitDeclaration(module: Module, gen: VIRGenFunction) throws -> Function {
+        guard let mangledName = self.mangledName,
+            let deinitType = self.deinitType?.cannonicalType(module: module) else {
+            throw VIRError.noType(#file)
+        }
+        return try module.getOrInsertFunction(named: mangledName, type: deinitType)
+    }
 }
 
 
@@ -155,7 +155,7 @@ extension Function {
     
 }
 
-private extension BasicBlock {
+extension BasicBlock {
     
     /// Corrects any phi nodes which were changed by splitting the block
     /// - note moves the insert point away from the current position
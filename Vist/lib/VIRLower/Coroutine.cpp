@@ -0,0 +1,279 @@
+//
+//  Coroutine.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include "Coroutine.hpp"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include <vector>
+
+using namespace llvm;
+
+/// A call to the yield target. Its block is split after the call, so the
+/// generator suspends at the end of `block` and continues from `resume`
+struct Suspend {
+    CallInst *yield;
+    BasicBlock *block, *resume;
+    /// The blocks from which control can reach the yield
+    SmallPtrSet<BasicBlock *, 16> reachesYield;
+    /// The blocks control can reach after resuming
+    SmallPtrSet<BasicBlock *, 16> reachedFromResume;
+};
+
+/// Adds `block`, and the blocks reachable from it along the edges `next`
+/// gives, to `reachable`
+template <typename Edges>
+static void markReachable(BasicBlock *block, SmallPtrSetImpl<BasicBlock *> &reachable, Edges next) {
+    SmallVector<BasicBlock *, 16> worklist = {block};
+    while (!worklist.empty()) {
+        auto current = worklist.pop_back_val();
+        if (!reachable.insert(current).second)
+            continue;
+        for (auto edge : next(current))
+            worklist.push_back(edge);
+    }
+}
+
+/// Whether `generator` can be split; the yield target must only be called,
+/// and the stack memory must be fixed size allocas in the entry block which
+/// the frame's layout can align
+static bool canSplit(Function &generator, Argument &yieldTarget, const DataLayout &layout) {
+
+    if (generator.isDeclaration() || generator.isVarArg() || yieldTarget.use_empty()
+        || !generator.getReturnType()->isVoidTy())
+        return false;
+
+    for (auto user : yieldTarget.users()) {
+        auto call = dyn_cast<CallInst>(user);
+        if (!call || call->getCalledValue() != &yieldTarget || !call->getType()->isVoidTy())
+            return false;
+        for (auto &arg : call->arg_operands())
+            if (arg.get() == &yieldTarget)
+                return false;
+    }
+
+    for (auto &inst : instructions(generator)) {
+        if (auto alloca = dyn_cast<AllocaInst>(&inst)) {
+            if (!alloca->isStaticAlloca()
+                || alloca->getAlignment() > layout.getABITypeAlignment(alloca->getAllocatedType()))
+                return false;
+        }
+        else if (isa<InvokeInst>(inst) || inst.isEHPad())
+            return false;
+    }
+    return true;
+}
+
+/// Whether the value of `inst` may be used after a yield it was defined before
+static bool isLiveAcrossYield(Instruction &inst, const std::vector<Suspend> &suspends) {
+    auto definition = inst.getParent();
+
+    for (auto &use : inst.uses()) {
+        auto user = cast<Instruction>(use.getUser());
+        // a phi uses the value at the end of the incoming block
+        auto block = isa<PHINode>(user) ? cast<PHINode>(user)->getIncomingBlock(use) : user->getParent();
+        // yields end their block, so a use in the defining block is reached
+        // without suspending
+        if (block == definition)
+            continue;
+
+        for (auto &suspend : suspends)
+            if (suspend.reachesYield.count(definition) && suspend.reachedFromResume.count(block))
+                return true;
+    }
+    return false;
+}
+
+bool lowerGeneratorToCoroutine(LLVMValueRef function, unsigned yieldParamIndex) {
+
+    auto &generator = *unwrap<Function>(function);
+    if (yieldParamIndex >= generator.arg_size())
+        return false;
+
+    auto &yieldTarget = *std::next(generator.arg_begin(), yieldParamIndex);
+    auto &module = *generator.getParent();
+    auto &context = generator.getContext();
+    const auto &layout = module.getDataLayout();
+
+    if (!canSplit(generator, yieldTarget, layout))
+        return false;
+
+    // lifetimes of the stack memory don't apply once it is moved into the frame
+    SmallVector<IntrinsicInst *, 8> lifetimeMarkers;
+    for (auto &inst : instructions(generator))
+        if (auto intrinsic = dyn_cast<IntrinsicInst>(&inst))
+            if (intrinsic->getIntrinsicID() == Intrinsic::lifetime_start
+                || intrinsic->getIntrinsicID() == Intrinsic::lifetime_end)
+                lifetimeMarkers.push_back(intrinsic);
+    for (auto marker : lifetimeMarkers)
+        marker->eraseFromParent();
+
+    // end a block after each yield, the yield's block is only known once they
+    // are all split as a later yield may share it
+    std::vector<Suspend> suspends(yieldTarget.getNumUses());
+    auto yieldCall = yieldTarget.user_begin();
+    for (auto &suspend : suspends) {
+        suspend.yield = cast<CallInst>(*yieldCall++);
+        suspend.resume = suspend.yield->getParent()->splitBasicBlock(suspend.yield->getNextNode(), "yield.resume");
+    }
+    for (auto &suspend : suspends) {
+        suspend.block = suspend.yield->getParent();
+        markReachable(suspend.block, suspend.reachesYield, [](BasicBlock *b) { return predecessors(b); });
+        markReachable(suspend.resume, suspend.reachedFromResume, [](BasicBlock *b) { return successors(b); });
+    }
+
+    // values live across a yield are moved to the stack, which becomes part
+    // of the frame
+    SmallVector<Instruction *, 16> spills;
+    for (auto &inst : instructions(generator))
+        if (!isa<AllocaInst>(inst) && isLiveAcrossYield(inst, suspends))
+            spills.push_back(&inst);
+    auto allocaPoint = &*generator.getEntryBlock().begin();
+    for (auto inst : spills)
+        DemoteRegToStack(*inst, false, allocaPoint);
+
+    // the frame is laid out as the resume state, the yielded values, the
+    // generator's args, then its stack memory
+    auto yieldType = cast<FunctionType>(cast<PointerType>(yieldTarget.getType())->getElementType());
+    SmallVector<Type *, 16> fields = {Type::getInt32Ty(context)};
+
+    unsigned valueField = fields.size();
+    fields.append(yieldType->param_begin(), yieldType->param_end());
+
+    unsigned argField = fields.size();
+    SmallVector<Argument *, 4> args;
+    for (auto &arg : generator.args())
+        if (&arg != &yieldTarget) {
+            args.push_back(&arg);
+            fields.push_back(arg.getType());
+        }
+
+    unsigned allocaField = fields.size();
+    SmallVector<AllocaInst *, 16> allocas;
+    for (auto &inst : generator.getEntryBlock())
+        if (auto alloca = dyn_cast<AllocaInst>(&inst)) {
+            auto count = cast<ConstantInt>(alloca->getArraySize())->getZExtValue();
+            allocas.push_back(alloca);
+            fields.push_back(count == 1 ? alloca->getAllocatedType() : ArrayType::get(alloca->getAllocatedType(), count));
+        }
+
+    auto frameType = StructType::create(context, fields, (generator.getName() + ".frame").str());
+
+    // move the body into the resume function
+    auto resume = Function::Create(FunctionType::get(Type::getInt1Ty(context), {frameType->getPointerTo()}, false),
+                                   generator.getLinkage(), generator.getName() + ".resume", &module);
+    resume->setVisibility(generator.getVisibility());
+    resume->addAttributes(AttributeSet::FunctionIndex, generator.getAttributes().getFnAttributes());
+    resume->removeFnAttr(Attribute::AlwaysInline);
+    resume->setDoesNotAlias(1);
+    resume->setDoesNotCapture(1);
+    resume->getBasicBlockList().splice(resume->end(), generator.getBasicBlockList());
+
+    auto frame = &*resume->arg_begin();
+    frame->setName("frame");
+    auto body = &resume->getEntryBlock();
+    auto entry = BasicBlock::Create(context, "entry", resume, body);
+    auto finished = BasicBlock::Create(context, "finished", resume);
+
+    IRBuilder<> builder(entry);
+    for (unsigned i = 0; i < args.size(); ++i) {
+        auto arg = builder.CreateLoad(builder.CreateStructGEP(frameType, frame, argField + i), args[i]->getName());
+        args[i]->replaceAllUsesWith(arg);
+    }
+    for (unsigned i = 0; i < allocas.size(); ++i) {
+        Value *slot = builder.CreateStructGEP(frameType, frame, allocaField + i);
+        if (slot->getType() != allocas[i]->getType())
+            slot = builder.CreateBitCast(slot, allocas[i]->getType());
+        slot->takeName(allocas[i]);
+        allocas[i]->replaceAllUsesWith(slot);
+        allocas[i]->eraseFromParent();
+    }
+
+    // jump to where the frame was suspended, state 0 is the start of the body
+    auto state = builder.CreateLoad(builder.CreateStructGEP(frameType, frame, 0), "state");
+    auto dispatch = builder.CreateSwitch(state, finished, suspends.size() + 1);
+    dispatch->addCase(builder.getInt32(0), body);
+
+    // yields store their value and the state to resume from, and suspend
+    for (unsigned i = 0; i < suspends.size(); ++i) {
+        auto &suspend = suspends[i];
+        auto resumeState = builder.getInt32(i + 1);
+
+        builder.SetInsertPoint(suspend.yield);
+        for (unsigned arg = 0; arg < suspend.yield->getNumArgOperands(); ++arg)
+            builder.CreateStore(suspend.yield->getArgOperand(arg),
+                                builder.CreateStructGEP(frameType, frame, valueField + arg));
+        builder.CreateStore(resumeState, builder.CreateStructGEP(frameType, frame, 0));
+        suspend.yield->eraseFromParent();
+
+        suspend.block->getTerminator()->eraseFromParent();
+        ReturnInst::Create(context, builder.getTrue(), suspend.block);
+        dispatch->addCase(resumeState, suspend.resume);
+    }
+
+    // returning from the body finishes the generator, so resuming again
+    // does nothing
+    builder.SetInsertPoint(finished);
+    builder.CreateStore(builder.getInt32(~0u), builder.CreateStructGEP(frameType, frame, 0));
+    builder.CreateRet(builder.getFalse());
+
+    SmallVector<ReturnInst *, 4> returns;
+    for (auto &block : *resume)
+        if (auto ret = dyn_cast<ReturnInst>(block.getTerminator()))
+            if (!ret->getReturnValue())
+                returns.push_back(ret);
+    for (auto ret : returns) {
+        BranchInst::Create(finished, ret);
+        ret->eraseFromParent();
+    }
+
+    // the generator now runs the frame to completion, passing each value to
+    // the yield target. The frame doesn't escape, so it is allocated on the
+    // stack, and once inlined into a loop it can be promoted to registers
+    auto generatorEntry = BasicBlock::Create(context, "entry", &generator);
+    auto loop = BasicBlock::Create(context, "loop", &generator);
+    auto yield = BasicBlock::Create(context, "yield", &generator);
+    auto exit = BasicBlock::Create(context, "exit", &generator);
+
+    builder.SetInsertPoint(generatorEntry);
+    auto generatorFrame = builder.CreateAlloca(frameType, nullptr, "frame");
+    auto frameSize = builder.getInt64(layout.getTypeAllocSize(frameType));
+    builder.CreateLifetimeStart(generatorFrame, frameSize);
+    builder.CreateStore(builder.getInt32(0), builder.CreateStructGEP(frameType, generatorFrame, 0));
+    for (unsigned i = 0; i < args.size(); ++i)
+        builder.CreateStore(args[i], builder.CreateStructGEP(frameType, generatorFrame, argField + i));
+    builder.CreateBr(loop);
+
+    builder.SetInsertPoint(loop);
+    builder.CreateCondBr(builder.CreateCall(resume, {generatorFrame}), yield, exit);
+
+    builder.SetInsertPoint(yield);
+    SmallVector<Value *, 4> values;
+    for (unsigned i = 0; i < yieldType->getNumParams(); ++i)
+        values.push_back(builder.CreateLoad(builder.CreateStructGEP(frameType, generatorFrame, valueField + i)));
+    builder.CreateCall(&yieldTarget, values);
+    builder.CreateBr(loop);
+
+    builder.SetInsertPoint(exit);
+    builder.CreateLifetimeEnd(generatorFrame, frameSize);
+    builder.CreateRetVoid();
+
+    generator.removeFnAttr(Attribute::NoInline);
+    generator.addFnAttr(Attribute::AlwaysInline);
+    return true;
+}
@@ -0,0 +1,36 @@
+//
+//  Coroutine.hpp
+//  Vist
+//
+//  Created by Josef Willsher on 17/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#ifndef Coroutine_hpp
+#define Coroutine_hpp
+
+#include "LLVM.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /// Splits the lowered generator `function` into a resumable frame.
+    ///
+    /// The generator's body moves to `<name>.resume`, which takes the frame and
+    /// runs from the last yield to the next, leaving the yielded value in the
+    /// frame and returning true, or returns false once the body has finished.
+    /// Values live across a yield, the generator's args, and its stack memory
+    /// are kept in the frame. `function` keeps its type and is rewritten to
+    /// allocate the frame on its stack and call the yield target with each value
+    /// it resumes to, so it is small enough to inline into every loop.
+    ///
+    /// \param yieldParamIndex the param holding the function each value is yielded to
+    /// \returns whether the generator could be split, if not it is unchanged
+    bool lowerGeneratorToCoroutine(LLVMValueRef __nonnull function, unsigned yieldParamIndex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* Coroutine_hpp */
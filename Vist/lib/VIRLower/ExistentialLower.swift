@@ -64,15 +64,113 @@ extension ExistentialWitnessInst : VIRLower {
             .asMethodWithOpaqueParent()
             .cannonicalType(module: module)
             .importedType(in: module)
+        let functionType = BuiltinType.pointer(to: fnType).lowered(module: module)
         
-        let ref = module.getRuntimeFunction(.getWitnessMethod, igf: &igf)
+        guard module.loweringOptions.contains(.inlineWitnessLookup) else {
+            let ref = module.getRuntimeFunction(.getWitnessMethod, igf: &igf)
+            
+            let conformanceIndex = LLVMValue.constInt(value: 0, size: 32), methodIndex = LLVMValue.constInt(value: i, size: 32)
+            let functionPointer = try igf.builder.buildCall(function: ref, args: [existential.loweredValue!, conformanceIndex, methodIndex])
+            
+            return try igf.builder.buildBitcast(value: functionPointer, to: functionType, name: irName) // fntype*
+        }
         
-        let conformanceIndex = LLVMValue.constInt(value: 0, size: 32), methodIndex = LLVMValue.constInt(value: i, size: 32)
-        let functionPointer = try igf.builder.buildCall(function: ref, args: [existential.loweredValue!, conformanceIndex, methodIndex])
+        let exType = Runtime.existentialObjectType.importedCanType(in: module).getPointerType()
+        let ex = try igf.builder.buildBitcast(value: existential.loweredValue!, to: exType)
         
-        let functionType = BuiltinType.pointer(to: fnType).lowered(module: module)
+        // if only one type in the module models the concept, we speculate that is
+        // what the existential holds
+        let tables = module.witnessTables.filter { $0.concept == existentialType }
+        if tables.count == 1, let table = tables.first {
+            return try lowerInlineCache(ex: ex, table: table, methodIndex: i, functionType: functionType, igf: &igf)
+        }
+        
+        let functionPointer = try loadWitness(ex: ex, methodIndex: i, igf: &igf)
         return try igf.builder.buildBitcast(value: functionPointer, to: functionType, name: irName) // fntype*
     }
+    
+    /// Inlines `vist_getWitnessMethod`, loading `ex->conformances[0]->witnesses[methodIndex]`
+    private func loadWitness(ex: LLVMValue, methodIndex: Int, igf: inout IRGenFunction) throws -> LLVMValue {
+        let conformances = try igf.builder.buildLoad(from: igf.builder.buildStructGEP(ofAggregate: ex, index: 1)) // WitnessTable**
+        let table = try igf.builder.buildLoad(from: igf.builder.buildGEP(ofAggregate: conformances,
+                                                                        index: LLVMValue.constInt(value: 0, size: 32))) // WitnessTable*
+        let witnesses = try igf.builder.buildLoad(from: igf.builder.buildStructGEP(ofAggregate: table, index: 4)) // i8**
+        return try igf.builder.buildLoad(from: igf.builder.buildGEP(ofAggregate: witnesses,
+                                                                   index: LLVMValue.constInt(value: methodIndex, size: 32))) // i8*
+    }
+    
+    /// Emits a monomorphic inline cache: if the existential's metadata is that of
+    /// `table.type` we use its witness directly, otherwise we load the witness from
+    /// the existential's witness table
+    /// - note moves the insert point into a continuation block
+    private func lowerInlineCache(ex: LLVMValue, table: VIRWitnessTable, methodIndex: Int,
+                                  functionType: LLVMType, igf: inout IRGenFunction) throws -> LLVMValue {
+        guard let fn = parentFunction, let current = parentBlock else { fatalError() }
+        
+        let metadata = try igf.builder.buildLoad(from: igf.builder.buildStructGEP(ofAggregate: ex, index: 3))
+        let expectedMetadata = try table.type.getLLVMTypeMetadata(igf: &igf, module: module)
+        let isHit = try igf.builder.buildIntCompare(.equal,
+                                                    lhs: igf.builder.buildBitcast(value: metadata, to: .opaquePointer),
+                                                    rhs: LLVMBuilder.constBitcast(value: expectedMetadata, to: .opaquePointer))
+        
+        var site: LLVMValue? = nil
+        if module.loweringOptions.contains(.witnessCacheStats) {
+            site = try witnessCacheSite(igf: &igf)
+        }
+        
+        let hit = try fn.loweredFunction!.appendBasicBlock(named: "\(current.name).ic.hit")
+        let miss = try fn.loweredFunction!.appendBasicBlock(named: "\(current.name).ic.miss")
+        var cont = try fn.loweredFunction!.appendBasicBlock(named: "\(current.name).ic.cont")
+        hit.move(after: current.loweredBlock!)
+        miss.move(after: hit)
+        cont.move(after: miss)
+        try igf.builder.buildCondBr(if: isHit, to: hit, elseTo: miss)
+        
+        // hit: call the speculated witness directly
+        igf.builder.position(atEndOf: hit)
+        let witness = try LLVMFunction(ref: table.getWitness(name: methodName, module: module).loweredValue!._value!)
+        let direct = try LLVMBuilder.constBitcast(value: witness.function, to: functionType)
+        if let site = site {
+            try igf.builder.buildCall(function: module.getRuntimeFunction(.recordWitnessCacheLookup, igf: &igf),
+                                      args: [site, LLVMValue.constBool(value: true)])
+        }
+        try igf.builder.buildBr(to: cont)
+        
+        // miss: fall back to the witness table
+        igf.builder.position(atEndOf: miss)
+        let loaded = try igf.builder.buildBitcast(value: loadWitness(ex: ex, methodIndex: methodIndex, igf: &igf), to: functionType)
+        if let site = site {
+            try igf.builder.buildCall(function: module.getRuntimeFunction(.recordWitnessCacheLookup, igf: &igf),
+                                      args: [site, LLVMValue.constBool(value: false)])
+        }
+        try igf.builder.buildBr(to: cont)
+        
+        igf.builder.position(atEndOf: cont)
+        let phi = try igf.builder.buildPhi(type: functionType, name: irName)
+        phi.addPhiIncoming([(value: direct, from: hit), (value: loaded, from: miss)])
+        
+        // the rest of this block is lowered into `cont`
+        try current.splitBlock(backEdge: &cont, igf: &igf)
+        igf.builder.position(atEndOf: cont)
+        return phi
+    }
+    
+    /// A global recording hits and misses of this call site's inline cache
+    private func witnessCacheSite(igf: inout IRGenFunction) throws -> LLVMValue {
+        let siteName = "\(parentFunction!.name.demangleName()).\(name) !\(methodName)"
+        let siteType = Runtime.witnessCacheSiteType.importedCanType(in: module)
+        let global = LLVMGlobalValue(module: igf.module, type: siteType, name: "_g_ic_site")
+        global.initialiser = try LLVMBuilder.constAggregate(type: siteType, elements: [
+            igf.module.getCachedGlobalString(siteName, name: "_g_ic_site.name", igf: &igf),
+            LLVMValue.constInt(value: 0, size: 64),
+            LLVMValue.constInt(value: 0, size: 64),
+            LLVMValue.constNull(type: .opaquePointer),
+            LLVMValue.constBool(value: false),
+            ])
+        global.isConstant = false
+        global.linkage = LLVMPrivateLinkage
+        return global.value
+    }
 }
 
 extension ExistentialProjectPropertyInst : VIRLower {
@@ -107,8 +205,20 @@ extension ExistentialProjectInst : VIRLower {
         let exType = Runtime.existentialObjectType.importedCanType(in: module).getPointerType()
         let ex = try igf.builder.buildBitcast(value: existential.loweredValue!, to: exType)
         
-        let ref = module.getRuntimeFunction(.getBufferProjection, igf: &igf)
-        return try igf.builder.buildCall(function: ref, args: [ex])
+        // Inline `ExistentialObject::projectBuffer()`; if the inline tag is set
+        // the instance is stored in the existential, otherwise mask out the tag
+        // bits to get the instance ptr
+        let wordSize = BuiltinType.wordType.lowered(module: module).size(unit: .bits, igf: igf)
+        let taggedPtr = try igf.builder.buildLoad(from: igf.builder.buildStructGEP(ofAggregate: ex, index: 0))
+        let inlineTag = try igf.builder.buildAnd(lhs: taggedPtr, rhs: LLVMValue.constInt(value: Runtime.existentialInlineTag, size: wordSize))
+        let isInline = try igf.builder.buildIntCompare(.notEqual, lhs: inlineTag, rhs: LLVMValue.constInt(value: 0, size: wordSize))
+        
+        let inlineBuffer = try igf.builder.buildBitcast(value: igf.builder.buildStructGEP(ofAggregate: ex, index: 4),
+                                                        to: .opaquePointer)
+        let untagged = try igf.builder.buildAnd(lhs: taggedPtr, rhs: LLVMValue.constInt(value: ~Runtime.existentialTagMask, size: wordSize))
+        let outOfLine = try igf.builder.buildIntToPtr(value: untagged, to: .opaquePointer)
+        
+        return try igf.builder.buildSelect(if: isInline, then: inlineBuffer, else: outOfLine, name: irName)
     }
 }
 
@@ -130,7 +240,9 @@ extension NominalType {
     func getTypeMetadata(igf: inout IRGenFunction, module: Module) throws -> TypeDeclMetadata {
         
         let confs: [WitnessTableMetadata]
-        if let s = getConcreteNominalType(), !s.isConceptType(), !s.isRuntimeType() {
+        // declared metadata doesn't list its conformances
+        if let s = getConcreteNominalType(), !s.isConceptType(), !s.isRuntimeType(),
+            !module.loweringOptions.contains(.externalMetadata) {
             confs = try concepts.map { concept in
                 try self.generateConformanceMetadata(concept: concept, igf: &igf, module: module)
             }
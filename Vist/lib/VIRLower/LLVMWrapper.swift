@@ -20,6 +20,10 @@ enum LLVMError : VistError {
     case invalidParamCount(expected: Int, got: Int)
     case invalidParamIndex(Int, function: String?)
     case noSuccessor, notPhi
+    case emitFailed(path: String, message: String)
+    case jitFailed(message: String)
+    case optimiseFailed(message: String)
+    case unknownTarget(cpu: String, message: String)
     
     var description: String {
         switch self {
@@ -29,6 +33,10 @@ enum LLVMError : VistError {
         case .invalidParamIndex(let i, let f): return "No param at index \(i)" + (f.map { " for function '\($0)'" } ?? "")
         case .noSuccessor: return "Inst does not have a successor"
         case .notPhi: return "Can only add incoming values to a phi node"
+        case .emitFailed(let path, let message): return "Could not emit '\(path)': \(message)"
+        case .jitFailed(let message): return "Could not run module: \(message)"
+        case .optimiseFailed(let message): return "Could not optimise module: \(message)"
+        case .unknownTarget(let cpu, let message): return "Could not target CPU '\(cpu)': \(message)"
         }
     }
 }
@@ -92,6 +100,12 @@ extension LLVMBuilder {
     func buildBitcast(value val: LLVMValue, to type: LLVMType, name: String? = nil) throws -> LLVMValue {
         return try wrap(LLVMBuildBitCast(builder, val.val(), type.type!, name ?? ""))
     }
+    func buildIntToPtr(value val: LLVMValue, to type: LLVMType, name: String? = nil) throws -> LLVMValue {
+        return try wrap(LLVMBuildIntToPtr(builder, val.val(), type.type!, name ?? ""))
+    }
+    func buildSelect(if cond: LLVMValue, then val: LLVMValue, else other: LLVMValue, name: String? = nil) throws -> LLVMValue {
+        return try wrap(LLVMBuildSelect(builder, cond.val(), val.val(), other.val(), name ?? ""))
+    }
     static func constBitcast(value val: LLVMValue, to type: LLVMType) throws -> LLVMValue {
         return try LLVMValue(ref:LLVMConstBitCast(val.val(), type.type!))
     }
@@ -441,6 +455,85 @@ struct LLVMModule : Dumpable {
     func dump() { LLVMDumpModule(module) }
     func description() -> String { return String(cString: LLVMPrintModuleToString(module)) }
     
+    /// Runs codegen for the host on this module, writing an object file, or
+    /// assembly if `assembly`, to `path`
+    /// - parameter cpu: the CPU to tune for, nil is the generic CPU
+    func emit(to path: String, assembly: Bool, cpu: String? = nil) throws {
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let module = module else { fatalError() }
+        guard compileModule(module, path, assembly, cpu, &errorMessage) else {
+            let message = errorMessage.map { String(cString: $0) } ?? ""
+            LLVMDisposeMessage(errorMessage)
+            throw error(LLVMError.emitFailed(path: path, message: message))
+        }
+    }
+    
+    /// Runs the LLVM pass pipeline for `optLevel` over the module
+    /// - parameter cpu: the CPU the cost models target, nil is the generic CPU
+    /// - parameter timer: if set, the time each pass took is recorded in it
+    func optimise(optLevel: Int, isStdLib: Bool, cpu: String?,
+                  profileGenerate: String?, profileUse: String?, timer: CompileTimer?) throws {
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        var timings: UnsafeMutablePointer<LLVMPassTiming>? = nil, count: Int32 = 0
+        guard let module = module else { fatalError() }
+        let succeeded = timer == nil ?
+            performLLVMOptimisations(module, Int32(optLevel), isStdLib, cpu, profileGenerate, profileUse,
+                                     nil, nil, &errorMessage) :
+            performLLVMOptimisations(module, Int32(optLevel), isStdLib, cpu, profileGenerate, profileUse,
+                                     &timings, &count, &errorMessage)
+        guard succeeded else {
+            let message = errorMessage.map { String(cString: $0) } ?? ""
+            LLVMDisposeMessage(errorMessage)
+            throw error(LLVMError.optimiseFailed(message: message))
+        }
+        if let timer = timer, let timings = timings {
+            for timing in UnsafeBufferPointer(start: timings, count: Int(count)) {
+                timer.record(llvmPass: String(cString: timing.name), time: timing.time,
+                             instructionDelta: timing.instructionDelta)
+            }
+            disposeLLVMPassTimings(timings, count)
+        }
+    }
+    
+    /// JIT compiles the module and runs its `main` in process
+    /// - parameter libraries: dylibs the module's external symbols are resolved from
+    /// - parameter outputFD: if not -1, stdout is written here while main runs
+    func run(libraries: [String], outputFD: Int32 = -1) throws {
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let module = module else { fatalError() }
+        for library in libraries {
+            guard loadJITLibrary(library, &errorMessage) else {
+                let message = errorMessage.map { String(cString: $0) } ?? ""
+                LLVMDisposeMessage(errorMessage)
+                throw error(LLVMError.jitFailed(message: message))
+            }
+        }
+        guard runModuleJIT(module, outputFD, &errorMessage) else {
+            let message = errorMessage.map { String(cString: $0) } ?? ""
+            LLVMDisposeMessage(errorMessage)
+            throw error(LLVMError.jitFailed(message: message))
+        }
+    }
+    
+    /// Sets the host triple and the data layout of a target machine for `cpu`
+    /// - parameter cpu: a CPU name or "native", nil is the generic CPU
+    func setHostTarget(cpu: String?) throws {
+        var errorMessage: UnsafeMutablePointer<Int8>? = nil
+        guard let module = module else { fatalError() }
+        guard setModuleTarget(module, cpu, &errorMessage) else {
+            let message = errorMessage.map { String(cString: $0) } ?? ""
+            LLVMDisposeMessage(errorMessage)
+            throw error(LLVMError.unknownTarget(cpu: cpu ?? "generic", message: message))
+        }
+    }
+    
+    /// Tags every function defined in the module with `cpu`'s
+    /// target-cpu and target-features
+    func setFunctionTarget(cpu: String) {
+        guard let module = module else { fatalError() }
+        addTargetAttributes(module, cpu)
+    }
+    
     var dataLayout: String {
         get { return String(cString: LLVMGetDataLayout(module)) }
         nonmutating set { LLVMSetDataLayout(module, newValue) }
@@ -467,6 +560,16 @@ struct LLVMModule : Dumpable {
         return global
     }
     
+    /// Declares a global defined in another object, cached by its name like
+    /// the globals `createCachedGlobal` defines
+    mutating func declareCachedGlobal(type: LLVMType, name: String, igf: inout IRGenFunction) -> LLVMGlobalValue {
+        if let g = globalMetadataMap[name] { return g }
+        let global = LLVMGlobalValue(module: igf.module, type: type, name: name)
+        global.isConstant = true
+        globalMetadataMap[name] = global
+        return global
+    }
+    
     /// An initialiser which loads from a bitcode file
     /// - precondition: path points at a bitcode file
     init(path: String, name: String) {
@@ -609,6 +712,8 @@ struct LLVMValue : Dumpable, Hashable {
         let arr = constArray(of: elementType, vals: vals)
         let global = LLVMGlobalValue(module: igf.module, type: arr.type, name: name)
         global.initialiser = arr
+        // only referenced by the global using it, so objects linked together can't clash
+        global.linkage = LLVMPrivateLinkage
         return try LLVMBuilder.constBitcast(value: LLVMBuilder.constGEP(ofAggregate: global.value, index: LLVMValue.constInt(value: 0, size: 32)), to: elementType.getPointerType())
     }
     
@@ -722,6 +827,17 @@ struct LLVMFunction : Dumpable {
         get { return try! LLVMGetLinkage(function.val()) }
         nonmutating set(linkage) { try! LLVMSetLinkage(function.val(), linkage) }
     }
+    /// Whether the function has no body. A function in a lazily read module
+    /// whose body hasn't been read is not a declaration
+    var isDeclaration: Bool {
+        return try! LLVMIsDeclaration(function.val()) != 0
+    }
+    
+    /// Deletes the function from its module
+    /// - precondition: the function has no users
+    func eraseFromParent() throws {
+        try LLVMDeleteFunction(function.val())
+    }
 
     func appendBasicBlock(named name: String) throws -> LLVMBasicBlock {
         return LLVMBasicBlock(ref:
@@ -741,6 +857,12 @@ struct LLVMFunction : Dumpable {
     
     var type: LLVMType { return function.type }
     
+    /// Splits this generator into a resumable frame, see `lowerGeneratorToCoroutine`
+    /// - returns: whether it could be split
+    func lowerToCoroutine(yieldParamIndex: Int) throws -> Bool {
+        return try lowerGeneratorToCoroutine(function.val()!, UInt32(yieldParamIndex))
+    }
+    
     /// Returns the function parameter at `index`
     func param(at index: Int) throws -> LLVMValue {
         guard index < paramCount else { throw error(LLVMError.invalidParamIndex(index, function: name)) }
@@ -55,6 +55,10 @@ struct TypeDeclMetadata : RuntimeMetadata {
         let declType = TypeDeclMetadata.loweredType.importedCanType(in: module)
         let wtType = WitnessTableMetadata.loweredType.importedCanType(in: module)
         
+        if module.loweringOptions.contains(.externalMetadata) {
+            return igf.module.declareCachedGlobal(type: declType, name: globalName, igf: &igf).value
+        }
+        
         // build val and construct
         let val = try LLVMBuilder.constAggregate(type: declType, elements: [
                 LLVMValue.constGlobalArray(of: wtType.getPointerType(), vals: conformances.map { $0.loweredValue },
@@ -110,6 +114,10 @@ struct WitnessTableMetadata : RuntimeMetadata {
     func lowerMetadata(igf: inout IRGenFunction, module: Module) throws -> LLVMValue {
         // get types used
         let tableType = WitnessTableMetadata.loweredType.importedCanType(in: module)
+        
+        if module.loweringOptions.contains(.externalMetadata) {
+            return igf.module.declareCachedGlobal(type: tableType, name: globalName, igf: &igf).value
+        }
         // build val and construct
         let val = try LLVMBuilder.constAggregate(type: tableType, elements: [
                 LLVMBuilder.constBitcast(value: concept.loweredValue, to: .opaquePointer),
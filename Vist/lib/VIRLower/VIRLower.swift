@@ -28,6 +28,22 @@ extension LLVMBool : ExpressibleByBooleanLiteral {
 
 typealias IRGenFunction = (builder: LLVMBuilder, module: LLVMModule)
 
+/// Options controlling how VIR is lowered to LLVM IR
+struct VIRLowerOptions : OptionSet {
+    let rawValue: Int
+    init(rawValue: Int) { self.rawValue = rawValue }
+    
+    /// Load witnesses from the existential's witness table in the IR rather than
+    /// calling `vist_getWitnessMethod`, and emit an inline cache when the witness
+    /// can be speculated
+    static let inlineWitnessLookup = VIRLowerOptions(rawValue: 1 << 0)
+    /// Count hits and misses of each witness inline cache in the runtime
+    static let witnessCacheStats = VIRLowerOptions(rawValue: 1 << 1)
+    /// Declare type metadata and witness tables rather than defining them, as
+    /// another compilation unit of the program defines them
+    static let externalMetadata = VIRLowerOptions(rawValue: 1 << 2)
+}
+
 protocol VIRLower {
     func virLower(igf: inout IRGenFunction) throws -> LLVMValue
 }
@@ -49,9 +65,10 @@ extension Module {
         return module.getOrAddFunction(named: fn.name, type: fn.type.importedType(in: self) as! FunctionType, igf: &igf)
     }
     
-    func virLower(module: LLVMModule, isStdLib: Bool) throws {
+    func virLower(module: LLVMModule, isStdLib: Bool, options: VIRLowerOptions = []) throws {
         
         let builder = LLVMBuilder()
+        loweringOptions = options
         loweredBuilder = builder
         loweredModule = module
         var igf = (builder, module) as IRGenFunction
@@ -118,8 +135,27 @@ extension Module {
 
 extension Function : VIRLower {
     
+    /// Generators with more instructions than this are split into a resumable
+    /// frame rather than inlined into every loop over them
+    private static let generatorInlineLimit = 60
+    
+    /// Whether this generator is lowered to a resumable frame, see
+    /// `lowerGeneratorToCoroutine`
+    private var lowersToCoroutine: Bool {
+        guard type.isGeneratorFunction, blocks != nil else { return false }
+        switch inlineRequirement {
+        case .always: return false
+        case .never: return true
+        case .default: return (blocks ?? []).reduce(0) { $0 + $1.instructions.count } > Function.generatorInlineLimit
+        }
+    }
+    
     private func applyInline() throws {
         switch inlineRequirement {
+        case .default where type.isGeneratorFunction && !lowersToCoroutine:
+            // small generators are inlined into their loops, where the
+            // yield target is known
+            try loweredFunction?.addAttr(LLVMAlwaysInlineAttribute)
         case .default: break
         case .always: try loweredFunction?.addAttr(LLVMAlwaysInlineAttribute)
         case .never: try loweredFunction?.addAttr(LLVMNoInlineAttribute)
@@ -206,6 +242,12 @@ extension Function : VIRLower {
                                       args: [constSize, globalPointer])
         }
         
+        // split large generators into a resumable frame, if they can't be
+        // they are inlined into their loops
+        if lowersToCoroutine, try !fn.lowerToCoroutine(yieldParamIndex: 1), inlineRequirement != .never {
+            try fn.addAttr(LLVMAlwaysInlineAttribute)
+        }
+        
         if let b = b { igf.builder.position(atEndOf: b) }
         
         return fn.function
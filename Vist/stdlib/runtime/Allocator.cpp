@@ -0,0 +1,204 @@
+//
+//  Allocator.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 02/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <mutex>
+#ifdef RUNTIME_SLAB_STATS
+#include <atomic>
+#endif
+
+// A size-classed slab allocator for runtime heap objects.
+//
+// Small allocations are rounded up to a multiple of `slabGranularity` and served
+// from a per-thread free list for that size class. When a free list is empty we
+// bump-allocate from the thread's current slab for the class, and when that runs
+// out a new slab is malloc'd. Slabs are never returned to the system, freed
+// blocks are pushed onto the freeing thread's list and reused.
+//
+// Allocations larger than `maxSlabAllocationSize` go straight to malloc.
+//
+// Once a thread's cache has been destroyed at thread exit, later destructors on
+// that thread allocate size class blocks with malloc and free blocks onto the
+// orphan lists, as slab blocks can't be passed to free.
+//
+// Building the runtime with -DRUNTIME_SLAB_STATS dumps per size class counters
+// to stderr when the process exits.
+
+static const size_t slabGranularity = 16;
+static const size_t maxSlabAllocationSize = 512;
+static const size_t numSizeClasses = maxSlabAllocationSize / slabGranularity;
+static const size_t slabSize = 64 * 1024;
+
+/// A freed block, threaded onto its size class' free list
+struct FreeBlock {
+    FreeBlock *_Nullable next;
+};
+
+static inline size_t sizeClassIndex(size_t size) {
+    return (size + slabGranularity - 1) / slabGranularity - 1;
+}
+
+static inline size_t sizeClassSize(size_t index) {
+    return (index + 1) * slabGranularity;
+}
+
+#ifdef RUNTIME_SLAB_STATS
+struct SlabStats {
+    std::atomic<uint64_t> allocs[numSizeClasses];
+    std::atomic<uint64_t> freeListHits[numSizeClasses];
+    std::atomic<uint64_t> orphanHits[numSizeClasses];
+    std::atomic<uint64_t> slabRefills[numSizeClasses];
+    std::atomic<uint64_t> frees[numSizeClasses];
+    std::atomic<uint64_t> largeAllocs;
+    std::atomic<uint64_t> largeFrees;
+
+    ~SlabStats() {
+        fprintf(stderr, "slab allocator stats:\n");
+        fprintf(stderr, "  class   allocs      free-list   orphaned    slabs   frees\n");
+        for (size_t i = 0; i < numSizeClasses; ++i) {
+            if (allocs[i] == 0)
+                continue;
+            fprintf(stderr, "  %-7zu %-11llu %-11llu %-11llu %-7llu %llu\n",
+                    sizeClassSize(i),
+                    (unsigned long long)allocs[i], (unsigned long long)freeListHits[i],
+                    (unsigned long long)orphanHits[i], (unsigned long long)slabRefills[i],
+                    (unsigned long long)frees[i]);
+        }
+        fprintf(stderr, "  large allocs=%llu frees=%llu\n",
+                (unsigned long long)largeAllocs, (unsigned long long)largeFrees);
+    }
+};
+static SlabStats slabStats;
+#define SLAB_STAT(counter) slabStats.counter.fetch_add(1, std::memory_order_relaxed)
+#else
+#define SLAB_STAT(counter)
+#endif
+
+/// Free lists abandoned by threads which have exited, refills take from
+/// here before carving a new slab
+static FreeBlock *_Nullable orphanedBlocks[numSizeClasses];
+static std::mutex orphanedBlocksMutex;
+
+/// A thread's allocation state for one size class
+struct SizeClassCache {
+    FreeBlock *_Nullable freeList;
+    char *_Nullable bump;
+    char *_Nullable bumpEnd;
+};
+
+/// Set when this thread's cache is destroyed; trivially destructible so it
+/// can still be read by destructors which run after the cache's
+static thread_local bool threadSlabCacheDestroyed = false;
+
+struct ThreadSlabCache {
+    SizeClassCache classes[numSizeClasses];
+
+    /// Hand this thread's free blocks back so other threads can use them
+    ~ThreadSlabCache() {
+        threadSlabCacheDestroyed = true;
+        std::lock_guard<std::mutex> lock(orphanedBlocksMutex);
+        for (size_t i = 0; i < numSizeClasses; ++i) {
+            FreeBlock *block = classes[i].freeList;
+            while (block) {
+                auto next = block->next;
+                block->next = orphanedBlocks[i];
+                orphanedBlocks[i] = block;
+                block = next;
+            }
+            classes[i].freeList = nullptr;
+        }
+    }
+};
+
+static thread_local ThreadSlabCache threadSlabCache;
+
+/// Slow path of `vist_slabAllocate`, the size class' free list is empty
+static void *_Nonnull refillSizeClass(SizeClassCache &cache, size_t index) {
+    size_t blockSize = sizeClassSize(index);
+
+    // bump allocate from the current slab
+    if (cache.bump && cache.bump + blockSize <= cache.bumpEnd) {
+        void *block = cache.bump;
+        cache.bump += blockSize;
+        return block;
+    }
+
+    // take any blocks left behind by exited threads
+    {
+        std::lock_guard<std::mutex> lock(orphanedBlocksMutex);
+        if (auto orphaned = orphanedBlocks[index]) {
+            orphanedBlocks[index] = nullptr;
+            SLAB_STAT(orphanHits[index]);
+            cache.freeList = orphaned->next;
+            return orphaned;
+        }
+    }
+
+    // otherwise carve a new slab
+    SLAB_STAT(slabRefills[index]);
+    auto slab = reinterpret_cast<char *>(malloc(slabSize));
+    if (!slab) {
+        fprintf(stderr, "vist: out of memory\n");
+        abort();
+    }
+    cache.bump = slab + blockSize;
+    cache.bumpEnd = slab + slabSize;
+    return slab;
+}
+
+/// Allocates `size` bytes, aligned to 16 bytes
+void *_Nonnull vist_slabAllocate(size_t size) {
+    if (size > maxSlabAllocationSize) {
+        SLAB_STAT(largeAllocs);
+        return malloc(size);
+    }
+    size_t index = sizeClassIndex(size == 0 ? 1 : size);
+    SLAB_STAT(allocs[index]);
+    if (threadSlabCacheDestroyed) {
+        auto block = malloc(sizeClassSize(index));
+        if (!block) {
+            fprintf(stderr, "vist: out of memory\n");
+            abort();
+        }
+        return block;
+    }
+    SizeClassCache &cache = threadSlabCache.classes[index];
+
+    if (auto block = cache.freeList) {
+        SLAB_STAT(freeListHits[index]);
+        cache.freeList = block->next;
+        return block;
+    }
+    return refillSizeClass(cache, index);
+}
+
+/// Frees memory allocated by `vist_slabAllocate`, `size` must be the size
+/// which was requested when allocating
+void vist_slabDeallocate(void *_Nonnull ptr, size_t size) {
+    if (size > maxSlabAllocationSize) {
+        SLAB_STAT(largeFrees);
+        free(ptr);
+        return;
+    }
+    size_t index = sizeClassIndex(size == 0 ? 1 : size);
+    SLAB_STAT(frees[index]);
+    auto block = reinterpret_cast<FreeBlock *>(ptr);
+
+    if (threadSlabCacheDestroyed) {
+        std::lock_guard<std::mutex> lock(orphanedBlocksMutex);
+        block->next = orphanedBlocks[index];
+        orphanedBlocks[index] = block;
+        return;
+    }
+    SizeClassCache &cache = threadSlabCache.classes[index];
+    block->next = cache.freeList;
+    cache.freeList = block;
+}
+
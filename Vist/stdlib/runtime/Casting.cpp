@@ -7,6 +7,116 @@
 //
 
 #include <cstring>
+#include <atomic>
+
+// Conformance cache
+//
+// Maps (type, concept) to the index of the type's witness table for the
+// concept, or `noConformance`. A fixed size open addressed table which is
+// only ever appended to, so readers never lock: a writer claims an empty
+// slot with a CAS, fills it, then publishes it with a release store of
+// `state`. If a key's probe sequence is full the result just isn't cached.
+// It is only emptied by `vist_flushConformanceCache`, when no program code
+// is running.
+//
+// A hash and probe costs about as much as scanning a couple of witness
+// tables, so types with few conformances skip the cache and are scanned.
+
+static const int32_t noConformance = -1;
+static const size_t conformanceCacheSize = 4096; // must be a power of 2
+static const size_t conformanceCacheMaxProbes = 16;
+/// Types with at most this many conformances are scanned, not cached
+static const int32_t conformanceScanLimit = 2;
+
+struct ConformanceCacheEntry {
+    enum : uint32_t { empty, writing, ready };
+    std::atomic<uint32_t> state;
+    const TypeMetadata *_Nullable type;
+    const TypeMetadata *_Nullable concept;
+    int32_t index;
+};
+
+static ConformanceCacheEntry conformanceCache[conformanceCacheSize];
+
+INLINE
+static size_t conformanceCacheHash(const TypeMetadata *_Nonnull type, const TypeMetadata *_Nonnull concept) {
+    auto hash = (uintptr_t)type * 0x9E3779B97F4A7C15ull ^ ((uintptr_t)concept >> 3);
+    return (hash ^ (hash >> 29)) & (conformanceCacheSize - 1);
+}
+
+/// \returns whether the cache holds a result for (type, concept), setting `index`
+static bool conformanceCacheLookup(const TypeMetadata *_Nonnull type,
+                                   const TypeMetadata *_Nonnull concept,
+                                   int32_t *_Nonnull index) {
+    auto slot = conformanceCacheHash(type, concept);
+    for (size_t probe = 0; probe < conformanceCacheMaxProbes; ++probe) {
+        auto &entry = conformanceCache[(slot + probe) & (conformanceCacheSize - 1)];
+        auto state = entry.state.load(std::memory_order_acquire);
+        // entries are never removed, so an empty slot ends the probe sequence
+        if (state == ConformanceCacheEntry::empty)
+            return false;
+        if (state == ConformanceCacheEntry::ready && entry.type == type && entry.concept == concept) {
+            *index = entry.index;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void conformanceCacheInsert(const TypeMetadata *_Nonnull type,
+                                   const TypeMetadata *_Nonnull concept,
+                                   int32_t index) {
+    auto slot = conformanceCacheHash(type, concept);
+    for (size_t probe = 0; probe < conformanceCacheMaxProbes; ++probe) {
+        auto &entry = conformanceCache[(slot + probe) & (conformanceCacheSize - 1)];
+        uint32_t expected = ConformanceCacheEntry::empty;
+        if (entry.state.compare_exchange_strong(expected, ConformanceCacheEntry::writing,
+                                                std::memory_order_acquire)) {
+            entry.type = type;
+            entry.concept = concept;
+            entry.index = index;
+            entry.state.store(ConformanceCacheEntry::ready, std::memory_order_release);
+            return;
+        }
+        // another thread raced us to insert this key, theirs is just as good
+        if (expected == ConformanceCacheEntry::ready && entry.type == type && entry.concept == concept)
+            return;
+    }
+}
+
+void vist_flushConformanceCache() {
+    for (auto &entry : conformanceCache)
+        entry.state.store(ConformanceCacheEntry::empty, std::memory_order_release);
+}
+
+/// \returns the index of `type`'s witness table for `concept`, or `noConformance`
+INLINE
+static int32_t scanConformances(TypeMetadata *_Nonnull type, TypeMetadata *_Nonnull concept) {
+    for (int32_t i = 0; i < type->numConformances; i += 1) {
+#ifdef RUNTIME_DEBUG
+        auto conf = type->conformances[i];
+        printf("   ↳witness=%p:\t%s\n", conf, conf->concept->name);
+#endif
+        if (type->conformances[i]->concept == concept)
+            return i;
+    }
+    return noConformance;
+}
+
+/// Finds the index of `type`'s witness table for `concept`
+/// \returns the index, or `noConformance` if `type` does not conform
+int32_t vist_lookupConformance(TypeMetadata *_Nonnull type, TypeMetadata *_Nonnull concept) {
+    if (type->numConformances <= conformanceScanLimit)
+        return scanConformances(type, concept);
+    
+    int32_t index;
+    if (conformanceCacheLookup(type, concept, &index))
+        return index;
+    
+    index = scanConformances(type, concept);
+    conformanceCacheInsert(type, concept, index);
+    return index;
+}
 
 RUNTIME_COMPILER_INTERFACE
 bool vist_castExistentialToConcrete(ExistentialObject *_Nonnull existential,
@@ -23,56 +133,44 @@ RUNTIME_COMPILER_INTERFACE
 bool vist_castExistentialToConcept(ExistentialObject *_Nonnull existential,
                                    TypeMetadata *_Nonnull conceptMetadata,
                                    ExistentialObject *_Nullable out) {
-    auto conformances = existential->metadata->conformances;
-    
 #ifdef RUNTIME_DEBUG
     printf("→cast %s:\t%p to\t%s\n", existential->metadata->name, (void*)existential->projectBuffer(), conceptMetadata->name);
 #endif
     
-    for (int index = 0; index < existential->metadata->numConformances; index += 1) {
+    auto index = vist_lookupConformance(existential->metadata, conceptMetadata);
+    if (index != noConformance) {
+        // if it conforms, we can construct a non local existential
+        
+        auto in = (void*)existential->projectBuffer();
+        *out = ExistentialObject(0, existential->metadata,
+                                 // it requires an arr of conforming types, we...
+                                 // just provide a view into the original, 1 long
+                                 1, existential->metadata->conformances+index);
+        if (existential->metadata->isRefCounted) {
 #ifdef RUNTIME_DEBUG
-        auto conf = conformances[index];
-        printf("   ↳witness=%p:\t%s\n", conf, conf->concept->name);
+            printf("   ↳cast_existential_retain↘︎\n");
 #endif
-        if (conformances[index]->concept == conceptMetadata) {
-            // if the metadata is the same, we can construct a non local existential
-            
-            auto in = (void*)existential->projectBuffer();
-            void *mem;
-            if (existential->metadata->isRefCounted) {
+            vist_retainObject((RefcountedObject*)in);
+            out->instanceTaggedPtr = (uintptr_t)in;
+        } else if (auto copyConstructor = existential->metadata->copyConstructor) {
+            auto mem = out->allocateBuffer();
 #ifdef RUNTIME_DEBUG
-                printf("   ↳cast_existential_retain↘︎\n");
+            printf("     ↳cast_deep_copy %s:\t%p to: %p\n", existential->metadata->name, in, mem);
+            printf("         ↳cast_deep_copy_fn=%p\n", copyConstructor);
 #endif
-                vist_retainObject((RefcountedObject*)existential->projectBuffer());
-                mem = in;
-            } else if (auto copyConstructor = existential->metadata->copyConstructor) {
+            copyConstructor(in, mem);
+        } else {
+            // if there is no copy constructor, we just have to do a shallow copy
+            auto mem = out->allocateBuffer();
 #ifdef RUNTIME_DEBUG
-                printf("     ↳cast_deep_copy %s:\t%p to: %p\n", existential->metadata->name, in, mem);
-                printf("         ↳cast_deep_copy_fn=%p\n", copyConstructor);
+            printf("     ↳cast_copy %s:\t%p to: %p\n", conceptMetadata->name, in, mem);
 #endif
-                mem = malloc(existential->metadata->storageSize());
-                copyConstructor(in, mem);
-            } else {
-#ifdef RUNTIME_DEBUG
-                printf("     ↳cast_copy %s:\t%p to: %p\n", conceptMetadata->name, in, mem);
-#endif
-                // if there is no copy constructor, we just have to do a shallow copy
-                mem = malloc(existential->metadata->storageSize());
-                memcpy(mem, in, existential->metadata->storageSize());
-            }
-            *out = ExistentialObject((uintptr_t)mem, existential->metadata,
-                                     // it requires an arr of conforming types, we...
-                                     // just provide a view into the original, 1 long
-                                     1, existential->metadata->conformances+index);
-            return true;
+            memcpy(mem, in, existential->metadata->storageSize());
         }
+        return true;
     }
 #ifdef RUNTIME_DEBUG
     printf("     ↳no match found\n");
 #endif
     return false;
 }
-
-// cache metadata referenced and check here first
-// static metadataCache
-
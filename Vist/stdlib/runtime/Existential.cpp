@@ -10,31 +10,30 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <cstring>
+#include <mutex>
 
 
 RUNTIME_COMPILER_INTERFACE
 void vist_constructExistential(WitnessTable *_Nonnull *_Nonnull conformances, int numConformances,
                                void *_Nonnull instance, TypeMetadata *_Nonnull metadata,
-                               bool _isNonLocal, ExistentialObject *_Nullable outExistential) {
-    uintptr_t ptr;
-    bool isNonLocal = true; // TODO: optimisation to promote to local ones
-    if (isNonLocal) {
-        auto mem = malloc(metadata->storageSize());
-        // copy stack into new buffer
-        memcpy(mem, instance, metadata->storageSize());
-        ptr = (uintptr_t)mem;
+                               bool /*isNonLocal*/, ExistentialObject *_Nullable outExistential) {
+    *outExistential = ExistentialObject(0, metadata, numConformances,
+                                        conformances); // <hack, should malloc memory to store the witnesses
+    // a class instance is shared, the existential takes over the reference
+    // to its box
+    if (metadata->isRefCounted) {
+        outExistential->instanceTaggedPtr = (uintptr_t)instance;
 #ifdef RUNTIME_DEBUG
-        printf("→alloc_ex %s:\t%p \tat: %lu\n", metadata->name, instance, ptr);
+        printf("→alloc_ref_ex %s:\t%p\n", metadata->name, instance);
 #endif
-    } else {
-        ptr = (uintptr_t)instance;
+        return;
+    }
+    // copy stack into the existential's buffer
+    auto mem = outExistential->allocateBuffer();
+    memcpy(mem, instance, metadata->storageSize());
 #ifdef RUNTIME_DEBUG
-        printf("→alloc_stack_ex %s:\t%p\n", metadata->name, instance);
+    printf("→alloc_%s_ex %s:\t%p \tat: %p\n", outExistential->isInline() ? "inline" : "heap", metadata->name, instance, mem);
 #endif
-    }
-    
-    *outExistential = ExistentialObject(ptr | isNonLocal, metadata, numConformances,
-                                        conformances); // <hack, should malloc memory to store the witnesses
 }
 
 RUNTIME_COMPILER_INTERFACE
@@ -67,27 +66,27 @@ void vist_deallocExistentialBuffer(ExistentialObject *_Nonnull existential) {
         free(buff);
 #ifdef RUNTIME_DEBUG
     // DEBUGGING: set stack to 0, if not a shared heap ptr
-    else if (!existential->metadata->isRefCounted)
+    else
         memset(buff, 0, existential->metadata->storageSize());
 #endif
 }
 
 RUNTIME_COMPILER_INTERFACE
 void vist_exportExistentialBuffer(ExistentialObject *_Nonnull existential) {
-    // if it is already on the heap, we are done
-    auto in = existential->projectBuffer();
-    if (existential->isNonLocal() || existential->metadata->isRefCounted) {
+    // if it is already on the heap or stored inline, we are done -- inline
+    // storage moves with the existential
+    if (existential->isNonLocal() || existential->isInline() || existential->metadata->isRefCounted) {
 #ifdef RUNTIME_DEBUG
-        printf("     ↳dupe_export %s:\t%p\n", existential->metadata->name, (void*)in);
+        printf("     ↳dupe_export %s:\t%p\n", existential->metadata->name, (void*)existential->projectBuffer());
 #endif
         return;
     }
-    auto mem = malloc(existential->metadata->storageSize());
+    auto in = (void*)existential->projectBuffer();
     // copy stack into new buffer
-    memcpy(mem, (void*)existential->projectBuffer(), existential->metadata->storageSize());
-    existential->instanceTaggedPtr = (uintptr_t)mem | true;
+    auto mem = existential->allocateBuffer();
+    memcpy(mem, in, existential->metadata->storageSize());
 #ifdef RUNTIME_DEBUG
-    printf("   ↳export %s:\t%p to: %p\n", existential->metadata->name, (void*)in, (void*)existential->projectBuffer());
+    printf("   ↳export %s:\t%p to: %p\n", existential->metadata->name, in, mem);
 #endif
 }
 
@@ -96,7 +95,11 @@ void vist_copyExistentialBuffer(ExistentialObject *_Nonnull existential,
                                 ExistentialObject *_Nullable outExistential) {
     
     auto in = (void*)existential->projectBuffer();
-    void *mem;
+    // construct the new existential
+    *outExistential = ExistentialObject(0,
+                                        existential->metadata,
+                                        existential->numConformances,
+                                        existential->conformances);
     // we must copy different objects differently
     //  - trivial types can be shallow copied
     //  - call its copy constructor if defined -- this is needed to move over
@@ -107,9 +110,9 @@ void vist_copyExistentialBuffer(ExistentialObject *_Nonnull existential,
         printf("   ↳existential_retain↘︎\n");
 #endif
         vist_retainObject((RefcountedObject*)in);
-        mem = in;
+        outExistential->instanceTaggedPtr = (uintptr_t)in;
     } else if (auto copyConstructor = existential->metadata->copyConstructor) {
-        mem = malloc(existential->metadata->storageSize());
+        auto mem = outExistential->allocateBuffer();
 #ifdef RUNTIME_DEBUG
         printf("   ↳deep_copy %s:\t%p to: %p\n", existential->metadata->name, in, mem);
         printf("       ↳deep_copy_fn=%p\n", copyConstructor);
@@ -117,18 +120,12 @@ void vist_copyExistentialBuffer(ExistentialObject *_Nonnull existential,
         copyConstructor(in, mem);
     } else {
         // if there is no copy constructor, we just have to do a shallow copy
-        mem = malloc(existential->metadata->storageSize());
+        auto mem = outExistential->allocateBuffer();
 #ifdef RUNTIME_DEBUG
         printf("   ↳copy %s:\t%p to: %p\n", existential->metadata->name, in, mem);
 #endif
         memcpy(mem, in, existential->metadata->storageSize());
     }
-
-    // construct the new existential
-    *outExistential = ExistentialObject((uintptr_t)mem | true,
-                                        existential->metadata,
-                                        existential->numConformances,
-                                        existential->conformances);
 }
 
 
@@ -142,6 +139,49 @@ vist_getWitnessMethod(ExistentialObject *_Nonnull existential,
         ->witnesses[methodIndex];
 }
 
+static WitnessCacheSite *_Nullable witnessCacheSites = nullptr;
+static bool witnessCacheSitesDumpedAtExit = false;
+static std::mutex witnessCacheSitesMutex;
+
+/// Prints the counts of the registered sites and unregisters them, the sites
+/// live in the program's globals so must not be read once it is unloaded
+void vist_flushWitnessCacheSites() {
+    std::lock_guard<std::mutex> lock(witnessCacheSitesMutex);
+    if (!witnessCacheSites)
+        return;
+    printf("witness cache stats:\n");
+    for (auto site = witnessCacheSites; site; ) {
+        auto hits = __atomic_load_n(&site->hits, __ATOMIC_RELAXED);
+        auto misses = __atomic_load_n(&site->misses, __ATOMIC_RELAXED);
+        printf("   ↳%s\thit=%llu miss=%llu\n", site->name, (unsigned long long)hits, (unsigned long long)misses);
+        
+        auto next = site->next;
+        site->next = nullptr;
+        __atomic_store_n(&site->registered, false, __ATOMIC_RELEASE);
+        site = next;
+    }
+    witnessCacheSites = nullptr;
+}
+
+/// Records a lookup at an inline cached witness call site, the counts of
+/// all sites are printed at exit
+RUNTIME_COMPILER_INTERFACE
+void vist_recordWitnessCacheLookup(WitnessCacheSite *_Nonnull site, bool hit) {
+    if (!__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE)) {
+        std::lock_guard<std::mutex> lock(witnessCacheSitesMutex);
+        if (!site->registered) {
+            if (!witnessCacheSitesDumpedAtExit) {
+                atexit(vist_flushWitnessCacheSites);
+                witnessCacheSitesDumpedAtExit = true;
+            }
+            site->next = witnessCacheSites;
+            witnessCacheSites = site;
+            __atomic_store_n(&site->registered, true, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_fetch_add(hit ? &site->hits : &site->misses, 1, __ATOMIC_RELAXED);
+}
+
 RUNTIME_COMPILER_INTERFACE
 void *_Nonnull
 vist_getPropertyProjection(ExistentialObject *_Nonnull existential,
@@ -0,0 +1,209 @@
+//
+//  Output.cpp
+//  Vist
+//
+//  Created by Josef Willsher on 12/11/2016.
+//  Copyright © 2016 vistlang. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Buffered stdout for the print shims.
+//
+// stdio takes a lock and parses a format string on every printf, so programs
+// which print a lot are bound by it. Instead each thread formats into its own
+// buffer, which is handed to write(2) when it fills, when the thread exits
+// (including the main thread at exit), or when `vist_outputFlush` is called.
+// If stdout is a terminal the buffer is also written after each line.
+//
+// The debug runtime logs with printf, so when built with -DRUNTIME_DEBUG
+// output goes through stdio instead to keep the two in order.
+
+static const size_t outputBufferSize = 64 * 1024;
+
+/// Writes all of `bytes` to stdout, which write(2) may take several calls to.
+/// Gives up on an error, as there is nowhere to report it
+static void writeAll(const char *_Nonnull bytes, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        auto result = ::write(STDOUT_FILENO, bytes + written, size - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return;
+        written += result;
+    }
+}
+
+struct OutputBuffer {
+    size_t length = 0;
+    /// Whether to flush after each newline
+    bool lineBuffered;
+    char bytes[outputBufferSize];
+    
+    OutputBuffer() : lineBuffered(isatty(STDOUT_FILENO)) {}
+    ~OutputBuffer() { flush(); }
+    
+    void flush() {
+        writeAll(bytes, length);
+        length = 0;
+    }
+    
+    /// Returns space for `size` bytes, `size` must not be larger than the buffer
+    INLINE char *_Nonnull reserve(size_t size) {
+        if (length + size > outputBufferSize)
+            flush();
+        return bytes + length;
+    }
+    INLINE void commit(size_t size) {
+        length += size;
+    }
+    INLINE void lineEnded() {
+        if (lineBuffered)
+            flush();
+    }
+};
+
+static thread_local OutputBuffer outputBuffer;
+
+/// Two digit pairs, so integers are converted 2 digits per division
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// Writes the decimal digits of `value` backwards from `end`
+/// \returns the first digit written
+static char *_Nonnull formatUInt64(uint64_t value, char *_Nonnull end) {
+    char *out = end;
+    while (value >= 100) {
+        auto pair = (value % 100) * 2;
+        value /= 100;
+        out -= 2;
+        memcpy(out, digitPairs + pair, 2);
+    }
+    if (value >= 10) {
+        out -= 2;
+        memcpy(out, digitPairs + value * 2, 2);
+    }
+    else
+        *--out = '0' + char(value);
+    return out;
+}
+
+/// The largest value whose %f form is computed by `formatDouble`, above
+/// this `value * 1e6` is not exact in the integer part
+static const double maxFastFormatDouble = 9007199254.0; // 2^53 / 1e6
+
+/// Formats `value` as printf's "%f" would, into `buffer`, which must have
+/// space for at least 32 bytes. `value`'s magnitude must be less than
+/// `maxFastFormatDouble`
+/// \returns the number of bytes written
+static size_t formatDouble(double value, char *_Nonnull buffer) {
+    
+    double magnitude = fabs(value);
+    
+    // value * 1e6 rounded to an integer is the %f digits, fma recovers the
+    // rounding error of the multiply so ties round on the exact value
+    double scaled = magnitude * 1e6;
+    double error = fma(magnitude, 1e6, -scaled);
+    double whole = floor(scaled);
+    double fraction = scaled - whole;
+    auto digits = uint64_t(whole);
+    
+    if (fraction > 0.5 || (fraction == 0.5 && (error > 0 || (error == 0 && (digits & 1)))))
+        digits += 1;
+    else if (fraction == 0 && error == 0.5 && (digits & 1))
+        digits += 1; // the rounding error alone is a half, ties to even
+    else if (fraction == 0 && error == -0.5 && (digits & 1))
+        digits -= 1;
+    
+    char scratch[32];
+    char *end = scratch + sizeof(scratch);
+    char *first = formatUInt64(digits, end);
+    // pad to at least "0.000000"
+    while (end - first < 7)
+        *--first = '0';
+    
+    size_t length = 0;
+    if (signbit(value))
+        buffer[length++] = '-';
+    size_t wholeDigits = (end - first) - 6;
+    memcpy(buffer + length, first, wholeDigits);
+    length += wholeDigits;
+    buffer[length++] = '.';
+    memcpy(buffer + length, first + wholeDigits, 6);
+    return length + 6;
+}
+
+void vist_outputWrite(const void *_Nonnull bytes, size_t size) {
+#ifdef RUNTIME_DEBUG
+    fwrite(bytes, size, 1, stdout);
+#else
+    if (size > outputBufferSize) {
+        // too big to buffer, write it straight after anything pending
+        outputBuffer.flush();
+        writeAll(reinterpret_cast<const char *>(bytes), size);
+        return;
+    }
+    memcpy(outputBuffer.reserve(size), bytes, size);
+    outputBuffer.commit(size);
+    if (size && reinterpret_cast<const char *>(bytes)[size - 1] == '\n')
+        outputBuffer.lineEnded();
+#endif
+}
+
+void vist_outputWriteByte(char byte) {
+#ifdef RUNTIME_DEBUG
+    putchar(byte);
+#else
+    *outputBuffer.reserve(1) = byte;
+    outputBuffer.commit(1);
+    if (byte == '\n')
+        outputBuffer.lineEnded();
+#endif
+}
+
+void vist_outputWriteInt64(int64_t value) {
+    char scratch[24];
+    char *end = scratch + sizeof(scratch);
+    // negate as unsigned so INT64_MIN doesn't overflow
+    uint64_t magnitude = value < 0 ? 0 - uint64_t(value) : uint64_t(value);
+    char *first = formatUInt64(magnitude, end);
+    if (value < 0)
+        *--first = '-';
+    vist_outputWrite(first, end - first);
+}
+
+void vist_outputWriteDouble(double value) {
+    if (fabs(value) < maxFastFormatDouble) {
+        char scratch[32];
+        vist_outputWrite(scratch, formatDouble(value, scratch));
+        return;
+    }
+    // large values, infinities and nan are rare enough for snprintf, the
+    // largest double is 309 digits before the point
+    char scratch[320];
+    int length = snprintf(scratch, sizeof(scratch), "%f", value);
+    vist_outputWrite(scratch, length);
+}
+
+void vist_outputFlush() {
+#ifdef RUNTIME_DEBUG
+    fflush(stdout);
+#else
+    outputBuffer.flush();
+#endif
+}
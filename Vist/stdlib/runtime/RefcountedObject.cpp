@@ -12,14 +12,45 @@
 #include <assert.h>
 
 // Private
+
+// Retains only need to be atomic, nothing is published by taking a reference.
+// Releases use release ordering so this thread's writes to the object happen
+// before whichever thread observes the count reach 0 -- that thread acquires
+// before running the destructor.
+//
+// A runtime built with RUNTIME_SINGLE_THREADED uses plain loads and stores, it
+// must only be linked into programs which never share objects between threads.
+
 INLINE
 void incrementRefCount(RefcountedObject *_Nonnull object) {
+#ifdef RUNTIME_SINGLE_THREADED
+    ++object->refCount;
+#else
     __atomic_fetch_add(&object->refCount, 1, __ATOMIC_RELAXED);
+#endif
 }
 
+/// Decrements the ref count
+/// \returns whether this was the last reference to the object
 INLINE
-void decrementRefCount(RefcountedObject *_Nonnull object) {
-    __atomic_fetch_sub(&object->refCount, 1, __ATOMIC_RELAXED);
+bool decrementRefCountAndTest(RefcountedObject *_Nonnull object) {
+#ifdef RUNTIME_SINGLE_THREADED
+    return --object->refCount == 0;
+#else
+    if (__atomic_sub_fetch(&object->refCount, 1, __ATOMIC_RELEASE) != 0)
+        return false;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return true;
+#endif
+}
+
+INLINE
+uint32_t loadRefCount(RefcountedObject *_Nonnull object) {
+#ifdef RUNTIME_SINGLE_THREADED
+    return object->refCount;
+#else
+    return __atomic_load_n(&object->refCount, __ATOMIC_RELAXED);
+#endif
 }
 
 // Ref counting
@@ -28,13 +59,13 @@ void decrementRefCount(RefcountedObject *_Nonnull object) {
 RUNTIME_COMPILER_INTERFACE
 RefcountedObject *_Nonnull
 vist_allocObject(TypeMetadata *_Nonnull metadata) {
-    // malloc the object storage
-    void *object = malloc(metadata->size);
-    // calloc the box storage -- need calloc so it is initialised
-    auto refCountedObject = reinterpret_cast<RefcountedObject *_Nonnull>(malloc(sizeof(RefcountedObject)));
+    // allocate the box and object storage together, the object follows
+    // the header
+    auto size = RefcountedObject::allocationSize(metadata);
+    auto refCountedObject = reinterpret_cast<RefcountedObject *_Nonnull>(vist_slabAllocate(size));
     
     // store the object and initial ref count in the box
-    refCountedObject->object = object;
+    refCountedObject->object = reinterpret_cast<char *>(refCountedObject) + RefcountedObject::instanceOffset();
     refCountedObject->refCount = 1;
     refCountedObject->metadata = metadata;
 #ifdef RUNTIME_DEBUG
@@ -55,8 +86,7 @@ void vist_deallocObject(RefcountedObject *_Nonnull object) {
     if (auto destructor = object->metadata->destructor) {
         destructor(object);
     }
-    free(object->object);
-    free(object);
+    vist_slabDeallocate(object, RefcountedObject::allocationSize(object->metadata));
 };
 
 /// Releases this capture. If its now unowned we dealloc
@@ -67,12 +97,9 @@ void vist_releaseObject(RefcountedObject *_Nonnull object) {
     assert(object->refCount > 0 && "Ref count should never be less than 0");
     printf("→release\t%p %p, rc=%i\n", object->object, object, object->refCount-1);
 #endif
-    // if no more references, we dealloc it
-    if (object->refCount == 1)
+    // if that was the last reference, we dealloc it
+    if (decrementRefCountAndTest(object))
         vist_deallocObject(object);
-    // otherwise we decrement
-    else
-        decrementRefCount(object);
 };
 
 /// Retain an object
@@ -92,7 +119,7 @@ RUNTIME_COMPILER_INTERFACE
 uint64_t vist_getObjectRefcount(RefcountedObject *_Nonnull object) {
     // Vist CC expects object to be released before returning
     vist_releaseObject(object);
-    return (uint64_t)object->refCount;
+    return (uint64_t)loadRefCount(object);
 };
 
 /// Check if the object is singly referenced
@@ -103,7 +130,7 @@ bool vist_objectHasUniqueReference(RefcountedObject *_Nonnull object) {
 #ifdef RUNTIME_DEBUG
     printf("→REF:%s %p, %p\n", object->refCount == 1 ? "unique" : "non_unique", object->object, object);
 #endif
-    return object->refCount == 1;
+    return loadRefCount(object) == 1;
 };
 
 
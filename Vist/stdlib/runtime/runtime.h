@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdlib.h>
+#include <assert.h>
 
 
 // These functions must have a stub decl with the @runtime attr in the stdlib
@@ -22,6 +23,10 @@
 // be exposed to the compiler
 #define RUNTIME_COMPILER_INTERFACE extern "C"
 
+// These functions are called by the C shims in Vist/stdlib/shims.c, which
+// declare them themselves
+#define RUNTIME_SHIMS_INTERFACE extern "C"
+
 #define INLINE __attribute__((always_inline))
 
 
@@ -30,6 +35,7 @@ typedef struct TypeMetadata TypeMetadata;
 typedef struct ExistentialObject ExistentialObject;
 typedef struct WitnessTable WitnessTable;
 typedef struct RefcountedObject RefcountedObject;
+typedef struct WitnessCacheSite WitnessCacheSite;
 
 // Existential
 RUNTIME_COMPILER_INTERFACE
@@ -44,6 +50,9 @@ void *_Nonnull
 vist_getWitnessMethod(ExistentialObject *_Nonnull,
                       int32_t, int32_t);
 
+RUNTIME_COMPILER_INTERFACE
+void vist_recordWitnessCacheLookup(WitnessCacheSite *_Nonnull, bool);
+
 RUNTIME_COMPILER_INTERFACE
 void *_Nonnull
 vist_getPropertyProjection(ExistentialObject *_Nonnull,
@@ -95,12 +104,48 @@ void vist_releaseObject(RefcountedObject *_Nonnull object);
 RUNTIME_COMPILER_INTERFACE
 void vist_retainObject(RefcountedObject *_Nonnull object);
 
-
+// allocator
+void *_Nonnull vist_slabAllocate(size_t size);
+void vist_slabDeallocate(void *_Nonnull ptr, size_t size);
+
+// output
+RUNTIME_SHIMS_INTERFACE
+void vist_outputWrite(const void *_Nonnull bytes, size_t size);
+RUNTIME_SHIMS_INTERFACE
+void vist_outputWriteByte(char byte);
+RUNTIME_SHIMS_INTERFACE
+void vist_outputWriteInt64(int64_t value);
+RUNTIME_SHIMS_INTERFACE
+void vist_outputWriteDouble(double value);
+RUNTIME_SHIMS_INTERFACE
+void vist_outputFlush();
+
+// caches keyed on the addresses of a program's metadata, the compiler's JIT
+// clears them before unloading a program so a later one can't hit its entries
+extern "C" void vist_flushConformanceCache();
+extern "C" void vist_flushWitnessCacheSites();
+
+// the conformance lookup behind `vist_castExistentialToConcept`, exposed so
+// it can be benchmarked on its own
+extern "C" int32_t vist_lookupConformance(TypeMetadata *_Nonnull type,
+                                          TypeMetadata *_Nonnull concept);
+
+
+/// The layout must match the compiler's `vist.class_box`, which is copied
+/// into existentials by `TypeMetadata::storageSize()`
 struct RefcountedObject {
+    /// The instance, stored inline after this header
     void *_Nonnull object;
     uint32_t refCount;
     TypeMetadata *_Nonnull metadata;
+    
+    /// The offset of the instance in the allocation, the header is padded so
+    /// the instance keeps the 16 byte alignment of the slab block
+    static size_t instanceOffset();
+    /// The size of the allocation holding the header and instance
+    static size_t allocationSize(TypeMetadata *_Nonnull metadata);
 };
+static_assert(sizeof(RefcountedObject) == 24, "RefcountedObject must match the compiler's class box");
 
 struct TypeMetadata {
     /// witness tables
@@ -130,6 +175,14 @@ struct TypeMetadata {
     }
 };
 
+INLINE inline size_t RefcountedObject::instanceOffset() {
+    return (sizeof(RefcountedObject) + 15) & ~size_t(15);
+}
+
+INLINE inline size_t RefcountedObject::allocationSize(TypeMetadata *_Nonnull metadata) {
+    return instanceOffset() + metadata->size;
+}
+
 /// The modeling of a concept -- the concept and witness table
 struct WitnessTable {
     /// The concept we are conforming to
@@ -147,9 +200,10 @@ struct WitnessTable {
 };
 
 struct ExistentialObject {
-    /// a tagged pointer containing the instance, and in the least
-    /// significant bit, a flag stating whether the ptr is stored
-    /// on the heap and needs deallocating
+    /// a tagged pointer containing the instance. The least significant
+    /// bit states whether the ptr is stored on the heap and needs
+    /// deallocating, the second whether the instance is stored in
+    /// `inlineBuffer` -- in which case the pointer bits are unused
     uintptr_t instanceTaggedPtr;
     
 public:
@@ -157,28 +211,67 @@ public:
     int32_t numConformances;
     /// The instance metadata
     TypeMetadata *_Nonnull metadata;
+    /// Storage for instances whose `storageSize()` fits, these are never
+    /// heap allocated. Addressed relative to `this` so existentials can
+    /// be moved with a memcpy
+    uintptr_t inlineBuffer[3];
+    
+    static const uintptr_t nonLocalTag = 0x1, inlineTag = 0x2;
+    static const size_t inlineBufferSize = sizeof(inlineBuffer);
     
     ExistentialObject(uintptr_t object,
                       TypeMetadata *_Nonnull metadata,
                       int32_t numConformances,
                       WitnessTable *_Nonnull *_Nullable conformances)
-    : instanceTaggedPtr(object), metadata(metadata), numConformances(numConformances), conformances(conformances) {}
+    : instanceTaggedPtr(object), conformances(conformances), numConformances(numConformances), metadata(metadata) {}
     
     INLINE uintptr_t projectBuffer() {
-        return (uintptr_t)instanceTaggedPtr & ~0x1;
+        if (isInline())
+            return (uintptr_t)inlineBuffer;
+        return (uintptr_t)instanceTaggedPtr & ~(nonLocalTag | inlineTag);
     }
     INLINE bool isNonLocal() {
-        return (uintptr_t)instanceTaggedPtr & 0x1;
+        return (uintptr_t)instanceTaggedPtr & nonLocalTag;
+    }
+    INLINE bool isInline() {
+        return (uintptr_t)instanceTaggedPtr & inlineTag;
     }
     INLINE void setNonLocalTag(bool tag) {
         if (tag)
-            instanceTaggedPtr |= tag;
+            instanceTaggedPtr |= nonLocalTag;
         else
-            instanceTaggedPtr &= ~0x1;
+            instanceTaggedPtr &= ~nonLocalTag;
+    }
+    
+    /// Sets up storage for a value instance of `metadata`, inline if
+    /// it fits, otherwise on the heap
+    /// \returns the memory to copy the instance into
+    INLINE void *_Nonnull allocateBuffer() {
+        auto storageSize = metadata->storageSize();
+        assert(storageSize >= 0 && "Negative storage size");
+        auto size = size_t(storageSize);
+        if (size <= inlineBufferSize) {
+            instanceTaggedPtr = inlineTag;
+            return inlineBuffer;
+        }
+        auto mem = malloc(size);
+        instanceTaggedPtr = (uintptr_t)mem | nonLocalTag;
+        return mem;
     }
 };
 
 
+/// Hit and miss counts of a witness method inline cache, one is emitted by
+/// the compiler for each cached call site when debugging the runtime
+struct WitnessCacheSite {
+    const char *_Nonnull name;
+    uint64_t hits, misses;
+    /// The next site in the list dumped at exit
+    WitnessCacheSite *_Nullable next;
+    bool registered;
+};
+
+
 
 const char * _Nullable vist_demangle(const char * _Nonnull);
 
@@ -20,15 +20,29 @@
 #define ALWAYSINLINE __attribute__((always_inline))
 
 // Printing
+//
+// Output goes through the runtime's per thread buffer, see Output.cpp
+
+void vist_outputWrite(const void *bytes, size_t size);
+void vist_outputWriteByte(char byte);
+void vist_outputWriteInt64(int64_t value);
+void vist_outputWriteDouble(double value);
+void vist_outputFlush();
 
 void
 _Vvist$Ucshim$Uwrite_topi64(const void *str, int64_t size) {
-    fwrite(str, size, 1, stdout);
+    vist_outputWrite(str, size);
 };
 
 void
 _Vvist$Ucshim$Uputchar_ti8(char c) {
-    putchar_unlocked(c);
+    vist_outputWriteByte(c);
+};
+
+NOINLINE
+void
+_Vvist$Ucshim$Uflush_t() {
+    vist_outputFlush();
 };
 
 NOINLINE
@@ -55,39 +69,45 @@ _Vvist$Ucshim$Utime_t() {
 NOINLINE
 void
 _Vvist$Ucshim$Uprint_ti64(int64_t i) {
-    printf("%lli\n", i);
+    vist_outputWriteInt64(i);
+    vist_outputWriteByte('\n');
 };
 
 NOINLINE
 void
 _Vvist$Ucshim$Uprint_ti32(int32_t i) {
-    printf("%i\n", i);
+    vist_outputWriteInt64(i);
+    vist_outputWriteByte('\n');
 };
 
 NOINLINE
 void
 _Vvist$Ucshim$Uprint_tf64(double d)
 {
-    printf("%lf\n", d);
+    vist_outputWriteDouble(d);
+    vist_outputWriteByte('\n');
 };
 
 NOINLINE
 void
 _Vvist$Ucshim$Uprint_tf32(float d) {
-    printf("%f\n", d);
+    vist_outputWriteDouble(d);
+    vist_outputWriteByte('\n');
 };
 
 NOINLINE
 void
 _Vvist$Ucshim$Uprint_tb(bool b) {
-    printf(b ? "true\n" : "false\n");
+    if (b) vist_outputWrite("true\n", 5);
+    else vist_outputWrite("false\n", 6);
 };
 
 NOINLINE
 void
 _Vvist$Ucshim$Ulog_t() {
     static int i = 0;
-    printf(">LOG=%i\n", i);
+    vist_outputWrite(">LOG=", 5);
+    vist_outputWriteInt64(i);
+    vist_outputWriteByte('\n');
     i += 1;
 };
-